@@ -10,9 +10,16 @@ uniform mat4 u_model;
 uniform mat4 u_view;
 uniform mat4 u_projection;
 
+// Compact vertex format (PackedVertex in StaticMesh.hpp): a_Pos is unorm16 inside the mesh bounds
+uniform bool u_quantizedVertex;
+uniform vec3 u_posScale;
+uniform vec3 u_posBias;
+
 void main()
 {
     TexCoords = a_TexCoords;
 
-    gl_Position = u_projection * u_view * u_model * vec4(a_Pos, 1.0);
+    vec3 position = u_quantizedVertex ? u_posBias + a_Pos * u_posScale : a_Pos;
+
+    gl_Position = u_projection * u_view * u_model * vec4(position, 1.0);
 }
@@ -5,6 +5,7 @@
 in vec3 FragPos;
 in vec3 FragNormal;
 in vec2 TexCoords;
+in float ViewDepth;
 
 struct Material
 {
@@ -53,6 +54,46 @@ struct DirectionalLight
 uniform DirectionalLight u_dirLight;
 uniform bool u_useDirectionalLight;
 
+
+// Cascaded shadow maps for the directional light (see ShadowMap.hpp)
+#define MAX_CASCADES 4
+uniform bool u_useShadows;
+uniform sampler2DArrayShadow u_cascadeShadowMap;
+uniform mat4 u_cascadeMatrices[MAX_CASCADES];
+uniform float u_cascadeSplits[MAX_CASCADES]; // view depth where each cascade ends
+uniform int u_cascadeCount;
+
+// 1.0 = lit, 0.0 = fully in shadow
+float CalculateDirectionalShadow(vec3 normal, vec3 lightDir)
+{
+    int cascade = 0;
+    while (cascade < u_cascadeCount && ViewDepth > u_cascadeSplits[cascade])
+        cascade++;
+
+    if (cascade == u_cascadeCount)
+        return 1.0;
+
+    vec4 lightSpacePos = u_cascadeMatrices[cascade] * vec4(FragPos, 1.0);
+    vec3 coords = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+    if (coords.z > 1.0)
+        return 1.0;
+
+    // slope scaled bias on top of the polygon offset used when rendering the map
+    float bias = max(0.0015 * (1.0 - dot(normalize(normal), normalize(-lightDir))), 0.0003);
+    float refDepth = coords.z - bias;
+
+    // 3x3 taps, each one already bilinearly filtered by the comparison sampler
+    vec2 texelSize = 1.0 / vec2(textureSize(u_cascadeShadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+            lit += texture(u_cascadeShadowMap, vec4(coords.xy + vec2(x, y) * texelSize, float(cascade), refDepth));
+    }
+
+    return lit / 9.0;
+}
+
 vec3 CalculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 diffMap, vec3 specMap)
 {
     vec3 ambientLight = light.ambient * diffMap;
@@ -61,13 +102,15 @@ vec3 CalculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 diffMap
 
     vec3 specularLight = CalculateSpecularLight(light.specular, specMap, normal, light.direction);
 
-    return (ambientLight + diffuseLight + specularLight); 
+    float shadow = u_useShadows ? CalculateDirectionalShadow(normal, light.direction) : 1.0;
+
+    return (ambientLight + shadow * (diffuseLight + specularLight)); 
 }
 
 
 float LightAttenuation(float c, float lin, float quad, float dist)
 {
-    return (1.0 / (c * lin*dist + quad*dist*dist));
+    return (1.0 / (c + lin*dist + quad*dist*dist));
 }
 
 
@@ -152,13 +195,146 @@ vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 diffMap, vec3 specMap
     specularLight *= intensity;
 
     // calculate and apply attenuation on return
-    float dist = length(fragLightDir);
+    float dist = length(light.position - FragPos);
     float attenuation = LightAttenuation(light.attConstant, light.attLinear, light.attQuadratic, dist);
 
     return ((ambientLight + diffuseLight + specularLight) * attenuation);
 }
 
 
+// Clustered lights (see ClusteredLighting.hpp)
+// every light takes LIGHT_TEXELS texels of u_clusterLightData:
+// 0: position, range
+// 1: direction, type (0 = point, 1 = spot)
+// 2: ambient, inner cutoff (radians)
+// 3: diffuse, outer cutoff (radians)
+// 4: specular, first shadow atlas layer + 1 (0 = no shadows)
+// 5: constant, linear, quadratic attenuation, tangent of the spot shadow half fov
+#define LIGHT_TEXELS 6
+#define LIGHT_TYPE_SPOT 1.0
+
+uniform bool u_useClusteredLights;
+uniform samplerBuffer u_clusterLightData;
+uniform usamplerBuffer u_clusterGrid;        // (offset, count) per cluster
+uniform usamplerBuffer u_clusterLightIndices;
+uniform uvec3 u_clusterDims;
+uniform vec2 u_clusterTileSize;
+uniform vec2 u_clusterZParams;               // slice = log(depth) * x - y
+
+// Shadow maps of point and spot lights (see ShadowAtlas in ShadowMap.hpp)
+// must match the face directions and up vectors used to render the point light faces
+uniform sampler2DArrayShadow u_shadowAtlas;
+
+const vec3 CUBE_FACE_DIR[6] = vec3[6](
+    vec3( 1.0,  0.0,  0.0), vec3(-1.0,  0.0,  0.0),
+    vec3( 0.0,  1.0,  0.0), vec3( 0.0, -1.0,  0.0),
+    vec3( 0.0,  0.0,  1.0), vec3( 0.0,  0.0, -1.0)
+);
+const vec3 CUBE_FACE_UP[6] = vec3[6](
+    vec3( 0.0, -1.0,  0.0), vec3( 0.0, -1.0,  0.0),
+    vec3( 0.0,  0.0,  1.0), vec3( 0.0,  0.0, -1.0),
+    vec3( 0.0, -1.0,  0.0), vec3( 0.0, -1.0,  0.0)
+);
+
+// projects toFrag the same way glm::lookAt + glm::perspective did when rendering the layer
+float SampleShadowAtlasFace(float layer, vec3 forward, vec3 up, float tanHalfFov, vec3 toFrag, float refDepth)
+{
+    vec3 s = normalize(cross(forward, up));
+    vec3 u = cross(s, forward);
+
+    float z = dot(forward, toFrag);
+    if (z <= 0.0)
+        return 1.0;
+
+    vec2 ndc = vec2(dot(s, toFrag), dot(u, toFrag)) / (z * tanHalfFov);
+    if (any(greaterThan(abs(ndc), vec2(1.0))))
+        return 1.0;
+
+    return texture(u_shadowAtlas, vec4(ndc * 0.5 + 0.5, layer, refDepth));
+}
+
+// 1.0 = lit, 0.0 = fully in shadow
+float CalculateLocalLightShadow(float firstLayer, vec3 position, float range, vec3 direction, bool isSpot, float tanHalfFov, vec3 normal)
+{
+    vec3 toFrag = FragPos - position;
+
+    // the maps store distance / range
+    float bias = max(0.02 * (1.0 - dot(normalize(normal), normalize(-toFrag))), 0.004);
+    float refDepth = length(toFrag) / range - bias;
+
+    if (isSpot)
+    {
+        vec3 forward = normalize(direction);
+        vec3 up = (abs(forward.y) > 0.99) ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+        return SampleShadowAtlasFace(firstLayer, forward, up, tanHalfFov, toFrag, refDepth);
+    }
+
+    // the cube face is the one of the major axis
+    vec3 absDir = abs(toFrag);
+    int face;
+    if (absDir.x >= absDir.y && absDir.x >= absDir.z)
+        face = (toFrag.x > 0.0) ? 0 : 1;
+    else if (absDir.y >= absDir.z)
+        face = (toFrag.y > 0.0) ? 2 : 3;
+    else
+        face = (toFrag.z > 0.0) ? 4 : 5;
+
+    return SampleShadowAtlasFace(firstLayer + float(face), CUBE_FACE_DIR[face], CUBE_FACE_UP[face], 1.0, toFrag, refDepth);
+}
+
+vec3 CalculateClusteredLights(vec3 normal, vec3 diffMap, vec3 specMap)
+{
+    uint slice = uint(max(log(ViewDepth) * u_clusterZParams.x - u_clusterZParams.y, 0.0));
+    uvec3 cluster = min(uvec3(uvec2(gl_FragCoord.xy / u_clusterTileSize), slice), u_clusterDims - uvec3(1u));
+    int clusterIndex = int(cluster.x + cluster.y * u_clusterDims.x + cluster.z * u_clusterDims.x * u_clusterDims.y);
+
+    uvec2 lightList = texelFetch(u_clusterGrid, clusterIndex).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < lightList.y; i++)
+    {
+        int base = int(texelFetch(u_clusterLightIndices, int(lightList.x + i)).r) * LIGHT_TEXELS;
+
+        vec4 posRange     = texelFetch(u_clusterLightData, base);
+        vec4 dirType      = texelFetch(u_clusterLightData, base + 1);
+        vec4 ambientInner = texelFetch(u_clusterLightData, base + 2);
+        vec4 diffuseOuter = texelFetch(u_clusterLightData, base + 3);
+        vec4 specularShadow = texelFetch(u_clusterLightData, base + 4);
+        vec4 attenuationFov = texelFetch(u_clusterLightData, base + 5);
+
+        bool isSpot = (dirType.w == LIGHT_TYPE_SPOT);
+
+        vec3 lightResult;
+        if (isSpot)
+        {
+            SpotLight light = SpotLight(
+                posRange.xyz, dirType.xyz, ambientInner.w, diffuseOuter.w,
+                ambientInner.rgb, diffuseOuter.rgb, specularShadow.rgb,
+                attenuationFov.x, attenuationFov.y, attenuationFov.z
+            );
+            lightResult = CalculateSpotLight(light, normal, diffMap, specMap);
+        }
+        else
+        {
+            PointLight light = PointLight(
+                posRange.xyz,
+                ambientInner.rgb, diffuseOuter.rgb, specularShadow.rgb,
+                attenuationFov.x, attenuationFov.y, attenuationFov.z
+            );
+            lightResult = CalculatePointLight(light, normal, diffMap, specMap);
+        }
+
+        // local lights have a tiny ambient term, shadowing all of it keeps the functions above untouched
+        if (specularShadow.w > 0.0)
+            lightResult *= CalculateLocalLightShadow(specularShadow.w - 1.0, posRange.xyz, posRange.w, dirType.xyz, isSpot, attenuationFov.w, normal);
+
+        result += lightResult;
+    }
+
+    return result;
+}
+
+
 uniform bool u_DEBUG_noRenderMaterial;
 
 void main()
@@ -183,6 +359,9 @@ void main()
     if (u_useSpotLight)
         resultColor += CalculateSpotLight(u_spotLight, FragNormal, texDiffuse, texSpecular);
 
+    if (u_useClusteredLights)
+        resultColor += CalculateClusteredLights(FragNormal, texDiffuse, texSpecular);
+
 
     if (u_DEBUG_noRenderMaterial)
 	resultColor = vec3(1.0);
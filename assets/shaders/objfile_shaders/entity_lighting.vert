@@ -7,17 +7,38 @@ layout (location = 2) in vec2 a_TexCoords;
 out vec3 FragPos;
 out vec3 FragNormal;
 out vec2 TexCoords;
+out float ViewDepth;
 
 uniform mat4 u_model;
 uniform mat4 u_view;
 uniform mat4 u_projection;
 
+// Compact vertex format (PackedVertex in StaticMesh.hpp): a_Pos is unorm16 inside the mesh bounds
+uniform bool u_quantizedVertex;
+uniform vec3 u_posScale;
+uniform vec3 u_posBias;
+
+// a_Normal.xy holds an octahedral encoded normal
+vec3 OctahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
 void main()
 {
-    FragNormal = mat3(transpose(inverse(u_model))) * a_Normal;
-    FragPos = vec3(u_model * vec4(a_Pos, 1.0));
+    vec3 position = u_quantizedVertex ? u_posBias + a_Pos * u_posScale : a_Pos;
+    vec3 normal = u_quantizedVertex ? OctahedralDecode(a_Normal.xy) : a_Normal;
+
+    FragNormal = mat3(transpose(inverse(u_model))) * normal;
+    FragPos = vec3(u_model * vec4(position, 1.0));
     TexCoords = a_TexCoords;
 
-    gl_Position = u_projection * u_view * vec4(FragPos, 1.0);
+    vec4 viewPos = u_view * vec4(FragPos, 1.0);
+    ViewDepth = -viewPos.z;
+
+    gl_Position = u_projection * viewPos;
 }
 
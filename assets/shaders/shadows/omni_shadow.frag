@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec3 WorldPos;
+
+uniform vec3 u_lightPos;
+uniform float u_farPlane;
+
+void main()
+{
+    // linear distance to the light, so every face of a cube compares the same way
+    gl_FragDepth = length(WorldPos - u_lightPos) / u_farPlane;
+}
@@ -0,0 +1,11 @@
+#version 330 core
+
+layout (location = 0) in vec3 a_Pos;
+
+uniform mat4 u_model;
+
+void main()
+{
+    // world space, the geometry shader projects it once per face
+    gl_Position = u_model * vec4(a_Pos, 1.0);
+}
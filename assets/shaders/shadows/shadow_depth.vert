@@ -0,0 +1,11 @@
+#version 330 core
+
+layout (location = 0) in vec3 a_Pos;
+
+uniform mat4 u_model;
+uniform mat4 u_lightSpace;
+
+void main()
+{
+    gl_Position = u_lightSpace * u_model * vec4(a_Pos, 1.0);
+}
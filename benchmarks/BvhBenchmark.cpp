@@ -0,0 +1,167 @@
+// Builds MeshBvh over generated meshes and casts camera rays at them one at a time and in packets of four,
+// checking both against testing every triangle. Exits with 1 on a mismatch.
+// Build with -DNE_BUILD_BENCHMARKS=ON, in Release.
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "JobSystem.hpp"
+#include "MeshBvh.hpp"
+
+// A bumpy terrain of size x size quads, 2 triangles each, in [-50, 50] on x and z
+static void makeTerrain(unsigned int size, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    positions.clear();
+    indices.clear();
+    for (unsigned int z = 0; z <= size; z++)
+    {
+        for (unsigned int x = 0; x <= size; x++)
+        {
+            const float u = 100.0f * x / size - 50.0f, v = 100.0f * z / size - 50.0f;
+            positions.emplace_back(u, 3.0f * std::sin(u * 0.3f) * std::cos(v * 0.2f) + std::sin(u * 2.1f + v * 1.7f) * 0.3f, v);
+        }
+    }
+    for (unsigned int z = 0; z < size; z++)
+    {
+        for (unsigned int x = 0; x < size; x++)
+        {
+            const uint32_t a = z * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+}
+
+static bool bruteForce(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const Ray& ray, RayHit& outHit)
+{
+    bool hit = false;
+    float closest = ray.MaxDistance;
+    for (size_t triangle = 0; triangle < indices.size() / 3; triangle++)
+    {
+        const glm::vec3 v0 = positions[indices[triangle * 3]];
+        const glm::vec3 edge1 = positions[indices[triangle * 3 + 1]] - v0, edge2 = positions[indices[triangle * 3 + 2]] - v0;
+        const glm::vec3 p = glm::cross(ray.Direction, edge2);
+        const float det = glm::dot(edge1, p);
+        if (det == 0.0f)
+            continue;
+        const glm::vec3 s = ray.Origin - v0;
+        const float u = glm::dot(s, p) / det;
+        const glm::vec3 q = glm::cross(s, edge1);
+        const float v = glm::dot(ray.Direction, q) / det;
+        const float t = glm::dot(edge2, q) / det;
+        if (u < 0.0f || v < 0.0f || u + v > 1.0f || t < 0.0f || t >= closest)
+            continue;
+        closest = t;
+        outHit.Distance = t;
+        outHit.Triangle = static_cast<uint32_t>(triangle);
+        hit = true;
+    }
+    return hit;
+}
+
+static inline bool sameHit(bool hitA, const RayHit& a, bool hitB, const RayHit& b)
+{
+    return hitA == hitB && (!hitA || std::abs(a.Distance - b.Distance) <= 1e-3f * std::max(1.0f, b.Distance));
+}
+
+int main()
+{
+    JobSystem::Init();
+    std::printf("%u workers\n", JobSystem::GetWorkerCount());
+    std::printf("%10s %10s %8s %8s %10s %12s %12s %10s\n", "triangles", "build ms", "nodes", "depth", "SAH cost", "single us", "packet us", "hit rate");
+
+    int mismatches = 0;
+    for (unsigned int size : { 70u, 224u, 708u })
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+        makeTerrain(size, positions, indices);
+
+        const auto bvh = MeshBvh::Build(positions.data(), positions.size(), indices.data(), indices.size());
+        const MeshBvhStats& stats = bvh->GetStats();
+
+        /// A 512x512 image from a camera above the terrain, looking down at it ahead
+        const unsigned int width = 512, height = 512;
+        std::vector<Ray> rays(width * height);
+        const glm::vec3 eye(0.0f, 20.0f, 60.0f);
+        const glm::vec3 forward = glm::normalize(glm::vec3(0.0f, -0.5f, -1.0f));
+        const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        const glm::vec3 up = glm::cross(right, forward);
+        for (unsigned int y = 0; y < height; y++)
+        {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                const float u = (x + 0.5f) / width * 2.0f - 1.0f, v = (y + 0.5f) / height * 2.0f - 1.0f;
+                Ray& ray = rays[y * width + x];
+                ray.Origin = eye;
+                ray.Direction = glm::normalize(forward + 0.6f * (u * right + v * up));
+            }
+        }
+
+        // best of a few runs, in microseconds per ray
+        auto measure = [&](auto&& func) {
+            double best = 1e30;
+            for (int run = 0; run < 3; run++)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                func();
+                best = std::min(best, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            }
+            return best / rays.size();
+        };
+
+        std::vector<RayHit> single(rays.size()), packet(rays.size());
+        std::vector<unsigned char> singleHit(rays.size()), packetHit(rays.size());
+        const double singleUs = measure([&]() {
+            for (size_t i = 0; i < rays.size(); i++)
+                singleHit[i] = bvh->Raycast(rays[i], single[i]);
+        });
+        // packets of 2x2 pixels
+        const double packetUs = measure([&]() {
+            for (unsigned int y = 0; y < height; y += 2)
+            {
+                for (unsigned int x = 0; x < width; x += 2)
+                {
+                    const size_t pixels[4] = { y * width + x, y * width + x + 1, (y + 1) * width + x, (y + 1) * width + x + 1 };
+                    const Ray packetRays[4] = { rays[pixels[0]], rays[pixels[1]], rays[pixels[2]], rays[pixels[3]] };
+                    RayHit hits[4];
+                    const unsigned int mask = bvh->Raycast4(packetRays, hits);
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        packet[pixels[lane]] = hits[lane];
+                        packetHit[pixels[lane]] = (mask >> lane) & 1;
+                    }
+                }
+            }
+        });
+
+        size_t hits = 0;
+        for (size_t i = 0; i < rays.size(); i++)
+        {
+            hits += singleHit[i];
+            if (!sameHit(singleHit[i], single[i], packetHit[i], packet[i]))
+                mismatches++;
+        }
+
+        // every triangle for a sample of the rays
+        for (size_t i = 0; i < rays.size(); i += rays.size() / 64 + 1)
+        {
+            RayHit expected;
+            const bool expectedHit = bruteForce(positions, indices, rays[i], expected);
+            if (!sameHit(singleHit[i], single[i], expectedHit, expected))
+                mismatches++;
+        }
+
+        std::printf("%10u %10.2f %8u %8u %10.2f %12.3f %12.3f %9.1f%%\n", stats.Triangles, stats.BuildMs, stats.Nodes, stats.MaxDepth,
+                    stats.SahCost, singleUs, packetUs, 100.0 * hits / rays.size());
+    }
+
+    std::printf("%d mismatches\n", mismatches);
+    JobSystem::Shutdown();
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+// Updating and culling entities stored in World's chunks against heap objects behind pointers,
+// the way Entity kept them. Build with -DNE_BUILD_BENCHMARKS=ON, in Release.
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "JobSystem.hpp"
+#include "World.hpp"
+
+struct Position { glm::vec3 Value; };
+struct Velocity { glm::vec3 Value; };
+struct Sphere { float Radius; bool Visible; };
+
+// What an entity looked like before: one allocation each, updated through a virtual call
+class HeapObject
+{
+public:
+    virtual ~HeapObject() = default;
+    virtual void Update(float deltaTime) { Position += Velocity * deltaTime; }
+
+    glm::vec3 Position;
+    glm::vec3 Velocity;
+    float Radius;
+    bool Visible;
+    char Payload[192];      // the rest of what an entity carried (mesh, transform state)
+};
+
+// the camera looks down -z at the origin, 90 degrees wide
+static inline bool inFrustum(const glm::vec4* planes, const glm::vec3& center, float radius)
+{
+    for (int p = 0; p < 5; p++)
+    {
+        if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+// Best of a few runs, in nanoseconds per entity
+template <typename Func>
+static double measure(size_t count, Func&& func)
+{
+    double best = 1e30;
+    for (int run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best / (double)count;
+}
+
+int main()
+{
+    JobSystem::Init();
+
+    const glm::vec4 planes[5] = {
+        glm::normalize(glm::vec4(1.0f, 0.0f, -1.0f, 0.0f)),
+        glm::normalize(glm::vec4(-1.0f, 0.0f, -1.0f, 0.0f)),
+        glm::normalize(glm::vec4(0.0f, 1.0f, -1.0f, 0.0f)),
+        glm::normalize(glm::vec4(0.0f, -1.0f, -1.0f, 0.0f)),
+        glm::vec4(0.0f, 0.0f, -1.0f, -0.1f),
+    };
+    const float deltaTime = 1.0f / 60.0f;
+
+    std::printf("%u workers\n", JobSystem::GetWorkerCount());
+    std::printf("%10s %12s %12s %12s %12s %12s   (ns per entity)\n", "count", "spawn", "heap", "chunks", "chunks MT", "destroy");
+
+    for (size_t count : { (size_t)10000, (size_t)100000, (size_t)1000000 })
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+
+        /// Heap objects, in the allocation order shuffled the way a long running scene ends up
+        std::vector<std::unique_ptr<HeapObject>> objects(count);
+        for (auto& object : objects)
+        {
+            object = std::make_unique<HeapObject>();
+            object->Position = glm::vec3(position(rng), position(rng), position(rng));
+            object->Velocity = glm::vec3(velocity(rng), velocity(rng), velocity(rng));
+            object->Radius = 1.0f;
+        }
+        std::shuffle(objects.begin(), objects.end(), rng);
+
+        const double heap = measure(count, [&]() {
+            for (auto& object : objects)
+            {
+                object->Update(deltaTime);
+                object->Visible = inFrustum(planes, object->Position, object->Radius);
+            }
+        });
+
+        /// The same in a world
+        std::vector<EntityId> ids;
+        double spawn = 0.0;
+        {
+            World world;
+            auto start = std::chrono::steady_clock::now();
+            world.Spawn(count, &ids, Position{ glm::vec3(0.0f) }, Velocity{ glm::vec3(0.0f) }, Sphere{ 1.0f, false });
+            spawn = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double)count;
+        }
+
+        World world;
+        ids.clear();
+        world.Spawn(count, &ids, Position{ glm::vec3(0.0f) }, Velocity{ glm::vec3(0.0f) }, Sphere{ 1.0f, false });
+        rng.seed(1234);
+        for (EntityId id : ids)
+        {
+            world.Get<Position>(id)->Value = glm::vec3(position(rng), position(rng), position(rng));
+            world.Get<Velocity>(id)->Value = glm::vec3(velocity(rng), velocity(rng), velocity(rng));
+        }
+
+        auto updateChunk = [&](size_t n, const EntityId*, Position* positions, const Velocity* velocities, Sphere* spheres) {
+            for (size_t i = 0; i < n; i++)
+            {
+                positions[i].Value += velocities[i].Value * deltaTime;
+                spheres[i].Visible = inFrustum(planes, positions[i].Value, spheres[i].Radius);
+            }
+        };
+
+        const double chunks = measure(count, [&]() { world.ForEachChunk<Position, const Velocity, Sphere>(updateChunk); });
+        const double chunksMT = measure(count, [&]() { world.ParallelForEachChunk<Position, const Velocity, Sphere>(updateChunk); });
+
+        size_t visible = 0;
+        world.ForEach<const Sphere>([&visible](EntityId, const Sphere& sphere) { visible += sphere.Visible; });
+
+        std::shuffle(ids.begin(), ids.end(), rng);
+        auto start = std::chrono::steady_clock::now();
+        for (EntityId id : ids)
+            world.Destroy(id);
+        const double destroy = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double)count;
+
+        std::printf("%10zu %12.2f %12.2f %12.2f %12.2f %12.2f   %zu visible\n",
+                    count, spawn, heap, chunks, chunksMT, destroy, visible);
+    }
+
+    JobSystem::Shutdown();
+    return 0;
+}
@@ -0,0 +1,56 @@
+// Checks that a model's mesh cache key follows its material library: editing the .mtl of an .obj (a texture path,
+// the shininess) must change the key and so re-import the model. Exits with 1 on a failure.
+// Build with -DNE_BUILD_BENCHMARKS=ON.
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "MeshCache.hpp"
+
+static void writeFile(const std::filesystem::path& path, const std::string& text)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+int main()
+{
+    int failures = 0;
+    auto check = [&failures](const char* what, bool ok) {
+        std::printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    };
+
+    /// Parsing
+    const char* obj = "# model\r\n  mtllib  my materials.mtl \r\nv 0 0 0\nmtllib\textra.mtl\nusemtl a\nmtllibx no.mtl\n";
+    const auto libraries = MeshCache::GetMaterialLibraries(obj, std::strlen(obj));
+    check("mtllib lines found, names trimmed", libraries.size() == 2 && libraries[0] == "my materials.mtl" && libraries[1] == "extra.mtl");
+
+    /// Keys
+    const std::filesystem::path folder = std::filesystem::temp_directory_path() / "ne_mesh_cache_sources_check";
+    std::filesystem::create_directories(folder);
+    const std::string objPath = (folder / "model.obj").string();
+    writeFile(objPath, "mtllib model.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\nusemtl stone\nf 1 2 3\n");
+    writeFile(folder / "model.mtl", "newmtl stone\nNs 32\nmap_Kd stone.png\n");
+
+    uint64_t original = 0, again = 0, edited = 0, missing = 0;
+    check("model hashed", MeshCache::HashModelSources(objPath, original));
+    MeshCache::HashModelSources(objPath, again);
+    check("same sources, same key", original == again);
+
+    writeFile(folder / "model.mtl", "newmtl stone\nNs 32\nmap_Kd stone_new.png\n");
+    MeshCache::HashModelSources(objPath, edited);
+    check("edited .mtl texture path, new key", edited != original);
+
+    std::filesystem::remove(folder / "model.mtl");
+    check("missing .mtl still hashes", MeshCache::HashModelSources(objPath, missing));
+    check("missing .mtl, new key", missing != original && missing != edited);
+
+    std::filesystem::remove_all(folder);
+
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+// Checks the mip levels the renderer asks the TextureStreamer for: a big texture far away must not want its full
+// image, close up it must. Exits with 1 on a failure.
+// Build with -DNE_BUILD_BENCHMARKS=ON.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+
+#include "TextureStreamer.hpp"
+
+// as Render does it: pixels per world unit at distance, for a 45 degree camera on a 1080 pixels tall viewport
+static float pixelsPerUnitAt(float distance)
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    return projection[1][1] * 0.5f * 1080.0f / distance;
+}
+
+int main()
+{
+    int failures = 0;
+    auto check = [&failures](const char* what, bool ok, float level) {
+        std::printf("%-50s level %6.2f  %s\n", what, level, ok ? "ok" : "FAILED");
+        failures += ok ? 0 : 1;
+    };
+
+    // a 4096x4096 texture tiled once per world unit
+    const float uvPerUnit = 1.0f;
+
+    const float far = TextureStreamer::GetSampledLevel(4096, 4096, uvPerUnit, pixelsPerUnitAt(100.0f));
+    check("4096^2 at 100 units", far > 0.0f, far);
+
+    const float farther = TextureStreamer::GetSampledLevel(4096, 4096, uvPerUnit, pixelsPerUnitAt(400.0f));
+    check("4096^2 at 400 units, coarser than at 100", farther > far, farther);
+
+    const float near = TextureStreamer::GetSampledLevel(4096, 4096, uvPerUnit, pixelsPerUnitAt(0.1f));
+    check("4096^2 at 0.1 units", near == 0.0f, near);
+
+    const float small = TextureStreamer::GetSampledLevel(64, 64, uvPerUnit, pixelsPerUnitAt(1.0f));
+    check("64^2 at 1 unit", small == 0.0f, small);
+
+    const float unknown = TextureStreamer::GetSampledLevel(4096, 4096, 0.0f, pixelsPerUnitAt(100.0f));
+    check("4096^2 without UV density", unknown == 0.0f, unknown);
+
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+// Per-object TransformComponent matrices against TransformSystem's batched kernels.
+// Build with -DNE_BUILD_BENCHMARKS=ON (and -DNE_ENABLE_AVX=ON for the AVX kernel), in Release.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "JobSystem.hpp"
+#include "TransformComponent.hpp"
+#include "TransformSystem.hpp"
+
+struct TransformValues
+{
+    glm::vec3 Position;
+    glm::vec3 Rotation;     // degrees
+    glm::vec3 Scale;
+};
+
+// The Euler matrix TransformComponent built before it stored quaternions
+static glm::mat4 eulerMatrix(const TransformValues& t)
+{
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), t.Position);
+    m = glm::rotate(m, glm::radians(t.Rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    m = glm::rotate(m, glm::radians(t.Rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    m = glm::rotate(m, glm::radians(t.Rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    return glm::scale(m, t.Scale);
+}
+
+static float maxDifference(const glm::mat4& a, const glm::mat4& b)
+{
+    float diff = 0.0f;
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            diff = std::max(diff, std::abs(a[c][r] - b[c][r]));
+    return diff;
+}
+
+// Best of a few runs, in nanoseconds per transform
+template <typename Func>
+static double measure(size_t count, Func&& func)
+{
+    double best = 1e30;
+    for (int run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best / (double)count;
+}
+
+int main()
+{
+    JobSystem::Init();
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+    std::uniform_real_distribution<float> scale(0.1f, 4.0f);
+
+    std::printf("widest kernel: %s, %u workers\n",
+                TransformSystem::GetKernelName(TransformSystem::GetKernel()), JobSystem::GetWorkerCount());
+    std::printf("%10s %12s %12s %12s %12s %12s %12s   (ns per transform)\n",
+                "count", "component", "euler", "scalar", "SSE", "AVX", "all threads");
+
+    for (size_t count : { (size_t)10000, (size_t)100000, (size_t)1000000 })
+    {
+        std::vector<TransformValues> values(count);
+        for (auto& v : values)
+        {
+            v.Position = glm::vec3(position(rng), position(rng), position(rng));
+            v.Rotation = glm::vec3(angle(rng), angle(rng), angle(rng));
+            v.Scale = glm::vec3(scale(rng), scale(rng), scale(rng));
+        }
+
+        std::vector<TransformComponent> components(count);
+        TransformSystem system;
+        system.Reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            components[i].SetPosition(values[i].Position);
+            components[i].SetRotation(values[i].Rotation);
+            components[i].SetScale(values[i].Scale);
+            system.Add(values[i].Position, EulerToQuat(values[i].Rotation), values[i].Scale);
+        }
+
+        // every object moved this frame: mark dirty and rebuild one at a time
+        const double component = measure(count, [&]() {
+            for (size_t i = 0; i < count; i++)
+            {
+                components[i].GetPositionRef().x += 1e-3f;
+                components[i].Update();
+            }
+        });
+
+        std::vector<glm::mat4> eulerMatrices(count);
+        const double euler = measure(count, [&]() {
+            for (size_t i = 0; i < count; i++)
+                eulerMatrices[i] = eulerMatrix(values[i]);
+        });
+
+        const double scalar = measure(count, [&]() { system.Compose(0, count, TransformSystem::Kernel::Scalar); });
+        const double sse = measure(count, [&]() { system.Compose(0, count, TransformSystem::Kernel::SSE); });
+        const double avx = measure(count, [&]() { system.Compose(0, count, TransformSystem::Kernel::AVX); });
+        const double all = measure(count, [&]() { system.ComposeAll(); });
+
+        float worst = 0.0f;
+        for (size_t i = 0; i < count; i++)
+            worst = std::max(worst, maxDifference(system.GetMatrix(i), eulerMatrices[i]));
+
+        std::printf("%10zu %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f   max error %.2e\n",
+                    count, component, euler, scalar, sse, avx, all, worst);
+    }
+
+    JobSystem::Shutdown();
+    return 0;
+}
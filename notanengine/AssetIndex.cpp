@@ -0,0 +1,375 @@
+#include "AssetIndex.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _NE_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+struct IndexState
+{
+    std::string root;
+
+    // relative path ('/' separated) -> full path
+    std::unordered_map<std::string, std::string> byRelativePath;
+    // file name -> relative paths of every file with that name, sorted
+    std::unordered_map<std::string, std::vector<std::string>> byFileName;
+
+    // names already reported as ambiguous, so each is only reported once
+    std::unordered_set<std::string> reported;
+
+    std::shared_mutex mutex;
+
+#ifdef _NE_LINUX
+    int inotifyFd = -1;
+    // watch descriptor -> relative path of the watched directory ("" for the root)
+    std::unordered_map<int, std::string> watches;
+#endif
+};
+static IndexState g_index;
+
+static std::string normalizePath(const std::string& path)
+{
+    std::string out = path;
+    std::replace(out.begin(), out.end(), '\\', '/');
+    while (out.compare(0, 2, "./") == 0)
+        out.erase(0, 2);
+    return out;
+}
+
+static std::string getFileName(const std::string& relativePath)
+{
+    const size_t slash = relativePath.find_last_of('/');
+    return slash == std::string::npos ? relativePath : relativePath.substr(slash + 1);
+}
+
+static std::string joinRelative(const std::string& directory, const std::string& name)
+{
+    return directory.empty() ? name : directory + "/" + name;
+}
+
+/// Index edits, the caller holds the unique lock
+
+static void addFile(const std::string& relativePath)
+{
+    if (!g_index.byRelativePath.emplace(relativePath, g_index.root + "/" + relativePath).second)
+        return;
+
+    auto& sameName = g_index.byFileName[getFileName(relativePath)];
+    sameName.insert(std::lower_bound(sameName.begin(), sameName.end(), relativePath), relativePath);
+}
+
+static void removeFile(const std::string& relativePath)
+{
+    if (g_index.byRelativePath.erase(relativePath) == 0)
+        return;
+
+    const std::string name = getFileName(relativePath);
+    auto it = g_index.byFileName.find(name);
+    if (it == g_index.byFileName.end())
+        return;
+
+    auto& sameName = it->second;
+    sameName.erase(std::remove(sameName.begin(), sameName.end(), relativePath), sameName.end());
+    if (sameName.empty())
+        g_index.byFileName.erase(it);
+}
+
+// every file inside the directory, at any depth
+static void removeDirectory(const std::string& relativeDirectory)
+{
+    const std::string prefix = relativeDirectory + "/";
+    std::vector<std::string> removed;
+    for (const auto& [relativePath, fullPath] : g_index.byRelativePath)
+    {
+        if (relativePath.compare(0, prefix.size(), prefix) == 0)
+            removed.push_back(relativePath);
+    }
+
+    for (const auto& relativePath : removed)
+        removeFile(relativePath);
+
+#ifdef _NE_LINUX
+    // a directory moved out of the tree keeps its watches, and they'd report under the old path
+    for (auto it = g_index.watches.begin(); it != g_index.watches.end();)
+    {
+        if (it->second == relativeDirectory || it->second.compare(0, prefix.size(), prefix) == 0)
+        {
+            inotify_rm_watch(g_index.inotifyFd, it->first);
+            it = g_index.watches.erase(it);
+        }
+        else
+            ++it;
+    }
+#endif
+}
+
+#ifdef _NE_LINUX
+static void watchDirectory(const std::string& relativeDirectory)
+{
+    if (g_index.inotifyFd < 0)
+        return;
+
+    const std::string fullPath = relativeDirectory.empty() ? g_index.root : g_index.root + "/" + relativeDirectory;
+    const int wd = inotify_add_watch(g_index.inotifyFd, fullPath.c_str(),
+                                     IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd >= 0)
+        g_index.watches[wd] = relativeDirectory;
+}
+#endif
+
+// adds the files under the directory and watches it and its subdirectories
+static void scanDirectory(const std::string& relativeDirectory)
+{
+    const std::filesystem::path start = relativeDirectory.empty()
+        ? std::filesystem::path(g_index.root)
+        : std::filesystem::path(g_index.root) / relativeDirectory;
+
+#ifdef _NE_LINUX
+    watchDirectory(relativeDirectory);
+#endif
+
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(start, error);
+         !error && it != std::filesystem::recursive_directory_iterator();
+         it.increment(error))
+    {
+        // the iterator's paths start with the root as it was given
+        const std::string relativePath = normalizePath(it->path().generic_string().substr(g_index.root.size() + 1));
+
+        if (it->is_directory(error))
+        {
+#ifdef _NE_LINUX
+            watchDirectory(relativePath);
+#endif
+            continue;
+        }
+
+        addFile(relativePath);
+    }
+}
+
+static void rebuild()
+{
+    g_index.byRelativePath.clear();
+    g_index.byFileName.clear();
+
+#ifdef _NE_LINUX
+    for (const auto& [wd, directory] : g_index.watches)
+        inotify_rm_watch(g_index.inotifyFd, wd);
+    g_index.watches.clear();
+#endif
+
+    scanDirectory("");
+}
+
+static void reportAmbiguousNames()
+{
+    std::vector<std::string> names;
+    for (const auto& [name, paths] : g_index.byFileName)
+    {
+        if (paths.size() > 1)
+            names.push_back(name);
+    }
+    if (names.empty())
+        return;
+
+    std::sort(names.begin(), names.end());
+    std::cout << "AssetIndex: " << names.size() << " file names are used more than once, lookups by name alone are ambiguous:\n";
+    for (const auto& name : names)
+    {
+        std::cout << "    " << name << ":";
+        for (const auto& path : g_index.byFileName[name])
+            std::cout << ' ' << path;
+        std::cout << '\n';
+    }
+}
+
+// Lookup, the caller holds at least the shared lock. outCandidates gets the files the pick was arbitrary among
+static std::string find(const std::string& path, std::vector<std::string>& outCandidates)
+{
+    if (auto it = g_index.byRelativePath.find(path); it != g_index.byRelativePath.end())
+        return it->second;
+
+    auto it = g_index.byFileName.find(getFileName(path));
+    if (it == g_index.byFileName.end())
+        return "";
+
+    const std::vector<std::string>& sameName = it->second;
+    if (sameName.size() == 1)
+        return g_index.byRelativePath.at(sameName.front());
+
+    // the files whose path ends with the requested one (a model referencing "textures/a.png" from its folder)
+    std::vector<std::string> matches;
+    const std::string suffix = "/" + path;
+    for (const auto& candidate : sameName)
+    {
+        if (candidate.size() >= suffix.size() && candidate.compare(candidate.size() - suffix.size(), suffix.size(), suffix) == 0)
+            matches.push_back(candidate);
+    }
+
+    if (matches.size() == 1)
+        return g_index.byRelativePath.at(matches.front());
+
+    outCandidates = matches.empty() ? sameName : matches;
+    return g_index.byRelativePath.at(outCandidates.front());
+}
+
+namespace AssetIndex
+{
+    void Build(const std::string& rootPath)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        std::unique_lock<std::shared_mutex> lock(g_index.mutex);
+        g_index.root = normalizePath(rootPath);
+        g_index.reported.clear();
+
+#ifdef _NE_LINUX
+        if (g_index.inotifyFd < 0)
+        {
+            g_index.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (g_index.inotifyFd < 0)
+                std::cerr << "AssetIndex: inotify unavailable, changes to " << g_index.root << " won't be picked up\n";
+        }
+#endif
+
+        rebuild();
+
+        const float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "AssetIndex: " << g_index.byRelativePath.size() << " files under " << g_index.root << " indexed in " << ms << " ms\n";
+        reportAmbiguousNames();
+    }
+
+    void Shutdown()
+    {
+        std::unique_lock<std::shared_mutex> lock(g_index.mutex);
+#ifdef _NE_LINUX
+        if (g_index.inotifyFd >= 0)
+            close(g_index.inotifyFd);
+        g_index.inotifyFd = -1;
+        g_index.watches.clear();
+#endif
+        g_index.byRelativePath.clear();
+        g_index.byFileName.clear();
+    }
+
+    std::string Resolve(const std::string& path)
+    {
+        const std::string normalized = normalizePath(path);
+        if (normalized.empty())
+            return "";
+
+        // absolute paths that exist are taken as they are, the others (from the machine a model was made on) go by name
+        std::error_code error;
+        if (std::filesystem::path(normalized).is_absolute() && std::filesystem::is_regular_file(normalized, error))
+            return normalized;
+
+        std::string fullPath;
+        std::vector<std::string> candidates;
+        {
+            std::shared_lock<std::shared_mutex> lock(g_index.mutex);
+            fullPath = find(normalized, candidates);
+        }
+
+#ifndef _NE_LINUX
+        // nothing tells the index about new files, look again before giving up
+        if (fullPath.empty())
+        {
+            std::unique_lock<std::shared_mutex> lock(g_index.mutex);
+            rebuild();
+            fullPath = find(normalized, candidates);
+        }
+#endif
+
+        if (!candidates.empty())
+        {
+            std::unique_lock<std::shared_mutex> lock(g_index.mutex);
+            if (g_index.reported.insert(normalized).second)
+            {
+                std::cerr << "AssetIndex: " << path << " is ambiguous, using " << candidates.front() << " out of";
+                for (const auto& candidate : candidates)
+                    std::cerr << ' ' << candidate;
+                std::cerr << '\n';
+            }
+        }
+
+        return fullPath;
+    }
+
+    void Poll()
+    {
+#ifdef _NE_LINUX
+        if (g_index.inotifyFd < 0)
+            return;
+
+        alignas(inotify_event) char buffer[4096];
+        while (true)
+        {
+            const ssize_t length = read(g_index.inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0)
+                return;
+
+            std::unique_lock<std::shared_mutex> lock(g_index.mutex);
+            for (ssize_t offset = 0; offset < length;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                // events were dropped, the index can't be patched anymore
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    rebuild();
+                    continue;
+                }
+
+                auto watch = g_index.watches.find(event->wd);
+                if (watch == g_index.watches.end())
+                    continue;
+
+                if (event->mask & IN_IGNORED)
+                {
+                    g_index.watches.erase(watch);
+                    continue;
+                }
+
+                if (event->len == 0)
+                    continue;
+
+                const std::string relativePath = joinRelative(watch->second, event->name);
+                const bool added = event->mask & (IN_CREATE | IN_MOVED_TO);
+
+                if (event->mask & IN_ISDIR)
+                {
+                    if (added)
+                        scanDirectory(relativePath);
+                    else
+                        removeDirectory(relativePath);
+                }
+                else if (added)
+                    addFile(relativePath);
+                else
+                    removeFile(relativePath);
+
+                // whatever was ambiguous may not be anymore (or the other way around)
+                g_index.reported.clear();
+            }
+        }
+#endif
+    }
+
+    size_t GetFileCount()
+    {
+        std::shared_lock<std::shared_mutex> lock(g_index.mutex);
+        return g_index.byRelativePath.size();
+    }
+}
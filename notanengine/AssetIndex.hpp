@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+/*
+    Index of every file under the assets folder, built once at startup so
+    resolving an asset path is a couple of hash lookups instead of a walk of
+    the whole tree.
+    Files are indexed by their path relative to the root and by file name.
+    Models reference textures relative to themselves (or with paths from the
+    machine they were exported on), so a path that isn't a relative path of
+    the index falls back to its file name. When several files share that name
+    the one whose path ends like the requested one wins, and the ambiguity is
+    reported.
+    On Linux the index follows changes to the tree through inotify (see Poll).
+    Elsewhere a lookup that misses rescans the tree once.
+    Resolve is safe from any thread.
+*/
+namespace AssetIndex
+{
+    void Build(const std::string& rootPath);
+    void Shutdown();
+
+    // Full path of the asset, empty if no file matches
+    std::string Resolve(const std::string& path);
+
+    // Applies the file system changes since the last call. Call once per frame
+    void Poll();
+
+    size_t GetFileCount();
+}
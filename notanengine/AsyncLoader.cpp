@@ -0,0 +1,437 @@
+#include "AsyncLoader.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TextureStreamer.hpp"
+
+struct TextureJob
+{
+    Texture2D Texture;                      // the cached placeholder, kept alive until its image is in
+    ResourceManager::DecodedImage Image;    // decoded on a loader thread, or by a model import
+
+    // levels go coarsest first, each in bands of rows (of blocks when compressed)
+    size_t LevelsUploaded = 0;
+    // rows of the level being uploaded already in
+    int NextRow = 0;
+    // finest level uploaded here, the TextureStreamer brings in the ones above it
+    size_t FirstLevel = 0;
+
+    inline bool IsDone() const noexcept { return LevelsUploaded + FirstLevel == Image.Mips.Levels.size(); }
+};
+
+struct ModelJob
+{
+    std::shared_ptr<AsyncLoader::AsyncModel> Handle;
+    std::function<void(const ResourceManager::Model&)> OnReady;
+    ResourceManager::ModelImport Import;
+    bool Imported = false;
+};
+
+// pixel buffers cycled through, so a new band never waits on the copy of the previous one
+constexpr unsigned int NUM_UPLOAD_BUFFERS = 3;
+
+struct LoaderState
+{
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop = false;
+
+    // done on a loader thread, waiting for the GL thread. Guarded by mutex
+    std::deque<std::shared_ptr<TextureJob>> decodedTextures;
+    std::deque<std::shared_ptr<ModelJob>> importedModels;
+
+    /// GL thread only
+    std::shared_ptr<TextureJob> uploadingTexture;
+    std::shared_ptr<ModelJob> uploadingModel;
+    unsigned int uploadBuffers[NUM_UPLOAD_BUFFERS] = {};
+    unsigned int nextUploadBuffer = 0;
+    size_t uploadBudget = AsyncLoader::DEFAULT_UPLOAD_BUDGET;
+    AsyncLoader::AsyncLoaderStats stats;
+};
+static LoaderState g_loader;
+
+static void loaderThreadLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(g_loader.mutex);
+            g_loader.cv.wait(lock, [] { return g_loader.stop || !g_loader.jobs.empty(); });
+
+            if (g_loader.stop)
+                return;
+
+            job = std::move(g_loader.jobs.front());
+            g_loader.jobs.pop_front();
+        }
+        job();
+    }
+}
+
+// runs inline when there are no loader threads, like the JobSystem does
+static void submit(std::function<void()> job)
+{
+    if (g_loader.threads.empty())
+    {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_loader.mutex);
+        g_loader.jobs.push_back(std::move(job));
+    }
+    g_loader.cv.notify_one();
+}
+
+// Copies bytes into the next pixel buffer of the ring and leaves it bound. Returns what the GL upload call
+// takes as its data: an offset into the buffer, or src itself (and no buffer bound) if the mapping failed
+static const void* stageUpload(const void* src, size_t bytes)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_loader.uploadBuffers[g_loader.nextUploadBuffer]);
+    g_loader.nextUploadBuffer = (g_loader.nextUploadBuffer + 1) % NUM_UPLOAD_BUFFERS;
+
+    // orphan the old storage instead of waiting for the copy out of it to finish
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!dst)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return src;
+    }
+
+    std::memcpy(dst, src, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return nullptr;
+}
+
+// Uploads bands of the coarsest level not uploaded yet until budget is used (at least one band), down to FirstLevel.
+// A level becomes the texture's base once all of it is in, so the texture sharpens as levels come in. Returns the bytes uploaded
+static size_t uploadTextureLevels(TextureJob& job, size_t budget)
+{
+    const TextureCompression::CompressedImage& image = job.Image.Mips;
+    const GLint numLevels = static_cast<GLint>(image.Levels.size());
+
+    size_t uploaded = 0;
+    while (!job.IsDone() && uploaded < budget)
+    {
+        const GLint level = numLevels - 1 - static_cast<GLint>(job.LevelsUploaded);
+        uploaded += AsyncLoader::UploadLevelRows(job.Texture.GetID(), image, level, job.NextRow, budget - uploaded);
+        if (job.NextRow < image.Levels[level].Height)
+            continue;
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+        job.LevelsUploaded++;
+        job.NextRow = 0;
+    }
+
+    if (job.IsDone())
+    {
+        // later requests for the path get the real size, and the pixels can dedupe other paths
+        const GLenum format = TextureCompression::GetGLFormat(image.Format, image.Channels);
+        ResourceManager::UpdateCachedTexture(job.Texture, Texture2DProperties{ image.Width, image.Height, format, job.Image.Path },
+                                             job.Image.ContentHash);
+
+        // the finer levels are the streamer's now
+        if (job.FirstLevel > 0)
+            TextureStreamer::Register(job.Texture, image, job.Image.CachePath, job.Image.SourceHash, job.FirstLevel);
+    }
+
+    return uploaded;
+}
+
+static size_t getPackedMeshSize(const PackedMeshView& mesh)
+{
+    const size_t indexSize = mesh.IndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+    return mesh.NumVertices * (sizeof(PackedVertex) + sizeof(glm::vec3)) + mesh.NumIndices * indexSize;
+}
+
+// Placeholder texture whose image is queued for upload. It goes in the texture cache right away, so
+// requests for the same path while the image is on its way get it too. GL thread
+static Texture2D createStreamedTexture(const std::string& path, bool flipVertically, uint64_t contentHash)
+{
+    // mid grey until the image is in
+    unsigned char placeholder[4] = { 128, 128, 128, 255 };
+    Texture2D texture(placeholder, Texture2DProperties{ 1, 1, GL_RGBA, path });
+    g_loader.stats.PendingTextures++;
+    return ResourceManager::CacheTexture(texture, path, flipVertically, contentHash);
+}
+
+static void queueDecodedTexture(const std::shared_ptr<TextureJob>& job)
+{
+    std::lock_guard<std::mutex> lock(g_loader.mutex);
+    g_loader.decodedTextures.push_back(job);
+}
+
+// Uploads submeshes of the current model until the budget is used. Returns the bytes uploaded
+static size_t uploadModels(size_t budget)
+{
+    size_t uploaded = 0;
+    while (uploaded < budget)
+    {
+        if (!g_loader.uploadingModel)
+        {
+            std::lock_guard<std::mutex> lock(g_loader.mutex);
+            if (g_loader.importedModels.empty())
+                break;
+
+            g_loader.uploadingModel = std::move(g_loader.importedModels.front());
+            g_loader.importedModels.pop_front();
+        }
+
+        ModelJob& job = *g_loader.uploadingModel;
+        AsyncLoader::AsyncModel& model = *job.Handle;
+
+        if (!job.Imported)
+        {
+            model.Failed = true;
+            g_loader.stats.PendingModels--;
+            g_loader.uploadingModel.reset();
+            continue;
+        }
+
+        model.SubMeshesTotal = job.Import.Meshes.size();
+        if (model.SubMeshesUploaded < model.SubMeshesTotal)
+        {
+            // a submesh goes in whole, so a big one can overshoot the budget
+            const size_t subMesh = model.SubMeshesUploaded++;
+            uploaded += getPackedMeshSize(job.Import.Meshes[subMesh]);
+            model.Model.Mesh.GetSubMeshesRef().push_back(ResourceManager::CreateSubMesh(job.Import, subMesh, [&job](const std::string& path) {
+                // the import already decoded its textures, they go straight to the upload queue
+                auto image = job.Import.Images.find(path);
+                if (image == job.Import.Images.end())
+                    return AsyncLoader::LoadTexture(path);
+
+                Texture2D texture;
+                if (ResourceManager::FindCachedTexture(image->second, texture))
+                    return texture;
+
+                auto textureJob = std::make_shared<TextureJob>();
+                textureJob->Image = std::move(image->second);
+                job.Import.Images.erase(image);
+
+                textureJob->Texture = createStreamedTexture(path, false, textureJob->Image.ContentHash);
+                queueDecodedTexture(textureJob);
+                return textureJob->Texture;
+            }));
+            continue;
+        }
+
+        model.Model.Path = job.Import.Path;
+        model.Ready = true;
+        g_loader.stats.PendingModels--;
+        g_loader.stats.ModelsLoaded++;
+
+        if (job.OnReady)
+            job.OnReady(model.Model);
+
+        // unmaps the cache file or frees the packed buffers
+        g_loader.uploadingModel.reset();
+    }
+
+    return uploaded;
+}
+
+// Uploads mip levels of decoded textures until the budget is used. Returns the bytes uploaded
+static size_t uploadTextures(size_t budget)
+{
+    size_t uploaded = 0;
+    while (uploaded < budget)
+    {
+        if (!g_loader.uploadingTexture)
+        {
+            std::lock_guard<std::mutex> lock(g_loader.mutex);
+            if (g_loader.decodedTextures.empty())
+                break;
+
+            g_loader.uploadingTexture = std::move(g_loader.decodedTextures.front());
+            g_loader.decodedTextures.pop_front();
+        }
+
+        TextureJob& job = *g_loader.uploadingTexture;
+        // DecodeImage always leaves a mip chain
+        const bool decoded = job.Image.Mips.IsValid();
+        if (decoded)
+        {
+            if (job.LevelsUploaded == 0 && job.NextRow == 0)
+                job.FirstLevel = TextureStreamer::IsEnabled() ? TextureStreamer::GetTailLevel(job.Image.Mips) : 0;
+            uploaded += uploadTextureLevels(job, budget - uploaded);
+        }
+
+        // a texture that failed to decode keeps its placeholder
+        if (!decoded || job.IsDone())
+        {
+            g_loader.stats.PendingTextures--;
+            if (decoded)
+                g_loader.stats.TexturesLoaded++;
+            g_loader.uploadingTexture.reset();
+        }
+    }
+
+    return uploaded;
+}
+
+namespace AsyncLoader
+{
+    void Init(unsigned int numThreads)
+    {
+        if (!g_loader.threads.empty())
+            return;
+
+        if (numThreads == 0)
+            numThreads = 2;
+
+        glGenBuffers(NUM_UPLOAD_BUFFERS, g_loader.uploadBuffers);
+
+        g_loader.stop = false;
+        g_loader.threads.reserve(numThreads);
+        for (unsigned int i = 0; i < numThreads; i++)
+            g_loader.threads.emplace_back(loaderThreadLoop);
+    }
+
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(g_loader.mutex);
+            g_loader.stop = true;
+            g_loader.jobs.clear();
+        }
+        g_loader.cv.notify_all();
+
+        for (auto& thread : g_loader.threads)
+            thread.join();
+        g_loader.threads.clear();
+
+        g_loader.decodedTextures.clear();
+        g_loader.importedModels.clear();
+        g_loader.uploadingTexture.reset();
+        g_loader.uploadingModel.reset();
+
+        glDeleteBuffers(NUM_UPLOAD_BUFFERS, g_loader.uploadBuffers);
+        std::fill(std::begin(g_loader.uploadBuffers), std::end(g_loader.uploadBuffers), 0);
+    }
+
+    void Update()
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        size_t uploaded = uploadModels(g_loader.uploadBudget);
+        if (uploaded < g_loader.uploadBudget)
+            uploaded += uploadTextures(g_loader.uploadBudget - uploaded);
+
+        g_loader.stats.BytesUploaded = uploaded;
+        g_loader.stats.UploadMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void Submit(std::function<void()> job)
+    {
+        submit(std::move(job));
+    }
+
+    size_t UploadLevelRows(unsigned int texture, const TextureCompression::CompressedImage& image, size_t level, int& nextRow, size_t budget)
+    {
+        const TextureCompression::CompressedLevel& info = image.Levels[level];
+        const GLenum format = TextureCompression::GetGLFormat(image.Format, image.Channels);
+        const bool compressed = TextureCompression::IsBlockCompressed(image.Format);
+        const GLint glLevel = static_cast<GLint>(level);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // a band is a row of texels, or of 4x4 blocks
+        const int bandHeight = compressed ? 4 : 1;
+        const size_t bandBytes = compressed
+            ? TextureCompression::GetLevelSize(image.Format, info.Width, 4)
+            : size_t(info.Width) * image.Channels;
+        const int numBands = (info.Height + bandHeight - 1) / bandHeight;
+
+        // the level's storage first, the bands fill it. Levels below the base are ignored meanwhile
+        if (nextRow == 0)
+        {
+            if (compressed)
+                glCompressedTexImage2D(GL_TEXTURE_2D, glLevel, format, info.Width, info.Height, 0, static_cast<GLsizei>(info.Size), nullptr);
+            else
+                glTexImage2D(GL_TEXTURE_2D, glLevel, format, info.Width, info.Height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+        }
+
+        const int firstBand = nextRow / bandHeight;
+        const int bands = static_cast<int>(std::clamp<size_t>(budget / bandBytes, 1, numBands - firstBand));
+        const int rows = std::min(bands * bandHeight, info.Height - nextRow);
+        const size_t bytes = size_t(bands) * bandBytes;
+
+        const void* data = stageUpload(image.Data.data() + info.Offset + firstBand * bandBytes, bytes);
+        if (compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, glLevel, 0, nextRow, info.Width, rows, format, static_cast<GLsizei>(bytes), data);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, glLevel, 0, nextRow, info.Width, rows, format, GL_UNSIGNED_BYTE, data);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        nextRow += rows;
+        return bytes;
+    }
+
+    void SetUploadBudget(size_t bytesPerFrame)
+    {
+        g_loader.uploadBudget = std::max<size_t>(bytesPerFrame, 1);
+    }
+
+    size_t GetUploadBudget()
+    {
+        return g_loader.uploadBudget;
+    }
+
+    Texture2D LoadTexture(const std::string& path, bool flipVertically)
+    {
+        Texture2D texture;
+        if (ResourceManager::FindCachedTexture(path, flipVertically, texture))
+            return texture;
+
+        auto job = std::make_shared<TextureJob>();
+        job->Texture = createStreamedTexture(path, flipVertically, 0);
+
+        submit([job, path, flipVertically]() {
+            job->Image = ResourceManager::DecodeImage(path, flipVertically);
+            queueDecodedTexture(job);
+        });
+
+        return job->Texture;
+    }
+
+    std::shared_ptr<const AsyncModel> LoadModel(const std::string& path, std::function<void(const ResourceManager::Model&)> onReady)
+    {
+        auto job = std::make_shared<ModelJob>();
+        job->Handle = std::make_shared<AsyncModel>();
+        job->OnReady = std::move(onReady);
+        g_loader.stats.PendingModels++;
+
+        submit([job, path]() {
+            job->Imported = ResourceManager::ImportModel(path, job->Import);
+
+            std::lock_guard<std::mutex> lock(g_loader.mutex);
+            g_loader.importedModels.push_back(job);
+        });
+
+        return job->Handle;
+    }
+
+    const AsyncLoaderStats& GetStats()
+    {
+        return g_loader.stats;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "ResourceManager.hpp"
+#include "Texture2D.hpp"
+
+/*
+    Loads textures and models without blocking the render loop.
+    Loader threads read, decode and import (stb_image, the mesh cache, Assimp
+    and the import processing); the GL thread uploads the results in Update,
+    never more than the upload budget per frame. Textures go through a pixel
+    buffer object a mip level at a time, coarsest first, so they show up
+    blurry and sharpen as the big levels arrive; a level that doesn't fit in
+    the budget goes in bands of rows (of 4x4 blocks when compressed).
+    Requests return right away with something usable: a texture is a real GL
+    texture showing a 1x1 placeholder until its image is in, a model is an
+    AsyncModel whose mesh fills in one submesh at a time as each is uploaded
+    and is complete once Ready is set, so a model may draw partly for a few
+    frames.
+    Everything here but the loader threads must be called from the GL thread.
+*/
+namespace AsyncLoader
+{
+    constexpr size_t DEFAULT_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+    struct AsyncModel
+    {
+        ResourceManager::Model Model;  // fills in a submesh at a time, complete when Ready
+        bool Ready = false;
+        bool Failed = false;
+        size_t SubMeshesUploaded = 0;
+        size_t SubMeshesTotal = 0;     // known once the import is done
+    };
+
+    struct AsyncLoaderStats
+    {
+        unsigned int PendingTextures = 0;   // queued, decoding or uploading
+        unsigned int PendingModels = 0;
+        unsigned int TexturesLoaded = 0;
+        unsigned int ModelsLoaded = 0;
+        size_t BytesUploaded = 0;           // during the last Update
+        float UploadMs = 0.0f;              // CPU time of the last Update
+    };
+
+    // numThreads = 0 picks 2: loading is mostly waiting on the disk, and imports spread on the JobSystem anyway
+    void Init(unsigned int numThreads = 0);
+    // Drops what's still queued. Must run before JobSystem::Shutdown
+    void Shutdown();
+
+    // Uploads finished work until the budget is used. Call once per frame
+    void Update();
+
+    // Runs job on a loader thread (inline before Init), for other systems reading from disk
+    void Submit(std::function<void()> job);
+
+    // Uploads bands of rows of a level of image into texture, from nextRow on, until budget is used (at least one
+    // band). Defines the level's storage when nextRow is 0 and moves nextRow past what was uploaded; the level is
+    // complete once nextRow reaches its height. Leaves the texture bound to unit 0. Returns the bytes uploaded
+    size_t UploadLevelRows(unsigned int texture, const TextureCompression::CompressedImage& image, size_t level, int& nextRow, size_t budget);
+
+    void SetUploadBudget(size_t bytesPerFrame);
+    size_t GetUploadBudget();
+
+    // Through the ResourceManager texture cache, so the same texture for the same file whichever loader asked first.
+    // flipVertically is per request, the loader threads don't touch stb_image's global flag
+    Texture2D LoadTexture(const std::string& path, bool flipVertically = false);
+
+    // onReady runs in Update, on the GL thread, once the whole model is uploaded
+    std::shared_ptr<const AsyncModel> LoadModel(const std::string& path,
+                                                std::function<void(const ResourceManager::Model&)> onReady = {});
+
+    const AsyncLoaderStats& GetStats();
+}
@@ -0,0 +1,86 @@
+#include "Bounds.hpp"
+
+#include <algorithm>
+
+AABB AABB::Transformed(const glm::mat4& m) const noexcept
+{
+    if (!IsValid())
+        return AABB();
+
+    // transform center and extents (Arvo): the new extents are |M| * extents
+    const glm::vec3 center = glm::vec3(m * glm::vec4(GetCenter(), 1.0f));
+    const glm::vec3 extents = GetExtents();
+
+    const glm::mat3 absM(glm::abs(glm::vec3(m[0])), glm::abs(glm::vec3(m[1])), glm::abs(glm::vec3(m[2])));
+    const glm::vec3 newExtents = absM * extents;
+
+    return AABB(center - newExtents, center + newExtents);
+}
+
+bool AABB::IntersectRay(const Ray& ray, float& outNear, float& outFar) const noexcept
+{
+    // slabs. A zero direction component gives infinities, which compare right unless the origin is on a face
+    const glm::vec3 inverse = 1.0f / ray.Direction;
+    const glm::vec3 t0 = (Min - ray.Origin) * inverse;
+    const glm::vec3 t1 = (Max - ray.Origin) * inverse;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+
+    outNear = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    outFar = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, ray.MaxDistance));
+    return outNear <= outFar;
+}
+
+Frustum Frustum::FromMatrix(const glm::mat4& m) noexcept
+{
+    // Gribb & Hartmann plane extraction, glm matrices are column-major so rows are m[.][i]
+    const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.Planes[0] = row3 + row0; // left
+    frustum.Planes[1] = row3 - row0; // right
+    frustum.Planes[2] = row3 + row1; // bottom
+    frustum.Planes[3] = row3 - row1; // top
+    frustum.Planes[4] = row3 + row2; // near
+    frustum.Planes[5] = row3 - row2; // far
+
+    for (auto& plane : frustum.Planes)
+    {
+        const float len = glm::length(glm::vec3(plane));
+        if (len > 0.0f)
+            plane /= len;
+    }
+
+    return frustum;
+}
+
+bool Frustum::Intersects(const AABB& box) const noexcept
+{
+    const glm::vec3 center = box.GetCenter();
+    const glm::vec3 extents = box.GetExtents();
+
+    for (const auto& plane : Planes)
+    {
+        const glm::vec3 normal(plane);
+        // projected radius of the box on the plane normal
+        const float radius = glm::dot(extents, glm::abs(normal));
+        if (glm::dot(normal, center) + plane.w < -radius)
+            return false;
+    }
+
+    return true;
+}
+
+bool Frustum::Intersects(const glm::vec3& center, float radius) const noexcept
+{
+    for (const auto& plane : Planes)
+    {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+
+// Half line from Origin along Direction. Distances along it count in lengths of Direction, so a ray
+// transformed by a matrix (Direction not normalized again) hits at the same distances
+struct Ray
+{
+    glm::vec3 Origin = glm::vec3(0.0f);
+    glm::vec3 Direction = glm::vec3(0.0f, 0.0f, -1.0f);
+    float MaxDistance = FLT_MAX;
+};
+
+/*
+    Axis aligned bounding box. A default constructed box is empty (Min > Max)
+    and becomes valid after the first Expand.
+*/
+struct AABB
+{
+    AABB()
+        : Min(FLT_MAX), Max(-FLT_MAX) {}
+
+    AABB(const glm::vec3& min, const glm::vec3& max)
+        : Min(min), Max(max) {}
+
+    glm::vec3 Min;
+    glm::vec3 Max;
+
+    inline bool IsValid() const noexcept { return Min.x <= Max.x && Min.y <= Max.y && Min.z <= Max.z; }
+
+    inline glm::vec3 GetCenter() const noexcept { return 0.5f * (Min + Max); }
+    inline glm::vec3 GetExtents() const noexcept { return 0.5f * (Max - Min); }
+
+    inline void Expand(const glm::vec3& point) noexcept
+    {
+        Min = glm::min(Min, point);
+        Max = glm::max(Max, point);
+    }
+
+    inline void Expand(const AABB& other) noexcept
+    {
+        Min = glm::min(Min, other.Min);
+        Max = glm::max(Max, other.Max);
+    }
+
+    // box enclosing this box after being transformed by m
+    AABB Transformed(const glm::mat4& m) const noexcept;
+
+    // the part of the ray inside the box, within [0, ray.MaxDistance]. false if there's none
+    bool IntersectRay(const Ray& ray, float& outNear, float& outFar) const noexcept;
+};
+
+/*
+    Six planes (left, right, bottom, top, near, far) pointing inwards,
+    extracted from a view-projection matrix.
+    Passing a model-view-projection matrix gives the planes in model space.
+*/
+struct Frustum
+{
+    glm::vec4 Planes[6];
+
+    static Frustum FromMatrix(const glm::mat4& m) noexcept;
+
+    bool Intersects(const AABB& box) const noexcept;
+    bool Intersects(const glm::vec3& center, float radius) const noexcept;
+};
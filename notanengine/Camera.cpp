@@ -29,6 +29,23 @@ void Camera::Update(float deltaTime)
 
 
     // ===== MOUSE MOVEMENT LOOK =====
+    updateLook();
+    // ===== END MOUSE MOVEMENT LOOK =====
+
+    // ===== ZOOM =====
+    float scroll = Input::GetMouseScroll();
+    if (scroll)
+        FOV -= scroll; // subtract because otherwise the scrolling is inverted
+    
+    // Clamp FOV to 1.0 and 180.0
+    if (FOV < 1.0f)
+        FOV = 1.0f;
+    else if (FOV > 180.0f)
+        FOV = 180.0f;
+}
+
+void Camera::updateLook()
+{
     // Pitch: rotate around X-axis, Yaw: rotate around Y-axis
     float mouseXOffset = Input::GetMouseXOffset() * Sensitivity;
     float mouseYOffset = -1.0f * Input::GetMouseYOffset() * Sensitivity;
@@ -51,21 +68,25 @@ void Camera::Update(float deltaTime)
     direction.y = std::sin(glm::radians(m_pitch));
     direction.z = std::sin(glm::radians(m_yaw)) * std::cos(glm::radians(m_pitch));
     m_front = glm::normalize(direction);
-    // ===== END MOUSE MOVEMENT LOOK =====
-
-    // ===== ZOOM =====
-    float scroll = Input::GetMouseScroll();
-    if (scroll)
-        FOV -= scroll; // subtract because otherwise the scrolling is inverted
-    
-    // Clamp FOV to 1.0 and 180.0
-    if (FOV < 1.0f)
-        FOV = 1.0f;
-    else if (FOV > 180.0f)
-        FOV = 180.0f;
 }
 
 glm::mat4 Camera::GetLookAtMatrix() const noexcept
 {
     return glm::lookAt(Transform.GetPosition(), Transform.GetPosition() + m_front, m_up);
 }
+
+Ray Camera::GetRay(const glm::vec2& ndc, const glm::mat4& projection) const noexcept
+{
+    const glm::mat4 clipToWorld = glm::inverse(projection * GetLookAtMatrix());
+    glm::vec4 nearPoint = clipToWorld * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = clipToWorld * glm::vec4(ndc, 1.0f, 1.0f);
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+
+    Ray ray;
+    ray.Origin = glm::vec3(nearPoint);
+    ray.Direction = glm::vec3(farPoint - nearPoint);
+    ray.MaxDistance = glm::length(ray.Direction);
+    ray.Direction /= ray.MaxDistance;
+    return ray;
+}
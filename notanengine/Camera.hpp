@@ -1,6 +1,7 @@
 #pragma once
 
 #include "TransformComponent.hpp"
+#include "Bounds.hpp"
 
 class Camera
 {
@@ -15,6 +16,9 @@ public:
 
     inline glm::vec3 GetFrontVector() const noexcept { return m_front; }
 
+    // World space ray through a point of the screen in normalized device coordinates (y up), from the near plane to the far one
+    Ray GetRay(const glm::vec2& ndc, const glm::mat4& projection) const noexcept;
+
 public:
     TransformComponent Transform;
 
@@ -29,4 +33,7 @@ private:
 
     float m_yaw   = -90.0f;
     float m_pitch = 0.0f;
+
+    // the mouse look part of Update
+    void updateLook();
 };
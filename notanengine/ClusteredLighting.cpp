@@ -0,0 +1,399 @@
+#include "ClusteredLighting.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#include "JobSystem.hpp"
+#include "Simd.hpp"
+
+// texture units used by the cluster buffer textures
+// (Shader::SetMaterial uses at most units 0..28)
+constexpr int LIGHT_DATA_TEXTURE_UNIT    = 29;
+constexpr int CLUSTER_GRID_TEXTURE_UNIT  = 30;
+constexpr int LIGHT_INDEX_TEXTURE_UNIT   = 31;
+
+// number of RGBA32F texels per light (must match LIGHT_TEXELS in entity_lighting.frag)
+constexpr size_t LIGHT_TEXELS = 6;
+
+constexpr float LIGHT_TYPE_POINT = 0.0f;
+constexpr float LIGHT_TYPE_SPOT  = 1.0f;
+
+// SIMD loads read up to 3 floats past the last cluster
+constexpr size_t CLUSTER_PADDING = 4;
+
+static void createBufferTexture(unsigned int& buffer, unsigned int& texture, GLenum internalFormat)
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, buffer);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+static void uploadBufferTexture(unsigned int buffer, const void* data, size_t size)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    // orphan the old storage so we don't wait for the previous frame to finish reading it
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(size, 16), nullptr, GL_STREAM_DRAW);
+    if (size)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusterGrid::LightClusterGrid(const ClusterGridProperties& props)
+    : m_props(props)
+{
+    m_numClusters = m_props.TilesX * m_props.TilesY * m_props.Slices;
+
+    m_minX.resize(m_numClusters + CLUSTER_PADDING, 0.0f);
+    m_minY.resize(m_numClusters + CLUSTER_PADDING, 0.0f);
+    m_minZ.resize(m_numClusters + CLUSTER_PADDING, 0.0f);
+    m_maxX.resize(m_numClusters + CLUSTER_PADDING, 0.0f);
+    m_maxY.resize(m_numClusters + CLUSTER_PADDING, 0.0f);
+    m_maxZ.resize(m_numClusters + CLUSTER_PADDING, 0.0f);
+
+    m_clusterCounts.resize(m_numClusters, 0);
+    m_clusterScratch.resize(static_cast<size_t>(m_numClusters) * m_props.MaxLightsPerCluster, 0);
+    m_gridData.resize(2 * static_cast<size_t>(m_numClusters), 0);
+
+    createBufferTexture(m_lightDataBuffer, m_lightDataTexture, GL_RGBA32F);
+    createBufferTexture(m_gridBuffer, m_gridTexture, GL_RG32UI);
+    createBufferTexture(m_indexBuffer, m_indexTexture, GL_R32UI);
+}
+
+LightClusterGrid::~LightClusterGrid()
+{
+    const unsigned int textures[] = { m_lightDataTexture, m_gridTexture, m_indexTexture };
+    const unsigned int buffers[] = { m_lightDataBuffer, m_gridBuffer, m_indexBuffer };
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+void LightClusterGrid::SetViewportSize(int width, int height) noexcept
+{
+    m_viewportWidth = std::max(width, 1);
+    m_viewportHeight = std::max(height, 1);
+}
+
+void LightClusterGrid::Update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+                              const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights)
+{
+    Assign(view, projection, zNear, zFar, pointLights, spotLights);
+    Upload();
+}
+
+void LightClusterGrid::Assign(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+                              const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    const glm::vec4 projParams(projection[0][0], projection[1][1], zNear, zFar);
+    if (projParams != m_cachedProjection)
+        rebuildClusterBounds(projection, zNear, zFar);
+
+    gatherLights(view, pointLights, spotLights);
+
+    std::fill(m_clusterCounts.begin(), m_clusterCounts.end(), 0u);
+
+    // every slice belongs to exactly one batch, so the jobs never write to the same cluster
+    std::atomic<unsigned int> overflows(0);
+    JobSystem::ParallelFor(m_props.Slices, 1, [this, &overflows](size_t begin, size_t end) {
+        overflows.fetch_add(assignSlices(begin, end), std::memory_order_relaxed);
+    });
+
+    compact();
+
+    m_stats.NumLights = static_cast<unsigned int>(m_volumes.size());
+    m_stats.NumOverflows = overflows.load();
+    m_stats.UpdateTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void LightClusterGrid::Upload()
+{
+    uploadBufferTexture(m_lightDataBuffer, m_lightData.data(), m_lightData.size() * sizeof(glm::vec4));
+    uploadBufferTexture(m_gridBuffer, m_gridData.data(), m_gridData.size() * sizeof(unsigned int));
+    uploadBufferTexture(m_indexBuffer, m_lightIndices.data(), m_lightIndices.size() * sizeof(unsigned int));
+}
+
+void LightClusterGrid::SetUniforms(const Shader& shader) const
+{
+    shader.Use();
+
+    glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lightDataTexture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_gridTexture);
+    glActiveTexture(GL_TEXTURE0 + LIGHT_INDEX_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.SetInt("u_clusterLightData", LIGHT_DATA_TEXTURE_UNIT);
+    shader.SetInt("u_clusterGrid", CLUSTER_GRID_TEXTURE_UNIT);
+    shader.SetInt("u_clusterLightIndices", LIGHT_INDEX_TEXTURE_UNIT);
+
+    shader.SetUVec3("u_clusterDims", glm::uvec3(m_props.TilesX, m_props.TilesY, m_props.Slices));
+    shader.SetVec2("u_clusterTileSize", glm::vec2(
+        static_cast<float>(m_viewportWidth) / m_props.TilesX,
+        static_cast<float>(m_viewportHeight) / m_props.TilesY
+    ));
+
+    // slice = log(depth) * scale - bias
+    const float logRatio = std::log(m_zFar / m_zNear);
+    const float scale = m_props.Slices / logRatio;
+    const float bias = m_props.Slices * std::log(m_zNear) / logRatio;
+    shader.SetVec2("u_clusterZParams", glm::vec2(scale, bias));
+
+    shader.SetBool("u_useClusteredLights", true);
+}
+
+int LightClusterGrid::depthToSlice(float depth) const noexcept
+{
+    if (depth <= m_zNear)
+        return 0;
+
+    const int slice = static_cast<int>(std::log(depth / m_zNear) / std::log(m_zFar / m_zNear) * m_props.Slices);
+    return std::min(slice, static_cast<int>(m_props.Slices) - 1);
+}
+
+void LightClusterGrid::rebuildClusterBounds(const glm::mat4& projection, float zNear, float zFar)
+{
+    m_cachedProjection = glm::vec4(projection[0][0], projection[1][1], zNear, zFar);
+    m_zNear = zNear;
+    m_zFar = zFar;
+
+    const float invScaleX = 1.0f / projection[0][0];
+    const float invScaleY = 1.0f / projection[1][1];
+
+    for (unsigned int z = 0; z < m_props.Slices; z++)
+    {
+        const float dNear = zNear * std::pow(zFar / zNear, static_cast<float>(z) / m_props.Slices);
+        const float dFar  = zNear * std::pow(zFar / zNear, static_cast<float>(z + 1) / m_props.Slices);
+
+        for (unsigned int y = 0; y < m_props.TilesY; y++)
+        {
+            const float ndcY0 = -1.0f + 2.0f * y / m_props.TilesY;
+            const float ndcY1 = -1.0f + 2.0f * (y + 1) / m_props.TilesY;
+
+            for (unsigned int x = 0; x < m_props.TilesX; x++)
+            {
+                const float ndcX0 = -1.0f + 2.0f * x / m_props.TilesX;
+                const float ndcX1 = -1.0f + 2.0f * (x + 1) / m_props.TilesX;
+
+                // the tile's side planes go through the eye, so the extremes are on the near or far depth
+                const size_t cluster = x + y * m_props.TilesX + z * m_props.TilesX * m_props.TilesY;
+                m_minX[cluster] = std::min(ndcX0 * dNear, ndcX0 * dFar) * invScaleX;
+                m_maxX[cluster] = std::max(ndcX1 * dNear, ndcX1 * dFar) * invScaleX;
+                m_minY[cluster] = std::min(ndcY0 * dNear, ndcY0 * dFar) * invScaleY;
+                m_maxY[cluster] = std::max(ndcY1 * dNear, ndcY1 * dFar) * invScaleY;
+                m_minZ[cluster] = -dFar;
+                m_maxZ[cluster] = -dNear;
+            }
+        }
+    }
+}
+
+bool LightClusterGrid::computeVolumeRange(LightVolume& volume) const noexcept
+{
+    const float depth = -volume.Center.z;
+    const float r = volume.Radius;
+
+    if (r <= 0.0f || depth + r < m_zNear || depth - r > m_zFar)
+        return false;
+
+    volume.MinSlice = depthToSlice(depth - r);
+    volume.MaxSlice = depthToSlice(depth + r);
+
+    // x/d is monotonic on each variable for d > 0, so the box corners give a conservative ndc range
+    const float dMin = std::max(depth - r, m_zNear);
+    const float dMax = depth + r;
+
+    const float scaleX = m_cachedProjection.x;
+    const float scaleY = m_cachedProjection.y;
+
+    const float xs[4] = {
+        (volume.Center.x - r) * scaleX / dMin, (volume.Center.x - r) * scaleX / dMax,
+        (volume.Center.x + r) * scaleX / dMin, (volume.Center.x + r) * scaleX / dMax
+    };
+    const float ys[4] = {
+        (volume.Center.y - r) * scaleY / dMin, (volume.Center.y - r) * scaleY / dMax,
+        (volume.Center.y + r) * scaleY / dMin, (volume.Center.y + r) * scaleY / dMax
+    };
+
+    const float ndcMinX = std::min(std::min(xs[0], xs[1]), std::min(xs[2], xs[3]));
+    const float ndcMaxX = std::max(std::max(xs[0], xs[1]), std::max(xs[2], xs[3]));
+    const float ndcMinY = std::min(std::min(ys[0], ys[1]), std::min(ys[2], ys[3]));
+    const float ndcMaxY = std::max(std::max(ys[0], ys[1]), std::max(ys[2], ys[3]));
+
+    if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+        return false;
+
+    auto toTile = [](float ndc, unsigned int numTiles) {
+        const int tile = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * numTiles));
+        return std::clamp(tile, 0, static_cast<int>(numTiles) - 1);
+    };
+
+    volume.MinTileX = toTile(ndcMinX, m_props.TilesX);
+    volume.MaxTileX = toTile(ndcMaxX, m_props.TilesX);
+    volume.MinTileY = toTile(ndcMinY, m_props.TilesY);
+    volume.MaxTileY = toTile(ndcMaxY, m_props.TilesY);
+
+    return true;
+}
+
+void LightClusterGrid::gatherLights(const glm::mat4& view, const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights)
+{
+    m_volumes.clear();
+    m_lightData.clear();
+    m_volumes.reserve(pointLights.size() + spotLights.size());
+    m_lightData.reserve(LIGHT_TEXELS * (pointLights.size() + spotLights.size()));
+
+    for (const auto& light : pointLights)
+    {
+        LightVolume volume{};
+        volume.Center = glm::vec3(view * glm::vec4(light.Position, 1.0f));
+        volume.Radius = light.GetRange();
+        if (!computeVolumeRange(volume))
+            continue;
+
+        m_volumes.push_back(volume);
+        m_lightData.emplace_back(light.Position, volume.Radius);
+        m_lightData.emplace_back(glm::vec3(0.0f), LIGHT_TYPE_POINT);
+        m_lightData.emplace_back(light.Ambient, 0.0f);
+        m_lightData.emplace_back(light.Diffuse, 0.0f);
+        m_lightData.emplace_back(light.Specular, static_cast<float>(light.ShadowLayer + 1));
+        m_lightData.emplace_back(light.Attenuation.Constant, light.Attenuation.Linear, light.Attenuation.Quadratic, 0.0f);
+    }
+
+    // spot lights are bounded by the sphere around their position,
+    // it's loose for narrow cones but keeps the assignment the same for both types
+    for (const auto& light : spotLights)
+    {
+        LightVolume volume{};
+        volume.Center = glm::vec3(view * glm::vec4(light.Position, 1.0f));
+        volume.Radius = light.GetRange();
+        if (!computeVolumeRange(volume))
+            continue;
+
+        m_volumes.push_back(volume);
+        m_lightData.emplace_back(light.Position, volume.Radius);
+        m_lightData.emplace_back(light.Direction, LIGHT_TYPE_SPOT);
+        m_lightData.emplace_back(light.Ambient, glm::radians(light.InnerCutoff));
+        m_lightData.emplace_back(light.Diffuse, glm::radians(light.OuterCutoff));
+        m_lightData.emplace_back(light.Specular, static_cast<float>(light.ShadowLayer + 1));
+        m_lightData.emplace_back(light.Attenuation.Constant, light.Attenuation.Linear, light.Attenuation.Quadratic, light.GetShadowFovTangent());
+    }
+}
+
+unsigned int LightClusterGrid::assignSlices(size_t firstSlice, size_t lastSlice)
+{
+    const unsigned int maxLights = m_props.MaxLightsPerCluster;
+    const size_t sliceSize = static_cast<size_t>(m_props.TilesX) * m_props.TilesY;
+    unsigned int overflows = 0;
+
+    auto appendLight = [&](size_t cluster, unsigned int lightIndex) {
+        unsigned int& count = m_clusterCounts[cluster];
+        if (count < maxLights)
+            m_clusterScratch[cluster * maxLights + count++] = lightIndex;
+        else
+            overflows++;
+    };
+
+    for (unsigned int lightIndex = 0; lightIndex < m_volumes.size(); lightIndex++)
+    {
+        const LightVolume& volume = m_volumes[lightIndex];
+
+        const int zBegin = std::max(volume.MinSlice, static_cast<int>(firstSlice));
+        const int zEnd = std::min(volume.MaxSlice, static_cast<int>(lastSlice) - 1);
+        if (zBegin > zEnd)
+            continue;
+
+        const float r2 = volume.Radius * volume.Radius;
+
+        for (int z = zBegin; z <= zEnd; z++)
+        {
+            for (int y = volume.MinTileY; y <= volume.MaxTileY; y++)
+            {
+                const size_t rowBase = z * sliceSize + y * m_props.TilesX;
+                int x = volume.MinTileX;
+
+#if NE_SIMD_SSE
+                // sphere vs AABB for 4 clusters of the row at a time
+                const __m128 cx = _mm_set1_ps(volume.Center.x);
+                const __m128 cy = _mm_set1_ps(volume.Center.y);
+                const __m128 cz = _mm_set1_ps(volume.Center.z);
+                const __m128 radius2 = _mm_set1_ps(r2);
+                const __m128 zero = _mm_setzero_ps();
+
+                for (; x <= volume.MaxTileX; x += 4)
+                {
+                    const size_t c = rowBase + x;
+                    const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minX[c]), cx), zero), _mm_sub_ps(cx, _mm_loadu_ps(&m_maxX[c])));
+                    const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minY[c]), cy), zero), _mm_sub_ps(cy, _mm_loadu_ps(&m_maxY[c])));
+                    const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minZ[c]), cz), zero), _mm_sub_ps(cz, _mm_loadu_ps(&m_maxZ[c])));
+                    const __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, radius2));
+                    // drop lanes past the end of the light's tile range
+                    const int validLanes = std::min(4, volume.MaxTileX - x + 1);
+                    mask &= (1 << validLanes) - 1;
+
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        if (mask & (1 << lane))
+                            appendLight(c + lane, lightIndex);
+                    }
+                }
+#else
+                for (; x <= volume.MaxTileX; x++)
+                {
+                    const size_t c = rowBase + x;
+                    const float dx = std::max(std::max(m_minX[c] - volume.Center.x, 0.0f), volume.Center.x - m_maxX[c]);
+                    const float dy = std::max(std::max(m_minY[c] - volume.Center.y, 0.0f), volume.Center.y - m_maxY[c]);
+                    const float dz = std::max(std::max(m_minZ[c] - volume.Center.z, 0.0f), volume.Center.z - m_maxZ[c]);
+                    if (dx*dx + dy*dy + dz*dz <= r2)
+                        appendLight(c, lightIndex);
+                }
+#endif
+            }
+        }
+    }
+
+    return overflows;
+}
+
+void LightClusterGrid::compact()
+{
+    const unsigned int maxLights = m_props.MaxLightsPerCluster;
+
+    unsigned int total = 0;
+    unsigned int maxInCluster = 0;
+    for (unsigned int cluster = 0; cluster < m_numClusters; cluster++)
+    {
+        m_gridData[2 * cluster] = total;
+        m_gridData[2 * cluster + 1] = m_clusterCounts[cluster];
+        total += m_clusterCounts[cluster];
+        maxInCluster = std::max(maxInCluster, m_clusterCounts[cluster]);
+    }
+
+    m_lightIndices.resize(total);
+    for (unsigned int cluster = 0; cluster < m_numClusters; cluster++)
+    {
+        std::copy_n(
+            m_clusterScratch.begin() + static_cast<size_t>(cluster) * maxLights,
+            m_clusterCounts[cluster],
+            m_lightIndices.begin() + m_gridData[2 * cluster]
+        );
+    }
+
+    m_stats.NumAssignments = total;
+    m_stats.MaxLightsInCluster = maxInCluster;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Light.hpp"
+#include "Shader.hpp"
+
+struct ClusterGridProperties
+{
+    unsigned int TilesX = 16;
+    unsigned int TilesY = 9;
+    unsigned int Slices = 24;
+    unsigned int MaxLightsPerCluster = 128;
+};
+
+struct ClusterGridStats
+{
+    unsigned int NumLights = 0;
+    unsigned int NumAssignments = 0;
+    unsigned int MaxLightsInCluster = 0;
+    unsigned int NumOverflows = 0;
+    float UpdateTimeMs = 0.0f;
+};
+
+/*
+    Clustered forward lighting.
+    The view frustum is split in TilesX * TilesY screen tiles and Slices
+    exponential depth slices. Every frame point and spot light volumes are
+    assigned to the clusters they touch on the CPU and the compacted lists are
+    uploaded to buffer textures, so the lighting shader only loops over the
+    lights of the fragment's own cluster.
+
+    Cluster ids are x + y * TilesX + z * TilesX * TilesY, tile (0,0) being the
+    bottom-left corner of the screen (same as gl_FragCoord).
+*/
+class LightClusterGrid
+{
+public:
+    LightClusterGrid(const ClusterGridProperties& props = ClusterGridProperties());
+    ~LightClusterGrid();
+
+    LightClusterGrid(const LightClusterGrid&) = delete;
+    LightClusterGrid& operator=(const LightClusterGrid&) = delete;
+
+    void SetViewportSize(int width, int height) noexcept;
+
+    // projection must be a symmetric perspective projection built with zNear/zFar
+    void Update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+                const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights);
+
+    // Update in two steps: Assign only works on the CPU side and can run on any thread, Upload (GL thread) sends its result
+    void Assign(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+                const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights);
+    void Upload();
+
+    void SetUniforms(const Shader& shader) const;
+
+    inline const ClusterGridStats& GetStats() const noexcept { return m_stats; }
+    inline const ClusterGridProperties& GetProperties() const noexcept { return m_props; }
+
+private:
+    ClusterGridProperties m_props;
+    ClusterGridStats m_stats;
+
+    unsigned int m_numClusters = 0;
+    int m_viewportWidth = 1, m_viewportHeight = 1;
+
+    // cluster view space AABBs (SoA, padded so SIMD loads can read past the last tile of a row)
+    std::vector<float> m_minX, m_minY, m_minZ;
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+    glm::vec4 m_cachedProjection = glm::vec4(0.0f); // P[0][0], P[1][1], zNear, zFar
+
+    // light volumes in view space
+    struct LightVolume
+    {
+        glm::vec3 Center;
+        float Radius;
+
+        // conservative cluster range touched by the volume
+        int MinTileX, MaxTileX;
+        int MinTileY, MaxTileY;
+        int MinSlice, MaxSlice;
+    };
+    std::vector<LightVolume> m_volumes;
+    std::vector<glm::vec4> m_lightData;
+
+    // per cluster scratch lists filled by the assignment jobs
+    std::vector<unsigned int> m_clusterCounts;
+    std::vector<unsigned int> m_clusterScratch;
+
+    // compacted data sent to the gpu
+    std::vector<unsigned int> m_gridData;
+    std::vector<unsigned int> m_lightIndices;
+
+    unsigned int m_lightDataBuffer = 0, m_lightDataTexture = 0;
+    unsigned int m_gridBuffer = 0, m_gridTexture = 0;
+    unsigned int m_indexBuffer = 0, m_indexTexture = 0;
+
+    float m_zNear = 0.1f, m_zFar = 100.0f;
+
+    void rebuildClusterBounds(const glm::mat4& projection, float zNear, float zFar);
+    bool computeVolumeRange(LightVolume& volume) const noexcept;
+    void gatherLights(const glm::mat4& view, const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights);
+    unsigned int assignSlices(size_t firstSlice, size_t lastSlice);
+    void compact();
+
+    int depthToSlice(float depth) const noexcept;
+};
@@ -0,0 +1,135 @@
+#include "FramePacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+FramePacer::FramePacer()
+    : m_nextFrame(Clock::now()), m_frameStart(m_nextFrame)
+{
+}
+
+FramePacer::~FramePacer()
+{
+    waitForGpu(0);
+}
+
+void FramePacer::BeginFrame()
+{
+    m_stats.GpuWaitMs = m_stats.SleepMs = m_stats.SpinMs = m_stats.LateByMs = 0.0f;
+
+    if (!m_settings.Enabled)
+    {
+        // only letting go of the fences already passed
+        waitForGpu(MAX_FRAMES_IN_FLIGHT);
+        m_nextFrame = m_frameStart = Clock::now();
+        return;
+    }
+
+    /// The GPU first: waiting on it may use up the time there was to sleep
+    const unsigned int maxInFlight = std::min(m_settings.MaxFramesInFlight, MAX_FRAMES_IN_FLIGHT);
+    waitForGpu(maxInFlight > 0 ? maxInFlight - 1 : MAX_FRAMES_IN_FLIGHT);
+
+    /// Then the frame's start time
+    if (m_settings.TargetFps > 0.0f)
+    {
+        const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_settings.TargetFps));
+        waitUntil(m_nextFrame);
+
+        const Clock::time_point now = Clock::now();
+        m_stats.LateByMs = std::max(0.0f, std::chrono::duration<float, std::milli>(now - m_nextFrame).count());
+        // more than a frame behind: start over from now rather than hurry the frames after
+        m_nextFrame = (now - m_nextFrame > period) ? now + period : m_nextFrame + period;
+    }
+    else
+        m_nextFrame = Clock::now();
+
+    m_frameStart = Clock::now();
+}
+
+void FramePacer::EndFrame()
+{
+    m_stats.CpuMs = std::chrono::duration<float, std::milli>(Clock::now() - m_frameStart).count();
+
+    if (!m_settings.Enabled || m_settings.MaxFramesInFlight == 0)
+        return;
+
+    // the oldest is given up on rather than waited for when the limit went up meanwhile
+    if (m_fenceCount == MAX_FRAMES_IN_FLIGHT)
+    {
+        glDeleteSync(m_fences[m_firstFence]);
+        m_firstFence = (m_firstFence + 1) % MAX_FRAMES_IN_FLIGHT;
+        m_fenceCount--;
+    }
+
+    m_fences[(m_firstFence + m_fenceCount) % MAX_FRAMES_IN_FLIGHT] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_fenceCount++;
+    m_stats.FramesInFlight = m_fenceCount;
+}
+
+// Until at most maxInFlight fenced frames are left unfinished. Finished ones are let go on the way
+void FramePacer::waitForGpu(unsigned int maxInFlight)
+{
+    const Clock::time_point start = Clock::now();
+    while (m_fenceCount > 0)
+    {
+        GLsync& fence = m_fences[m_firstFence];
+        if (m_fenceCount > maxInFlight)
+        {
+            // flushing, or the fence might never get to the GPU
+            GLenum result;
+            do
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            while (result == GL_TIMEOUT_EXPIRED);
+        }
+        else
+        {
+            GLint status = GL_UNSIGNALED;
+            glGetSynciv(fence, GL_SYNC_STATUS, 1, nullptr, &status);
+            if (status != GL_SIGNALED)
+                break;
+        }
+
+        glDeleteSync(fence);
+        fence = nullptr;
+        m_firstFence = (m_firstFence + 1) % MAX_FRAMES_IN_FLIGHT;
+        m_fenceCount--;
+    }
+    m_stats.GpuWaitMs += std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    m_stats.FramesInFlight = m_fenceCount;
+}
+
+void FramePacer::waitUntil(Clock::time_point deadline)
+{
+    /// Sleep a millisecond at a time while the time left is more than a sleep may take
+    Clock::time_point now = Clock::now();
+    const Clock::time_point sleepStart = now;
+    while (true)
+    {
+        const double leftMs = std::chrono::duration<double, std::milli>(deadline - now).count();
+        const double sleepErrorMs = m_sleepMean + std::sqrt(m_sleepVariance);
+        if (leftMs <= sleepErrorMs)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        const Clock::time_point woke = Clock::now();
+
+        // exponentially weighted, so it follows the scheduler when the machine gets busy
+        const double sleptMs = std::chrono::duration<double, std::milli>(woke - now).count();
+        const double delta = sleptMs - m_sleepMean;
+        m_sleepMean += 0.05 * delta;
+        m_sleepVariance = 0.95 * (m_sleepVariance + 0.05 * delta * delta);
+        now = woke;
+    }
+    m_stats.SleepMs = std::chrono::duration<float, std::milli>(now - sleepStart).count();
+    m_stats.SleepErrorMs = static_cast<float>(m_sleepMean + std::sqrt(m_sleepVariance) - 1.0);
+
+    /// Spin the rest
+    const Clock::time_point spinStart = now;
+    while (now < deadline)
+    {
+        std::this_thread::yield();
+        now = Clock::now();
+    }
+    m_stats.SpinMs = std::chrono::duration<float, std::milli>(now - spinStart).count();
+}
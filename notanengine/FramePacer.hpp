@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+
+struct FramePacerSettings
+{
+    bool Enabled = true;
+    float TargetFps = 144.0f;
+    // frames the GPU may be behind the CPU before BeginFrame waits for it. Fewer means less input lag, 0 no limit
+    unsigned int MaxFramesInFlight = 1;
+    // reads the input again after the frame's UI work, right before the camera moves and everything using it runs
+    bool LateLatch = true;
+};
+
+struct FramePacerStats
+{
+    float CpuMs = 0.0f;         // of the last frame, without the waits
+    float GpuWaitMs = 0.0f;     // for the frames in flight
+    float SleepMs = 0.0f;
+    float SpinMs = 0.0f;
+    float LateByMs = 0.0f;      // how far past its start time the frame really started
+    float SleepErrorMs = 0.0f;  // how much longer than asked a sleep may take, as measured
+    unsigned int FramesInFlight = 0;
+};
+
+/*
+    Holds the main loop to a frame rate and keeps the CPU from running ahead
+    of the GPU, so input gets to the screen sooner and idle time is spent
+    asleep instead of spinning.
+    BeginFrame waits for the oldest frame in flight to finish (a fence per
+    frame), then until the frame's start time: sleeping while the OS
+    scheduler can be trusted to wake it in time, spinning the rest. How
+    late sleeps run is measured as it goes. A frame that starts late moves
+    the schedule instead of rushing the next ones.
+    GL thread only.
+*/
+class FramePacer
+{
+public:
+    static constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 4;
+
+    FramePacer();
+    ~FramePacer();
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Before the frame samples its input
+    void BeginFrame();
+    // Right after the swap
+    void EndFrame();
+
+    inline FramePacerSettings& GetSettingsRef() noexcept { return m_settings; }
+    inline const FramePacerStats& GetStats() const noexcept { return m_stats; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    FramePacerSettings m_settings;
+    FramePacerStats m_stats;
+
+    GLsync m_fences[MAX_FRAMES_IN_FLIGHT] = {};     // oldest at m_firstFence
+    unsigned int m_firstFence = 0;
+    unsigned int m_fenceCount = 0;
+
+    Clock::time_point m_nextFrame;
+    Clock::time_point m_frameStart;     // when BeginFrame was done waiting
+
+    // running mean and variance of how long a 1 ms sleep takes, in ms
+    double m_sleepMean = 1.0;
+    double m_sleepVariance = 0.0;
+
+    void waitForGpu(unsigned int maxInFlight);
+    void waitUntil(Clock::time_point deadline);
+};
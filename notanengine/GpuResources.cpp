@@ -0,0 +1,197 @@
+#include "GpuResources.hpp"
+
+#include <glad/glad.h>
+
+#include <mutex>
+#include <vector>
+
+struct GpuObject
+{
+    GpuObjectType Type = GpuObjectType::Texture;
+    unsigned int ID = 0;
+    uint32_t RefCount = 0;
+};
+
+struct PendingDeletion
+{
+    GpuObjectType Type;
+    unsigned int ID;
+    uint64_t Frame;     // deleted once EndFrame reaches it
+};
+
+struct GpuResourceState
+{
+    std::mutex mutex;
+    ResourcePool<GpuObject> pool;
+    std::vector<PendingDeletion> pending;
+    uint64_t frame = 0;
+    unsigned int deletionDelay = GpuResources::DEFAULT_DELETION_DELAY;
+    bool shutDown = false;
+    GpuResourceStats stats;
+};
+
+// Never destroyed: assets held by other statics release their objects during static destruction
+static GpuResourceState& getState()
+{
+    static GpuResourceState* state = new GpuResourceState();
+    return *state;
+}
+
+static void deleteObjects(GpuObjectType type, const std::vector<unsigned int>& ids)
+{
+    if (ids.empty())
+        return;
+
+    const GLsizei count = static_cast<GLsizei>(ids.size());
+    switch (type)
+    {
+    case GpuObjectType::Texture:
+        glDeleteTextures(count, ids.data());
+        break;
+    case GpuObjectType::Buffer:
+        glDeleteBuffers(count, ids.data());
+        break;
+    case GpuObjectType::VertexArray:
+        glDeleteVertexArrays(count, ids.data());
+        break;
+    case GpuObjectType::Program:
+        for (unsigned int id : ids)
+            glDeleteProgram(id);
+        break;
+    default:
+        break;
+    }
+}
+
+// Deletes the pending objects due by frame, grouped by type. GL thread
+static size_t deleteDue(std::vector<PendingDeletion>& pending, uint64_t frame)
+{
+    std::vector<unsigned int> ids[static_cast<size_t>(GpuObjectType::Count)];
+    size_t deleted = 0;
+
+    for (size_t i = 0; i < pending.size();)
+    {
+        if (pending[i].Frame > frame)
+        {
+            i++;
+            continue;
+        }
+
+        ids[static_cast<size_t>(pending[i].Type)].push_back(pending[i].ID);
+        pending[i] = pending.back();
+        pending.pop_back();
+        deleted++;
+    }
+
+    for (size_t type = 0; type < static_cast<size_t>(GpuObjectType::Count); type++)
+        deleteObjects(static_cast<GpuObjectType>(type), ids[type]);
+
+    return deleted;
+}
+
+namespace GpuResources
+{
+    ResourceHandle Register(GpuObjectType type, unsigned int id)
+    {
+        if (id == 0)
+            return ResourceHandle();
+
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        const ResourceHandle handle = state.pool.Create(GpuObject{ type, id, 1 });
+        if (!handle.IsNull())
+            state.stats.LiveObjects[static_cast<size_t>(type)]++;
+        return handle;
+    }
+
+    void AddRef(ResourceHandle handle)
+    {
+        if (handle.IsNull())
+            return;
+
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (GpuObject* object = state.pool.Get(handle))
+            object->RefCount++;
+    }
+
+    void Release(ResourceHandle handle)
+    {
+        if (handle.IsNull())
+            return;
+
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        GpuObject* object = state.pool.Get(handle);
+        if (!object || --object->RefCount > 0)
+            return;
+
+        state.stats.LiveObjects[static_cast<size_t>(object->Type)]--;
+        if (!state.shutDown)
+            state.pending.push_back({ object->Type, object->ID, state.frame + state.deletionDelay });
+        state.pool.Destroy(handle);
+    }
+
+    unsigned int GetID(ResourceHandle handle)
+    {
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        const GpuObject* object = state.pool.Get(handle);
+        return object ? object->ID : 0;
+    }
+
+    void EndFrame()
+    {
+        GpuResourceState& state = getState();
+
+        // deleting outside the lock, loader threads may be releasing meanwhile
+        std::vector<PendingDeletion> pending;
+        uint64_t frame;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            frame = ++state.frame;
+            pending.swap(state.pending);
+        }
+
+        const size_t deleted = deleteDue(pending, frame);
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.pending.insert(state.pending.end(), pending.begin(), pending.end());
+        state.stats.PendingDeletions = state.pending.size();
+        state.stats.DeletedLastFrame = deleted;
+    }
+
+    void Shutdown()
+    {
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        deleteDue(state.pending, UINT64_MAX);
+        state.shutDown = true;
+        state.stats.PendingDeletions = 0;
+    }
+
+    void SetDeletionDelay(unsigned int frames)
+    {
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.deletionDelay = frames;
+    }
+
+    unsigned int GetDeletionDelay()
+    {
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.deletionDelay;
+    }
+
+    GpuResourceStats GetStats()
+    {
+        GpuResourceState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.stats;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ResourcePool.hpp"
+
+/*
+    Lifetime of the GL objects the engine creates for assets (textures,
+    buffers, vertex arrays, programs).
+    Each object gets a generation-checked handle with a reference count. When
+    the count drops to zero the handle goes stale right away, but the object
+    itself is only deleted DeletionDelay frames later: frames already
+    submitted may still be reading it.
+    Reference counting is safe on any thread (textures are dropped by loader
+    threads too), deleting happens in EndFrame on the GL thread.
+    GpuObjectRef does the counting for the classes that own GL objects.
+*/
+enum class GpuObjectType : uint8_t
+{
+    Texture,
+    Buffer,
+    VertexArray,
+    Program,
+    Count
+};
+
+struct GpuResourceStats
+{
+    size_t LiveObjects[static_cast<size_t>(GpuObjectType::Count)] = {};
+    size_t PendingDeletions = 0;
+    size_t DeletedLastFrame = 0;
+};
+
+namespace GpuResources
+{
+    // frames in flight the driver may still be working on
+    constexpr unsigned int DEFAULT_DELETION_DELAY = 3;
+
+    // Takes ownership of the object, with one reference. A null handle for id 0
+    ResourceHandle Register(GpuObjectType type, unsigned int id);
+    void AddRef(ResourceHandle handle);
+    void Release(ResourceHandle handle);
+
+    // 0 for a stale handle
+    unsigned int GetID(ResourceHandle handle);
+
+    // Deletes the objects released DeletionDelay frames ago. GL thread, after the frame is submitted
+    void EndFrame();
+    // Deletes everything waiting right away. Releases after it don't touch GL anymore, the context is going away
+    void Shutdown();
+
+    void SetDeletionDelay(unsigned int frames);
+    unsigned int GetDeletionDelay();
+
+    GpuResourceStats GetStats();
+}
+
+// One reference to a registered GL object. Copies add a reference, the last one gone releases the object
+class GpuObjectRef
+{
+public:
+    GpuObjectRef() = default;
+    GpuObjectRef(GpuObjectType type, unsigned int id)
+        : m_handle(GpuResources::Register(type, id)) {}
+
+    GpuObjectRef(const GpuObjectRef& other)
+        : m_handle(other.m_handle)
+    {
+        GpuResources::AddRef(m_handle);
+    }
+
+    GpuObjectRef(GpuObjectRef&& other) noexcept
+        : m_handle(other.m_handle)
+    {
+        other.m_handle = ResourceHandle();
+    }
+
+    ~GpuObjectRef()
+    {
+        GpuResources::Release(m_handle);
+    }
+
+    GpuObjectRef& operator=(const GpuObjectRef& other)
+    {
+        if (this != &other)
+        {
+            GpuResources::AddRef(other.m_handle);
+            GpuResources::Release(m_handle);
+            m_handle = other.m_handle;
+        }
+
+        return *this;
+    }
+
+    GpuObjectRef& operator=(GpuObjectRef&& other) noexcept
+    {
+        if (this != &other)
+        {
+            GpuResources::Release(m_handle);
+            m_handle = other.m_handle;
+            other.m_handle = ResourceHandle();
+        }
+
+        return *this;
+    }
+
+    inline ResourceHandle GetHandle() const noexcept { return m_handle; }
+    inline unsigned int GetID() const { return GpuResources::GetID(m_handle); }
+
+private:
+    ResourceHandle m_handle;
+};
@@ -66,8 +66,9 @@ static void mouseMoveCallback(GLFWwindow* window, double xpos, double ypos)
     mouseTracker.currX = static_cast<float>(xpos);
     mouseTracker.currY = static_cast<float>(ypos);
 
-    mouseTracker.xOffset = mouseTracker.currX - mouseTracker.lastX;
-    mouseTracker.yOffset = mouseTracker.currY - mouseTracker.lastY;
+    // summed until read: a frame may get several moves, the more so when frames are paced or input is polled twice
+    mouseTracker.xOffset += mouseTracker.currX - mouseTracker.lastX;
+    mouseTracker.yOffset += mouseTracker.currY - mouseTracker.lastY;
 }
 
 static void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
@@ -0,0 +1,454 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+
+#ifdef _NE_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct JobSystem::Job
+{
+    std::function<void()> Func;
+    Counter* Done = nullptr;
+};
+
+struct JobSystem::CounterAccess
+{
+    static void Add(Counter& counter) noexcept { counter.m_pending.fetch_add(1, std::memory_order_relaxed); }
+
+    // One of counter's jobs ran. Returns the jobs that were waiting for the last one
+    static std::vector<Job*> Finish(Counter& counter)
+    {
+        std::vector<Job*> released;
+        std::lock_guard<std::mutex> lock(counter.m_mutex);
+        if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            released.swap(counter.m_waiting);
+        return released;
+    }
+
+    // false if counter is done and job can go right away
+    static bool Park(Counter& counter, Job* job)
+    {
+        std::lock_guard<std::mutex> lock(counter.m_mutex);
+        if (counter.m_pending.load(std::memory_order_acquire) == 0)
+            return false;
+        counter.m_waiting.push_back(job);
+        return true;
+    }
+
+    // whoever finished counter is out of its mutex, so it can go away
+    static void Settle(Counter& counter) { std::lock_guard<std::mutex> lock(counter.m_mutex); }
+};
+
+using JobSystem::Job;
+
+/*
+    Chase-Lev deque of a fixed size. The owning thread pushes and pops at the
+    bottom, anyone steals at the top; only the last job is contended.
+    Sequentially consistent atomics stand in for the paper's fences.
+*/
+class WorkDeque
+{
+public:
+    static constexpr int64_t CAPACITY = 4096;
+
+    // Owner only. false when full
+    bool Push(Job* job) noexcept
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+        if (bottom - top >= CAPACITY)
+            return false;
+
+        m_slots[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        m_bottom.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner only. Newest first
+    Job* Pop() noexcept
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+
+        if (top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = m_slots[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // the last one: race the thieves for it
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // Any thread. Oldest first; nullptr when empty or when another thread got there first
+    Job* Steal() noexcept
+    {
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+        if (top >= bottom)
+            return nullptr;
+
+        Job* job = m_slots[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> m_top{ 0 };
+    alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+    alignas(64) std::atomic<Job*> m_slots[CAPACITY] = {};
+};
+
+struct JobPool
+{
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkDeque>> deques;     // 0 for the main thread, then one per worker
+    std::thread::id mainThread;
+
+    // jobs of threads without a deque, and of full deques
+    std::deque<Job*> injected;
+    std::mutex injectedMutex;
+    std::atomic<size_t> injectedCount{ 0 };
+
+    std::atomic<int64_t> pendingJobs{ 0 };      // queued anywhere a worker can take them from
+    std::atomic<unsigned int> sleepers{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    std::atomic<bool> stop{ false };
+
+    std::deque<Job*> mainThreadJobs;
+    std::mutex mainThreadMutex;
+};
+static JobPool g_pool;
+
+// index of the thread's deque in g_pool.deques, -1 for threads without one
+static thread_local int t_deque = -1;
+static thread_local uint32_t t_random = 0;
+
+static void runJob(Job* job);
+
+// Where a worker can take job from
+static void enqueue(Job* job)
+{
+    if (t_deque < 0 || !g_pool.deques[t_deque]->Push(job))
+    {
+        std::lock_guard<std::mutex> lock(g_pool.injectedMutex);
+        g_pool.injected.push_back(job);
+        g_pool.injectedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // pendingJobs before sleepers: a worker going to sleep counts itself before checking pendingJobs,
+    // so one of the two sees the other
+    g_pool.pendingJobs.fetch_add(1, std::memory_order_seq_cst);
+    if (g_pool.sleepers.load(std::memory_order_seq_cst) != 0)
+    {
+        { std::lock_guard<std::mutex> lock(g_pool.sleepMutex); }
+        g_pool.sleepCv.notify_one();
+    }
+}
+
+static void schedule(Job* job)
+{
+    if (g_pool.workers.empty())
+        runJob(job);
+    else
+        enqueue(job);
+}
+
+static void runJob(Job* job)
+{
+    job->Func();
+    if (job->Done)
+    {
+        for (Job* released : JobSystem::CounterAccess::Finish(*job->Done))
+            schedule(released);
+    }
+    delete job;
+}
+
+// Own deque first, then the shared queue, then the others' from a random one on
+static Job* findJob()
+{
+    Job* job = nullptr;
+    if (t_deque >= 0)
+        job = g_pool.deques[t_deque]->Pop();
+
+    if (!job && g_pool.injectedCount.load(std::memory_order_relaxed) != 0)
+    {
+        std::lock_guard<std::mutex> lock(g_pool.injectedMutex);
+        if (!g_pool.injected.empty())
+        {
+            job = g_pool.injected.front();
+            g_pool.injected.pop_front();
+            g_pool.injectedCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!job)
+    {
+        // xorshift
+        uint32_t& state = t_random;
+        if (state == 0)
+            state = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        const size_t numDeques = g_pool.deques.size();
+        const size_t first = state % numDeques;
+        for (size_t i = 0; i < numDeques && !job; i++)
+        {
+            const size_t victim = (first + i) % numDeques;
+            if (static_cast<int>(victim) != t_deque)
+                job = g_pool.deques[victim]->Steal();
+        }
+    }
+
+    if (job)
+        g_pool.pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+    return job;
+}
+
+static void workerLoop(int deque)
+{
+    t_deque = deque;
+
+    // a few rounds of looking before sleeping, as jobs tend to come in bursts
+    constexpr unsigned int SPIN_ROUNDS = 64;
+    unsigned int idle = 0;
+    while (true)
+    {
+        if (Job* job = findJob())
+        {
+            runJob(job);
+            idle = 0;
+            continue;
+        }
+
+        if (g_pool.stop.load(std::memory_order_acquire) && g_pool.pendingJobs.load(std::memory_order_seq_cst) <= 0)
+            return;
+
+        if (++idle < SPIN_ROUNDS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(g_pool.sleepMutex);
+        g_pool.sleepers.fetch_add(1, std::memory_order_seq_cst);
+        g_pool.sleepCv.wait(lock, [] {
+            return g_pool.stop.load(std::memory_order_relaxed) || g_pool.pendingJobs.load(std::memory_order_seq_cst) > 0;
+        });
+        g_pool.sleepers.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+static void setupThread(std::thread& thread, unsigned int worker, bool pin)
+{
+#ifdef _NE_LINUX
+    const std::string name = "ne-worker-" + std::to_string(worker);
+    pthread_setname_np(thread.native_handle(), name.substr(0, 15).c_str());
+
+    const unsigned int hwThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (pin && hwThreads > 1)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET((worker + 1) % hwThreads, &cpus);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+    }
+#else
+    (void)thread;
+    (void)worker;
+    (void)pin;
+#endif
+}
+
+// One ParallelFor call. Ranges are claimed from next by the caller and by helper jobs on the workers,
+// so the caller only ever runs its own batches and never a long job someone else queued
+struct ParallelForState
+{
+    const std::function<void(size_t, size_t)>* func = nullptr;
+    size_t count = 0;
+    size_t minBatchSize = 1;
+    size_t divisor = 1;
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> done{ 0 };
+};
+
+static void runBatches(ParallelForState& state)
+{
+    size_t begin = state.next.load(std::memory_order_relaxed);
+    while (true)
+    {
+        // guided: a share of what's left, so the batches shrink as the range runs out
+        size_t end;
+        do
+        {
+            if (begin >= state.count)
+                return;
+            const size_t size = std::max(state.minBatchSize, (state.count - begin) / state.divisor);
+            end = std::min(state.count, begin + size);
+        } while (!state.next.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+
+        // claiming a batch means the caller is still waiting, so func is alive
+        (*state.func)(begin, end);
+        state.done.fetch_add(end - begin, std::memory_order_release);
+        begin = end;
+    }
+}
+
+namespace JobSystem
+{
+    void Init(unsigned int numWorkers, bool pinThreads)
+    {
+        if (!g_pool.workers.empty())
+            return;
+
+        if (numWorkers == 0)
+        {
+            const unsigned int hwThreads = std::thread::hardware_concurrency();
+            numWorkers = (hwThreads > 1) ? hwThreads - 1 : 0;
+        }
+
+        g_pool.mainThread = std::this_thread::get_id();
+        t_deque = 0;
+
+        g_pool.stop.store(false, std::memory_order_relaxed);
+        g_pool.deques.clear();
+        for (unsigned int i = 0; i <= numWorkers; i++)
+            g_pool.deques.push_back(std::make_unique<WorkDeque>());
+
+        g_pool.workers.reserve(numWorkers);
+        for (unsigned int i = 0; i < numWorkers; i++)
+        {
+            g_pool.workers.emplace_back(workerLoop, static_cast<int>(i + 1));
+            setupThread(g_pool.workers.back(), i, pinThreads);
+        }
+    }
+
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(g_pool.sleepMutex);
+            g_pool.stop.store(true, std::memory_order_release);
+        }
+        g_pool.sleepCv.notify_all();
+
+        for (auto& worker : g_pool.workers)
+            worker.join();
+        g_pool.workers.clear();
+        g_pool.deques.clear();
+        g_pool.pendingJobs.store(0, std::memory_order_relaxed);
+        t_deque = -1;
+    }
+
+    unsigned int GetWorkerCount() noexcept
+    {
+        return static_cast<unsigned int>(g_pool.workers.size());
+    }
+
+    bool IsMainThread() noexcept
+    {
+        return g_pool.workers.empty() || std::this_thread::get_id() == g_pool.mainThread;
+    }
+
+    void ParallelFor(size_t count, size_t minBatchSize, const std::function<void(size_t begin, size_t end)>& func)
+    {
+        if (count == 0)
+            return;
+
+        minBatchSize = std::max<size_t>(minBatchSize, 1);
+        if (count <= minBatchSize || g_pool.workers.empty())
+        {
+            func(0, count);
+            return;
+        }
+
+        // the first batches take half the range between the threads, each later one a smaller share
+        const size_t numThreads = g_pool.workers.size() + 1;
+        auto state = std::make_shared<ParallelForState>();
+        state->func = &func;
+        state->count = count;
+        state->minBatchSize = minBatchSize;
+        state->divisor = numThreads * 2;
+
+        // on the caller's own deque, for idle workers to steal. A helper that comes too late finds nothing left
+        const size_t numHelpers = std::min((count + minBatchSize - 1) / minBatchSize - 1, g_pool.workers.size());
+        for (size_t i = 0; i < numHelpers; i++)
+            enqueue(new Job{ [state]() { runBatches(*state); }, nullptr });
+
+        // the calling thread works too. Nested ParallelFor calls can't deadlock: every caller
+        // runs whatever batches of its own are left unclaimed
+        runBatches(*state);
+        while (state->done.load(std::memory_order_acquire) != count)
+            std::this_thread::yield();
+    }
+
+    void Submit(std::function<void()> job, Counter* done, Counter* dependency)
+    {
+        Job* newJob = new Job{ std::move(job), done };
+        if (done)
+            CounterAccess::Add(*done);
+
+        if (dependency && CounterAccess::Park(*dependency, newJob))
+            return;
+        schedule(newJob);
+    }
+
+    void Wait(Counter& counter)
+    {
+        const bool mainThread = IsMainThread();
+        while (!counter.IsDone())
+        {
+            // the counter may be waiting for a main thread job
+            if (mainThread)
+                RunMainThreadJobs();
+
+            Job* job = g_pool.workers.empty() ? nullptr : findJob();
+            if (job)
+                runJob(job);
+            else
+                std::this_thread::yield();
+        }
+        CounterAccess::Settle(counter);
+    }
+
+    void SubmitMainThread(std::function<void()> job, Counter* done)
+    {
+        if (done)
+            CounterAccess::Add(*done);
+
+        std::lock_guard<std::mutex> lock(g_pool.mainThreadMutex);
+        g_pool.mainThreadJobs.push_back(new Job{ std::move(job), done });
+    }
+
+    void RunMainThreadJobs()
+    {
+        // only those queued so far: a job queueing another doesn't keep this going
+        std::deque<Job*> jobs;
+        {
+            std::lock_guard<std::mutex> lock(g_pool.mainThreadMutex);
+            jobs.swap(g_pool.mainThreadJobs);
+        }
+        for (Job* job : jobs)
+            runJob(job);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*
+    Pool of worker threads shared by the engine systems that want to split
+    CPU work (importing, culling, transform updates, texture encoding, ...).
+    Every worker, and the thread calling Init (the main thread), has its own
+    deque of jobs: it pushes and pops at one end, and idle workers steal
+    from the other end of someone else's. Other threads hand their jobs to
+    a shared queue. Workers with nothing to do sleep.
+    Jobs can count themselves on a Counter, to be waited on or to hold back
+    other jobs until they're all done. Jobs that must run on the main thread
+    (GL calls) go to a queue it runs every frame.
+    If the pool was never initialized every call just runs inline on the
+    calling thread, so callers don't need to care.
+*/
+namespace JobSystem
+{
+    struct Job;
+    struct CounterAccess;
+
+    // Jobs not done yet out of those submitted with it. Must outlive them, and isn't moved
+    class Counter
+    {
+    public:
+        Counter() = default;
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+
+        inline bool IsDone() const noexcept { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend struct CounterAccess;
+
+        std::atomic<uint32_t> m_pending{ 0 };
+        std::mutex m_mutex;
+        std::vector<Job*> m_waiting;    // jobs to start once it's done
+    };
+
+    // numWorkers = 0 means "hardware threads - 1" (the calling thread also works).
+    // pinThreads: keeps worker i on core i + 1, leaving core 0 to the main thread (Linux only)
+    void Init(unsigned int numWorkers = 0, bool pinThreads = false);
+    // Runs the jobs still queued, then stops the workers. Jobs waiting on a counter that never gets done are dropped
+    void Shutdown();
+
+    unsigned int GetWorkerCount() noexcept;
+    bool IsMainThread() noexcept;
+
+    // Calls func(begin, end) over [0, count) in batches of at least minBatchSize, big ones first and smaller ones
+    // as the range runs out, so threads finish together.
+    // Blocks until every batch is done; the calling thread runs batches of this call too (and only those).
+    void ParallelFor(size_t count, size_t minBatchSize, const std::function<void(size_t begin, size_t end)>& func);
+
+    // Queues job for the workers and returns right away. Without workers it runs before returning.
+    // done, if any, counts it until it has run. If dependency isn't done, the job waits for it:
+    // submit the jobs counting on dependency first
+    void Submit(std::function<void()> job, Counter* done = nullptr, Counter* dependency = nullptr);
+
+    // Runs other jobs until counter is done
+    void Wait(Counter& counter);
+
+    // Queues job for the main thread, which runs it in RunMainThreadJobs
+    void SubmitMainThread(std::function<void()> job, Counter* done = nullptr);
+    // Main thread only: runs the main thread jobs queued so far. Once a frame, and while the main thread Waits
+    void RunMainThreadJobs();
+}
@@ -1,5 +1,35 @@
 #include "Light.hpp"
 
+#include <algorithm>
+#include <cmath>
+
+// Used when the attenuation never reaches the cutoff (e.g. constant-only attenuation)
+constexpr float MAX_LIGHT_RANGE = 1000.0f;
+
+float AttenuationProperties::GetRange(float intensity, float cutoff) const noexcept
+{
+    // solve intensity / (c + l*d + q*d^2) = cutoff for d
+    const float c = Constant - intensity / cutoff;
+    if (c >= 0.0f)
+        return 0.0f;
+
+    if (Quadratic > 0.0f)
+    {
+        const float delta = Linear * Linear - 4.0f * Quadratic * c;
+        return std::min(MAX_LIGHT_RANGE, (-Linear + std::sqrt(delta)) / (2.0f * Quadratic));
+    }
+
+    if (Linear > 0.0f)
+        return std::min(MAX_LIGHT_RANGE, -c / Linear);
+
+    return MAX_LIGHT_RANGE;
+}
+
+static float maxComponent(const glm::vec3& v)
+{
+    return std::max(v.x, std::max(v.y, v.z));
+}
+
 void Light::SetLightUniforms(const Shader& shader)
 {
     shader.SetVec3(UniformName + ".ambient", Ambient);
@@ -27,6 +57,11 @@ void PointLight::SetLightUniforms(const Shader& shader)
     shader.SetFloat(UniformName + ".attQuadratic", Attenuation.Quadratic);
 }
 
+float PointLight::GetRange() const noexcept
+{
+    return Attenuation.GetRange(std::max(maxComponent(Diffuse), maxComponent(Specular)));
+}
+
 
 void SpotLight::SetLightUniforms(const Shader& shader)
 {
@@ -43,3 +78,12 @@ void SpotLight::SetLightUniforms(const Shader& shader)
     shader.SetFloat(UniformName + ".attQuadratic", Attenuation.Quadratic);
 }
 
+float SpotLight::GetRange() const noexcept
+{
+    return Attenuation.GetRange(std::max(maxComponent(Diffuse), maxComponent(Specular)));
+}
+
+float SpotLight::GetShadowFovTangent() const noexcept
+{
+    return std::tan(glm::radians(std::min(OuterCutoff + 2.0f, 85.0f)));
+}
@@ -17,6 +17,9 @@ struct AttenuationProperties
     float Constant;
     float Linear;
     float Quadratic;
+
+    // distance where the attenuated intensity falls below cutoff (used to bound the light volume)
+    float GetRange(float intensity, float cutoff = 1.0f / 256.0f) const noexcept;
 };
 
 
@@ -64,6 +67,12 @@ struct PointLight : public Light
     glm::vec3 Position;
 
     AttenuationProperties Attenuation;
+
+    // Shadows are rendered by the ShadowAtlas, which also sets ShadowLayer (-1 = no shadow map this frame)
+    bool CastShadows = false;
+    int ShadowLayer = -1;
+
+    float GetRange() const noexcept;
     
     void SetLightUniforms(const Shader& shader) override;
 };
@@ -84,5 +93,13 @@ struct SpotLight : public Light
 
     AttenuationProperties Attenuation;
 
+    bool CastShadows = false;
+    int ShadowLayer = -1;
+
+    float GetRange() const noexcept;
+
+    // tan of half the field of view of the spot light's shadow map (slightly wider than the outer cone)
+    float GetShadowFovTangent() const noexcept;
+
     void SetLightUniforms(const Shader& shader) override;
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include "Texture2D.hpp"
@@ -12,3 +13,12 @@ struct Material
     float Shininess = 10.0f;
 };
 
+// A material before its textures are loaded, as the importer and the mesh cache see it
+struct MaterialDescription
+{
+    std::vector<std::string> DiffusePaths;
+    std::vector<std::string> SpecularPaths;
+    float TilingFactor = 1.0f;
+    float Shininess = 10.0f;
+};
+
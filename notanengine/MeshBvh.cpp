@@ -0,0 +1,635 @@
+#include "MeshBvh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "JobSystem.hpp"
+#include "Simd.hpp"
+
+// SAH costs, relative to one triangle test
+static constexpr float TRAVERSAL_COST = 1.0f;
+static constexpr unsigned int SAH_BINS = 16;
+
+// below this many triangles the build stays on the calling thread
+static constexpr size_t PARALLEL_BUILD_TRIANGLES = 1 << 15;
+
+static constexpr uint32_t NO_TRIANGLE = std::numeric_limits<uint32_t>::max();
+
+static inline float surfaceArea(const AABB& box) noexcept
+{
+    const glm::vec3 size = box.Max - box.Min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// 1 / direction without infinities, so a ray along an axis never makes 0 * inf in the slab test
+static inline glm::vec3 safeInverse(const glm::vec3& direction) noexcept
+{
+    glm::vec3 inverse;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const float d = direction[axis];
+        inverse[axis] = 1.0f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+    }
+    return inverse;
+}
+
+/// Build
+
+struct MeshBvh::Builder
+{
+    // a triangle being sorted into the leaves. Moved around whole so the passes over a node read memory in order
+    struct Reference
+    {
+        AABB Bounds;
+        glm::vec3 Centroid;
+        uint32_t Triangle;
+    };
+    std::vector<Reference> References;  // partitioned into the leaves' ranges
+
+    struct Task
+    {
+        uint32_t Node;
+        uint32_t Depth;
+    };
+
+    AABB RangeBounds(uint32_t first, uint32_t count) const noexcept
+    {
+        AABB bounds;
+        for (uint32_t i = first; i < first + count; i++)
+            bounds.Expand(References[i].Bounds);
+        return bounds;
+    }
+
+    // Splits nodes[root] down to the leaves. With deferred, children of at most deferBelow triangles
+    // are left for later instead, to be built on their own
+    void Split(std::vector<Node>& nodes, uint32_t root, uint32_t rootDepth, uint32_t deferBelow, std::vector<Task>* deferred)
+    {
+        std::vector<Task> stack = { { root, rootDepth } };
+        while (!stack.empty())
+        {
+            const Task task = stack.back();
+            stack.pop_back();
+
+            const uint32_t first = nodes[task.Node].First;
+            const uint32_t count = nodes[task.Node].Count;
+            if (count <= 2 || task.Depth + 1 >= MAX_DEPTH)
+                continue;
+
+            AABB centroidBounds;
+            for (uint32_t i = first; i < first + count; i++)
+                centroidBounds.Expand(References[i].Centroid);
+            const glm::vec3 extent = centroidBounds.Max - centroidBounds.Min;
+
+            /// Binned SAH: the best of the planes between SAH_BINS bins along each axis
+            int bestAxis = -1;
+            uint32_t bestPlane = 0;
+            float bestCost = std::numeric_limits<float>::max();
+            AABB bestLeft, bestRight;
+            uint32_t bestLeftCount = 0;
+
+            // one pass fills the bins of the three axes
+            struct Bin
+            {
+                AABB Bounds;
+                uint32_t Count = 0;
+            } bins[3][SAH_BINS];
+
+            glm::vec3 scale(0.0f);
+            for (int axis = 0; axis < 3; axis++)
+                scale[axis] = extent[axis] > 0.0f ? SAH_BINS / extent[axis] : 0.0f;
+
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const Reference& reference = References[i];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    Bin& bin = bins[axis][binOf(reference.Centroid[axis], centroidBounds.Min[axis], scale[axis])];
+                    bin.Bounds.Expand(reference.Bounds);
+                    bin.Count++;
+                }
+            }
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (extent[axis] <= 0.0f)
+                    continue;
+
+                // right to left sweep first, then left to right meets it at every plane
+                AABB rightBounds[SAH_BINS];
+                uint32_t rightCounts[SAH_BINS];
+                AABB accumulated;
+                uint32_t accumulatedCount = 0;
+                for (uint32_t plane = SAH_BINS - 1; plane > 0; plane--)
+                {
+                    accumulated.Expand(bins[axis][plane].Bounds);
+                    accumulatedCount += bins[axis][plane].Count;
+                    rightBounds[plane] = accumulated;
+                    rightCounts[plane] = accumulatedCount;
+                }
+
+                AABB leftBounds;
+                uint32_t leftCount = 0;
+                for (uint32_t plane = 1; plane < SAH_BINS; plane++)
+                {
+                    leftBounds.Expand(bins[axis][plane - 1].Bounds);
+                    leftCount += bins[axis][plane - 1].Count;
+                    if (leftCount == 0 || rightCounts[plane] == 0)
+                        continue;
+
+                    const float cost = surfaceArea(leftBounds) * leftCount + surfaceArea(rightBounds[plane]) * rightCounts[plane];
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestPlane = plane;
+                        bestLeft = leftBounds;
+                        bestRight = rightBounds[plane];
+                        bestLeftCount = leftCount;
+                    }
+                }
+            }
+
+            const float area = surfaceArea(AABB(nodes[task.Node].Min, nodes[task.Node].Max));
+            const float splitCost = TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+            if (count <= MAX_LEAF_TRIANGLES && (bestAxis < 0 || splitCost >= float(count)))
+                continue;
+
+            uint32_t leftCount = bestLeftCount;
+            if (bestAxis >= 0)
+            {
+                const float origin = centroidBounds.Min[bestAxis];
+                std::partition(References.begin() + first, References.begin() + first + count, [&](const Reference& reference) {
+                    return binOf(reference.Centroid[bestAxis], origin, scale[bestAxis]) < bestPlane;
+                });
+            }
+            else
+            {
+                // every centroid in the same place: halves, only to keep the leaves small
+                leftCount = count / 2;
+                bestLeft = RangeBounds(first, leftCount);
+                bestRight = RangeBounds(first + leftCount, count - leftCount);
+            }
+
+            const uint32_t left = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({ bestLeft.Min, first, bestLeft.Max, leftCount });
+            nodes.push_back({ bestRight.Min, first + leftCount, bestRight.Max, count - leftCount });
+            nodes[task.Node].First = left;
+            nodes[task.Node].Count = 0;
+
+            for (uint32_t child = left; child < left + 2; child++)
+            {
+                if (deferred && nodes[child].Count <= deferBelow)
+                    deferred->push_back({ child, task.Depth + 1 });
+                else
+                    stack.push_back({ child, task.Depth + 1 });
+            }
+        }
+    }
+
+    static inline uint32_t binOf(float centroid, float origin, float scale) noexcept
+    {
+        const int bin = static_cast<int>((centroid - origin) * scale);
+        return static_cast<uint32_t>(std::clamp(bin, 0, int(SAH_BINS) - 1));
+    }
+};
+
+template <typename Index>
+std::shared_ptr<const MeshBvh> MeshBvh::build(const glm::vec3* positions, size_t numPositions, const Index* indices, size_t numTriangles)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto bvh = std::make_shared<MeshBvh>();
+
+    auto vertexOf = [indices](size_t triangle, size_t corner) -> size_t {
+        return indices ? size_t(indices[triangle * 3 + corner]) : triangle * 3 + corner;
+    };
+
+    /// Triangle bounds, skipping the ones with indices out of range
+    std::vector<AABB> bounds(numTriangles);
+    JobSystem::ParallelFor(numTriangles, 4096, [&](size_t begin, size_t end) {
+        for (size_t triangle = begin; triangle < end; triangle++)
+        {
+            for (size_t corner = 0; corner < 3; corner++)
+            {
+                const size_t vertex = vertexOf(triangle, corner);
+                if (vertex >= numPositions)
+                {
+                    bounds[triangle] = AABB();
+                    break;
+                }
+                bounds[triangle].Expand(positions[vertex]);
+            }
+        }
+    });
+
+    Builder builder;
+    builder.References.reserve(numTriangles);
+    for (size_t triangle = 0; triangle < numTriangles; triangle++)
+    {
+        if (!bounds[triangle].IsValid())
+            continue;
+        builder.References.push_back({ bounds[triangle], bounds[triangle].GetCenter(), static_cast<uint32_t>(triangle) });
+        bvh->m_bounds.Expand(bounds[triangle]);
+    }
+    if (builder.References.empty())
+        return nullptr;
+
+    /// Nodes. A big mesh splits its top levels here, then builds the subtrees under them in parallel
+    std::vector<Node>& nodes = bvh->m_nodes;
+    nodes.reserve(builder.References.size());
+    nodes.push_back({ bvh->m_bounds.Min, 0, bvh->m_bounds.Max, static_cast<uint32_t>(builder.References.size()) });
+
+    const size_t numThreads = JobSystem::GetWorkerCount() + 1;
+    if (numThreads > 1 && builder.References.size() >= PARALLEL_BUILD_TRIANGLES)
+    {
+        std::vector<Builder::Task> tasks;
+        const uint32_t deferBelow = static_cast<uint32_t>(std::max<size_t>(PARALLEL_BUILD_TRIANGLES / 8, builder.References.size() / (numThreads * 8)));
+        builder.Split(nodes, 0, 0, deferBelow, &tasks);
+
+        std::vector<std::vector<Node>> subtrees(tasks.size());
+        JobSystem::ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                subtrees[i] = { nodes[tasks[i].Node] };
+                builder.Split(subtrees[i], 0, tasks[i].Depth, 0, nullptr);
+            }
+        });
+
+        // a subtree's root takes the place of its task node, the rest goes at the end. Siblings stay together
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            const std::vector<Node>& subtree = subtrees[i];
+            const uint32_t base = static_cast<uint32_t>(nodes.size()) - 1;
+            for (size_t local = 0; local < subtree.size(); local++)
+            {
+                Node node = subtree[local];
+                if (node.Count == 0)
+                    node.First += base;
+                if (local == 0)
+                    nodes[tasks[i].Node] = node;
+                else
+                    nodes.push_back(node);
+            }
+        }
+    }
+    else
+    {
+        builder.Split(nodes, 0, 0, 0, nullptr);
+    }
+    nodes.shrink_to_fit();
+
+    /// Triangles in leaf order
+    bvh->m_triangles.resize(builder.References.size());
+    bvh->m_triangleIds.resize(builder.References.size());
+    for (size_t i = 0; i < builder.References.size(); i++)
+    {
+        const size_t triangle = builder.References[i].Triangle;
+        bvh->m_triangleIds[i] = builder.References[i].Triangle;
+        const glm::vec3& v0 = positions[vertexOf(triangle, 0)];
+        bvh->m_triangles[i] = { v0, positions[vertexOf(triangle, 1)] - v0, positions[vertexOf(triangle, 2)] - v0 };
+    }
+
+    /// Stats
+    MeshBvhStats& stats = bvh->m_stats;
+    stats.Nodes = static_cast<unsigned int>(nodes.size());
+    stats.Triangles = static_cast<unsigned int>(builder.References.size());
+    const float rootArea = surfaceArea(bvh->m_bounds);
+    std::vector<std::pair<uint32_t, unsigned int>> stack = { { 0, 0 } };
+    while (!stack.empty())
+    {
+        const auto [index, depth] = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[index];
+        const float relativeArea = rootArea > 0.0f ? surfaceArea(AABB(node.Min, node.Max)) / rootArea : 1.0f;
+        stats.MaxDepth = std::max(stats.MaxDepth, depth);
+        if (node.Count > 0)
+        {
+            stats.Leaves++;
+            stats.SahCost += relativeArea * node.Count;
+            continue;
+        }
+        stats.SahCost += relativeArea * TRAVERSAL_COST;
+        stack.push_back({ node.First, depth + 1 });
+        stack.push_back({ node.First + 1, depth + 1 });
+    }
+    stats.BuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return bvh;
+}
+
+std::shared_ptr<const MeshBvh> MeshBvh::Build(const glm::vec3* positions, size_t numPositions, const uint32_t* indices, size_t numIndices)
+{
+    return build(positions, numPositions, indices, numIndices / 3);
+}
+
+std::shared_ptr<const MeshBvh> MeshBvh::Build(const glm::vec3* positions, size_t numPositions, const uint16_t* indices, size_t numIndices)
+{
+    return build(positions, numPositions, indices, numIndices / 3);
+}
+
+std::shared_ptr<const MeshBvh> MeshBvh::Build(const glm::vec3* positions, size_t numPositions)
+{
+    return build(positions, numPositions, static_cast<const uint32_t*>(nullptr), numPositions / 3);
+}
+
+/// Single ray
+
+static inline bool intersectBox(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverse,
+                                float maxDistance, float& outEntry) noexcept
+{
+    const glm::vec3 t0 = (min - origin) * inverse;
+    const glm::vec3 t1 = (max - origin) * inverse;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+    outEntry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    return outEntry <= std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+}
+
+bool MeshBvh::Raycast(const Ray& ray, RayHit& outHit) const noexcept
+{
+    if (m_nodes.empty())
+        return false;
+
+    const glm::vec3 inverse = safeInverse(ray.Direction);
+    float closest = ray.MaxDistance;
+    uint32_t hitIndex = NO_TRIANGLE;
+    glm::vec2 barycentrics(0.0f);
+
+    float entry, entryRight;
+    if (!intersectBox(m_nodes[0].Min, m_nodes[0].Max, ray.Origin, inverse, closest, entry))
+        return false;
+
+    // far children left for later. Every one is the sibling of a node on the way down, so MAX_DEPTH is enough
+    uint32_t stack[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t current = 0;
+    while (true)
+    {
+        const Node& node = m_nodes[current];
+        if (node.Count == 0)
+        {
+            const uint32_t left = node.First;
+            const bool hitLeft = intersectBox(m_nodes[left].Min, m_nodes[left].Max, ray.Origin, inverse, closest, entry);
+            const bool hitRight = intersectBox(m_nodes[left + 1].Min, m_nodes[left + 1].Max, ray.Origin, inverse, closest, entryRight);
+            if (hitLeft && hitRight)
+            {
+                const bool leftFirst = entry <= entryRight;
+                stack[stackSize++] = leftFirst ? left + 1 : left;
+                current = leftFirst ? left : left + 1;
+                continue;
+            }
+            if (hitLeft || hitRight)
+            {
+                current = hitLeft ? left : left + 1;
+                continue;
+            }
+        }
+        else
+        {
+            // Moller-Trumbore
+            for (uint32_t i = node.First; i < node.First + node.Count; i++)
+            {
+                const Triangle& triangle = m_triangles[i];
+                const glm::vec3 p = glm::cross(ray.Direction, triangle.Edge2);
+                const float det = glm::dot(triangle.Edge1, p);
+                if (det == 0.0f)
+                    continue;
+                const float inverseDet = 1.0f / det;
+
+                const glm::vec3 s = ray.Origin - triangle.V0;
+                const float u = glm::dot(s, p) * inverseDet;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+                const glm::vec3 q = glm::cross(s, triangle.Edge1);
+                const float v = glm::dot(ray.Direction, q) * inverseDet;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+                const float t = glm::dot(triangle.Edge2, q) * inverseDet;
+                if (t < 0.0f || t >= closest)
+                    continue;
+
+                closest = t;
+                hitIndex = i;
+                barycentrics = glm::vec2(u, v);
+            }
+        }
+
+        // the next far child still closer than the closest hit
+        bool found = false;
+        while (stackSize > 0 && !found)
+        {
+            current = stack[--stackSize];
+            found = intersectBox(m_nodes[current].Min, m_nodes[current].Max, ray.Origin, inverse, closest, entry);
+        }
+        if (!found)
+            break;
+    }
+
+    if (hitIndex == NO_TRIANGLE)
+        return false;
+
+    outHit.Distance = closest;
+    outHit.Triangle = m_triangleIds[hitIndex];
+    outHit.Barycentrics = barycentrics;
+    return true;
+}
+
+/// Packets of four rays
+
+#if NE_SIMD_SSE
+
+namespace
+{
+    struct RayPacket
+    {
+        __m128 OriginX, OriginY, OriginZ;
+        __m128 DirectionX, DirectionY, DirectionZ;
+        __m128 InverseX, InverseY, InverseZ;
+        __m128 Closest;
+    };
+
+    inline __m128 select(__m128 mask, __m128 a, __m128 b) noexcept
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline __m128 horizontalMin(__m128 v) noexcept
+    {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return v;
+    }
+
+    // bit per ray entering the box before its closest hit. outEntry: the earliest entry of those rays
+    inline int intersectBox4(const glm::vec3& min, const glm::vec3& max, const RayPacket& rays, float& outEntry) noexcept
+    {
+        const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.x), rays.OriginX), rays.InverseX);
+        const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.x), rays.OriginX), rays.InverseX);
+        const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.y), rays.OriginY), rays.InverseY);
+        const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.y), rays.OriginY), rays.InverseY);
+        const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.z), rays.OriginZ), rays.InverseZ);
+        const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.z), rays.OriginZ), rays.InverseZ);
+
+        const __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                                        _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+        const __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                                       _mm_min_ps(_mm_max_ps(t0z, t1z), rays.Closest));
+        const __m128 hit = _mm_cmple_ps(tNear, tFar);
+
+        outEntry = _mm_cvtss_f32(horizontalMin(select(hit, tNear, _mm_set1_ps(FLT_MAX))));
+        return _mm_movemask_ps(hit);
+    }
+}
+
+unsigned int MeshBvh::Raycast4(const Ray rays[4], RayHit outHits[4]) const noexcept
+{
+    if (m_nodes.empty())
+        return 0;
+
+    alignas(16) float values[10][4];
+    for (int lane = 0; lane < 4; lane++)
+    {
+        const glm::vec3 inverse = safeInverse(rays[lane].Direction);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            values[axis][lane] = rays[lane].Origin[axis];
+            values[3 + axis][lane] = rays[lane].Direction[axis];
+            values[6 + axis][lane] = inverse[axis];
+        }
+        values[9][lane] = rays[lane].MaxDistance;
+    }
+
+    RayPacket packet;
+    packet.OriginX = _mm_load_ps(values[0]);
+    packet.OriginY = _mm_load_ps(values[1]);
+    packet.OriginZ = _mm_load_ps(values[2]);
+    packet.DirectionX = _mm_load_ps(values[3]);
+    packet.DirectionY = _mm_load_ps(values[4]);
+    packet.DirectionZ = _mm_load_ps(values[5]);
+    packet.InverseX = _mm_load_ps(values[6]);
+    packet.InverseY = _mm_load_ps(values[7]);
+    packet.InverseZ = _mm_load_ps(values[8]);
+    packet.Closest = _mm_load_ps(values[9]);
+
+    __m128i hitIndex = _mm_set1_epi32(-1);
+    __m128 hitU = _mm_setzero_ps();
+    __m128 hitV = _mm_setzero_ps();
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    float entry, entryRight;
+    if (!intersectBox4(m_nodes[0].Min, m_nodes[0].Max, packet, entry))
+        return 0;
+
+    uint32_t stack[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t current = 0;
+    while (true)
+    {
+        const Node& node = m_nodes[current];
+        if (node.Count == 0)
+        {
+            // the packet goes where any of its rays needs to, nearest child first
+            const uint32_t left = node.First;
+            const int hitLeft = intersectBox4(m_nodes[left].Min, m_nodes[left].Max, packet, entry);
+            const int hitRight = intersectBox4(m_nodes[left + 1].Min, m_nodes[left + 1].Max, packet, entryRight);
+            if (hitLeft && hitRight)
+            {
+                const bool leftFirst = entry <= entryRight;
+                stack[stackSize++] = leftFirst ? left + 1 : left;
+                current = leftFirst ? left : left + 1;
+                continue;
+            }
+            if (hitLeft || hitRight)
+            {
+                current = hitLeft ? left : left + 1;
+                continue;
+            }
+        }
+        else
+        {
+            // Moller-Trumbore on four rays. A zero determinant gives infinities and NaNs that fail the tests
+            for (uint32_t i = node.First; i < node.First + node.Count; i++)
+            {
+                const Triangle& triangle = m_triangles[i];
+                const __m128 e1x = _mm_set1_ps(triangle.Edge1.x), e1y = _mm_set1_ps(triangle.Edge1.y), e1z = _mm_set1_ps(triangle.Edge1.z);
+                const __m128 e2x = _mm_set1_ps(triangle.Edge2.x), e2y = _mm_set1_ps(triangle.Edge2.y), e2z = _mm_set1_ps(triangle.Edge2.z);
+
+                const __m128 px = _mm_sub_ps(_mm_mul_ps(packet.DirectionY, e2z), _mm_mul_ps(packet.DirectionZ, e2y));
+                const __m128 py = _mm_sub_ps(_mm_mul_ps(packet.DirectionZ, e2x), _mm_mul_ps(packet.DirectionX, e2z));
+                const __m128 pz = _mm_sub_ps(_mm_mul_ps(packet.DirectionX, e2y), _mm_mul_ps(packet.DirectionY, e2x));
+                const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                const __m128 inverseDet = _mm_div_ps(one, det);
+
+                const __m128 sx = _mm_sub_ps(packet.OriginX, _mm_set1_ps(triangle.V0.x));
+                const __m128 sy = _mm_sub_ps(packet.OriginY, _mm_set1_ps(triangle.V0.y));
+                const __m128 sz = _mm_sub_ps(packet.OriginZ, _mm_set1_ps(triangle.V0.z));
+                const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDet);
+
+                const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(packet.DirectionX, qx), _mm_mul_ps(packet.DirectionY, qy)),
+                                                       _mm_mul_ps(packet.DirectionZ, qz)), inverseDet);
+                const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+                const __m128 hit = _mm_and_ps(_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+                                                         _mm_cmple_ps(_mm_add_ps(u, v), one)),
+                                              _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, packet.Closest)));
+                if (_mm_movemask_ps(hit) == 0)
+                    continue;
+
+                packet.Closest = select(hit, t, packet.Closest);
+                hitU = select(hit, u, hitU);
+                hitV = select(hit, v, hitV);
+                const __m128i hitMask = _mm_castps_si128(hit);
+                hitIndex = _mm_or_si128(_mm_and_si128(hitMask, _mm_set1_epi32(static_cast<int>(i))), _mm_andnot_si128(hitMask, hitIndex));
+            }
+        }
+
+        bool found = false;
+        while (stackSize > 0 && !found)
+        {
+            current = stack[--stackSize];
+            found = intersectBox4(m_nodes[current].Min, m_nodes[current].Max, packet, entry) != 0;
+        }
+        if (!found)
+            break;
+    }
+
+    alignas(16) float closest[4], us[4], vs[4];
+    alignas(16) uint32_t indices[4];
+    _mm_store_ps(closest, packet.Closest);
+    _mm_store_ps(us, hitU);
+    _mm_store_ps(vs, hitV);
+    _mm_store_si128(reinterpret_cast<__m128i*>(indices), hitIndex);
+
+    unsigned int hits = 0;
+    for (int lane = 0; lane < 4; lane++)
+    {
+        if (indices[lane] == NO_TRIANGLE)
+            continue;
+        outHits[lane].Distance = closest[lane];
+        outHits[lane].Triangle = m_triangleIds[indices[lane]];
+        outHits[lane].Barycentrics = glm::vec2(us[lane], vs[lane]);
+        hits |= 1u << lane;
+    }
+    return hits;
+}
+
+#else
+
+unsigned int MeshBvh::Raycast4(const Ray rays[4], RayHit outHits[4]) const noexcept
+{
+    unsigned int hits = 0;
+    for (unsigned int lane = 0; lane < 4; lane++)
+    {
+        if (Raycast(rays[lane], outHits[lane]))
+            hits |= 1u << lane;
+    }
+    return hits;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bounds.hpp"
+
+struct RayHit
+{
+    float Distance = FLT_MAX;           // along the ray, in lengths of its direction
+    uint32_t Triangle = UINT32_MAX;     // in the mesh's index order: first index / 3
+    glm::vec2 Barycentrics = glm::vec2(0.0f);   // weights of the triangle's second and third vertex
+
+    inline bool IsHit() const noexcept { return Triangle != UINT32_MAX; }
+};
+
+struct MeshBvhStats
+{
+    unsigned int Nodes = 0;
+    unsigned int Leaves = 0;
+    unsigned int Triangles = 0;
+    unsigned int MaxDepth = 0;
+    float SahCost = 0.0f;       // expected cost of a ray through the root, in triangle tests
+    float BuildMs = 0.0f;
+};
+
+/*
+    Bounding volume hierarchy over the triangles of a mesh, for exact ray
+    queries on the CPU: picking, line of sight.
+    Split with the surface area heuristic on binned centroids. The nodes
+    are one array, siblings next to each other, and the triangles are
+    reordered to match the leaves and stored ready for the ray test. Big
+    meshes build their subtrees in parallel on the JobSystem.
+    Rays go one at a time, or four together (a packet, SSE on x86) when
+    they're coherent, like the pixels of a screen area: the packet visits
+    every node one of its rays needs.
+    Triangles are double sided, like the meshes draw. Read only once
+    built, so any number of threads can query it.
+*/
+class MeshBvh
+{
+public:
+    static constexpr unsigned int MAX_LEAF_TRIANGLES = 8;
+    static constexpr unsigned int MAX_DEPTH = 64;
+
+    // Triangles of indices, numIndices / 3 of them. Empty when there are none
+    static std::shared_ptr<const MeshBvh> Build(const glm::vec3* positions, size_t numPositions, const uint32_t* indices, size_t numIndices);
+    static std::shared_ptr<const MeshBvh> Build(const glm::vec3* positions, size_t numPositions, const uint16_t* indices, size_t numIndices);
+    // Triangles of consecutive positions (a glDrawArrays list)
+    static std::shared_ptr<const MeshBvh> Build(const glm::vec3* positions, size_t numPositions);
+
+    // Closest hit closer than ray.MaxDistance. outHit is left alone on a miss
+    bool Raycast(const Ray& ray, RayHit& outHit) const noexcept;
+
+    // Closest hits of four rays at once. Returns a bit per ray that hit, the other outHits are left alone
+    unsigned int Raycast4(const Ray rays[4], RayHit outHits[4]) const noexcept;
+
+    inline const AABB& GetBounds() const noexcept { return m_bounds; }
+    inline const MeshBvhStats& GetStats() const noexcept { return m_stats; }
+
+private:
+    // 32 bytes. Leaves have triangles [First, First + Count), inner nodes (Count 0) their children at First and First + 1
+    struct Node
+    {
+        glm::vec3 Min;
+        uint32_t First;
+        glm::vec3 Max;
+        uint32_t Count;
+    };
+
+    // what the ray test needs, as Moller-Trumbore takes it
+    struct Triangle
+    {
+        glm::vec3 V0, Edge1, Edge2;
+    };
+
+    struct Builder;
+
+    std::vector<Node> m_nodes;
+    std::vector<Triangle> m_triangles;      // in leaf order
+    std::vector<uint32_t> m_triangleIds;    // the mesh triangle of each
+    AABB m_bounds;
+    MeshBvhStats m_stats;
+
+    template <typename Index>
+    static std::shared_ptr<const MeshBvh> build(const glm::vec3* positions, size_t numPositions, const Index* indices, size_t numTriangles);
+};
@@ -0,0 +1,501 @@
+#include "MeshCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#ifdef _NE_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(std::is_trivially_copyable_v<PackedVertex>, "PackedVertex is copied as raw bytes");
+static_assert(std::is_trivially_copyable_v<MeshLod>, "MeshLod is copied as raw bytes");
+static_assert(std::is_trivially_copyable_v<Meshlet>, "Meshlet is copied as raw bytes");
+
+static constexpr char CACHE_MAGIC[8] = { 'N', 'E', 'M', 'E', 'S', 'H', 0, 0 };
+// every blob starts on this boundary, so pointers into the mapping are aligned for any of the types
+static constexpr size_t BLOB_ALIGNMENT = 16;
+
+struct CacheFileHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t NumSubMeshes;
+    uint64_t SourceHash;
+    uint64_t ImportKey;
+    uint64_t FileSize;
+    // the blobs are raw structs, a different compiler or platform could lay them out differently
+    uint32_t VertexSize;
+    uint32_t LodSize;
+    uint32_t MeshletSize;
+    uint32_t Padding;
+};
+
+struct CacheSubMeshEntry
+{
+    uint64_t VerticesOffset;
+    uint64_t PositionsOffset;
+    uint64_t IndicesOffset;
+    uint64_t LodsOffset;
+    uint64_t MeshletsOffset;
+    uint64_t MaterialOffset;
+    uint32_t NumVertices;
+    uint32_t NumIndices;
+    uint32_t IndexType;
+    uint32_t NumLods;
+    uint32_t NumMeshlets;
+    uint32_t MaterialSize;
+    float BoundsMin[3];
+    float BoundsMax[3];
+    float PositionScale[3];
+    float PositionBias[3];
+};
+
+// true when count elements of elementSize at offset are inside the file and aligned
+static bool isBlobInFile(uint64_t offset, uint64_t count, size_t elementSize, size_t fileSize)
+{
+    if (offset % BLOB_ALIGNMENT != 0 || offset > fileSize)
+        return false;
+    return count <= (fileSize - offset) / elementSize;
+}
+
+/// Material blob: TilingFactor, Shininess, diffuse count, specular count, then each path as a length and its characters
+static bool readMaterial(const unsigned char* data, size_t size, MaterialDescription& outMaterial)
+{
+    size_t cursor = 0;
+    auto read = [&](void* dst, size_t bytes) {
+        if (bytes > size - cursor)
+            return false;
+        std::memcpy(dst, data + cursor, bytes);
+        cursor += bytes;
+        return true;
+    };
+
+    uint32_t numDiffuse = 0, numSpecular = 0;
+    if (!read(&outMaterial.TilingFactor, sizeof(float)) || !read(&outMaterial.Shininess, sizeof(float))
+        || !read(&numDiffuse, sizeof(uint32_t)) || !read(&numSpecular, sizeof(uint32_t)))
+        return false;
+
+    auto readPaths = [&](uint32_t count, std::vector<std::string>& outPaths) {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t length = 0;
+            if (!read(&length, sizeof(uint32_t)) || length > size - cursor)
+                return false;
+            outPaths.emplace_back(reinterpret_cast<const char*>(data + cursor), length);
+            cursor += length;
+        }
+        return true;
+    };
+
+    return readPaths(numDiffuse, outMaterial.DiffusePaths) && readPaths(numSpecular, outMaterial.SpecularPaths);
+}
+
+static void appendBytes(std::vector<unsigned char>& buffer, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+// pads the buffer to BLOB_ALIGNMENT, appends the blob and returns where it starts
+static uint64_t appendBlob(std::vector<unsigned char>& buffer, const void* data, size_t size)
+{
+    buffer.resize((buffer.size() + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT, 0);
+    const uint64_t offset = buffer.size();
+    if (size > 0)
+        appendBytes(buffer, data, size);
+    return offset;
+}
+
+namespace MeshCache
+{
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+#ifdef _NE_WINDOWS
+    bool MappedFile::Open(const std::string& path)
+    {
+        Close();
+
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+        m_data = static_cast<const unsigned char*>(data);
+        m_size = static_cast<size_t>(size.QuadPart);
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file)
+            CloseHandle(m_file);
+
+        m_data = nullptr;
+        m_size = 0;
+        m_mapping = nullptr;
+        m_file = nullptr;
+    }
+#else
+    bool MappedFile::Open(const std::string& path)
+    {
+        Close();
+
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        // the whole file is read right away (validation, then upload), start paging it in
+        madvise(data, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+
+        m_fd = fd;
+        m_data = static_cast<const unsigned char*>(data);
+        m_size = static_cast<size_t>(info.st_size);
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_data)
+            munmap(const_cast<unsigned char*>(m_data), m_size);
+        if (m_fd >= 0)
+            close(m_fd);
+
+        m_data = nullptr;
+        m_size = 0;
+        m_fd = -1;
+    }
+#endif
+
+    uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+    {
+        constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    bool HashFile(const std::string& path, uint64_t& outHash)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+            return false;
+
+        outHash = HashBytes(file.GetData(), file.GetSize());
+        return true;
+    }
+
+    std::vector<std::string> GetMaterialLibraries(const char* objText, size_t size)
+    {
+        std::vector<std::string> libraries;
+        const char* end = objText + size;
+        for (const char* line = objText; line < end;)
+        {
+            const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+            if (!lineEnd)
+                lineEnd = end;
+
+            while (line < lineEnd && (*line == ' ' || *line == '\t'))
+                line++;
+            // the rest of the line is the file name, as Assimp reads it
+            if (lineEnd - line > 7 && std::strncmp(line, "mtllib", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+            {
+                const char* name = line + 7;
+                const char* nameEnd = lineEnd;
+                while (name < nameEnd && (*name == ' ' || *name == '\t'))
+                    name++;
+                while (nameEnd > name && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t' || nameEnd[-1] == '\r'))
+                    nameEnd--;
+                if (name < nameEnd)
+                    libraries.emplace_back(name, nameEnd);
+            }
+            line = lineEnd + 1;
+        }
+        return libraries;
+    }
+
+    bool HashModelSources(const std::string& path, uint64_t& outHash)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+            return false;
+
+        outHash = HashBytes(file.GetData(), file.GetSize());
+
+        const std::filesystem::path modelPath(path);
+        if (modelPath.extension() != ".obj" && modelPath.extension() != ".OBJ")
+            return true;
+
+        for (const std::string& library : GetMaterialLibraries(reinterpret_cast<const char*>(file.GetData()), file.GetSize()))
+        {
+            outHash = HashBytes(library.data(), library.size(), outHash);
+
+            uint64_t libraryHash = 0;
+            if (HashFile((modelPath.parent_path() / library).string(), libraryHash))
+                outHash = HashBytes(&libraryHash, sizeof(libraryHash), outHash);
+        }
+        return true;
+    }
+
+    bool CacheFile::Open(const std::string& path, uint64_t sourceHash, uint64_t importKey)
+    {
+        Close();
+
+        if (!m_file.Open(path))
+            return false;
+
+        const unsigned char* data = m_file.GetData();
+        const size_t fileSize = m_file.GetSize();
+
+        CacheFileHeader header;
+        if (fileSize < sizeof(header))
+        {
+            Close();
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.Magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+            || header.Version != FORMAT_VERSION
+            || header.SourceHash != sourceHash
+            || header.ImportKey != importKey
+            || header.FileSize != fileSize
+            || header.VertexSize != sizeof(PackedVertex)
+            || header.LodSize != sizeof(MeshLod)
+            || header.MeshletSize != sizeof(Meshlet)
+            || header.NumSubMeshes > (fileSize - sizeof(header)) / sizeof(CacheSubMeshEntry))
+        {
+            Close();
+            return false;
+        }
+
+        m_subMeshes.resize(header.NumSubMeshes);
+        for (uint32_t i = 0; i < header.NumSubMeshes; i++)
+        {
+            CacheSubMeshEntry entry;
+            std::memcpy(&entry, data + sizeof(header) + i * sizeof(CacheSubMeshEntry), sizeof(entry));
+
+            const size_t indexSize = entry.IndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+            const bool valid = (entry.IndexType == GL_UNSIGNED_SHORT || entry.IndexType == GL_UNSIGNED_INT)
+                && isBlobInFile(entry.VerticesOffset, entry.NumVertices, sizeof(PackedVertex), fileSize)
+                && isBlobInFile(entry.PositionsOffset, entry.NumVertices, sizeof(glm::vec3), fileSize)
+                && isBlobInFile(entry.IndicesOffset, entry.NumIndices, indexSize, fileSize)
+                && isBlobInFile(entry.LodsOffset, entry.NumLods, sizeof(MeshLod), fileSize)
+                && isBlobInFile(entry.MeshletsOffset, entry.NumMeshlets, sizeof(Meshlet), fileSize)
+                && isBlobInFile(entry.MaterialOffset, entry.MaterialSize, 1, fileSize);
+
+            CachedSubMesh& subMesh = m_subMeshes[i];
+            if (!valid || !readMaterial(data + entry.MaterialOffset, entry.MaterialSize, subMesh.Material))
+            {
+                std::cerr << "MeshCache: corrupted submesh table in " << path << '\n';
+                Close();
+                return false;
+            }
+
+            PackedMeshView& view = subMesh.Mesh;
+            view.Vertices = reinterpret_cast<const PackedVertex*>(data + entry.VerticesOffset);
+            view.NumVertices = entry.NumVertices;
+            view.Positions = reinterpret_cast<const glm::vec3*>(data + entry.PositionsOffset);
+            view.Indices = data + entry.IndicesOffset;
+            view.NumIndices = entry.NumIndices;
+            view.IndexType = entry.IndexType;
+            view.Lods = reinterpret_cast<const MeshLod*>(data + entry.LodsOffset);
+            view.NumLods = entry.NumLods;
+            view.Meshlets = reinterpret_cast<const Meshlet*>(data + entry.MeshletsOffset);
+            view.NumMeshlets = entry.NumMeshlets;
+            view.Bounds.Min = glm::vec3(entry.BoundsMin[0], entry.BoundsMin[1], entry.BoundsMin[2]);
+            view.Bounds.Max = glm::vec3(entry.BoundsMax[0], entry.BoundsMax[1], entry.BoundsMax[2]);
+            view.PositionScale = glm::vec3(entry.PositionScale[0], entry.PositionScale[1], entry.PositionScale[2]);
+            view.PositionBias = glm::vec3(entry.PositionBias[0], entry.PositionBias[1], entry.PositionBias[2]);
+
+            // ranges are drawn as is, they must stay inside the buffers
+            bool rangesValid = true;
+            for (size_t l = 0; l < view.NumLods; l++)
+                rangesValid &= uint64_t(view.Lods[l].IndexOffset) + view.Lods[l].IndexCount <= view.NumIndices;
+            for (size_t m = 0; m < view.NumMeshlets; m++)
+                rangesValid &= uint64_t(view.Meshlets[m].IndexOffset) + view.Meshlets[m].IndexCount <= view.NumIndices;
+            for (size_t k = 0; k < view.NumIndices && rangesValid; k++)
+            {
+                const unsigned int index = view.IndexType == GL_UNSIGNED_SHORT
+                    ? static_cast<const uint16_t*>(view.Indices)[k]
+                    : static_cast<const unsigned int*>(view.Indices)[k];
+                rangesValid = index < view.NumVertices;
+            }
+
+            if (!rangesValid)
+            {
+                std::cerr << "MeshCache: out of range indices in " << path << '\n';
+                Close();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void CacheFile::Close()
+    {
+        m_subMeshes.clear();
+        m_file.Close();
+    }
+
+    bool Write(const std::string& path, uint64_t sourceHash, uint64_t importKey,
+               const std::vector<PackedMeshView>& meshes, const std::vector<MaterialDescription>& materials)
+    {
+        if (meshes.size() != materials.size())
+            return false;
+
+        CacheFileHeader header{};
+        std::memcpy(header.Magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.Version = FORMAT_VERSION;
+        header.NumSubMeshes = static_cast<uint32_t>(meshes.size());
+        header.SourceHash = sourceHash;
+        header.ImportKey = importKey;
+        header.VertexSize = sizeof(PackedVertex);
+        header.LodSize = sizeof(MeshLod);
+        header.MeshletSize = sizeof(Meshlet);
+
+        // header and table first, filled in once the blob offsets are known
+        std::vector<unsigned char> buffer(sizeof(header) + meshes.size() * sizeof(CacheSubMeshEntry), 0);
+        std::vector<CacheSubMeshEntry> entries(meshes.size());
+
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const PackedMeshView& mesh = meshes[i];
+            CacheSubMeshEntry& entry = entries[i];
+
+            const size_t indexSize = mesh.IndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+            entry.NumVertices = static_cast<uint32_t>(mesh.NumVertices);
+            entry.NumIndices = static_cast<uint32_t>(mesh.NumIndices);
+            entry.IndexType = mesh.IndexType;
+            entry.NumLods = static_cast<uint32_t>(mesh.NumLods);
+            entry.NumMeshlets = static_cast<uint32_t>(mesh.NumMeshlets);
+
+            entry.VerticesOffset = appendBlob(buffer, mesh.Vertices, mesh.NumVertices * sizeof(PackedVertex));
+            entry.PositionsOffset = appendBlob(buffer, mesh.Positions, mesh.NumVertices * sizeof(glm::vec3));
+            entry.IndicesOffset = appendBlob(buffer, mesh.Indices, mesh.NumIndices * indexSize);
+            entry.LodsOffset = appendBlob(buffer, mesh.Lods, mesh.NumLods * sizeof(MeshLod));
+            entry.MeshletsOffset = appendBlob(buffer, mesh.Meshlets, mesh.NumMeshlets * sizeof(Meshlet));
+
+            for (int c = 0; c < 3; c++)
+            {
+                entry.BoundsMin[c] = mesh.Bounds.Min[c];
+                entry.BoundsMax[c] = mesh.Bounds.Max[c];
+                entry.PositionScale[c] = mesh.PositionScale[c];
+                entry.PositionBias[c] = mesh.PositionBias[c];
+            }
+
+            entry.MaterialOffset = appendBlob(buffer, nullptr, 0);
+            const MaterialDescription& material = materials[i];
+            const uint32_t numDiffuse = static_cast<uint32_t>(material.DiffusePaths.size());
+            const uint32_t numSpecular = static_cast<uint32_t>(material.SpecularPaths.size());
+            appendBytes(buffer, &material.TilingFactor, sizeof(float));
+            appendBytes(buffer, &material.Shininess, sizeof(float));
+            appendBytes(buffer, &numDiffuse, sizeof(uint32_t));
+            appendBytes(buffer, &numSpecular, sizeof(uint32_t));
+            for (const auto* paths : { &material.DiffusePaths, &material.SpecularPaths })
+            {
+                for (const auto& texturePath : *paths)
+                {
+                    const uint32_t length = static_cast<uint32_t>(texturePath.size());
+                    appendBytes(buffer, &length, sizeof(uint32_t));
+                    appendBytes(buffer, texturePath.data(), texturePath.size());
+                }
+            }
+            entry.MaterialSize = static_cast<uint32_t>(buffer.size() - entry.MaterialOffset);
+        }
+
+        header.FileSize = buffer.size();
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        if (!entries.empty())
+            std::memcpy(buffer.data() + sizeof(header), entries.data(), entries.size() * sizeof(CacheSubMeshEntry));
+
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cerr << "MeshCache: can't create " << tempPath << '\n';
+                return false;
+            }
+
+            file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            if (!file)
+            {
+                std::cerr << "MeshCache: failed to write " << tempPath << '\n';
+                file.close();
+                std::filesystem::remove(tempPath);
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error)
+        {
+            std::cerr << "MeshCache: failed to move " << tempPath << " to " << path << ": " << error.message() << '\n';
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "StaticMesh.hpp"
+
+/*
+    Binary cache of imported models, so warm loads skip Assimp and all of the
+    import processing (LODs, meshlets, reordering, quantization).
+    A cache file holds, for each submesh, the packed vertex, position, index,
+    LOD and meshlet blobs exactly as MeshData uploads them, plus its bounds,
+    dequantization scale/bias and material (shininess, tiling and texture paths).
+    Files are memory mapped and MeshData is built straight from pointers into
+    the mapping. A file is only used when its source hash (of the model and
+    its material libraries) and import key match, anything else (old version,
+    truncated file, bad offsets) is a cache miss.
+*/
+namespace MeshCache
+{
+    // Bump when the file layout changes
+    constexpr uint32_t FORMAT_VERSION = 1;
+
+    // Read-only view of a whole file: mmap on Linux, a file mapping on Windows
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool Open(const std::string& path);
+        void Close();
+
+        inline const unsigned char* GetData() const noexcept { return m_data; }
+        inline size_t GetSize() const noexcept { return m_size; }
+        inline bool IsOpen() const noexcept { return m_data != nullptr; }
+
+    private:
+        const unsigned char* m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _NE_WINDOWS
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#else
+        int m_fd = -1;
+#endif
+    };
+
+    struct CachedSubMesh
+    {
+        PackedMeshView Mesh;    // points into the mapped file
+        MaterialDescription Material;
+    };
+
+    // FNV-1a 64, pass a previous result as hash to chain several buffers
+    uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+    // HashBytes of the file's contents. Returns false if it can't be read
+    bool HashFile(const std::string& path, uint64_t& outHash);
+
+    // The material libraries (mtllib lines) of .obj text, as written in it: relative to the .obj's folder
+    std::vector<std::string> GetMaterialLibraries(const char* objText, size_t size);
+
+    // HashFile of a model, chained with the files its materials come from (an .obj's material libraries), since the
+    // cache keeps the materials too. A missing library counts by its name. Returns false if the model can't be read
+    bool HashModelSources(const std::string& path, uint64_t& outHash);
+
+    class CacheFile
+    {
+    public:
+        // Maps the file and checks it against the source. False (and nothing mapped) on any mismatch or corruption
+        bool Open(const std::string& path, uint64_t sourceHash, uint64_t importKey);
+
+        // Valid while the CacheFile stays open
+        inline const std::vector<CachedSubMesh>& GetSubMeshes() const noexcept { return m_subMeshes; }
+
+        void Close();
+
+    private:
+        MappedFile m_file;
+        std::vector<CachedSubMesh> m_subMeshes;
+    };
+
+    // Writes to a temporary file next to path and renames it, so readers never see half a file
+    bool Write(const std::string& path, uint64_t sourceHash, uint64_t importKey,
+               const std::vector<PackedMeshView>& meshes, const std::vector<MaterialDescription>& materials);
+}
@@ -0,0 +1,270 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+constexpr unsigned int INVALID_INDEX = std::numeric_limits<unsigned int>::max();
+
+namespace MeshOptimizer
+{
+    VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, IndexRange range, unsigned int cacheSize)
+    {
+        VertexCacheStats stats;
+        stats.Triangles = range.Count / 3;
+
+        // FIFO of vertex ids, a hit doesn't refresh the entry
+        std::vector<unsigned int> fifo(cacheSize, INVALID_INDEX);
+        size_t head = 0;
+
+        for (unsigned int i = range.Offset; i < range.Offset + range.Count; i++)
+        {
+            const unsigned int v = indices[i];
+            if (std::find(fifo.begin(), fifo.end(), v) != fifo.end())
+                continue;
+
+            fifo[head] = v;
+            head = (head + 1) % cacheSize;
+            stats.Misses++;
+        }
+
+        std::vector<unsigned int> unique(indices.begin() + range.Offset, indices.begin() + range.Offset + range.Count);
+        std::sort(unique.begin(), unique.end());
+        stats.Vertices = std::unique(unique.begin(), unique.end()) - unique.begin();
+
+        return stats;
+    }
+
+    std::vector<IndexRange> OptimizeVertexCache(std::vector<unsigned int>& indices, IndexRange range, unsigned int cacheSize)
+    {
+        std::vector<IndexRange> clusters;
+
+        const size_t numTriangles = range.Count / 3;
+        if (numTriangles == 0)
+            return clusters;
+
+        /// the range only touches a few of the mesh's vertices, work with local ids given in first use order
+        std::vector<unsigned int> localIndices(range.Count);
+        std::vector<unsigned int> localToGlobal;
+        {
+            std::unordered_map<unsigned int, unsigned int> globalToLocal;
+            globalToLocal.reserve(range.Count);
+
+            for (unsigned int i = 0; i < range.Count; i++)
+            {
+                const unsigned int global = indices[range.Offset + i];
+                auto [it, inserted] = globalToLocal.try_emplace(global, static_cast<unsigned int>(localToGlobal.size()));
+                if (inserted)
+                    localToGlobal.push_back(global);
+                localIndices[i] = it->second;
+            }
+        }
+
+        const size_t numVertices = localToGlobal.size();
+
+        /// vertex -> triangles adjacency and live triangle counts
+        std::vector<unsigned int> triangleOffsets(numVertices + 1, 0);
+        for (unsigned int v : localIndices)
+            triangleOffsets[v + 1]++;
+        for (size_t v = 0; v < numVertices; v++)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+
+        std::vector<unsigned int> vertexTriangles(localIndices.size());
+        std::vector<unsigned int> liveTriangles(numVertices);
+        {
+            std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (size_t i = 0; i < localIndices.size(); i++)
+                vertexTriangles[fill[localIndices[i]]++] = static_cast<unsigned int>(i / 3);
+            for (size_t v = 0; v < numVertices; v++)
+                liveTriangles[v] = triangleOffsets[v + 1] - triangleOffsets[v];
+        }
+
+        /// Tipsify
+        std::vector<unsigned int> cacheTime(numVertices, 0);
+        std::vector<unsigned char> emitted(numTriangles, 0);
+        std::vector<unsigned int> deadEnd;
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> output;
+        output.reserve(range.Count);
+
+        unsigned int timestamp = cacheSize + 1;
+        size_t cursor = 1;
+        unsigned int clusterStart = 0;
+        int fanning = 0;
+
+        while (fanning >= 0)
+        {
+            candidates.clear();
+
+            for (unsigned int k = triangleOffsets[fanning]; k < triangleOffsets[fanning + 1]; k++)
+            {
+                const unsigned int t = vertexTriangles[k];
+                if (emitted[t])
+                    continue;
+
+                for (int c = 0; c < 3; c++)
+                {
+                    const unsigned int v = localIndices[t * 3 + c];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+
+                    if (timestamp - cacheTime[v] > cacheSize)
+                        cacheTime[v] = timestamp++;
+                }
+                emitted[t] = 1;
+            }
+
+            // next fanning vertex: the candidate still in cache that stays there the longest after its fan
+            int next = -1;
+            int best = -1;
+            for (unsigned int v : candidates)
+            {
+                if (liveTriangles[v] == 0)
+                    continue;
+
+                int priority = 0;
+                if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = static_cast<int>(timestamp - cacheTime[v]);
+
+                if (priority > best)
+                {
+                    best = priority;
+                    next = static_cast<int>(v);
+                }
+            }
+
+            if (next < 0)
+            {
+                // dead end: the vertices used recently, then any vertex with triangles left. Also a cluster boundary
+                while (!deadEnd.empty() && next < 0)
+                {
+                    const unsigned int v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (liveTriangles[v] > 0)
+                        next = static_cast<int>(v);
+                }
+
+                while (next < 0 && cursor < numVertices)
+                {
+                    if (liveTriangles[cursor] > 0)
+                        next = static_cast<int>(cursor);
+                    cursor++;
+                }
+
+                if (output.size() > clusterStart)
+                {
+                    clusters.push_back({ range.Offset + clusterStart, static_cast<unsigned int>(output.size()) - clusterStart });
+                    clusterStart = static_cast<unsigned int>(output.size());
+                }
+            }
+
+            fanning = next;
+        }
+
+        if (output.size() > clusterStart)
+            clusters.push_back({ range.Offset + clusterStart, static_cast<unsigned int>(output.size()) - clusterStart });
+
+        for (size_t i = 0; i < output.size(); i++)
+            indices[range.Offset + i] = localToGlobal[output[i]];
+
+        return clusters;
+    }
+
+    std::vector<unsigned int> OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+                                               const std::vector<IndexRange>& clusters)
+    {
+        std::vector<unsigned int> order(clusters.size());
+        for (unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+
+        if (clusters.size() < 2)
+            return order;
+
+        /// centroid and area weighted normal of each cluster, and the centroid of them all
+        std::vector<glm::vec3> centroids(clusters.size(), glm::vec3(0.0f));
+        std::vector<glm::vec3> normals(clusters.size(), glm::vec3(0.0f));
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            float clusterArea = 0.0f;
+            for (unsigned int i = clusters[c].Offset; i < clusters[c].Offset + clusters[c].Count; i += 3)
+            {
+                const glm::vec3& p0 = positions[indices[i]];
+                const glm::vec3& p1 = positions[indices[i + 1]];
+                const glm::vec3& p2 = positions[indices[i + 2]];
+
+                const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                const float area = glm::length(n);
+
+                centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+                normals[c] += n;
+                clusterArea += area;
+            }
+
+            if (clusterArea > 0.0f)
+            {
+                meshCentroid += centroids[c];
+                meshArea += clusterArea;
+                centroids[c] /= clusterArea;
+            }
+
+            const float len = glm::length(normals[c]);
+            if (len > 0.0f)
+                normals[c] /= len;
+        }
+
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        // clusters far out along their own normal occlude the rest of the mesh, draw them first
+        std::vector<float> keys(clusters.size());
+        for (size_t c = 0; c < clusters.size(); c++)
+            keys[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+
+        std::stable_sort(order.begin(), order.end(), [&keys](unsigned int a, unsigned int b) {
+            return keys[a] > keys[b];
+        });
+
+        /// move the triangles in the new cluster order
+        unsigned int spanOffset = clusters[0].Offset;
+        size_t spanCount = 0;
+        for (const auto& cluster : clusters)
+        {
+            spanOffset = std::min(spanOffset, cluster.Offset);
+            spanCount += cluster.Count;
+        }
+
+        std::vector<unsigned int> reordered;
+        reordered.reserve(spanCount);
+        for (unsigned int c : order)
+            reordered.insert(reordered.end(), indices.begin() + clusters[c].Offset, indices.begin() + clusters[c].Offset + clusters[c].Count);
+
+        std::copy(reordered.begin(), reordered.end(), indices.begin() + spanOffset);
+
+        return order;
+    }
+
+    std::vector<unsigned int> OptimizeVertexFetch(std::vector<unsigned int>& indices, size_t numVertices)
+    {
+        std::vector<unsigned int> oldToNew(numVertices, INVALID_INDEX);
+        std::vector<unsigned int> newToOld;
+        newToOld.reserve(numVertices);
+
+        for (unsigned int& index : indices)
+        {
+            unsigned int& remapped = oldToNew[index];
+            if (remapped == INVALID_INDEX)
+            {
+                remapped = static_cast<unsigned int>(newToOld.size());
+                newToOld.push_back(index);
+            }
+            index = remapped;
+        }
+
+        return newToOld;
+    }
+}
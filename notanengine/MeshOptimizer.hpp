@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/*
+    Import time reordering of index and vertex buffers, in the order they
+    should run:
+      1. OptimizeVertexCache: Tipsify (Sander et al. 2007) reorders the
+         triangles of an index range for the GPU's post-transform cache and
+         returns the clusters it naturally splits the range in.
+      2. OptimizeOverdraw: sorts clusters so the ones facing outwards of the
+         mesh are drawn first, which occludes the inner ones early.
+      3. OptimizeVertexFetch: reorders the vertices in the order the index
+         buffer first uses them, so vertex fetches walk memory forward.
+    Everything is deterministic (no threads, no hash ordering), the same
+    input always gives the same bytes.
+*/
+namespace MeshOptimizer
+{
+    // cache size assumed by the reordering and by the statistics
+    constexpr unsigned int DEFAULT_CACHE_SIZE = 16;
+
+    struct IndexRange
+    {
+        unsigned int Offset = 0;    // in indices
+        unsigned int Count = 0;
+    };
+
+    struct VertexCacheStats
+    {
+        size_t Misses = 0;
+        size_t Triangles = 0;
+        size_t Vertices = 0;        // distinct vertices referenced
+
+        // average cache miss ratio: transformed vertices per triangle (0.5 is the ideal for big regular meshes)
+        inline float GetACMR() const noexcept { return Triangles ? float(Misses) / Triangles : 0.0f; }
+        // average transform to vertex ratio: 1.0 means every vertex is transformed once
+        inline float GetATVR() const noexcept { return Vertices ? float(Misses) / Vertices : 0.0f; }
+
+        inline void Add(const VertexCacheStats& other) noexcept
+        {
+            Misses += other.Misses;
+            Triangles += other.Triangles;
+            Vertices += other.Vertices;
+        }
+    };
+
+    // Simulates a FIFO post-transform cache over indices[range]
+    VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, IndexRange range, unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+
+    // Reorders the triangles in indices[range] in place. Returns the clusters of the new order, they tile the range
+    std::vector<IndexRange> OptimizeVertexCache(std::vector<unsigned int>& indices, IndexRange range, unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+
+    // Sorts clusters that tile a contiguous span of indices, moving their triangles along.
+    // Returns the old index of each cluster in the new order
+    std::vector<unsigned int> OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+                                               const std::vector<IndexRange>& clusters);
+
+    // Renumbers vertices by first use in indices and rewrites them. Returns the old vertex of each new one;
+    // vertices no index uses are dropped
+    std::vector<unsigned int> OptimizeVertexFetch(std::vector<unsigned int>& indices, size_t numVertices);
+}
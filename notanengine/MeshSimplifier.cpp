@@ -0,0 +1,347 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+// symmetric 4x4 matrix of the sum of squared distances to a set of planes
+struct Quadric
+{
+    double A2 = 0.0, B2 = 0.0, C2 = 0.0, D2 = 0.0;
+    double AB = 0.0, AC = 0.0, AD = 0.0;
+    double BC = 0.0, BD = 0.0, CD = 0.0;
+
+    static Quadric FromPlane(double a, double b, double c, double d)
+    {
+        Quadric q;
+        q.A2 = a * a; q.B2 = b * b; q.C2 = c * c; q.D2 = d * d;
+        q.AB = a * b; q.AC = a * c; q.AD = a * d;
+        q.BC = b * c; q.BD = b * d; q.CD = c * d;
+        return q;
+    }
+
+    void Add(const Quadric& q)
+    {
+        A2 += q.A2; B2 += q.B2; C2 += q.C2; D2 += q.D2;
+        AB += q.AB; AC += q.AC; AD += q.AD;
+        BC += q.BC; BD += q.BD; CD += q.CD;
+    }
+
+    double Evaluate(const glm::vec3& p) const
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double result = A2 * x * x + B2 * y * y + C2 * z * z
+            + 2.0 * (AB * x * y + AC * x * z + BC * y * z)
+            + 2.0 * (AD * x + BD * y + CD * z)
+            + D2;
+        // rounding can make it slightly negative
+        return std::max(result, 0.0);
+    }
+};
+
+struct PositionKey
+{
+    uint32_t Bits[3];
+
+    bool operator==(const PositionKey& other) const { return std::memcmp(Bits, other.Bits, sizeof(Bits)) == 0; }
+};
+
+struct PositionKeyHash
+{
+    size_t operator()(const PositionKey& key) const
+    {
+        return (size_t(key.Bits[0]) * 73856093u) ^ (size_t(key.Bits[1]) * 19349663u) ^ (size_t(key.Bits[2]) * 83492791u);
+    }
+};
+
+static PositionKey makePositionKey(const glm::vec3& p)
+{
+    PositionKey key;
+    std::memcpy(key.Bits, &p, sizeof(key.Bits));
+    return key;
+}
+
+static uint64_t makeEdgeKey(unsigned int a, unsigned int b)
+{
+    if (a > b)
+        std::swap(a, b);
+    return (uint64_t(a) << 32) | b;
+}
+
+struct Collapse
+{
+    unsigned int From;
+    unsigned int To;
+    double Cost;
+};
+
+namespace MeshSimplifier
+{
+    std::vector<unsigned int> Simplify(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& inputIndices,
+                                       size_t targetIndexCount, float maxError, float& outError)
+    {
+        outError = 0.0f;
+
+        std::vector<unsigned int> indices = inputIndices;
+        const size_t numVertices = positions.size();
+        if (indices.size() <= targetIndexCount || numVertices == 0)
+            return indices;
+
+        /// Vertices sharing a position are attribute seams: the first one found is the canonical vertex of the position
+        std::vector<unsigned int> canonical(numVertices);
+        std::vector<unsigned char> locked(numVertices, 0);
+        {
+            std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstAtPosition;
+            firstAtPosition.reserve(numVertices);
+
+            for (unsigned int v = 0; v < numVertices; v++)
+            {
+                auto [it, inserted] = firstAtPosition.try_emplace(makePositionKey(positions[v]), v);
+                canonical[v] = it->second;
+                if (!inserted)
+                    locked[it->second] = 1;
+            }
+        }
+
+        /// Edges not shared by exactly two triangles are borders (or non-manifold): lock their vertices
+        {
+            std::unordered_map<uint64_t, unsigned int> edgeUses;
+            edgeUses.reserve(indices.size());
+
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (int e = 0; e < 3; e++)
+                    edgeUses[makeEdgeKey(canonical[indices[i + e]], canonical[indices[i + (e + 1) % 3]])]++;
+            }
+
+            for (const auto& [key, uses] : edgeUses)
+            {
+                if (uses == 2)
+                    continue;
+
+                locked[key >> 32] = 1;
+                locked[key & 0xffffffffu] = 1;
+            }
+        }
+
+        // the lock and the quadric of a position live in its canonical vertex
+        for (unsigned int v = 0; v < numVertices; v++)
+            locked[v] = locked[canonical[v]];
+
+        /// Plane quadrics of every triangle, accumulated per position
+        std::vector<Quadric> quadrics(numVertices);
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const glm::vec3& p0 = positions[indices[i]];
+            const glm::vec3& p1 = positions[indices[i + 1]];
+            const glm::vec3& p2 = positions[indices[i + 2]];
+
+            const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            const float len = glm::length(n);
+            if (len <= 0.0f)
+                continue;
+
+            const glm::vec3 normal = n / len;
+            const Quadric q = Quadric::FromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0));
+            for (int c = 0; c < 3; c++)
+                quadrics[canonical[indices[i + c]]].Add(q);
+        }
+
+        const double maxCost = double(maxError) * double(maxError);
+        double doneMaxCost = 0.0;
+
+        std::vector<unsigned int> triangleOffsets(numVertices + 1);
+        std::vector<unsigned int> vertexTriangles;
+        std::vector<Collapse> collapses;
+        std::vector<unsigned int> remap(numVertices);
+        std::vector<unsigned char> touched(numVertices);
+
+        // every pass collapses a set of independent edges, cheapest first
+        while (indices.size() > targetIndexCount)
+        {
+            const size_t numTriangles = indices.size() / 3;
+
+            /// vertex -> triangles adjacency
+            std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+            for (unsigned int index : indices)
+                triangleOffsets[index + 1]++;
+            for (size_t v = 0; v < numVertices; v++)
+                triangleOffsets[v + 1] += triangleOffsets[v];
+
+            vertexTriangles.resize(indices.size());
+            {
+                std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+                for (size_t i = 0; i < indices.size(); i++)
+                    vertexTriangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+            }
+
+            /// candidate collapses
+            collapses.clear();
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    const unsigned int a = indices[i + e];
+                    const unsigned int b = indices[i + (e + 1) % 3];
+
+                    // an interior edge shows up in both of its triangles with opposite winding, keep one of them.
+                    // across a seam the twin uses other vertex indices, so those are kept twice
+                    if (a > b && !locked[a] && !locked[b])
+                        continue;
+
+                    Quadric q = quadrics[canonical[a]];
+                    q.Add(quadrics[canonical[b]]);
+
+                    Collapse best{ 0, 0, -1.0 };
+                    if (!locked[a])
+                        best = { a, b, q.Evaluate(positions[b]) };
+                    if (!locked[b])
+                    {
+                        const double cost = q.Evaluate(positions[a]);
+                        if (best.Cost < 0.0 || cost < best.Cost)
+                            best = { b, a, cost };
+                    }
+
+                    if (best.Cost >= 0.0)
+                        collapses.push_back(best);
+                }
+            }
+
+            if (collapses.empty())
+                break;
+
+            // ties broken by vertex so the result never depends on the sort implementation
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+                if (x.Cost != y.Cost)
+                    return x.Cost < y.Cost;
+                if (x.From != y.From)
+                    return x.From < y.From;
+                return x.To < y.To;
+            });
+
+            for (unsigned int v = 0; v < numVertices; v++)
+                remap[v] = v;
+            std::fill(touched.begin(), touched.end(), 0);
+
+            const size_t trianglesToRemove = (indices.size() - targetIndexCount + 2) / 3;
+            size_t removed = 0;
+            size_t collapsed = 0;
+
+            for (const Collapse& c : collapses)
+            {
+                if (removed >= trianglesToRemove || c.Cost > maxCost)
+                    break;
+
+                if (touched[c.From] || touched[c.To])
+                    continue;
+
+                const glm::vec3& target = positions[c.To];
+
+                // reject the collapse if any of the remaining triangles around From flips or degenerates
+                bool flips = false;
+                size_t sharedTriangles = 0;
+                for (unsigned int t = triangleOffsets[c.From]; t < triangleOffsets[c.From + 1] && !flips; t++)
+                {
+                    const unsigned int* tri = &indices[size_t(vertexTriangles[t]) * 3];
+                    if (tri[0] == c.To || tri[1] == c.To || tri[2] == c.To)
+                    {
+                        sharedTriangles++;
+                        continue;
+                    }
+
+                    glm::vec3 p[3] = { positions[tri[0]], positions[tri[1]], positions[tri[2]] };
+                    const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (tri[k] == c.From)
+                            p[k] = target;
+                    }
+                    const glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+                    flips = glm::dot(before, after) <= 0.0f;
+                }
+
+                if (flips)
+                    continue;
+
+                remap[c.From] = c.To;
+                quadrics[canonical[c.To]].Add(quadrics[canonical[c.From]]);
+
+                // the neighbourhood of From changed, no other collapse of this pass may touch it
+                for (unsigned int t = triangleOffsets[c.From]; t < triangleOffsets[c.From + 1]; t++)
+                {
+                    const unsigned int* tri = &indices[size_t(vertexTriangles[t]) * 3];
+                    touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+                }
+
+                removed += sharedTriangles;
+                collapsed++;
+                doneMaxCost = std::max(doneMaxCost, c.Cost);
+            }
+
+            if (collapsed == 0)
+                break;
+
+            /// apply the collapses and drop the triangles that became degenerate
+            size_t write = 0;
+            for (size_t t = 0; t < numTriangles; t++)
+            {
+                const unsigned int a = remap[indices[t * 3]];
+                const unsigned int b = remap[indices[t * 3 + 1]];
+                const unsigned int c = remap[indices[t * 3 + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+            indices.resize(write);
+        }
+
+        outError = static_cast<float>(std::sqrt(doneMaxCost));
+        return indices;
+    }
+
+    std::vector<LodLevel> BuildLodChain(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                                        const LodChainProperties& props)
+    {
+        std::vector<LodLevel> levels;
+        levels.push_back({ indices, 0.0f });
+
+        float extent = 0.0f;
+        if (!positions.empty())
+        {
+            glm::vec3 minPos = positions[0], maxPos = positions[0];
+            for (const auto& p : positions)
+            {
+                minPos = glm::min(minPos, p);
+                maxPos = glm::max(maxPos, p);
+            }
+            extent = glm::length(maxPos - minPos);
+        }
+
+        const float maxError = props.MaxRelativeError * extent;
+        float error = 0.0f;
+
+        for (unsigned int lod = 1; lod < props.MaxLods; lod++)
+        {
+            const std::vector<unsigned int>& previous = levels.back().Indices;
+            const size_t target = static_cast<size_t>(previous.size() * props.ReductionPerLod) / 3 * 3;
+
+            // errors add up between levels, the chain as a whole must stay under maxError
+            float levelError = 0.0f;
+            std::vector<unsigned int> simplified = Simplify(positions, previous, target, maxError - error, levelError);
+
+            if (simplified.empty() || simplified.size() > previous.size() * props.MinReduction)
+                break;
+
+            error += levelError;
+            levels.push_back({ std::move(simplified), error });
+        }
+
+        return levels;
+    }
+}
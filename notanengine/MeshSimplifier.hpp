@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/*
+    Quadric error metric mesh simplification (Garland & Heckbert).
+    Edges are collapsed onto one of their existing vertices, so every level
+    of detail is just a new index list over the same vertex buffer.
+    Vertices on open borders and on attribute seams (several vertices at the
+    same position, e.g. different normals or UVs) never move, which keeps
+    silhouettes and texture mapping intact.
+    Everything here is plain CPU work and safe to run from the JobSystem.
+*/
+namespace MeshSimplifier
+{
+    struct LodChainProperties
+    {
+        unsigned int MaxLods = 5;           // including the full resolution level
+        float ReductionPerLod = 0.5f;       // target index count of a level relative to the previous one
+        float MinReduction = 0.85f;         // stop when a level keeps more than this fraction of the previous one
+        float MaxRelativeError = 0.05f;     // largest error allowed, relative to the diagonal of the mesh bounds
+    };
+
+    struct LodLevel
+    {
+        std::vector<unsigned int> Indices;
+        float Error = 0.0f;                 // geometric deviation from the full mesh, in model space units
+    };
+
+    // Collapses edges until the index count reaches targetIndexCount or the next collapse would cost
+    // more than maxError. outError gets the error of the most expensive collapse done
+    std::vector<unsigned int> Simplify(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                                       size_t targetIndexCount, float maxError, float& outError);
+
+    // Level 0 is the original index list, every next level is simplified from the previous one
+    std::vector<LodLevel> BuildLodChain(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                                        const LodChainProperties& props = LodChainProperties());
+}
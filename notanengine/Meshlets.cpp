@@ -0,0 +1,207 @@
+#include "Meshlets.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static void computeMeshletBounds(Meshlet& meshlet, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+{
+    const unsigned int begin = meshlet.IndexOffset;
+    const unsigned int end = meshlet.IndexOffset + meshlet.IndexCount;
+
+    /// Sphere around the center of the vertices' box
+    glm::vec3 minPos(std::numeric_limits<float>::max());
+    glm::vec3 maxPos(-std::numeric_limits<float>::max());
+    for (unsigned int i = begin; i < end; i++)
+    {
+        minPos = glm::min(minPos, positions[indices[i]]);
+        maxPos = glm::max(maxPos, positions[indices[i]]);
+    }
+
+    meshlet.Center = 0.5f * (minPos + maxPos);
+    meshlet.Radius = 0.0f;
+    for (unsigned int i = begin; i < end; i++)
+        meshlet.Radius = std::max(meshlet.Radius, glm::length(positions[indices[i]] - meshlet.Center));
+
+    /// Normal cone: axis is the average normal, the angle the widest deviation from it
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.IndexCount / 3);
+
+    glm::vec3 normalSum(0.0f);
+    for (unsigned int i = begin; i < end; i += 3)
+    {
+        const glm::vec3& p0 = positions[indices[i]];
+        const glm::vec3 n = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        const float len = glm::length(n);
+        if (len <= 0.0f)
+            continue;
+
+        normals.push_back(n / len);
+        normalSum += normals.back();
+    }
+
+    meshlet.ConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.ConeCutoff = 1.0f;
+
+    const float sumLength = glm::length(normalSum);
+    if (normals.empty() || sumLength <= 0.0f)
+        return;
+
+    meshlet.ConeAxis = normalSum / sumLength;
+
+    float minDot = 1.0f;
+    for (const auto& n : normals)
+        minDot = std::min(minDot, glm::dot(n, meshlet.ConeAxis));
+
+    // close to a hemisphere the test can't cull anything anyway
+    if (minDot <= 0.1f)
+        return;
+
+    meshlet.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+namespace MeshletBuilder
+{
+    std::vector<Meshlet> Build(const std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices,
+                               size_t indexOffset, size_t indexCount)
+    {
+        std::vector<Meshlet> meshlets;
+
+        const size_t numTriangles = indexCount / 3;
+        const size_t numVertices = positions.size();
+        if (numTriangles == 0 || numVertices == 0)
+            return meshlets;
+
+        const unsigned int* triangles = indices.data() + indexOffset;
+
+        /// vertex -> triangles adjacency
+        std::vector<unsigned int> triangleOffsets(numVertices + 1, 0);
+        for (size_t i = 0; i < numTriangles * 3; i++)
+            triangleOffsets[triangles[i] + 1]++;
+        for (size_t v = 0; v < numVertices; v++)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+
+        std::vector<unsigned int> vertexTriangles(numTriangles * 3);
+        {
+            std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (size_t i = 0; i < numTriangles * 3; i++)
+                vertexTriangles[fill[triangles[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        std::vector<glm::vec3> centroids(numTriangles);
+        for (size_t t = 0; t < numTriangles; t++)
+            centroids[t] = (positions[triangles[t * 3]] + positions[triangles[t * 3 + 1]] + positions[triangles[t * 3 + 2]]) / 3.0f;
+
+        std::vector<unsigned char> emitted(numTriangles, 0);
+        // meshlet the vertex is in + 1, so 0 means none
+        std::vector<unsigned int> vertexMeshlet(numVertices, 0);
+
+        std::vector<unsigned int> order;
+        order.reserve(numTriangles);
+
+        std::vector<unsigned int> candidates;
+        size_t nextSeed = 0;
+
+        while (order.size() < numTriangles)
+        {
+            while (emitted[nextSeed])
+                nextSeed++;
+
+            const unsigned int meshletTag = static_cast<unsigned int>(meshlets.size()) + 1;
+            Meshlet meshlet;
+            meshlet.IndexOffset = static_cast<unsigned int>(indexOffset + order.size() * 3);
+
+            unsigned int vertexCount = 0;
+            unsigned int triangleCount = 0;
+            glm::vec3 centroidSum(0.0f);
+
+            candidates.clear();
+            unsigned int current = static_cast<unsigned int>(nextSeed);
+
+            // grow the meshlet from its seed through shared vertices
+            while (true)
+            {
+                emitted[current] = 1;
+                order.push_back(current);
+                triangleCount++;
+                centroidSum += centroids[current];
+
+                for (int c = 0; c < 3; c++)
+                {
+                    const unsigned int v = triangles[current * 3 + c];
+                    if (vertexMeshlet[v] == meshletTag)
+                        continue;
+
+                    vertexMeshlet[v] = meshletTag;
+                    vertexCount++;
+
+                    for (unsigned int t = triangleOffsets[v]; t < triangleOffsets[v + 1]; t++)
+                    {
+                        if (!emitted[vertexTriangles[t]])
+                            candidates.push_back(vertexTriangles[t]);
+                    }
+                }
+
+                if (triangleCount == Meshlet::MAX_TRIANGLES)
+                    break;
+
+                // fewest new vertices first, then closest to the meshlet's centroid
+                const glm::vec3 centroid = centroidSum / static_cast<float>(triangleCount);
+                int bestIndex = -1;
+                unsigned int bestNewVertices = 4;
+                float bestDistance = std::numeric_limits<float>::max();
+
+                for (size_t k = 0; k < candidates.size(); k++)
+                {
+                    const unsigned int t = candidates[k];
+                    if (emitted[t])
+                    {
+                        candidates[k--] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+
+                    unsigned int newVertices = 0;
+                    for (int c = 0; c < 3; c++)
+                        newVertices += (vertexMeshlet[triangles[t * 3 + c]] != meshletTag);
+
+                    if (vertexCount + newVertices > Meshlet::MAX_VERTICES)
+                        continue;
+
+                    const glm::vec3 d = centroids[t] - centroid;
+                    const float distance = glm::dot(d, d);
+                    if (newVertices < bestNewVertices || (newVertices == bestNewVertices && distance < bestDistance))
+                    {
+                        bestIndex = static_cast<int>(k);
+                        bestNewVertices = newVertices;
+                        bestDistance = distance;
+                    }
+                }
+
+                if (bestIndex < 0)
+                    break;
+
+                current = candidates[bestIndex];
+            }
+
+            meshlet.IndexCount = triangleCount * 3;
+            meshlets.push_back(meshlet);
+        }
+
+        /// write the triangles back in meshlet order
+        std::vector<unsigned int> reordered;
+        reordered.reserve(numTriangles * 3);
+        for (unsigned int t : order)
+        {
+            reordered.push_back(triangles[t * 3]);
+            reordered.push_back(triangles[t * 3 + 1]);
+            reordered.push_back(triangles[t * 3 + 2]);
+        }
+        std::copy(reordered.begin(), reordered.end(), indices.begin() + indexOffset);
+
+        for (auto& meshlet : meshlets)
+            computeMeshletBounds(meshlet, positions, indices);
+
+        return meshlets;
+    }
+}
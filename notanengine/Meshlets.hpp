@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/*
+    Small clusters of triangles (at most MAX_VERTICES vertices and
+    MAX_TRIANGLES triangles) that are culled on their own, so a big submesh
+    that's mostly off screen only draws the part that's visible.
+    A meshlet is a range of the element buffer, the builder reorders the
+    triangles so every meshlet is contiguous.
+*/
+struct Meshlet
+{
+    static constexpr unsigned int MAX_VERTICES = 64;
+    static constexpr unsigned int MAX_TRIANGLES = 124;
+
+    unsigned int IndexOffset = 0;   // in indices, not bytes
+    unsigned int IndexCount = 0;
+
+    // bounding sphere, model space
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 0.0f;
+
+    // every triangle normal is within the cone around ConeAxis.
+    // ConeCutoff is the sine of the cone's half angle, 1 when the cone is too wide to ever cull
+    glm::vec3 ConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    float ConeCutoff = 1.0f;
+
+    // true when every triangle faces away from a camera at cameraPosition (both in model space)
+    inline bool IsBackfacing(const glm::vec3& cameraPosition) const noexcept
+    {
+        const glm::vec3 toCenter = Center - cameraPosition;
+        return glm::dot(toCenter, ConeAxis) >= ConeCutoff * glm::length(toCenter) + Radius;
+    }
+};
+
+namespace MeshletBuilder
+{
+    // Splits the triangles in indices[indexOffset, indexOffset + indexCount) in meshlets, reordering them in place.
+    // Triangles are grown from neighbours sharing the most vertices, so meshlets stay compact
+    std::vector<Meshlet> Build(const std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices,
+                               size_t indexOffset, size_t indexCount);
+}
@@ -0,0 +1,214 @@
+#include "MipChain.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.hpp"
+#include "Simd.hpp"
+
+// 4096 steps on the linear side keep the darkest sRGB values apart
+constexpr int LINEAR_TABLE_SIZE = 4096;
+
+struct ConversionTables
+{
+    float SrgbToLinear[256];
+    unsigned char LinearToSrgb[LINEAR_TABLE_SIZE];
+
+    ConversionTables()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            const float c = i / 255.0f;
+            SrgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        for (int i = 0; i < LINEAR_TABLE_SIZE; i++)
+        {
+            const float l = i / float(LINEAR_TABLE_SIZE - 1);
+            const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            LinearToSrgb[i] = static_cast<unsigned char>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+        }
+    }
+};
+
+static const ConversionTables& getTables()
+{
+    static const ConversionTables tables;
+    return tables;
+}
+
+static int wrap(int i, int size)
+{
+    return ((i % size) + size) % size;
+}
+
+// One row as 4 floats per texel (missing channels 0), colour channels in linear space
+static void loadRow(const unsigned char* row, int width, int channels, int colorChannels, float* out)
+{
+    const ConversionTables& tables = getTables();
+    for (int x = 0; x < width; x++)
+    {
+        const unsigned char* src = row + size_t(x) * channels;
+        float* dst = out + size_t(x) * 4;
+        for (int c = 0; c < 4; c++)
+        {
+            if (c >= channels)
+                dst[c] = 0.0f;
+            else
+                dst[c] = c < colorChannels ? tables.SrgbToLinear[src[c]] : src[c] * (1.0f / 255.0f);
+        }
+    }
+}
+
+static void storeTexel(const float texel[4], int channels, int colorChannels, unsigned char* out)
+{
+    const ConversionTables& tables = getTables();
+    for (int c = 0; c < channels; c++)
+    {
+        const float v = std::clamp(texel[c], 0.0f, 1.0f);
+        out[c] = c < colorChannels
+            ? tables.LinearToSrgb[static_cast<int>(v * (LINEAR_TABLE_SIZE - 1) + 0.5f)]
+            : static_cast<unsigned char>(v * 255.0f + 0.5f);
+    }
+}
+
+// Half the size, filtered by (1 3 3 1) / 8 vertically then horizontally
+static MipChain::MipLevel downsample(const unsigned char* pixels, int width, int height, int channels, int colorChannels)
+{
+    MipChain::MipLevel level;
+    level.Width = std::max(1, width / 2);
+    level.Height = std::max(1, height / 2);
+    level.Pixels.resize(size_t(level.Width) * level.Height * channels);
+
+    const size_t rowSize = size_t(width) * channels;
+    JobSystem::ParallelFor(level.Height, 8, [&](size_t begin, size_t end) {
+        std::vector<float> rows[4];
+        for (auto& row : rows)
+            row.resize(size_t(width) * 4);
+        std::vector<float> column(size_t(width) * 4);
+
+        for (size_t y = begin; y < end; y++)
+        {
+            for (int tap = 0; tap < 4; tap++)
+            {
+                const int sourceY = wrap(static_cast<int>(y) * 2 - 1 + tap, height);
+                loadRow(pixels + sourceY * rowSize, width, channels, colorChannels, rows[tap].data());
+            }
+
+            /// vertical pass, a texel (4 floats) at a time
+#if NE_SIMD_SSE
+            const __m128 three = _mm_set1_ps(3.0f);
+            for (size_t i = 0; i < column.size(); i += 4)
+            {
+                const __m128 outer = _mm_add_ps(_mm_loadu_ps(&rows[0][i]), _mm_loadu_ps(&rows[3][i]));
+                const __m128 inner = _mm_add_ps(_mm_loadu_ps(&rows[1][i]), _mm_loadu_ps(&rows[2][i]));
+                _mm_storeu_ps(&column[i], _mm_add_ps(outer, _mm_mul_ps(inner, three)));
+            }
+#else
+            for (size_t i = 0; i < column.size(); i++)
+                column[i] = rows[0][i] + rows[3][i] + 3.0f * (rows[1][i] + rows[2][i]);
+#endif
+
+            /// horizontal pass, both weights normalized at the end
+            unsigned char* out = level.Pixels.data() + y * level.Width * channels;
+            for (int x = 0; x < level.Width; x++)
+            {
+                const float* t0 = &column[size_t(wrap(x * 2 - 1, width)) * 4];
+                const float* t1 = &column[size_t(wrap(x * 2, width)) * 4];
+                const float* t2 = &column[size_t(wrap(x * 2 + 1, width)) * 4];
+                const float* t3 = &column[size_t(wrap(x * 2 + 2, width)) * 4];
+
+                alignas(16) float texel[4];
+#if NE_SIMD_SSE
+                const __m128 outer = _mm_add_ps(_mm_loadu_ps(t0), _mm_loadu_ps(t3));
+                const __m128 inner = _mm_add_ps(_mm_loadu_ps(t1), _mm_loadu_ps(t2));
+                _mm_store_ps(texel, _mm_mul_ps(_mm_add_ps(outer, _mm_mul_ps(inner, three)), _mm_set1_ps(1.0f / 64.0f)));
+#else
+                for (int c = 0; c < 4; c++)
+                    texel[c] = (t0[c] + t3[c] + 3.0f * (t1[c] + t2[c])) * (1.0f / 64.0f);
+#endif
+                storeTexel(texel, channels, colorChannels, out + size_t(x) * channels);
+            }
+        }
+    });
+
+    return level;
+}
+
+// Scales the level's alpha so its coverage matches the target
+static void preserveAlphaCoverage(MipChain::MipLevel& level, float targetCoverage, float cutoff)
+{
+    // coverage only grows with the scale, bisect it
+    float low = 0.0f, high = 64.0f, scale = 1.0f;
+    for (int iteration = 0; iteration < 16; iteration++)
+    {
+        scale = 0.5f * (low + high);
+        const float coverage = MipChain::ComputeAlphaCoverage(level.Pixels.data(), level.Width, level.Height, cutoff, scale);
+        if (coverage < targetCoverage)
+            low = scale;
+        else
+            high = scale;
+    }
+    scale = high;
+
+    const size_t numPixels = size_t(level.Width) * level.Height;
+    for (size_t i = 0; i < numPixels; i++)
+    {
+        unsigned char& alpha = level.Pixels[i * 4 + 3];
+        alpha = static_cast<unsigned char>(std::min(255.0f, alpha * scale + 0.5f));
+    }
+}
+
+namespace MipChain
+{
+    std::vector<MipLevel> Build(const unsigned char* pixels, int width, int height, int channels, const MipChainProperties& props)
+    {
+        std::vector<MipLevel> levels;
+        if (!pixels || width <= 0 || height <= 0)
+            return levels;
+
+        const int colorChannels = (props.SRGB && channels >= 3) ? 3 : 0;
+
+        // alpha that's all opaque or all cut has no coverage to keep
+        float coverage = 0.0f;
+        bool keepCoverage = false;
+        if (props.PreserveAlphaCoverage && channels == 4)
+        {
+            coverage = ComputeAlphaCoverage(pixels, width, height, props.AlphaCutoff);
+            keepCoverage = coverage > 0.0f && coverage < 1.0f;
+        }
+
+        const unsigned char* previous = pixels;
+        int previousWidth = width, previousHeight = height;
+        while (previousWidth > 1 || previousHeight > 1)
+        {
+            MipLevel level = downsample(previous, previousWidth, previousHeight, channels, colorChannels);
+            if (keepCoverage)
+                preserveAlphaCoverage(level, coverage, props.AlphaCutoff);
+
+            levels.push_back(std::move(level));
+            previous = levels.back().Pixels.data();
+            previousWidth = levels.back().Width;
+            previousHeight = levels.back().Height;
+        }
+
+        return levels;
+    }
+
+    float ComputeAlphaCoverage(const unsigned char* pixels, int width, int height, float cutoff, float alphaScale)
+    {
+        const size_t numPixels = size_t(width) * height;
+        if (numPixels == 0)
+            return 0.0f;
+
+        // alpha * alphaScale / 255 >= cutoff, without the division per texel
+        const float threshold = cutoff * 255.0f / std::max(alphaScale, 1e-6f);
+        size_t passing = 0;
+        for (size_t i = 0; i < numPixels; i++)
+        {
+            if (pixels[i * 4 + 3] >= threshold)
+                passing++;
+        }
+        return float(passing) / float(numPixels);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+/*
+    Mip levels computed on the CPU when a texture is imported, instead of
+    glGenerateMipmap at load (a driver stall, with whatever filter the driver
+    picks).
+    Each level halves the previous one with a separable 4-tap filter
+    (1 3 3 1) / 8 per axis, wrapping around the edges like the textures'
+    GL_REPEAT does, every channel of a texel at once with SSE.
+    Colour is filtered in linear space: averaging sRGB values darkens the
+    small mips.
+    Alpha-tested textures (Sponza's foliage) lose coverage as the alpha gets
+    averaged away from the cutoff, so their alpha is rescaled per level to
+    keep the fraction of texels passing the test of level 0.
+*/
+namespace MipChain
+{
+    // entity_lighting.frag discards texels with less alpha than this
+    constexpr float DEFAULT_ALPHA_CUTOFF = 0.5f;
+
+    struct MipChainProperties
+    {
+        bool SRGB = true;                     // the first three channels of RGB(A) images are sRGB colour
+        bool PreserveAlphaCoverage = true;    // RGBA images whose alpha isn't all opaque
+        float AlphaCutoff = DEFAULT_ALPHA_CUTOFF;
+    };
+
+    struct MipLevel
+    {
+        int Width = 0;
+        int Height = 0;
+        std::vector<unsigned char> Pixels;
+    };
+
+    // Levels 1 and down to 1x1, level 0 being the image itself. Blocks of rows go on the JobSystem, safe on any thread
+    std::vector<MipLevel> Build(const unsigned char* pixels, int width, int height, int channels, const MipChainProperties& props = {});
+
+    // Fraction of the texels of an RGBA image whose alpha, times alphaScale, passes the cutoff
+    float ComputeAlphaCoverage(const unsigned char* pixels, int width, int height, float cutoff, float alphaScale = 1.0f);
+}
@@ -3,22 +3,211 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.hpp"
+#include "TextureStreamer.hpp"
+
+static int s_viewportHeight = 1;
+static float s_lodErrorThreshold = 1.0f;
+static Render::GeometryStats s_geometryStats;
+static Render::MeshletCullingSettings s_meshletCulling;
+
+// meshlets tested per job
+constexpr size_t MESHLET_CULL_BATCH = 128;
+
+// Tells the TextureStreamer how fine the material's textures are sampled on meshData: UV range per world unit
+// (from the mesh's UV density) and pixels per world unit at the closest point of its bounds
+static void requestTextureLevels(const MeshData& meshData, const glm::mat4& model, const glm::vec3& cameraPosition, const glm::mat4& projection)
+{
+    if (!meshData.Bounds.IsValid())
+	return;
+
+    const AABB worldBounds = meshData.Bounds.Transformed(model);
+    const glm::vec3 closest = glm::clamp(cameraPosition, worldBounds.Min, worldBounds.Max);
+    // inside the bounds asks for the full image anyway
+    const float distance = std::max(glm::length(closest - cameraPosition), 1e-3f);
+    const float pixelsPerUnit = projection[1][1] * 0.5f * s_viewportHeight / distance;
+    const float priority = glm::length(worldBounds.GetExtents()) * pixelsPerUnit;
+
+    const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+    const float uvPerUnit = meshData.TexelDensity * meshData.Mat.TilingFactor / std::max(scale, 1e-6f);
+
+    for (const auto& texture : meshData.Mat.DiffuseMaps)
+	TextureStreamer::RequestLevel(texture, uvPerUnit, pixelsPerUnit, priority);
+    for (const auto& texture : meshData.Mat.SpecularMaps)
+	TextureStreamer::RequestLevel(texture, uvPerUnit, pixelsPerUnit, priority);
+}
+
 namespace Render
 {
-    void DrawMeshData(MeshData& meshData)
+    void SetViewportHeight(int height)
+    {
+	s_viewportHeight = std::max(height, 1);
+    }
+
+    void SetLodErrorThreshold(float pixels)
+    {
+	s_lodErrorThreshold = pixels;
+    }
+
+    float GetLodErrorThreshold()
+    {
+	return s_lodErrorThreshold;
+    }
+
+    const GeometryStats& GetGeometryStats()
+    {
+	return s_geometryStats;
+    }
+
+    void ResetGeometryStats()
+    {
+	s_geometryStats = GeometryStats();
+    }
+
+    MeshletCullingSettings& GetMeshletCullingSettingsRef()
+    {
+	return s_meshletCulling;
+    }
+
+    unsigned int SelectLod(const MeshData& meshData, const glm::mat4& model, const glm::vec3& cameraPosition, const glm::mat4& projection)
+    {
+	if (meshData.Lods.size() < 2 || !meshData.Bounds.IsValid())
+	    return 0;
+
+	// errors are in model space, the largest axis scale brings them to world space
+	const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+
+	const glm::vec3 center = glm::vec3(model * glm::vec4(meshData.Bounds.GetCenter(), 1.0f));
+	const float radius = glm::length(meshData.Bounds.GetExtents()) * scale;
+	const float distance = glm::length(center - cameraPosition) - radius;
+	if (distance <= 0.0f)
+	    return 0;
+
+	// world units -> pixels at that distance
+	const float pixelsPerUnit = projection[1][1] * 0.5f * s_viewportHeight / distance;
+
+	unsigned int lod = 0;
+	while (lod + 1 < meshData.Lods.size() && meshData.Lods[lod + 1].Error * scale * pixelsPerUnit <= s_lodErrorThreshold)
+	    lod++;
+
+	return lod;
+    }
+
+    void SetVertexFormatUniforms(const Shader& shader, const MeshData& meshData)
+    {
+	shader.SetBool("u_quantizedVertex", meshData.QuantizedVertices);
+	if (meshData.QuantizedVertices)
+	{
+	    shader.SetVec3("u_posScale", meshData.PositionScale);
+	    shader.SetVec3("u_posBias", meshData.PositionBias);
+	}
+    }
+
+    void DrawMeshData(const MeshData& meshData)
     {
 	glBindVertexArray(meshData.VAO);
 	
 	if (meshData.UseIndexedDrawing)
-	    glDrawElements(GL_TRIANGLES, meshData.NumIndices, GL_UNSIGNED_INT, 0);
+	    glDrawElements(GL_TRIANGLES, meshData.NumIndices, meshData.IndexType, 0);
 
 	else
 	    glDrawArrays(GL_TRIANGLES, 0, meshData.NumIndices);
     }
 
+    void DrawMeshData(const MeshData& meshData, unsigned int lod)
+    {
+	glBindVertexArray(meshData.VAO);
+
+	s_geometryStats.TrianglesAtLod0 += meshData.NumIndices / 3;
+
+	if (!meshData.UseIndexedDrawing || lod >= meshData.Lods.size())
+	{
+	    if (meshData.UseIndexedDrawing)
+		glDrawElements(GL_TRIANGLES, meshData.NumIndices, meshData.IndexType, 0);
+	    else
+		glDrawArrays(GL_TRIANGLES, 0, meshData.NumIndices);
+
+	    s_geometryStats.TrianglesDrawn += meshData.NumIndices / 3;
+	    return;
+	}
+
+	const MeshLod& range = meshData.Lods[lod];
+	glDrawElements(GL_TRIANGLES, range.IndexCount, meshData.IndexType, (void*)(range.IndexOffset * meshData.GetIndexSize()));
+
+	s_geometryStats.TrianglesDrawn += range.IndexCount / 3;
+    }
+
+    void DrawMeshletsCulled(const MeshData& meshData, const glm::mat4& model, const glm::vec3& cameraPosition, const glm::mat4& viewProjection)
+    {
+	static std::vector<unsigned char> s_visible;
+	static std::vector<GLsizei> s_counts;
+	static std::vector<const void*> s_offsets;
+
+	const std::vector<Meshlet>& meshlets = meshData.Meshlets;
+
+	// planes of viewProjection * model and the camera in model space, so the meshlets are tested as they are stored
+	const Frustum frustum = Frustum::FromMatrix(viewProjection * model);
+	const glm::vec3 localCamera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+
+	// normal cones only survive rotations and uniform scales
+	const float scaleX = glm::length(glm::vec3(model[0]));
+	const bool uniformScale = std::abs(scaleX - glm::length(glm::vec3(model[1]))) <= 1e-3f * scaleX
+	    && std::abs(scaleX - glm::length(glm::vec3(model[2]))) <= 1e-3f * scaleX;
+	const bool backface = s_meshletCulling.Backface && uniformScale;
+
+	s_visible.resize(meshlets.size());
+	JobSystem::ParallelFor(meshlets.size(), MESHLET_CULL_BATCH, [&](size_t begin, size_t end) {
+	    for (size_t i = begin; i < end; i++)
+	    {
+		const Meshlet& meshlet = meshlets[i];
+		s_visible[i] = frustum.Intersects(meshlet.Center, meshlet.Radius) && !(backface && meshlet.IsBackfacing(localCamera));
+	    }
+	});
+
+	// meshlets are contiguous in the element buffer, so neighbouring visible ones merge in one range
+	s_counts.clear();
+	s_offsets.clear();
+	unsigned int trianglesDrawn = 0;
+	unsigned int culled = 0;
+
+	for (size_t i = 0; i < meshlets.size(); i++)
+	{
+	    const Meshlet& meshlet = meshlets[i];
+	    if (!s_visible[i])
+	    {
+		culled++;
+		continue;
+	    }
+
+	    trianglesDrawn += meshlet.IndexCount / 3;
+	    if (i > 0 && s_visible[i - 1])
+		s_counts.back() += meshlet.IndexCount;
+	    else
+	    {
+		s_counts.push_back(meshlet.IndexCount);
+		s_offsets.push_back((const void*)(size_t(meshlet.IndexOffset) * meshData.GetIndexSize()));
+	    }
+	}
+
+	s_geometryStats.TrianglesAtLod0 += meshData.NumIndices / 3;
+	s_geometryStats.TrianglesDrawn += trianglesDrawn;
+	s_geometryStats.MeshletsTested += static_cast<unsigned int>(meshlets.size());
+	s_geometryStats.MeshletsCulled += culled;
+	s_geometryStats.MeshletRanges += static_cast<unsigned int>(s_counts.size());
+
+	if (s_counts.empty())
+	    return;
+
+	glBindVertexArray(meshData.VAO);
+	glMultiDrawElements(GL_TRIANGLES, s_counts.data(), meshData.IndexType, s_offsets.data(), static_cast<GLsizei>(s_counts.size()));
+    }
+
     void DrawStaticMesh(StaticMesh& mesh)
     {
-        for (auto& meshData : mesh.GetSubMeshesRef())
+        for (const auto& meshData : mesh.GetSubMeshes())
         {
 	    DrawMeshData(meshData);
         }
@@ -26,7 +215,7 @@ namespace Render
 
     void DrawOutlineStaticMesh(StaticMesh& mesh, const Shader& defaultShader, const Shader& outlineShader, const glm::vec3& outlineColor)
     {
-	for (auto& meshData : mesh.GetSubMeshesRef())
+	for (const auto& meshData : mesh.GetSubMeshes())
 	{
 	    glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 	    // Draw mesh without stencing
@@ -35,6 +224,7 @@ namespace Render
 	    glStencilMask(0xFF);
 
 	    defaultShader.Use();
+	    SetVertexFormatUniforms(defaultShader, meshData);
 	    DrawMeshData(meshData);
 
 	    // Draw outline
@@ -46,6 +236,7 @@ namespace Render
 
 	    outlineShader.Use();
 	    outlineShader.SetVec3("u_outlineColor", outlineColor);
+	    SetVertexFormatUniforms(outlineShader, meshData);
 	    DrawMeshData(meshData);
 
 	    // return to default stencil
@@ -56,69 +247,207 @@ namespace Render
 	}
     }
 
-    void DrawOutlineEntity(Entity& entity, const Shader& defaultShader, const Shader& outlineShader, const glm::vec3& outlineColor, const Camera& camera, const glm::mat4& projection, float outlineFactor)
+    void DrawOutlineEntity(Scene& scene, EntityId entity, const Shader& defaultShader, const Shader& outlineShader, const glm::vec3& outlineColor, const Camera& camera, const glm::mat4& projection, float outlineFactor)
     {
-	if (!entity.IsVisible())
+	MeshComponent* mesh = scene.Get<MeshComponent>(entity);
+	const WorldTransformComponent* world = scene.Get<WorldTransformComponent>(entity);
+	if (!mesh || !world || !mesh->Visible)
 	    return;
 
-	DrawEntity(entity, defaultShader, camera, projection);
+	DrawEntity(scene, entity, camera, projection);
 
 	defaultShader.Use();
-	defaultShader.SetMat4("u_model", entity.Transform.GetTransformMatrix());
+	defaultShader.SetMat4("u_model", world->Matrix);
 	defaultShader.SetMat4("u_view", camera.GetLookAtMatrix());
 	defaultShader.SetMat4("u_projection", projection); 
 	
 	outlineShader.Use();
-	const glm::mat4 scaledModel = glm::scale(entity.Transform.GetTransformMatrix(), glm::vec3(outlineFactor));
+	const glm::mat4 scaledModel = glm::scale(world->Matrix, glm::vec3(outlineFactor));
 	outlineShader.SetMat4("u_model", scaledModel);
 	outlineShader.SetMat4("u_view", camera.GetLookAtMatrix());
 	outlineShader.SetMat4("u_projection", projection);
 
-	DrawOutlineStaticMesh(entity.GetMeshRef(), defaultShader, outlineShader, outlineColor);
+	DrawOutlineStaticMesh(mesh->Mesh, defaultShader, outlineShader, outlineColor);
     }
 
-    void DrawEntity(Entity& entity, const Shader& shader, const Camera& camera, const glm::mat4& projection)
+    // The submeshes of one entity, LOD, meshlet culling and texture streaming requests included.
+    // lods: by submesh, chosen beforehand (SelectLods), or nullptr to choose them here
+    static void drawMesh(const MeshComponent& mesh, const glm::mat4& model, const Camera& camera, const glm::mat4& projection,
+			 const std::vector<unsigned char>* lods = nullptr)
     {
-	if (!entity.IsVisible())
-	    return;
-
+	const Shader& shader = *mesh.DrawShader;
 	shader.Use();
 
-        shader.SetMat4("u_model", entity.Transform.GetTransformMatrix());
+        shader.SetMat4("u_model", model);
         shader.SetMat4("u_view", camera.GetLookAtMatrix());
         shader.SetMat4("u_projection", projection);
 
-        for (auto& meshData : entity.GetMeshRef().GetSubMeshesRef())
-        {
-            shader.SetBool("u_useMaterial", meshData.UseMaterial);
+        const glm::vec3 cameraPosition = camera.Transform.GetPosition();
+        const glm::mat4 viewProjection = projection * camera.GetLookAtMatrix();
+
+        const std::vector<MeshData>& subMeshes = mesh.Mesh.GetSubMeshes();
+        if (lods && lods->size() != subMeshes.size())
+            lods = nullptr;
 
-            if (meshData.UseMaterial && meshData.Mat.DiffuseMaps.empty())
+        for (size_t i = 0; i < subMeshes.size(); i++)
+        {
+            const MeshData& meshData = subMeshes[i];
+            // the submeshes may be shared with other entities, so a material without textures is skipped here rather than turned off
+            const bool useMaterial = meshData.UseMaterial && !meshData.Mat.DiffuseMaps.empty();
+            shader.SetBool("u_useMaterial", useMaterial);
+            if (useMaterial)
             {
-                shader.SetBool("u_useMaterial", false);
-                meshData.UseMaterial = false;
+                shader.SetMaterial("u_material", meshData.Mat);
+                // only what's in view, the rest ages out of the streamer's LRU
+                if (!meshData.Bounds.IsValid() || Frustum::FromMatrix(viewProjection * model).Intersects(meshData.Bounds))
+                    requestTextureLevels(meshData, model, cameraPosition, projection);
             }
 
-            else if (meshData.UseMaterial)
-                shader.SetMaterial("u_material", meshData.Mat);
+	    SetVertexFormatUniforms(shader, meshData);
 
-	    DrawMeshData(meshData);
+	    const unsigned int lod = lods ? (*lods)[i] : SelectLod(meshData, model, cameraPosition, projection);
+	    if (lod == 0 && s_meshletCulling.Enabled && !meshData.Meshlets.empty())
+		DrawMeshletsCulled(meshData, model, cameraPosition, viewProjection);
+	    else
+		DrawMeshData(meshData, lod);
         }
     }
 
-    void UpdateAndDrawEntity(Entity &entity, const Shader &shader, float deltaTime, const Camera &camera, const glm::mat4 &projection)
+    void DrawEntity(Scene& scene, EntityId entity, const Camera& camera, const glm::mat4& projection)
     {
-        entity.Update(deltaTime);
-	DrawEntity(entity, shader, camera, projection); 
+	const MeshComponent* mesh = scene.Get<MeshComponent>(entity);
+	const WorldTransformComponent* world = scene.Get<WorldTransformComponent>(entity);
+	if (!mesh || !world || !mesh->Visible || !mesh->DrawShader)
+	    return;
+
+	drawMesh(*mesh, world->Matrix, camera, projection);
     }
 
-    void UpdateAndDrawEntityMap(const EntityRenderMap &entities, float deltaTime, const Camera &camera, const glm::mat4 &projection)
+    void SelectLods(Scene& scene, const Camera& camera, const glm::mat4& projection)
     {
-        for (auto& [name, tupleEntityShader] : entities)
-        {
-            Entity& entity = std::get<0>(tupleEntityShader);
-            const Shader& shader = std::get<1>(tupleEntityShader);
+	const Frustum frustum = Frustum::FromMatrix(projection * camera.GetLookAtMatrix());
+	const glm::vec3 cameraPosition = camera.Transform.GetPosition();
 
-            UpdateAndDrawEntity(entity, shader, deltaTime, camera, projection);
-        }
+	scene.GetWorld().ParallelForEachChunk<const MeshComponent, const WorldTransformComponent, const WorldBoundsComponent, VisibilityComponent>(
+	    [&](size_t count, const EntityId*, const MeshComponent* meshes, const WorldTransformComponent* worlds, const WorldBoundsComponent* bounds,
+		VisibilityComponent* visibilities) {
+		for (size_t i = 0; i < count; i++)
+		{
+		    VisibilityComponent& visibility = visibilities[i];
+		    // no bounds (a model still loading, meshes without them) can't be culled
+		    visibility.InView = meshes[i].Visible && meshes[i].DrawShader
+			&& (!bounds[i].Bounds.IsValid() || frustum.Intersects(bounds[i].Bounds));
+		    if (!visibility.InView)
+			continue;
+
+		    const std::vector<MeshData>& subMeshes = meshes[i].Mesh.GetSubMeshes();
+		    visibility.Lods.resize(subMeshes.size());
+		    for (size_t m = 0; m < subMeshes.size(); m++)
+			visibility.Lods[m] = static_cast<unsigned char>(SelectLod(subMeshes[m], worlds[i].Matrix, cameraPosition, projection));
+		}
+	    });
+    }
+
+    void DrawScene(Scene& scene, const Camera& camera, const glm::mat4& projection)
+    {
+	scene.GetWorld().ForEachChunk<const MeshComponent, const WorldTransformComponent, const VisibilityComponent>(
+	    [&](size_t count, const EntityId*, const MeshComponent* meshes, const WorldTransformComponent* worlds, const VisibilityComponent* visibilities) {
+		for (size_t i = 0; i < count; i++)
+		{
+		    if (!meshes[i].Visible || !meshes[i].DrawShader || !visibilities[i].InView)
+			continue;
+
+		    drawMesh(meshes[i], worlds[i].Matrix, camera, projection, &visibilities[i].Lods);
+		}
+	    });
+    }
+
+    unsigned int DrawShadowCasters(Scene& scene, const Shader& depthShader, const glm::mat4& lightSpace, unsigned int& outCulled)
+    {
+	unsigned int drawn = 0;
+	outCulled = 0;
+
+	depthShader.Use();
+	depthShader.SetMat4("u_lightSpace", lightSpace);
+
+	scene.GetWorld().ForEach<const MeshComponent, const WorldTransformComponent>(
+	    [&](EntityId, const MeshComponent& mesh, const WorldTransformComponent& world) {
+		if (!mesh.Visible)
+		    return;
+
+		const glm::mat4& model = world.Matrix;
+		depthShader.SetMat4("u_model", model);
+
+		// planes of lightSpace * model are in model space, so the mesh bounds can be tested directly
+		const Frustum frustum = Frustum::FromMatrix(lightSpace * model);
+
+		for (const auto& meshData : mesh.Mesh.GetSubMeshes())
+		{
+		    if (meshData.Bounds.IsValid() && !frustum.Intersects(meshData.Bounds))
+		    {
+			outCulled++;
+			continue;
+		    }
+
+		    glBindVertexArray(meshData.ShadowVAO);
+		    if (meshData.UseIndexedDrawing)
+			glDrawElements(GL_TRIANGLES, meshData.NumIndices, meshData.IndexType, 0);
+		    else
+			glDrawArrays(GL_TRIANGLES, 0, meshData.NumIndices);
+
+		    drawn++;
+		}
+	    });
+
+	return drawn;
+    }
+
+    unsigned int DrawOmniShadowCasters(Scene& scene, const Shader& depthShader, const glm::vec3& lightPos, float radius, unsigned int& outCulled)
+    {
+	unsigned int drawn = 0;
+	outCulled = 0;
+
+	depthShader.Use();
+
+	// only the entities the spatial index finds in the light's sphere, the others aren't counted as culled
+	static std::vector<EntityId> s_casters;
+	s_casters.clear();
+	scene.GetSpatialIndex().QueryRadius(lightPos, radius, s_casters);
+
+	for (EntityId entity : s_casters)
+	{
+	    const MeshComponent* mesh = scene.Get<MeshComponent>(entity);
+	    const WorldTransformComponent* world = scene.Get<WorldTransformComponent>(entity);
+	    if (!mesh || !world || !mesh->Visible)
+		continue;
+
+	    const glm::mat4& model = world->Matrix;
+	    depthShader.SetMat4("u_model", model);
+
+	    for (const auto& meshData : mesh->Mesh.GetSubMeshes())
+	    {
+		if (meshData.Bounds.IsValid())
+		{
+		    const AABB worldBounds = meshData.Bounds.Transformed(model);
+		    const glm::vec3 closest = glm::clamp(lightPos, worldBounds.Min, worldBounds.Max);
+		    const glm::vec3 d = closest - lightPos;
+		    if (glm::dot(d, d) > radius * radius)
+		    {
+			outCulled++;
+			continue;
+		    }
+		}
+
+		glBindVertexArray(meshData.ShadowVAO);
+		if (meshData.UseIndexedDrawing)
+		    glDrawElements(GL_TRIANGLES, meshData.NumIndices, meshData.IndexType, 0);
+		else
+		    glDrawArrays(GL_TRIANGLES, 0, meshData.NumIndices);
+
+		drawn++;
+	    }
+	}
+
+	return drawn;
     }
 }
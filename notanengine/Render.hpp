@@ -3,25 +3,74 @@
 #include <unordered_map>
 #include <string>
 
-#include "Entity.hpp"
+#include "Scene.hpp"
 #include "Shader.hpp"
 #include "Camera.hpp"
 
-typedef std::unordered_map<std::string, std::tuple<Entity&, const Shader&>> EntityRenderMap;
-
 namespace Render
 {
-    void DrawMeshData(MeshData& meshData);
+    struct GeometryStats
+    {
+        unsigned int TrianglesDrawn = 0;
+        unsigned int TrianglesAtLod0 = 0;   // what the same draws would cost without LODs and meshlet culling
+        unsigned int MeshletsTested = 0;
+        unsigned int MeshletsCulled = 0;
+        unsigned int MeshletRanges = 0;     // contiguous runs of visible meshlets sent to glMultiDrawElements
+    };
+
+    struct MeshletCullingSettings
+    {
+        bool Enabled = true;
+        // GL_CULL_FACE isn't enabled, so back faces are visible today and this would change the picture of open meshes
+        bool Backface = false;
+    };
+    MeshletCullingSettings& GetMeshletCullingSettingsRef();
+
+    // LOD selection and texture streaming need the height of the viewport in pixels
+    void SetViewportHeight(int height);
+
+    // Largest error, in pixels, a LOD may show on screen
+    void SetLodErrorThreshold(float pixels);
+    float GetLodErrorThreshold();
+
+    const GeometryStats& GetGeometryStats();
+    void ResetGeometryStats();
+
+    // Coarsest LOD of meshData whose error, projected at the distance of its bounds, stays under the threshold
+    unsigned int SelectLod(const MeshData& meshData, const glm::mat4& model, const glm::vec3& cameraPosition, const glm::mat4& projection);
+
+    // Dequantization uniforms (u_quantizedVertex, u_posScale, u_posBias) of the mesh's vertex format. shader must be in use
+    void SetVertexFormatUniforms(const Shader& shader, const MeshData& meshData);
+
+    void DrawMeshData(const MeshData& meshData);
+    void DrawMeshData(const MeshData& meshData, unsigned int lod);
+
+    // Draws the meshlets of LOD 0 that pass the frustum (and backface) tests, testing them on the JobSystem workers
+    void DrawMeshletsCulled(const MeshData& meshData, const glm::mat4& model, const glm::vec3& cameraPosition, const glm::mat4& viewProjection);
 
     void DrawStaticMesh(StaticMesh& mesh);
 
     // stencil buffer test
     void DrawOutlineStaticMesh(StaticMesh& mesh, const Shader& defaultShader, const Shader& outlineShader, const glm::vec3& outlineColor);
     
-    void DrawEntity(Entity& entity, const Shader& shader, const Camera& camera, const glm::mat4& projection);
+    // Draws the entity's mesh with its shader and world matrix, as of the last Scene::Update
+    void DrawEntity(Scene& scene, EntityId entity, const Camera& camera, const glm::mat4& projection);
+
+    void DrawOutlineEntity(Scene& scene, EntityId entity, const Shader& defaultShader, const Shader& outlineShader, const glm::vec3& outlineColor, const Camera& camera, const glm::mat4& projection, float outlineFactor=1.1f);
+
+    // Frustum culls every entity on its world bounds and picks the LODs of those in view, into their VisibilityComponent.
+    // Only reads the rest of the scene, and spreads over the JobSystem
+    void SelectLods(Scene& scene, const Camera& camera, const glm::mat4& projection);
+
+    // Every visible entity SelectLods found in view, at the LODs it chose
+    void DrawScene(Scene& scene, const Camera& camera, const glm::mat4& projection);
 
-    void DrawOutlineEntity(Entity& entity, const Shader& defaultShader, const Shader& outlineShader, const glm::vec3& outlineColor, const Camera& camera, const glm::mat4& projection, float outlineFactor=1.1f);
+    // depth-only draw of every visible entity's position stream, culled against lightSpace.
+    // returns the number of submeshes drawn
+    unsigned int DrawShadowCasters(Scene& scene, const Shader& depthShader, const glm::mat4& lightSpace, unsigned int& outCulled);
 
-    void UpdateAndDrawEntity(Entity& entity, const Shader& shader, float deltaTime, const Camera& camera, const glm::mat4& projection);
-    void UpdateAndDrawEntityMap(const EntityRenderMap& entities, float deltaTime, const Camera& camera, const glm::mat4& projection);
+    // same as DrawShadowCasters for omnidirectional lights: only the submeshes inside the light's sphere are drawn,
+    // of the entities the scene's spatial index finds there (those with world bounds).
+    // the shader's uniforms other than u_model must already be set
+    unsigned int DrawOmniShadowCasters(Scene& scene, const Shader& depthShader, const glm::vec3& lightPos, float radius, unsigned int& outCulled);
 }
@@ -2,8 +2,11 @@
 
 #include <glad/glad.h>
 
+#include <chrono>
 #include <iostream>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <filesystem>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -13,6 +16,13 @@
 #include <assimp/postprocess.h>
 #include <assimp/material.h>
 
+#include "JobSystem.hpp"
+#include "MeshSimplifier.hpp"
+#include "Meshlets.hpp"
+#include "MeshCache.hpp"
+#include "AssetIndex.hpp"
+#include "TextureStreamer.hpp"
+
 static std::string formatPath(const std::string& p)
 {
     std::string out = p;
@@ -25,47 +35,189 @@ static std::string formatPath(const std::string& p)
     return out;
 }
 
-static std::string recursiveSearchForFile(const std::string& path, const std::string& desiredFileName)
+static std::string g_assetsFullPath;
+
+static constexpr unsigned int MODEL_IMPORT_FLAGS =
+	aiProcess_Triangulate |
+	aiProcess_SortByPType |
+	aiProcess_FlipUVs |
+	aiProcess_JoinIdenticalVertices |
+	aiProcess_GenNormals |
+	aiProcess_FixInfacingNormals;
+
+// Everything other than the source file that changes what an import outputs
+static uint64_t getImportKey()
 {
-    std::string formatted = formatPath(desiredFileName);
-    auto desiredFile = std::filesystem::path(formatted).filename();
+	// bump when the import processing changes its output without any of the settings below changing
+	constexpr uint32_t IMPORT_PROCESSING_VERSION = 2;
+
+	const MeshSimplifier::LodChainProperties lodProps;
+	const uint32_t settings[] = {
+		MODEL_IMPORT_FLAGS, IMPORT_PROCESSING_VERSION, lodProps.MaxLods,
+		Meshlet::MAX_VERTICES, Meshlet::MAX_TRIANGLES, MeshOptimizer::DEFAULT_CACHE_SIZE
+	};
+	const float lodSettings[] = { lodProps.ReductionPerLod, lodProps.MinReduction, lodProps.MaxRelativeError };
+
+	const uint64_t key = MeshCache::HashBytes(settings, sizeof(settings));
+	return MeshCache::HashBytes(lodSettings, sizeof(lodSettings), key);
+}
 
-    for (const auto& p : std::filesystem::recursive_directory_iterator(std::filesystem::path(path)))
-    {
-		if (std::filesystem::is_directory(p))
-			continue;
+static std::string getMeshCachePath(const std::string& modelPath)
+{
+	std::string name = formatPath(modelPath);
+	for (char& c : name)
+	{
+		if (c == '/' || c == ':')
+			c = '_';
+	}
+	return g_assetsFullPath + "/cache/" + name + ".nemesh";
+}
 
-		const std::string foundFile = p.path().filename().string();
-		if (foundFile.compare(desiredFile.string()) == 0)
-			return std::string(p.path().string());
-    }
+// Mip chains live next to the mesh cache, named after their path under the assets folder
+static std::string getTextureCachePath(const std::string& fullPath, bool flipVertically)
+{
+	std::string name = formatPath(fullPath);
+	if (name.compare(0, g_assetsFullPath.size() + 1, g_assetsFullPath + "/") == 0)
+		name.erase(0, g_assetsFullPath.size() + 1);
 
-    return "";
+	for (char& c : name)
+	{
+		if (c == '/' || c == ':')
+			c = '_';
+	}
+	return g_assetsFullPath + "/cache/textures/" + name + (flipVertically ? ".flipped" : "") + ".netex";
 }
 
-static std::string recursiveSearchForFolder(const std::string& path, const std::string& desiredPath)
+// Every texture path of the materials, each once, in order of first use
+static std::vector<std::string> getUniqueTexturePaths(const std::vector<MaterialDescription>& materials)
 {
-	std::string formatted = formatPath(desiredPath);
-	for (const auto& p : std::filesystem::recursive_directory_iterator(std::filesystem::path(path)))
-    {
-		if (!std::filesystem::is_directory(p))
-			continue;
+	std::vector<std::string> paths;
+	std::unordered_set<std::string> seen;
+	for (const auto& material : materials)
+	{
+		for (const auto* materialPaths : { &material.DiffusePaths, &material.SpecularPaths })
+		{
+			for (const auto& path : *materialPaths)
+			{
+				if (seen.insert(path).second)
+					paths.push_back(path);
+			}
+		}
+	}
+	return paths;
+}
 
-		const std::string foundFolder = p.path().filename().string();
-		if (foundFolder.compare(formatted) == 0)
-			return formatPath(std::string(p.path().string()));
-    }
+// Textures already in the cache aren't decoded again, their image is left empty and CreateSubMesh picks them from the cache
+static void decodeUncachedImage(const std::string& path, ResourceManager::DecodedImage& outImage)
+{
+	Texture2D cached;
+	if (!ResourceManager::FindCachedTexture(path, false, cached))
+		outImage = ResourceManager::DecodeImage(path);
+}
 
-	return "";
+static float getMillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 }
 
-static std::string g_assetsFullPath;
-void checkCurrentPath()
+/// Texture cache
+
+struct TextureCacheEntry
 {
-    if (std::filesystem::current_path().string().compare(g_assetsFullPath) != 0)
-	std::filesystem::current_path(g_assetsFullPath);
+	Texture2D Texture;                  // without owner, copies handed out get the entry as theirs
+	uint64_t ContentHash = 0;           // 0 until the pixels are known
+	std::vector<std::string> Keys;      // every path key pointing at this texture
+};
+
+struct TextureCache
+{
+	std::mutex mutex;
+	std::unordered_map<std::string, std::weak_ptr<TextureCacheEntry>> byPath;
+	std::unordered_map<uint64_t, std::weak_ptr<TextureCacheEntry>> byContent;
+
+	ResourceManager::TextureCacheStats stats;
+};
+static TextureCache g_textureCache;
+
+// Canonical path of the texture, so "a/../tex.png", "tex.png" and the absolute path are one key. Empty if there's no such file
+static std::string getTextureKey(const std::string& path, bool flipVertically)
+{
+	const std::string fullPath = AssetIndex::Resolve(path);
+	if (fullPath.empty())
+		return "";
+
+	std::error_code error;
+	std::string key = std::filesystem::weakly_canonical(fullPath, error).generic_string();
+	if (error)
+		key = fullPath;
+	return flipVertically ? key + "|flipped" : key;
 }
 
+// Runs wherever the last copy of the texture is dropped
+static void releaseTextureEntry(TextureCacheEntry* entry)
+{
+	{
+		std::lock_guard<std::mutex> lock(g_textureCache.mutex);
+
+		// a key may already point to a newer entry for the same file
+		for (const auto& key : entry->Keys)
+		{
+			auto it = g_textureCache.byPath.find(key);
+			if (it != g_textureCache.byPath.end() && it->second.expired())
+				g_textureCache.byPath.erase(it);
+		}
+		if (entry->ContentHash != 0)
+		{
+			auto it = g_textureCache.byContent.find(entry->ContentHash);
+			if (it != g_textureCache.byContent.end() && it->second.expired())
+				g_textureCache.byContent.erase(it);
+		}
+
+		g_textureCache.stats.Textures--;
+		g_textureCache.stats.Released++;
+	}
+	// drops the entry's reference to the GL texture, GpuResources deletes it a few frames later
+	delete entry;
+}
+
+// The caller holds the lock
+static Texture2D getOwnedTexture(const std::shared_ptr<TextureCacheEntry>& entry)
+{
+	Texture2D texture = entry->Texture;
+	texture.SetOwner(entry);
+	return texture;
+}
+
+// The caller holds the lock
+static bool findCachedByPath(const std::string& key, Texture2D& outTexture)
+{
+	auto it = g_textureCache.byPath.find(key);
+	if (it == g_textureCache.byPath.end())
+		return false;
+
+	auto entry = it->second.lock();
+	if (!entry)
+		return false;
+
+	outTexture = getOwnedTexture(entry);
+	g_textureCache.stats.PathHits++;
+	return true;
+}
+
+// The caller holds the lock
+static void addContentKey(const std::shared_ptr<TextureCacheEntry>& entry, uint64_t contentHash)
+{
+	if (contentHash == 0 || entry->ContentHash != 0)
+		return;
+
+	// the first texture with these pixels stays the one they lead to
+	auto& content = g_textureCache.byContent[contentHash];
+	if (content.expired())
+	{
+		content = entry;
+		entry->ContentHash = contentHash;
+	}
+}
 
 namespace ResourceManager
 {
@@ -81,205 +233,686 @@ namespace ResourceManager
 
 	g_assetsFullPath = formatPath(currentPath.string() + "/assets");
 	std::cout << "Updating g_assetsFullPath = " << g_assetsFullPath << '\n';
+
+	// every load goes through absolute paths, this is only for code that still opens assets relative to them
+	std::filesystem::current_path(g_assetsFullPath);
+
+	AssetIndex::Build(g_assetsFullPath);
     }
 
     Shader LoadShader(const std::string &vertexPath, const std::string &fragPath)
     {
-		checkCurrentPath();
         return Shader(g_assetsFullPath + "/" + formatPath(vertexPath), g_assetsFullPath + "/" + formatPath(fragPath));
     }
 
-    Texture2D LoadTextureFromFile(const std::string &path)
+    Shader LoadShader(const std::string &vertexPath, const std::string &geometryPath, const std::string &fragPath)
+    {
+        return Shader(
+            g_assetsFullPath + "/" + formatPath(vertexPath),
+            g_assetsFullPath + "/" + formatPath(geometryPath),
+            g_assetsFullPath + "/" + formatPath(fragPath)
+        );
+    }
+
+    Texture2D LoadTextureFromFile(const std::string &path, bool flipVertically)
 	{
-		checkCurrentPath();
+		Texture2D texture;
+		if (FindCachedTexture(path, flipVertically, texture))
+			return texture;
 
-		std::string fullPath = recursiveSearchForFile(".", path);
+		return CreateTexture(DecodeImage(path, flipVertically));
+	}
 
-		int width, height, nrChannels;
-		unsigned char* data = stbi_load(fullPath.c_str(), &width, &height, &nrChannels, 0);
+	void ImageDeleter::operator()(unsigned char *pixels) const
+	{
+		stbi_image_free(pixels);
+	}
 
-		if (!data)
+	DecodedImage DecodeImage(const std::string &path, bool flipVertically)
+	{
+		DecodedImage image;
+		image.Path = path;
+
+		image.Flipped = flipVertically;
+
+		const std::string fullPath = FindAssetFile(path);
+
+		/// Mips already built by an earlier run
+		// compressed and raw chains hash differently, toggling compression doesn't read back the other one
+		const bool compress = TextureCompression::IsEnabled();
+		uint64_t sourceHash = 0;
+		bool sourceHashed = false;
+		std::string cachePath;
+		if (!fullPath.empty())
+		{
+			const unsigned char flags[] = { static_cast<unsigned char>(flipVertically), static_cast<unsigned char>(compress) };
+			sourceHashed = MeshCache::HashFile(fullPath, sourceHash);
+			sourceHash = MeshCache::HashBytes(flags, sizeof(flags), sourceHash);
+			cachePath = getTextureCachePath(fullPath, flipVertically);
+
+			if (sourceHashed && TextureCompression::ReadCache(cachePath, sourceHash, image.Mips, image.ContentHash))
+			{
+				image.CachePath = cachePath;
+				image.SourceHash = sourceHash;
+				image.Width = image.Mips.Width;
+				image.Height = image.Mips.Height;
+				image.Channels = image.Mips.Channels;
+				return image;
+			}
+		}
+
+		// the flag of this thread only, images decode on several threads at once
+		stbi_set_flip_vertically_on_load_thread(flipVertically ? 1 : 0);
+		if (!fullPath.empty())
+			image.Pixels.reset(stbi_load(fullPath.c_str(), &image.Width, &image.Height, &image.Channels, 0));
+
+		if (!image.Pixels)
 		{
 			std::cerr << "Texture to failed to load from path given " << path << " using fullPath found " << fullPath << '\n';
-			stbi_image_free(data);
+			return image;
+		}
+
+		image.ContentHash = HashImage(image.Pixels.get(), image.Width, image.Height, image.Channels);
+
+		/// Build the mips (compressed when enabled) and cache them for the next run
+		const auto start = std::chrono::high_resolution_clock::now();
+		const TextureCompression::BlockFormat format = compress
+			? TextureCompression::ChooseFormat(image.Pixels.get(), image.Width, image.Height, image.Channels)
+			: TextureCompression::BlockFormat::Uncompressed;
+		image.Mips = TextureCompression::Compress(image.Pixels.get(), image.Width, image.Height, image.Channels, format);
+
+		std::cout << "Texture " << path << ": " << TextureCompression::GetFormatName(format) << ' ' << image.Width << 'x' << image.Height
+			<< ", " << image.Mips.Levels.size() << " levels, " << image.Mips.Data.size() / 1024 << " KB in "
+			<< getMillisecondsSince(start) << " ms";
+#ifdef _NE_DEBUG
+		// checked against the reference decoder
+		if (compress)
+			std::cout << ", PSNR " << TextureCompression::MeasurePSNR(image.Mips, image.Pixels.get()) << " dB";
+#endif
+		std::cout << '\n';
+
+		if (sourceHashed)
+		{
+			std::error_code error;
+			std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+			if (error || !TextureCompression::WriteCache(cachePath, sourceHash, image.ContentHash, image.Mips))
+			{
+				std::cerr << "Texture " << path << ": couldn't write the mip chain to " << cachePath << '\n';
+			}
+			else
+			{
+				image.CachePath = cachePath;
+				image.SourceHash = sourceHash;
+			}
+		}
+
+		// level 0 is in the chain too, the upload only needs the chain
+		if (image.Mips.IsValid())
+			image.Pixels.reset();
+
+		return image;
+	}
+
+	uint64_t HashImage(const unsigned char *pixels, int width, int height, int channels)
+	{
+		const int size[] = { width, height, channels };
+		const uint64_t hash = MeshCache::HashBytes(size, sizeof(size));
+		return MeshCache::HashBytes(pixels, size_t(width) * height * channels, hash);
+	}
+
+	Texture2D CreateTexture(const DecodedImage &image)
+	{
+		if (!image.IsValid())
 			return Texture2D();
+
+		Texture2D texture;
+		if (FindCachedTexture(image, texture))
+			return texture;
+
+		if (image.Mips.IsValid())
+		{
+			Texture2DProperties texProps{image.Width, image.Height, TextureCompression::GetGLFormat(image.Mips.Format, image.Channels), image.Path};
+
+			// only the coarse levels when streaming, the streamer brings in the others as they're needed
+			const size_t firstLevel = TextureStreamer::IsEnabled() ? TextureStreamer::GetTailLevel(image.Mips) : 0;
+			texture = CacheTexture(Texture2D(image.Mips, texProps, 0, firstLevel), image.Path, image.Flipped, image.ContentHash);
+			if (firstLevel > 0)
+				TextureStreamer::Register(texture, image.Mips, image.CachePath, image.SourceHash, firstLevel);
+			return texture;
 		}
 
-		GLenum format;
-		if (nrChannels == 1)
-			format = GL_RED;
-		else if (nrChannels == 3)
-			format = GL_RGB;
-		else if (nrChannels == 4)
-			format = GL_RGBA;
+		Texture2DProperties texProps{image.Width, image.Height, image.GetFormat(), image.Path};
+		return CacheTexture(Texture2D(image.Pixels.get(), texProps), image.Path, image.Flipped, image.ContentHash);
+	}
 
-		Texture2DProperties texProps{width, height, format, path};
+	bool FindCachedTexture(const std::string &path, bool flipVertically, Texture2D &outTexture)
+	{
+		// dropping what outTexture held may release an entry, which takes the lock
+		outTexture = Texture2D();
 
-		Texture2D texture(data, texProps);
-		stbi_image_free(data);
-		return texture;
+		const std::string key = getTextureKey(path, flipVertically);
+		if (key.empty())
+			return false;
+
+		std::lock_guard<std::mutex> lock(g_textureCache.mutex);
+		return findCachedByPath(key, outTexture);
 	}
 
+	bool FindCachedTexture(const DecodedImage &image, Texture2D &outTexture)
+	{
+		outTexture = Texture2D();
+		const std::string key = getTextureKey(image.Path, image.Flipped);
 
+		std::lock_guard<std::mutex> lock(g_textureCache.mutex);
+		if (!key.empty() && findCachedByPath(key, outTexture))
+			return true;
 
-	Model LoadModel(const std::string &path)
-	{	
-		checkCurrentPath();
+		auto content = g_textureCache.byContent.find(image.ContentHash);
+		if (image.ContentHash == 0 || content == g_textureCache.byContent.end())
+		{
+			g_textureCache.stats.Misses++;
+			return false;
+		}
 
-		Model out{};
+		auto entry = content->second.lock();
+		if (!entry)
+		{
+			g_textureCache.stats.Misses++;
+			return false;
+		}
+
+		// same pixels under another path
+		if (!key.empty())
+		{
+			g_textureCache.byPath[key] = entry;
+			entry->Keys.push_back(key);
+		}
+		outTexture = getOwnedTexture(entry);
+		g_textureCache.stats.ContentHits++;
+		return true;
+	}
+
+	Texture2D CacheTexture(const Texture2D &texture, const std::string &path, bool flipVertically, uint64_t contentHash)
+	{
+		if (texture.GetID() == 0)
+			return texture;
+
+		const std::string key = getTextureKey(path, flipVertically);
+
+		std::shared_ptr<TextureCacheEntry> entry(new TextureCacheEntry(), releaseTextureEntry);
+		entry->Texture = texture;
+		entry->Texture.SetOwner(nullptr);
+
+		std::lock_guard<std::mutex> lock(g_textureCache.mutex);
+		if (!key.empty())
+		{
+			g_textureCache.byPath[key] = entry;
+			entry->Keys.push_back(key);
+		}
+		addContentKey(entry, contentHash);
+		g_textureCache.stats.Textures++;
+
+		return getOwnedTexture(entry);
+	}
+
+	void UpdateCachedTexture(const Texture2D &texture, const Texture2DProperties &props, uint64_t contentHash)
+	{
+		auto entry = std::static_pointer_cast<TextureCacheEntry>(texture.GetOwner());
+		if (!entry)
+			return;
+
+		std::lock_guard<std::mutex> lock(g_textureCache.mutex);
+		entry->Texture.SetProperties(props);
+		addContentKey(entry, contentHash);
+	}
+
+	TextureCacheStats GetTextureCacheStats()
+	{
+		std::lock_guard<std::mutex> lock(g_textureCache.mutex);
+		return g_textureCache.stats;
+	}
+
+	bool ImportModel(const std::string &path, ModelImport &outImport)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		outImport = ModelImport();
+		outImport.Path = path;
+
+		// absolute, the current directory may change while this runs on a worker
+		const std::string fullPath = g_assetsFullPath + "/" + formatPath(path);
+		const uint64_t importKey = getImportKey();
+		const std::string cachePath = getMeshCachePath(path);
+
+		uint64_t sourceHash = 0;
+		// the .mtl too: the cache holds the materials
+		const bool sourceHashed = MeshCache::HashModelSources(fullPath, sourceHash);
+
+		/// Warm load: the submeshes point straight into the mapped cache file, only the textures need work
+		if (sourceHashed)
+		{
+			auto cache = std::make_shared<MeshCache::CacheFile>();
+			if (cache->Open(cachePath, sourceHash, importKey))
+			{
+				size_t fullTriangles = 0;
+				for (const auto& subMesh : cache->GetSubMeshes())
+				{
+					outImport.Meshes.push_back(subMesh.Mesh);
+					outImport.Materials.push_back(subMesh.Material);
+					fullTriangles += (subMesh.Mesh.NumLods > 0 ? subMesh.Mesh.Lods[0].IndexCount : subMesh.Mesh.NumIndices) / 3;
+				}
+				outImport.Cache = std::move(cache);
+				outImport.FromCache = true;
+
+				// the BVHs aren't cached, they build from the positions along with the textures
+				const std::vector<std::string> texturePaths = getUniqueTexturePaths(outImport.Materials);
+				std::vector<DecodedImage> images(texturePaths.size());
+				outImport.Bvhs.resize(outImport.Meshes.size());
+				JobSystem::ParallelFor(images.size() + outImport.Meshes.size(), 1, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++)
+					{
+						if (i < images.size())
+							decodeUncachedImage(texturePaths[i], images[i]);
+						else
+							outImport.Bvhs[i - images.size()] = BuildMeshBvh(outImport.Meshes[i - images.size()]);
+					}
+				});
+				for (auto& image : images)
+				{
+					if (!image.Path.empty())
+						outImport.Images.emplace(image.Path, std::move(image));
+				}
+
+				std::cout << "LoadModel " << path << ": " << outImport.Meshes.size() << " submeshes, "
+					<< fullTriangles << " triangles from cache " << cachePath << ", " << images.size() << " textures, "
+					<< getMillisecondsSince(start) << " ms\n";
+				return true;
+			}
+		}
 
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, 
-			aiProcess_Triangulate |
-			aiProcess_SortByPType |
-			aiProcess_FlipUVs | 
-			aiProcess_JoinIdenticalVertices |
-			aiProcess_GenNormals |
-			aiProcess_FixInfacingNormals
-		);
+		const aiScene* scene = importer.ReadFile(fullPath, MODEL_IMPORT_FLAGS);
 
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
 			std::cerr <<"LoadModel assimp error when loading " << path << ": " << importer.GetErrorString() << '\n';
+			return false;
 		}
-    
-		out.Mesh.GetSubMeshesRef().reserve(scene->mNumMeshes);
-		out.Path = path;
 
-		ProcessAssimpNode(scene->mRootNode, scene, out.Mesh.GetSubMeshesRef());
+		const float parseMs = getMillisecondsSince(start);
+
+		// the node tree places the meshes, its world matrices are baked into their vertices
+		TransformHierarchy sceneNodes;
+		std::vector<AssimpMeshInstance> sceneMeshes;
+		sceneMeshes.reserve(scene->mNumMeshes);
+		ProcessAssimpNode(scene->mRootNode, scene, sceneNodes, TransformHierarchy::INVALID_NODE, sceneMeshes);
+		sceneNodes.Update();
+
+		std::vector<MaterialDescription> sceneMaterials(scene->mNumMaterials);
+		for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+			sceneMaterials[i] = GetMaterialDescription(scene->mMaterials[i]);
+
+		const std::vector<std::string> texturePaths = getUniqueTexturePaths(sceneMaterials);
+
+		/// One job per texture to decode and per submesh to convert and process, all in one go.
+		// Textures come first, they're the longest jobs
+		std::vector<DecodedImage> images(texturePaths.size());
+		std::vector<MeshImportData> meshes(sceneMeshes.size());
+		std::vector<MeshOptimizer::VertexCacheStats> statsBefore(meshes.size()), statsAfter(meshes.size());
+
+		JobSystem::ParallelFor(images.size() + meshes.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				if (i < images.size())
+				{
+					decodeUncachedImage(texturePaths[i], images[i]);
+					continue;
+				}
+
+				MeshImportData& mesh = meshes[i - images.size()];
+				const AssimpMeshInstance& instance = sceneMeshes[i - images.size()];
+				ProcessAssimpMesh(instance.Mesh, sceneMaterials, sceneNodes.GetWorld(instance.Node), mesh);
+				if (mesh.Indices.empty())
+					continue;
+
+				BuildMeshLods(mesh);
+				BuildMeshMeshlets(mesh);
+				OptimizeMesh(mesh, statsBefore[i - images.size()], statsAfter[i - images.size()]);
+				mesh.Packed = PackMesh(mesh.Vertices, mesh.Indices, mesh.Lods, mesh.Meshlets);
+				mesh.Bvh = BuildMeshBvh(mesh.Packed.GetView());
+			}
+		});
+
+		for (auto& image : images)
+		{
+			if (!image.Path.empty())
+				outImport.Images.emplace(image.Path, std::move(image));
+		}
+
+		MeshOptimizer::VertexCacheStats totalBefore, totalAfter;
+		size_t fullTriangles = 0, coarsestTriangles = 0;
+		outImport.Packed.reserve(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			// points and lines
+			if (meshes[i].Indices.empty())
+				continue;
+
+			totalBefore.Add(statsBefore[i]);
+			totalAfter.Add(statsAfter[i]);
+			fullTriangles += meshes[i].Lods.front().IndexCount / 3;
+			coarsestTriangles += meshes[i].Lods.back().IndexCount / 3;
+
+			outImport.Packed.push_back(std::move(meshes[i].Packed));
+			outImport.Materials.push_back(std::move(meshes[i].Mat));
+			outImport.Bvhs.push_back(std::move(meshes[i].Bvh));
+		}
+		for (const auto& packed : outImport.Packed)
+			outImport.Meshes.push_back(packed.GetView());
+
+		std::cout << "LoadModel " << path << ": " << outImport.Meshes.size() << " submeshes, "
+			<< fullTriangles << " triangles (" << coarsestTriangles << " at the coarsest LODs), " << images.size() << " textures\n";
+		std::cout << "LoadModel " << path << ": ACMR " << totalBefore.GetACMR() << " -> " << totalAfter.GetACMR()
+			<< ", ATVR " << totalBefore.GetATVR() << " -> " << totalAfter.GetATVR()
+			<< " (FIFO cache of " << MeshOptimizer::DEFAULT_CACHE_SIZE << ")\n";
+		std::cout << "LoadModel " << path << ": " << getMillisecondsSince(start) << " ms (Assimp " << parseMs << " ms) on "
+			<< JobSystem::GetWorkerCount() + 1 << " threads\n";
+
+		/// Write the cache for the next load
+		if (sourceHashed)
+		{
+			std::error_code error;
+			std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+			if (!error && MeshCache::Write(cachePath, sourceHash, importKey, outImport.Meshes, outImport.Materials))
+				std::cout << "LoadModel " << path << ": wrote cache " << cachePath << '\n';
+		}
+
+		return true;
+	}
+
+	MeshData CreateSubMesh(const ModelImport &import, size_t subMesh, const TextureLoader &loadTexture)
+	{
+		// the images decoded by the import first, anything else from disk
+		const TextureLoader loadImported = [&import](const std::string& path) {
+			if (auto image = import.Images.find(path); image != import.Images.end())
+				return CreateTexture(image->second);
+			return LoadTextureFromFile(path);
+		};
+
+		MeshData mesh(import.Meshes[subMesh], LoadMaterial(import.Materials[subMesh], loadTexture ? loadTexture : loadImported));
+		if (subMesh < import.Bvhs.size())
+			mesh.Bvh = import.Bvhs[subMesh];
+		return mesh;
+	}
+
+	std::string FindAssetFile(const std::string &path)
+	{
+		return AssetIndex::Resolve(path);
+	}
+
+	Model LoadModel(const std::string &path)
+	{	
+		Model out{};
+
+		ModelImport import;
+		if (!ImportModel(path, import))
+			return out;
+
+		out.Path = path;
+		out.Mesh.GetSubMeshesRef().reserve(import.Meshes.size());
+		for (size_t i = 0; i < import.Meshes.size(); i++)
+			out.Mesh.GetSubMeshesRef().push_back(CreateSubMesh(import, i));
 
 		return out;
 	}
 
 
-    void ProcessAssimpNode(aiNode *node, const aiScene *scene, std::vector<MeshData> &meshBuffer)
+    void ProcessAssimpNode(aiNode *node, const aiScene *scene, TransformHierarchy &hierarchy, TransformHierarchy::NodeId parent,
+                           std::vector<AssimpMeshInstance> &outMeshes)
     {
-		// Process all node's meshes (if any)
+		// aiMatrix4x4 is row major
+		const aiMatrix4x4& m = node->mTransformation;
+		const glm::mat4 local(
+			m.a1, m.b1, m.c1, m.d1,
+			m.a2, m.b2, m.c2, m.d2,
+			m.a3, m.b3, m.c3, m.d3,
+			m.a4, m.b4, m.c4, m.d4);
+		const TransformHierarchy::NodeId id = hierarchy.Add(local, parent);
+
+		// Gather all node's meshes (if any)
 		for (unsigned int i = 0; i < node->mNumMeshes; i++)
-		{
-			// get mesh based on the index in mMeshes of the node
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-
-			// then convert to our Mesh type and add to the buffer
-			meshBuffer.push_back(ProcessAssimpMesh(mesh, scene));
-		}
+			outMeshes.push_back({ scene->mMeshes[node->mMeshes[i]], id });
 
 		// Then recursively do the same for each of its children
 		for (unsigned int i = 0; i < node->mNumChildren; i++)
 		{
-			ProcessAssimpNode(node->mChildren[i], scene, meshBuffer);
+			ProcessAssimpNode(node->mChildren[i], scene, hierarchy, id, outMeshes);
 		}
 	}
 
-	MeshData ProcessAssimpMesh(aiMesh *mesh, const aiScene *scene)
+	void ProcessAssimpMesh(const aiMesh *mesh, const std::vector<MaterialDescription> &materials, const glm::mat4 &transform, MeshImportData &outMesh)
 	{
 		// First, process each mesh Vertex (posVertex, normal and texcoord)
-		std::vector<Vertex> vertices;
-		vertices.reserve(mesh->mNumVertices);
+		std::vector<Vertex>& vertices = outMesh.Vertices;
+		vertices.resize(mesh->mNumVertices);
     
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
-			Vertex vertex;
-			glm::vec3 vec;
-		
+			Vertex& vertex = vertices[i];
+
 			// process mesh position vertices
-			vec.x = mesh->mVertices[i].x;
-			vec.y = mesh->mVertices[i].y;
-			vec.z = mesh->mVertices[i].z;
-			vertex.Position = vec;
+			vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
 
-			// process mesh normals
-			vec.x = mesh->mNormals[i].x;
-			vec.y = mesh->mNormals[i].y;
-			vec.z = mesh->mNormals[i].z;
-			vertex.Normal = vec;
+			// process mesh normals (GenNormals only adds them to triangle meshes)
+			if (mesh->mNormals)
+				vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+			else
+				vertex.Normal = glm::vec3(0.0f, 0.0f, 1.0f);
 
 			// process texture coordinates
 			// assimp allows models to have up to 8 different TexCoords
 			// but we only care about 1
 			if (mesh->mTextureCoords[0])
-			{
-				glm::vec2 tvec(
-				mesh->mTextureCoords[0][i].x,
-				mesh->mTextureCoords[0][i].y
-				);
-				vertex.TexCoords = tvec;
-			}
+				vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 			else
-			{
 				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-			}
-
-			vertices.push_back(vertex);
-
 		}
 
-		/// Process mesh indices for indexed drawing
-		// can't pre-reserve indices size because otherwise
-		// we would need to loop through every face
-		// BUT, if we assume every face is a triangle
-		// then the total number of indices is simply
-		// 3 * number of faces
-		std::vector<unsigned int> indices;
-		indices.reserve(3 * mesh->mNumFaces);
+		/// Process mesh indices for indexed drawing.
+		// SortByPType leaves point and line meshes apart, only triangles are kept
+		size_t numTriangles = 0;
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+			numTriangles += (mesh->mFaces[i].mNumIndices == 3);
 
+		std::vector<unsigned int>& indices = outMesh.Indices;
+		indices.resize(3 * numTriangles);
+
+		unsigned int* out = indices.data();
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
 			const aiFace& face = mesh->mFaces[i];
-			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
-		}
+			if (face.mNumIndices != 3)
+				continue;
 
-		/// Process mesh materials
-		Material meshMaterial;
+			*out++ = face.mIndices[0];
+			*out++ = face.mIndices[1];
+			*out++ = face.mIndices[2];
+		}
 
-		if (mesh->mMaterialIndex >= 0)
+		/// Node transform (most files leave them identity)
+		if (transform != glm::mat4(1.0f))
 		{
-			aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
+			const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+			for (Vertex& vertex : vertices)
+			{
+				vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+				vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+			}
+
+			// a mirroring transform turns the triangles inside out
+			if (glm::determinant(glm::mat3(transform)) < 0.0f)
+			{
+				for (size_t i = 0; i < indices.size(); i += 3)
+					std::swap(indices[i + 1], indices[i + 2]);
+			}
+		}
+
+		/// Material (textures are only referenced here, they load with the GL side of the mesh)
+		if (mesh->mMaterialIndex < materials.size())
+			outMesh.Mat = materials[mesh->mMaterialIndex];
+	}
+
+	MaterialDescription GetMaterialDescription(aiMaterial *mat)
+	{
+		MaterialDescription description;
+
+		// Take diffuse maps
+		description.DiffusePaths = GetMaterialTexturePaths(mat, aiTextureType_DIFFUSE);
+
+		// now take specular maps
+		description.SpecularPaths = GetMaterialTexturePaths(mat, aiTextureType_SPECULAR);
+
+		// and finally material shininess
+		float shininess; 
+		if (aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &shininess) != AI_SUCCESS)
+			shininess = 20.0f; // set default value if cant get shininess
 
-			// Take diffuse maps
-			meshMaterial.DiffuseMaps = LoadMaterialTextures(mat, aiTextureType_DIFFUSE);
+		description.Shininess = shininess;
+		return description;
+	}
 
-			// now take specular maps
-			meshMaterial.SpecularMaps = LoadMaterialTextures(mat, aiTextureType_SPECULAR);
+	void BuildMeshLods(MeshImportData& mesh)
+	{
+		std::vector<glm::vec3> positions;
+		positions.reserve(mesh.Vertices.size());
+		for (const auto& vertex : mesh.Vertices)
+			positions.push_back(vertex.Position);
 
-			// and finally material shininess
-			float shininess; 
-			if (aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &shininess) != AI_SUCCESS)
-				shininess = 20.0f; // set default value if cant get shininess
+		std::vector<MeshSimplifier::LodLevel> levels = MeshSimplifier::BuildLodChain(positions, mesh.Indices);
 
-			meshMaterial.Shininess = shininess;
+		// LOD 0 stays at the start of the buffer, the coarser ones follow it
+		mesh.Lods.clear();
+		mesh.Lods.push_back({ 0, static_cast<unsigned int>(mesh.Indices.size()), 0.0f });
+		for (size_t lod = 1; lod < levels.size(); lod++)
+		{
+			mesh.Lods.push_back({
+				static_cast<unsigned int>(mesh.Indices.size()),
+				static_cast<unsigned int>(levels[lod].Indices.size()),
+				levels[lod].Error
+			});
+			mesh.Indices.insert(mesh.Indices.end(), levels[lod].Indices.begin(), levels[lod].Indices.end());
 		}
+	}
 
-		return MeshData(vertices, indices, meshMaterial);
+	void BuildMeshMeshlets(MeshImportData& mesh)
+	{
+		std::vector<glm::vec3> positions;
+		positions.reserve(mesh.Vertices.size());
+		for (const auto& vertex : mesh.Vertices)
+			positions.push_back(vertex.Position);
+
+		const size_t lod0Count = mesh.Lods.empty() ? mesh.Indices.size() : mesh.Lods[0].IndexCount;
+		mesh.Meshlets = MeshletBuilder::Build(positions, mesh.Indices, 0, lod0Count);
 	}
 
-	std::vector<Texture2D> LoadMaterialTextures(aiMaterial *mat, aiTextureType type)
+	void OptimizeMesh(MeshImportData& mesh, MeshOptimizer::VertexCacheStats& outBefore, MeshOptimizer::VertexCacheStats& outAfter)
 	{
-		static std::unordered_map<std::string, Texture2D> s_loadedTextures;
+		std::vector<MeshOptimizer::IndexRange> lodRanges;
+		for (const auto& lod : mesh.Lods)
+			lodRanges.push_back({ lod.IndexOffset, lod.IndexCount });
+		if (lodRanges.empty())
+			lodRanges.push_back({ 0, static_cast<unsigned int>(mesh.Indices.size()) });
+
+		outBefore = MeshOptimizer::VertexCacheStats();
+		for (const auto& range : lodRanges)
+			outBefore.Add(MeshOptimizer::AnalyzeVertexCache(mesh.Indices, range));
+
+		std::vector<glm::vec3> positions;
+		positions.reserve(mesh.Vertices.size());
+		for (const auto& vertex : mesh.Vertices)
+			positions.push_back(vertex.Position);
+
+		for (size_t lod = 0; lod < lodRanges.size(); lod++)
+		{
+			if (lod == 0 && !mesh.Meshlets.empty())
+			{
+				// LOD 0 is culled per meshlet: reorder inside each one, then sort the meshlets themselves
+				std::vector<MeshOptimizer::IndexRange> meshletRanges;
+				for (const auto& meshlet : mesh.Meshlets)
+				{
+					meshletRanges.push_back({ meshlet.IndexOffset, meshlet.IndexCount });
+					MeshOptimizer::OptimizeVertexCache(mesh.Indices, meshletRanges.back());
+				}
+
+				const std::vector<unsigned int> order = MeshOptimizer::OptimizeOverdraw(mesh.Indices, positions, meshletRanges);
+
+				std::vector<Meshlet> sorted;
+				sorted.reserve(mesh.Meshlets.size());
+				unsigned int offset = lodRanges[0].Offset;
+				for (unsigned int m : order)
+				{
+					sorted.push_back(mesh.Meshlets[m]);
+					sorted.back().IndexOffset = offset;
+					offset += sorted.back().IndexCount;
+				}
+				mesh.Meshlets = std::move(sorted);
+				continue;
+			}
 
-		std::vector<Texture2D> textures;
+			const std::vector<MeshOptimizer::IndexRange> clusters = MeshOptimizer::OptimizeVertexCache(mesh.Indices, lodRanges[lod]);
+			MeshOptimizer::OptimizeOverdraw(mesh.Indices, positions, clusters);
+		}
+
+		// vertices in the order LOD 0 (then the coarser levels) first uses them
+		const std::vector<unsigned int> newToOld = MeshOptimizer::OptimizeVertexFetch(mesh.Indices, mesh.Vertices.size());
+
+		std::vector<Vertex> vertices;
+		vertices.reserve(newToOld.size());
+		for (unsigned int old : newToOld)
+			vertices.push_back(mesh.Vertices[old]);
+		mesh.Vertices = std::move(vertices);
+
+		outAfter = MeshOptimizer::VertexCacheStats();
+		for (const auto& range : lodRanges)
+			outAfter.Add(MeshOptimizer::AnalyzeVertexCache(mesh.Indices, range));
+	}
+
+	std::vector<std::string> GetMaterialTexturePaths(aiMaterial *mat, aiTextureType type)
+	{
+		std::vector<std::string> paths;
 		const unsigned int textureCount = mat->GetTextureCount(type);
     
 		for (unsigned int i = 0; i < textureCount; i++)
 		{
 			aiString aipath;
 			mat->GetTexture(type, i, &aipath);
-			std::string path(aipath.C_Str());
+			paths.emplace_back(aipath.C_Str());
+		}
 
-			// check if texture was loaded already
-			if (auto tex = s_loadedTextures.find(path); tex != s_loadedTextures.end())
-			{
-				textures.push_back(tex->second);
-				continue;
-			}
+		return paths;
+	}
+
+	Material LoadMaterial(const MaterialDescription &description, const TextureLoader &loadTexture)
+	{
+		Material material;
+		material.DiffuseMaps = LoadMaterialTextures(description.DiffusePaths, loadTexture);
+		material.SpecularMaps = LoadMaterialTextures(description.SpecularPaths, loadTexture);
+		material.TilingFactor = description.TilingFactor;
+		material.Shininess = description.Shininess;
+		return material;
+	}
 
-			Texture2D texture = LoadTextureFromFile(path);
+	std::vector<Texture2D> LoadMaterialTextures(const std::vector<std::string>& paths, const TextureLoader& loadTexture)
+	{
+		// the loaders go through the texture cache, a texture used by several materials is only loaded once
+		std::vector<Texture2D> textures;
+		for (const auto& path : paths)
+		{
+			Texture2D texture = loadTexture ? loadTexture(path) : LoadTextureFromFile(path);
 			if (texture.GetID() == 0)
 				continue;
 
 			textures.push_back(texture);
-			s_loadedTextures[path] = texture;
 		}
 
 		return textures;
@@ -3,13 +3,19 @@
 #include <vector>
 #include <array>
 #include <unordered_map>
+#include <memory>
+#include <functional>
+#include <string>
 
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 
 #include "Shader.hpp"
 #include "StaticMesh.hpp"
-#include "Entity.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshCache.hpp"
+#include "TextureCompression.hpp"
+#include "TransformHierarchy.hpp"
 
 //////////////////////////////////
 /// ASSIMP LOADING FUNCTIONS
@@ -20,8 +26,85 @@ namespace ResourceManager
     void InitializeLocations();
 
     Shader LoadShader(const std::string& vertexPath, const std::string& fragPath);
+    Shader LoadShader(const std::string& vertexPath, const std::string& geometryPath, const std::string& fragPath);
 
-    Texture2D LoadTextureFromFile(const std::string& path);
+    // Through the texture cache: decodes and uploads only the first time the image is asked for
+    Texture2D LoadTextureFromFile(const std::string& path, bool flipVertically = false);
+
+    struct ImageDeleter
+    {
+        void operator()(unsigned char* pixels) const;
+    };
+
+    // An image decoded on the CPU, waiting to become a texture
+    struct DecodedImage
+    {
+        std::string Path;
+        bool Flipped = false;
+        int Width = 0;
+        int Height = 0;
+        int Channels = 0;
+        std::unique_ptr<unsigned char, ImageDeleter> Pixels;   // null once the mips are built, or if the image couldn't be read
+        uint64_t ContentHash = 0;                              // of the pixels and the size, see HashImage
+        TextureCompression::CompressedImage Mips;              // every level down to 1x1, block-compressed or raw
+        std::string CachePath;                                 // where Mips can be read back from (see TextureCompression::ReadCache), empty if nowhere
+        uint64_t SourceHash = 0;
+
+        inline bool IsValid() const noexcept { return Pixels || Mips.IsValid(); }
+
+        inline GLenum GetFormat() const noexcept
+        {
+            switch (Channels)
+            {
+            case 1: return GL_RED;
+            case 2: return GL_RG;
+            case 3: return GL_RGB;
+            default: return GL_RGBA;
+            }
+        }
+    };
+
+    // No GL calls, safe on any thread. The vertical flip only applies to this decode.
+    // With texture compression on, the image comes block compressed from the texture cache folder, or is
+    // compressed and put there
+    DecodedImage DecodeImage(const std::string& path, bool flipVertically = false);
+
+    uint64_t HashImage(const unsigned char* pixels, int width, int height, int channels);
+
+    // An empty texture (id 0) if the image is. The cached texture if the path or the pixels are already in the cache
+    Texture2D CreateTexture(const DecodedImage& image);
+
+    /*
+        Texture cache shared by every loader (LoadTextureFromFile, material
+        textures, the AsyncLoader). Textures are keyed by their canonical path
+        (and whether they're flipped), and by the hash of their pixels so the
+        same image under two paths is one texture.
+        The cache only holds weak references: each Texture2D it hands out shares
+        an owner, and once the last copy is gone the entry leaves the cache and
+        its GL texture goes to GpuResources' deferred deletion.
+        Lookups are safe on any thread, creating textures is for the GL thread.
+    */
+    bool FindCachedTexture(const std::string& path, bool flipVertically, Texture2D& outTexture);
+    // By path, then by pixels. A hit by pixels makes the image's path another key of the texture
+    bool FindCachedTexture(const DecodedImage& image, Texture2D& outTexture);
+
+    // Puts a texture created elsewhere in the cache. contentHash = 0 if the pixels aren't known yet
+    Texture2D CacheTexture(const Texture2D& texture, const std::string& path, bool flipVertically, uint64_t contentHash = 0);
+    // For textures whose image arrives after they were cached (the AsyncLoader's placeholders)
+    void UpdateCachedTexture(const Texture2D& texture, const Texture2DProperties& props, uint64_t contentHash);
+
+    struct TextureCacheStats
+    {
+        size_t Textures = 0;
+        size_t PathHits = 0;
+        size_t ContentHits = 0;
+        size_t Misses = 0;
+        size_t Released = 0;
+    };
+    TextureCacheStats GetTextureCacheStats();
+
+    // Full path of the asset through the AssetIndex, empty if there's none. Safe on any thread
+    std::string FindAssetFile(const std::string& path);
 
     struct Model
     {
@@ -29,13 +112,79 @@ namespace ResourceManager
         std::string Path;
     };
 
+    // CPU side of a submesh while it's being imported, before it gets its GL buffers
+    struct MeshImportData
+    {
+        std::vector<Vertex> Vertices;
+        std::vector<unsigned int> Indices;   // every level of detail back to back once BuildMeshLods ran
+        MaterialDescription Mat;
+        std::vector<MeshLod> Lods;
+        std::vector<Meshlet> Meshlets;
+        PackedMesh Packed;                   // what gets uploaded and cached, filled last
+        std::shared_ptr<const MeshBvh> Bvh;  // of Packed
+    };
+
+    // A model read and processed on the CPU, waiting for its GL side. Meshes point into Packed or into Cache
+    struct ModelImport
+    {
+        std::string Path;
+        std::vector<PackedMeshView> Meshes;
+        std::vector<MaterialDescription> Materials;
+        std::unordered_map<std::string, DecodedImage> Images;  // every texture of the materials, by path
+        bool FromCache = false;
+
+        std::vector<PackedMesh> Packed;
+        std::shared_ptr<MeshCache::CacheFile> Cache;
+
+        std::vector<std::shared_ptr<const MeshBvh>> Bvhs;   // by submesh, built on the CPU with the rest
+    };
+
+    // Makes the texture of a path. An empty one means LoadTextureFromFile
+    using TextureLoader = std::function<Texture2D(const std::string& path)>;
+
+    // Loads from the binary cache in assets/cache when it matches the source file and import settings,
+    // otherwise imports with Assimp and writes the cache
     Model LoadModel(const std::string& path);
 
-    void ProcessAssimpNode(aiNode* node, const aiScene* scene, std::vector<MeshData>& meshBuffer);
+    // The CPU part of LoadModel: no GL calls and no change of the current directory, safe on any thread.
+    // Converts the submeshes, builds their BVHs and decodes their textures in parallel on the JobSystem. Returns false if the model can't be read
+    bool ImportModel(const std::string& path, ModelImport& outImport);
+
+    // The GL part of LoadModel for one submesh. Without loadTexture the textures come from the import's images
+    MeshData CreateSubMesh(const ModelImport& import, size_t subMesh, const TextureLoader& loadTexture = {});
+
+    // A mesh of the scene where a node of the tree places it (a mesh used by several nodes comes once per node)
+    struct AssimpMeshInstance
+    {
+        const aiMesh* Mesh;
+        TransformHierarchy::NodeId Node;
+    };
+
+    // Adds the node tree under parent to hierarchy with the nodes' transforms, and gathers their meshes, depth first
+    void ProcessAssimpNode(aiNode* node, const aiScene* scene, TransformHierarchy& hierarchy, TransformHierarchy::NodeId parent,
+                           std::vector<AssimpMeshInstance>& outMeshes);
+
+    // Converts the mesh's triangles into outMesh, moved by transform (its node's world matrix). materials are the scene's, by index
+    void ProcessAssimpMesh(const aiMesh* mesh, const std::vector<MaterialDescription>& materials, const glm::mat4& transform, MeshImportData& outMesh);
+
+    MaterialDescription GetMaterialDescription(aiMaterial* mat);
+
+    // Appends the simplified levels of detail of the mesh to its indices
+    void BuildMeshLods(MeshImportData& mesh);
+
+    // Splits LOD 0 in meshlets, reordering its triangles
+    void BuildMeshMeshlets(MeshImportData& mesh);
+
+    // Reorders triangles (vertex cache and overdraw) and vertices (fetch locality) of every LOD.
+    // Keeps the meshlets contiguous, must run after BuildMeshMeshlets
+    void OptimizeMesh(MeshImportData& mesh, MeshOptimizer::VertexCacheStats& outBefore, MeshOptimizer::VertexCacheStats& outAfter);
+
+    std::vector<std::string> GetMaterialTexturePaths(aiMaterial* mat, aiTextureType type);
 
-    MeshData ProcessAssimpMesh(aiMesh* mesh, const aiScene* scene);
+    Material LoadMaterial(const MaterialDescription& description, const TextureLoader& loadTexture = {});
 
-    std::vector<Texture2D> LoadMaterialTextures(aiMaterial* mat, aiTextureType type);
+    // Textures already loaded by path are shared
+    std::vector<Texture2D> LoadMaterialTextures(const std::vector<std::string>& paths, const TextureLoader& loadTexture = {});
 }
 
 //////////////////////////////////
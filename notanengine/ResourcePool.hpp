@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+    32-bit handle into a ResourcePool: 20 bits of slot index and 12 bits of
+    generation. A slot's generation changes every time it's freed, so a handle
+    kept past the resource's lifetime stops resolving instead of pointing at
+    whatever took the slot next. Generations start at 1, so 0 is never a valid
+    handle.
+*/
+struct ResourceHandle
+{
+    static constexpr uint32_t INDEX_BITS = 20;
+    static constexpr uint32_t GENERATION_BITS = 12;
+    static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+    static constexpr uint32_t MAX_GENERATION = (1u << GENERATION_BITS) - 1;
+    static constexpr uint32_t MAX_SLOTS = 1u << INDEX_BITS;
+
+    uint32_t Value = 0;
+
+    ResourceHandle() = default;
+    ResourceHandle(uint32_t index, uint32_t generation)
+        : Value((generation << INDEX_BITS) | (index & INDEX_MASK)) {}
+
+    inline uint32_t GetIndex() const noexcept { return Value & INDEX_MASK; }
+    inline uint32_t GetGeneration() const noexcept { return Value >> INDEX_BITS; }
+    inline bool IsNull() const noexcept { return Value == 0; }
+
+    inline bool operator==(const ResourceHandle& other) const noexcept { return Value == other.Value; }
+    inline bool operator!=(const ResourceHandle& other) const noexcept { return Value != other.Value; }
+};
+static_assert(sizeof(ResourceHandle) == 4, "ResourceHandle must stay 32 bits");
+
+// Slots of T reused through a free list. Not thread safe, the owner locks around it
+template <typename T>
+class ResourcePool
+{
+public:
+    // A null handle once every slot is in use
+    ResourceHandle Create(T value)
+    {
+        uint32_t index;
+        if (!m_freeSlots.empty())
+        {
+            index = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            if (m_slots.size() >= ResourceHandle::MAX_SLOTS)
+                return ResourceHandle();
+
+            index = static_cast<uint32_t>(m_slots.size());
+            m_slots.emplace_back();
+        }
+
+        Slot& slot = m_slots[index];
+        slot.Value = std::move(value);
+        slot.Alive = true;
+        m_size++;
+        return ResourceHandle(index, slot.Generation);
+    }
+
+    // nullptr for a null or stale handle
+    T* Get(ResourceHandle handle) noexcept
+    {
+        const uint32_t index = handle.GetIndex();
+        if (index >= m_slots.size())
+            return nullptr;
+
+        Slot& slot = m_slots[index];
+        return (slot.Alive && slot.Generation == handle.GetGeneration()) ? &slot.Value : nullptr;
+    }
+
+    const T* Get(ResourceHandle handle) const noexcept
+    {
+        return const_cast<ResourcePool*>(this)->Get(handle);
+    }
+
+    // False if the handle was already stale
+    bool Destroy(ResourceHandle handle)
+    {
+        if (!Get(handle))
+            return false;
+
+        const uint32_t index = handle.GetIndex();
+        Slot& slot = m_slots[index];
+        slot.Value = T();
+        slot.Alive = false;
+        slot.Generation = (slot.Generation == ResourceHandle::MAX_GENERATION) ? 1 : slot.Generation + 1;
+        m_freeSlots.push_back(index);
+        m_size--;
+        return true;
+    }
+
+    inline size_t GetSize() const noexcept { return m_size; }
+    inline size_t GetCapacity() const noexcept { return m_slots.size(); }
+
+private:
+    struct Slot
+    {
+        T Value{};
+        uint32_t Generation = 1;
+        bool Alive = false;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+    size_t m_size = 0;
+};
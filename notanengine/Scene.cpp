@@ -0,0 +1,237 @@
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+#include "JobSystem.hpp"
+
+EntityId Scene::CreateEntity(const std::string& name, const StaticMesh& mesh, const Shader& shader)
+{
+    WorldTransformComponent world;
+    world.Node = m_hierarchy.Add();
+    return m_world.Create(NameComponent{ name }, MeshComponent{ mesh, &shader, true }, TransformComponent(), std::move(world),
+                          WorldBoundsComponent(), VisibilityComponent());
+}
+
+EntityId Scene::CloneEntity(EntityId entity, const std::string& name)
+{
+    const MeshComponent* mesh = m_world.Get<MeshComponent>(entity);
+    const TransformComponent* transform = m_world.Get<TransformComponent>(entity);
+    const WorldTransformComponent* world = m_world.Get<WorldTransformComponent>(entity);
+    if (!mesh || !transform || !world)
+        return EntityId();
+
+    WorldTransformComponent cloneWorld;
+    cloneWorld.Node = m_hierarchy.Add(glm::mat4(1.0f), m_hierarchy.GetParent(world->Node));
+    // copied first: creating may move the chunks the pointers are in
+    MeshComponent cloneMesh = *mesh;
+    TransformComponent cloneTransform = *transform;
+    return m_world.Create(NameComponent{ name }, std::move(cloneMesh), std::move(cloneTransform), std::move(cloneWorld),
+                          WorldBoundsComponent(), VisibilityComponent());
+}
+
+void Scene::SpawnEntities(size_t count, const StaticMesh& mesh, const Shader& shader, const TransformComponent& transform,
+                          std::vector<EntityId>* outIds)
+{
+    std::vector<EntityId> ids;
+    m_world.Spawn(count, &ids, MeshComponent{ mesh, &shader, true }, transform, WorldTransformComponent(), WorldBoundsComponent(),
+                  VisibilityComponent());
+
+    m_hierarchy.Reserve(m_hierarchy.GetSize() + count);
+    for (EntityId id : ids)
+        m_world.Get<WorldTransformComponent>(id)->Node = m_hierarchy.Add();
+
+    if (outIds)
+        outIds->insert(outIds->end(), ids.begin(), ids.end());
+}
+
+void Scene::DestroyEntity(EntityId entity)
+{
+    if (const WorldTransformComponent* world = m_world.Get<WorldTransformComponent>(entity))
+        m_hierarchy.Remove(world->Node);
+    m_spatial.Remove(entity);
+    m_world.Destroy(entity);
+}
+
+bool Scene::SetParent(EntityId entity, EntityId parent)
+{
+    const WorldTransformComponent* world = m_world.Get<WorldTransformComponent>(entity);
+    if (!world)
+        return false;
+
+    const WorldTransformComponent* parentWorld = m_world.Get<WorldTransformComponent>(parent);
+    return m_hierarchy.SetParent(world->Node, parentWorld ? parentWorld->Node : TransformHierarchy::INVALID_NODE);
+}
+
+bool Scene::HasParent(EntityId entity, EntityId parent) const
+{
+    const WorldTransformComponent* world = m_world.Get<WorldTransformComponent>(entity);
+    if (!world)
+        return false;
+
+    const WorldTransformComponent* parentWorld = m_world.Get<WorldTransformComponent>(parent);
+    return m_hierarchy.GetParent(world->Node) == (parentWorld ? parentWorld->Node : TransformHierarchy::INVALID_NODE);
+}
+
+void Scene::Animate(float deltaTime)
+{
+    m_world.ForEach<TransformComponent, const AnimationComponent>(
+        [deltaTime](EntityId, TransformComponent& transform, const AnimationComponent& animation) {
+            if (animation.DegreesPerSecond != 0.0f)
+                transform.Rotate(animation.DegreesPerSecond * deltaTime, animation.Axis);
+        });
+}
+
+void Scene::Update()
+{
+    UpdateTransforms();
+    UpdateBounds();
+}
+
+void Scene::UpdateTransforms()
+{
+    /// Changed transforms into the hierarchy (on this thread, SetLocal marks the ancestors). The stale matrices
+    /// are only collected here, to be composed together
+    m_rebuilding.clear();
+    m_world.ForEachChunk<TransformComponent, WorldTransformComponent>(
+        [this](size_t count, const EntityId*, TransformComponent* transforms, WorldTransformComponent* worlds) {
+            for (size_t i = 0; i < count; i++)
+            {
+                if (transforms[i].IsDirty() && transforms[i].BeginRebuild())
+                {
+                    m_rebuilding.push_back({ &transforms[i], &worlds[i] });
+                    continue;
+                }
+
+                // built since it was last given, or new to the hierarchy
+                const uint64_t version = transforms[i].GetVersion();
+                if (version == worlds[i].LocalVersion)
+                    continue;
+                m_hierarchy.SetLocal(worlds[i].Node, transforms[i].GetTransformMatrix());
+                worlds[i].LocalVersion = version;
+            }
+        });
+
+    /// Their matrices with the TransformSystem's SIMD kernels, in batches on the JobSystem
+    m_rebuildBatch.Resize(m_rebuilding.size());
+    JobSystem::ParallelFor(m_rebuilding.size(), 1024, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const TransformComponent& transform = *m_rebuilding[i].first;
+            m_rebuildBatch.SetPosition(i, transform.GetPosition());
+            m_rebuildBatch.SetRotation(i, transform.GetOrientation());
+            m_rebuildBatch.SetScale(i, transform.GetScale());
+        }
+        m_rebuildBatch.Compose(begin, end);
+        for (size_t i = begin; i < end; i++)
+            m_rebuilding[i].first->EndRebuild(m_rebuildBatch.GetMatrix(i));
+    });
+
+    for (const auto& [transform, world] : m_rebuilding)
+    {
+        m_hierarchy.SetLocal(world->Node, transform->GetTransformMatrix());
+        world->LocalVersion = transform->GetVersion();
+    }
+
+    m_hierarchy.Update();
+
+    /// World matrices back into the entities, only when some moved
+    if (m_hierarchy.GetStats().NodesUpdated > 0)
+    {
+        m_world.ParallelForEachChunk<WorldTransformComponent>([this](size_t count, const EntityId*, WorldTransformComponent* worlds) {
+            for (size_t i = 0; i < count; i++)
+            {
+                const uint64_t version = m_hierarchy.GetVersion(worlds[i].Node);
+                if (version == worlds[i].Version)
+                    continue;
+                worlds[i].Matrix = m_hierarchy.GetWorld(worlds[i].Node);
+                worlds[i].Version = version;
+            }
+        });
+    }
+}
+
+void Scene::UpdateBounds()
+{
+    std::mutex changesMutex;
+    std::vector<std::pair<EntityId, AABB>> changes;
+
+    // also when the submeshes changed (a model finishing loading)
+    m_world.ParallelForEachChunk<const MeshComponent, const WorldTransformComponent, WorldBoundsComponent>(
+        [&](size_t count, const EntityId* ids, const MeshComponent* meshes, const WorldTransformComponent* worlds, WorldBoundsComponent* bounds) {
+            std::vector<std::pair<EntityId, AABB>> chunkChanges;
+            for (size_t i = 0; i < count; i++)
+            {
+                const std::vector<MeshData>& subMeshes = meshes[i].Mesh.GetSubMeshes();
+                WorldBoundsComponent& b = bounds[i];
+                if (b.Version == worlds[i].Version && b.SubMeshes == subMeshes.data() && b.NumSubMeshes == subMeshes.size())
+                    continue;
+
+                b.Bounds = AABB();
+                for (const auto& meshData : subMeshes)
+                {
+                    if (meshData.Bounds.IsValid())
+                        b.Bounds.Expand(meshData.Bounds.Transformed(worlds[i].Matrix));
+                }
+                b.Version = worlds[i].Version;
+                b.SubMeshes = subMeshes.data();
+                b.NumSubMeshes = subMeshes.size();
+                chunkChanges.push_back({ ids[i], b.Bounds });
+            }
+
+            if (!chunkChanges.empty())
+            {
+                std::lock_guard<std::mutex> lock(changesMutex);
+                changes.insert(changes.end(), chunkChanges.begin(), chunkChanges.end());
+            }
+        });
+
+    // what moved relocates in the spatial index, under a single lock
+    if (!changes.empty())
+        m_spatial.Update(changes);
+}
+
+bool Scene::Raycast(const Ray& ray, SceneRayHit& outHit) const
+{
+    std::vector<std::pair<EntityId, float>> candidates;
+    m_spatial.QueryRay(ray, candidates);
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+
+    SceneRayHit closest;
+    closest.Hit.Distance = ray.MaxDistance;
+    for (const auto& [entity, entry] : candidates)
+    {
+        // the rest of the bounds start behind the closest hit
+        if (entry >= closest.Hit.Distance)
+            break;
+
+        const MeshComponent* mesh = m_world.Get<MeshComponent>(entity);
+        const WorldTransformComponent* world = m_world.Get<WorldTransformComponent>(entity);
+        if (!mesh || !world || !mesh->Visible)
+            continue;
+
+        // the ray in model space, its direction not normalized again so distances stay the same
+        const glm::mat4 toModel = glm::inverse(world->Matrix);
+        Ray modelRay;
+        modelRay.Origin = glm::vec3(toModel * glm::vec4(ray.Origin, 1.0f));
+        modelRay.Direction = glm::vec3(toModel * glm::vec4(ray.Direction, 0.0f));
+
+        const std::vector<MeshData>& subMeshes = mesh->Mesh.GetSubMeshes();
+        for (size_t i = 0; i < subMeshes.size(); i++)
+        {
+            modelRay.MaxDistance = closest.Hit.Distance;
+            if (subMeshes[i].Bvh && subMeshes[i].Bvh->Raycast(modelRay, closest.Hit))
+            {
+                closest.Entity = entity;
+                closest.SubMesh = i;
+            }
+        }
+    }
+
+    if (!closest.Hit.IsHit())
+        return false;
+
+    closest.Position = ray.Origin + ray.Direction * closest.Hit.Distance;
+    outHit = closest;
+    return true;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Bounds.hpp"
+#include "MeshBvh.hpp"
+#include "Shader.hpp"
+#include "SpatialHash.hpp"
+#include "StaticMesh.hpp"
+#include "TransformComponent.hpp"
+#include "TransformHierarchy.hpp"
+#include "TransformSystem.hpp"
+#include "World.hpp"
+
+/// The engine's components, besides TransformComponent (the entity's transform relative to its parent)
+
+struct NameComponent
+{
+    std::string Name;
+};
+
+// What the entity draws. The submeshes may be shared with other entities
+struct MeshComponent
+{
+    StaticMesh Mesh;
+    const Shader* DrawShader = nullptr;
+    bool Visible = true;
+};
+
+// The entity's node in the scene's hierarchy and its world matrix, kept by Scene::Update
+struct WorldTransformComponent
+{
+    glm::mat4 Matrix = glm::mat4(1.0f);
+    uint64_t Version = 0;                   // changes whenever Matrix is recomputed, also when only a parent moved
+    TransformHierarchy::NodeId Node = TransformHierarchy::INVALID_NODE;
+    uint64_t LocalVersion = 0;              // of the TransformComponent last given to the hierarchy
+};
+
+// Bounds of every submesh in world space, recomputed only when the world matrix or the submeshes changed
+struct WorldBoundsComponent
+{
+    AABB Bounds;
+    uint64_t Version = 0;
+    const MeshData* SubMeshes = nullptr;
+    size_t NumSubMeshes = 0;
+};
+
+// Which submeshes draw this frame and at which LOD, filled by Render::SelectLods and read by Render::DrawScene
+struct VisibilityComponent
+{
+    bool InView = true;
+    std::vector<unsigned char> Lods;        // by submesh
+};
+
+// Turns the entity's transform at a constant rate, applied by Scene::Animate
+struct AnimationComponent
+{
+    glm::vec3 Axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float DegreesPerSecond = 0.0f;
+};
+
+// The closest triangle Scene::Raycast found
+struct SceneRayHit
+{
+    EntityId Entity;
+    size_t SubMesh = 0;
+    RayHit Hit;                             // the submesh's triangle, and the distance along the ray
+    glm::vec3 Position = glm::vec3(0.0f);   // in world space
+};
+
+/*
+    The entities of a level: a World with the engine's components, and the
+    transform hierarchy parenting them. Every entity made here has a mesh,
+    a transform, its world transform, world bounds and visibility; only
+    those of CreateEntity (and CloneEntity) have a name too, the ones
+    SpawnEntities makes in bulk don't, which keeps them out of the editor.
+    The entities with world bounds are also kept in a spatial index, for
+    the proximity queries and the raycasts.
+    Update runs once per frame after the transforms changed (editor,
+    gameplay, Animate) and before anything reads world matrices or bounds.
+    Its two halves are also callable on their own, for a SystemScheduler
+    to run them as separate systems.
+    Main thread only, except the queries Update itself spreads on the
+    JobSystem.
+*/
+class Scene
+{
+public:
+    EntityId CreateEntity(const std::string& name, const StaticMesh& mesh, const Shader& shader);
+    // Copies of the entity's name, mesh and transform, as a sibling of it (without its children)
+    EntityId CloneEntity(EntityId entity, const std::string& name);
+    // count unnamed roots sharing mesh, filling the chunks in order
+    void SpawnEntities(size_t count, const StaticMesh& mesh, const Shader& shader, const TransformComponent& transform,
+                       std::vector<EntityId>* outIds = nullptr);
+    // Its children go to its parent
+    void DestroyEntity(EntityId entity);
+
+    // An invalid parent makes it a root. false (nothing changes) if parent is the entity or one of its descendants
+    bool SetParent(EntityId entity, EntityId parent);
+    // Whether parent is the direct parent, an invalid one for a root
+    bool HasParent(EntityId entity, EntityId parent) const;
+
+    // Advances every AnimationComponent by deltaTime seconds
+    void Animate(float deltaTime);
+
+    // UpdateTransforms then UpdateBounds
+    void Update();
+    // Local transforms into the hierarchy, then the world matrices of what moved
+    void UpdateTransforms();
+    // World bounds of what moved or got new submeshes, and their place in the spatial index
+    void UpdateBounds();
+
+    template <typename T>
+    inline T* Get(EntityId entity) { return m_world.Get<T>(entity); }
+    template <typename T>
+    inline const T* Get(EntityId entity) const { return m_world.Get<T>(entity); }
+
+    // Closest triangle of the visible entities along a world space ray, as of the last UpdateBounds: the spatial index
+    // finds the bounds on the way, nearest first, and the submeshes' BVHs the triangles. false if it hits nothing
+    bool Raycast(const Ray& ray, SceneRayHit& outHit) const;
+
+    inline World& GetWorld() noexcept { return m_world; }
+    inline const TransformHierarchyStats& GetHierarchyStats() const noexcept { return m_hierarchy.GetStats(); }
+    // The entities by world bounds, as of the last UpdateBounds. Safe to query from several threads at once
+    inline const SpatialHash& GetSpatialIndex() const noexcept { return m_spatial; }
+
+private:
+    World m_world;
+    TransformHierarchy m_hierarchy;
+    // the transforms UpdateTransforms rebuilds, and their matrices composed together
+    std::vector<std::pair<const TransformComponent*, WorldTransformComponent*>> m_rebuilding;
+    TransformSystem m_rebuildBatch;
+    // cells of a few meters, about a light's range
+    SpatialHash m_spatial{ 4.0f };
+};
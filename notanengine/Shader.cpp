@@ -14,7 +14,13 @@ Shader::Shader(const std::string &vertexPath, const std::string &fragmentPath)
     Init(vertexPath, fragmentPath);
 }
 
+Shader::Shader(const std::string &vertexPath, const std::string &geometryPath, const std::string &fragmentPath)
+{
+    Init(vertexPath, geometryPath, fragmentPath);
+}
+
 Shader::Shader(const char *vertexCode, const char *fragCode)
+    : m_geomID(0)
 {
     int success = 0;
     char infoLog[512];
@@ -47,6 +53,7 @@ Shader::Shader(const char *vertexCode, const char *fragCode)
 
     // shader program
     ID = glCreateProgram();
+    m_program = GpuObjectRef(GpuObjectType::Program, ID);
     glAttachShader(ID, m_vertexID);
     glAttachShader(ID, m_fragID);
     glLinkProgram(ID);
@@ -74,72 +81,84 @@ Shader::Shader(const Shader &other)
 {
     this->ID = other.ID;
     this->m_vertexID = other.m_vertexID;
+    this->m_geomID = other.m_geomID;
     this->m_fragID = other.m_fragID;
+    this->m_program = other.m_program;
 }
 
-void Shader::Init(const std::string &vertexPath, const std::string &fragmentPath)
+static std::string readShaderFile(const std::string& path)
 {
-    std::ifstream vShaderFile, fShaderFile;
+    std::ifstream shaderFile;
     // ensure ifstream objects can throw exceptions
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
-    std::stringstream vShaderStream{}, fShaderStream{};
-    std::string vertexCode{}, fragCode{};
+    std::stringstream shaderStream{};
     try
     {
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-
-        vShaderFile.close();
-        fShaderFile.close();
-
-        vertexCode = vShaderStream.str();
-        fragCode = fShaderStream.str();    
+        shaderFile.open(path);
+        shaderStream << shaderFile.rdbuf();
+        shaderFile.close();
     }
     catch(const std::ifstream::failure& e)
     {
-        std::cerr << "Error while trying to read shader files from " << vertexPath << " or " << fragmentPath << ": " << e.what() << '\n';
+        std::cerr << "Error while trying to read shader file from " << path << ": " << e.what() << '\n';
     }
-    
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragCode.c_str();
+
+    return shaderStream.str();
+}
+
+static unsigned int compileShaderStage(GLenum type, const std::string& code, const char* stageName, const std::string& programName)
+{
+    const char* shaderCode = code.c_str();
 
     int success = 0;
     char infoLog[512];
 
-    // vertex shader
-    m_vertexID = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(m_vertexID, 1, &vShaderCode, nullptr);
-    glCompileShader(m_vertexID);
+    unsigned int shaderID = glCreateShader(type);
+    glShaderSource(shaderID, 1, &shaderCode, nullptr);
+    glCompileShader(shaderID);
 
     // check for compiler errors
-    glGetShaderiv(m_vertexID, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(m_vertexID, 512, nullptr, infoLog);
-        std::cout << "Error compiling vertex shader " << vertexPath << ": " << infoLog << "\n";
+        glGetShaderInfoLog(shaderID, 512, nullptr, infoLog);
+        std::cout << "Error compiling " << stageName << " shader of " << programName << ": " << infoLog << "\n";
     }
 
-    // fragment shader
-    m_fragID = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(m_fragID, 1, &fShaderCode, nullptr);
-    glCompileShader(m_fragID);
+    return shaderID;
+}
 
-    // check for compiler errors
-    glGetShaderiv(m_fragID, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(m_fragID, 512, nullptr, infoLog);
-        std::cout << "Error compiling fragment shader " << fragmentPath << ": " << infoLog << "\n";
-    }
+void Shader::Init(const std::string &vertexPath, const std::string &fragmentPath)
+{
+    compileAndLink(readShaderFile(vertexPath), std::string(), readShaderFile(fragmentPath), vertexPath + ", " + fragmentPath);
+}
+
+void Shader::Init(const std::string &vertexPath, const std::string &geometryPath, const std::string &fragmentPath)
+{
+    compileAndLink(
+        readShaderFile(vertexPath),
+        readShaderFile(geometryPath),
+        readShaderFile(fragmentPath),
+        vertexPath + ", " + geometryPath + ", " + fragmentPath
+    );
+}
+
+void Shader::compileAndLink(const std::string &vertexCode, const std::string &geometryCode, const std::string &fragCode, const std::string &programName)
+{
+    int success = 0;
+    char infoLog[512];
+
+    m_vertexID = compileShaderStage(GL_VERTEX_SHADER, vertexCode, "vertex", programName);
+    m_geomID = geometryCode.empty() ? 0 : compileShaderStage(GL_GEOMETRY_SHADER, geometryCode, "geometry", programName);
+    m_fragID = compileShaderStage(GL_FRAGMENT_SHADER, fragCode, "fragment", programName);
 
     // shader program
     ID = glCreateProgram();
+    m_program = GpuObjectRef(GpuObjectType::Program, ID);
     glAttachShader(ID, m_vertexID);
+    if (m_geomID)
+        glAttachShader(ID, m_geomID);
     glAttachShader(ID, m_fragID);
     glLinkProgram(ID);
     glValidateProgram(ID);
@@ -149,13 +168,19 @@ void Shader::Init(const std::string &vertexPath, const std::string &fragmentPath
     if (!success)
     {
         glGetProgramInfoLog(ID, 512, nullptr, infoLog);
-        std::cout << "Error linking shader program of " << vertexPath << ", " << fragmentPath << ": " << infoLog << "\n";
+        std::cout << "Error linking shader program of " << programName << ": " << infoLog << "\n";
     }
 
     // delete and detach shaders
     glDetachShader(ID, m_vertexID);
     glDeleteShader(m_vertexID);
 
+    if (m_geomID)
+    {
+        glDetachShader(ID, m_geomID);
+        glDeleteShader(m_geomID);
+    }
+
     glDetachShader(ID, m_fragID);
     glDeleteShader(m_fragID);
 
@@ -198,14 +223,26 @@ void Shader::SetMat4(const std::string &name, const glm::mat4 &m) const noexcept
     glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(m)); 
 }
 
+void Shader::SetVec2(const std::string &name, const glm::vec2 &v) const noexcept
+{
+    GLint loc = glGetUniformLocation(ID, name.c_str());
+    glUniform2fv(loc, 1, glm::value_ptr(v));
+}
+
 void Shader::SetVec3(const std::string &name, const glm::vec3 &v) const noexcept
 {
     GLint loc = glGetUniformLocation(ID, name.c_str());
     glUniform3fv(loc, 1, glm::value_ptr(v));
 }
 
+void Shader::SetUVec3(const std::string &name, const glm::uvec3 &v) const noexcept
+{
+    GLint loc = glGetUniformLocation(ID, name.c_str());
+    glUniform3uiv(loc, 1, glm::value_ptr(v));
+}
+
 
-void Shader::SetMaterial(const std::string& name, Material& mat) const noexcept
+void Shader::SetMaterial(const std::string& name, const Material& mat) const noexcept
 {
     constexpr size_t MAX_NUMBER_SAMPLER2D = 15;
 
@@ -220,9 +257,7 @@ void Shader::SetMaterial(const std::string& name, Material& mat) const noexcept
     // set diffuse textures in EVEN-numbered texture units
     for (int unit = 0, count = 0; count < diffuseSize; count++)
     {
-        Texture2D& diffuseTex = mat.DiffuseMaps[count];
-        diffuseTex.SetUnit(unit);
-        diffuseTex.Bind();
+        mat.DiffuseMaps[count].Bind(unit);
 
         char texIndex = count + '0';
         const std::string uniformTex(name + ".texture_diffuse[" + texIndex + ']');
@@ -233,9 +268,7 @@ void Shader::SetMaterial(const std::string& name, Material& mat) const noexcept
         // set specular textures in ODD-numbered texture units
         for (int unit = 1, count = 0; count < specularSize; count++)
         {
-        Texture2D& specularTex = mat.SpecularMaps[count];
-        specularTex.SetUnit(unit);
-        specularTex.Bind();
+        mat.SpecularMaps[count].Bind(unit);
 
 
         char texIndex = count + '0';
@@ -4,14 +4,16 @@
 #include <glm/glm.hpp>
 
 #include "Material.hpp"
+#include "GpuResources.hpp"
 
 class Shader
 {
 public:
     Shader()
-        : ID(0), m_vertexID(0), m_fragID(0) {}
+        : ID(0), m_vertexID(0), m_geomID(0), m_fragID(0) {}
 
     Shader(const std::string& vertexPath, const std::string& fragmentPath);
+    Shader(const std::string& vertexPath, const std::string& geometryPath, const std::string& fragmentPath);
     Shader(const char* vertexCode, const char* fragCode);
 
     Shader(const Shader& other);
@@ -19,6 +21,7 @@ public:
     unsigned int ID;
 
     void Init(const std::string& vertexPath, const std::string& fragmentPath);
+    void Init(const std::string& vertexPath, const std::string& geometryPath, const std::string& fragmentPath);
     void Use() const noexcept;
 
     void SetBool(const std::string& name, bool val) const noexcept;
@@ -26,10 +29,17 @@ public:
     void SetUInt(const std::string& name, unsigned int val) const noexcept;
     void SetFloat(const std::string& name, float val) const noexcept;
     void SetMat4(const std::string& name, const glm::mat4& m) const noexcept;
+    void SetVec2(const std::string& name, const glm::vec2& v) const noexcept;
     void SetVec3(const std::string& name, const glm::vec3& v) const noexcept;
+    void SetUVec3(const std::string& name, const glm::uvec3& v) const noexcept;
 
-    void SetMaterial(const std::string& name, Material& mat) const noexcept;
+    void SetMaterial(const std::string& name, const Material& mat) const noexcept;
 
 private:
-    unsigned int m_vertexID, m_fragID;
+    unsigned int m_vertexID, m_geomID, m_fragID;
+    // shared by copies, the program is deleted once none is left
+    GpuObjectRef m_program;
+
+    // geometryCode may be empty (no geometry stage)
+    void compileAndLink(const std::string& vertexCode, const std::string& geometryCode, const std::string& fragCode, const std::string& programName);
 };
@@ -0,0 +1,538 @@
+#include "ShadowMap.hpp"
+
+#include <glad/glad.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+
+// Shader::SetMaterial and the clustered lights use units 0..31
+constexpr int CASCADE_SHADOW_TEXTURE_UNIT = 32;
+
+static void hashCombine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+CascadedShadowMap::CascadedShadowMap(const CascadedShadowMapProperties& props)
+    : m_props(props)
+{
+    m_props.NumCascades = std::clamp(m_props.NumCascades, 1u, MAX_CASCADES);
+    m_props.FirstCachedCascade = std::min(m_props.FirstCachedCascade, m_props.NumCascades);
+
+    glGenTextures(1, &m_depthTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthTexture);
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0,
+        GL_DEPTH_COMPONENT32F,
+        m_props.Resolution,
+        m_props.Resolution,
+        m_props.NumCascades,
+        0,
+        GL_DEPTH_COMPONENT,
+        GL_FLOAT,
+        nullptr
+    );
+
+    // hardware depth comparison + bilinear filtering gives 2x2 PCF for free
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    // anything outside the map is lit
+    const float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteTextures(1, &m_depthTexture);
+}
+
+void CascadedShadowMap::Update(const Camera& camera, float aspectRatio, float zNear, float zFar, const glm::vec3& lightDirection)
+{
+    const glm::vec3 dir = glm::normalize(lightDirection);
+    const bool lightChanged = glm::dot(dir, m_lightDirection) < 0.99999f;
+    m_lightDirection = dir;
+
+    const float shadowFar = std::min(zFar, m_props.MaxShadowDistance);
+    const float tanHalfY = std::tan(glm::radians(camera.FOV) * 0.5f);
+    const float tanHalfX = tanHalfY * aspectRatio;
+    const glm::mat4 invView = glm::inverse(camera.GetLookAtMatrix());
+
+    float splitNear = zNear;
+    for (unsigned int i = 0; i < m_props.NumCascades; i++)
+    {
+        const float t = static_cast<float>(i + 1) / m_props.NumCascades;
+        const float uniformSplit = zNear + (shadowFar - zNear) * t;
+        const float logSplit = zNear * std::pow(shadowFar / zNear, t);
+        const float splitFar = glm::mix(uniformSplit, logSplit, m_props.SplitLambda);
+
+        // bounding sphere of the frustum slice
+        glm::vec3 corners[8];
+        int c = 0;
+        for (float depth : { splitNear, splitFar })
+        {
+            for (float sx : { -1.0f, 1.0f })
+            {
+                for (float sy : { -1.0f, 1.0f })
+                    corners[c++] = glm::vec3(invView * glm::vec4(sx * depth * tanHalfX, sy * depth * tanHalfY, -depth, 1.0f));
+            }
+        }
+
+        glm::vec3 center(0.0f);
+        for (const auto& corner : corners)
+            center += corner;
+        center /= 8.0f;
+
+        float radius = 0.0f;
+        for (const auto& corner : corners)
+            radius = std::max(radius, glm::length(corner - center));
+        // the radius only depends on the projection, quantizing it keeps it (and the texel size) constant between frames
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        Cascade& cascade = m_cascades[i];
+        cascade.SplitFar = splitFar;
+
+        if (i < m_props.FirstCachedCascade)
+        {
+            cascade.Center = center;
+            cascade.Radius = radius;
+            cascade.LightSpace = buildLightSpaceMatrix(center, radius);
+            cascade.NeedsRender = true;
+        }
+        else
+        {
+            // the cached sphere must still contain the whole slice, and not be too coarse for it
+            const float paddedRadius = radius * (1.0f + m_props.CachePadding);
+            const bool outside = glm::length(center - cascade.Center) + radius > cascade.Radius;
+            const bool tooCoarse = cascade.Radius > paddedRadius * 1.5f;
+
+            if (lightChanged || outside || tooCoarse)
+            {
+                cascade.Center = center;
+                cascade.Radius = paddedRadius;
+                cascade.LightSpace = buildLightSpaceMatrix(center, paddedRadius);
+                cascade.NeedsRender = true;
+            }
+        }
+
+        splitNear = splitFar;
+    }
+}
+
+void CascadedShadowMap::Render(Scene& casters, const Shader& depthShader)
+{
+    const size_t signature = computeCastersSignature(casters);
+    if (m_staticGeometryDirty || signature != m_castersSignature)
+    {
+        for (unsigned int i = m_props.FirstCachedCascade; i < m_props.NumCascades; i++)
+            m_cascades[i].NeedsRender = true;
+
+        m_castersSignature = signature;
+        m_staticGeometryDirty = false;
+    }
+
+    m_stats = CascadedShadowMapStats();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, m_props.Resolution, m_props.Resolution);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    for (unsigned int i = 0; i < m_props.NumCascades; i++)
+    {
+        Cascade& cascade = m_cascades[i];
+        if (!cascade.NeedsRender)
+            continue;
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0, i);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        unsigned int culled = 0;
+        m_stats.CastersDrawn += Render::DrawShadowCasters(casters, depthShader, cascade.LightSpace, culled);
+        m_stats.CastersCulled += culled;
+        m_stats.CascadesRendered++;
+
+        cascade.NeedsRender = false;
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CascadedShadowMap::SetUniforms(const Shader& shader) const
+{
+    shader.Use();
+
+    glActiveTexture(GL_TEXTURE0 + CASCADE_SHADOW_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.SetInt("u_cascadeShadowMap", CASCADE_SHADOW_TEXTURE_UNIT);
+    shader.SetInt("u_cascadeCount", static_cast<int>(m_props.NumCascades));
+
+    for (unsigned int i = 0; i < m_props.NumCascades; i++)
+    {
+        const std::string index = std::to_string(i);
+        shader.SetMat4("u_cascadeMatrices[" + index + "]", m_cascades[i].LightSpace);
+        shader.SetFloat("u_cascadeSplits[" + index + "]", m_cascades[i].SplitFar);
+    }
+
+    shader.SetBool("u_useShadows", true);
+}
+
+glm::mat4 CascadedShadowMap::buildLightSpaceMatrix(const glm::vec3& center, float radius) const
+{
+    const glm::vec3 up = (std::abs(m_lightDirection.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    const glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), m_lightDirection, up);
+
+    // move the cascade in whole texels only, otherwise the rasterization of the casters changes every frame
+    glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+    const float texelSize = 2.0f * radius / m_props.Resolution;
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    const glm::mat4 projection = glm::ortho(
+        lightCenter.x - radius, lightCenter.x + radius,
+        lightCenter.y - radius, lightCenter.y + radius,
+        -(lightCenter.z + radius + m_props.CasterDistance),
+        -(lightCenter.z - radius)
+    );
+
+    return projection * lightRotation;
+}
+
+size_t CascadedShadowMap::computeCastersSignature(Scene& casters) const
+{
+    size_t signature = 0;
+
+    casters.GetWorld().ForEach<const MeshComponent, const WorldTransformComponent>(
+        [&signature](EntityId entity, const MeshComponent& mesh, const WorldTransformComponent& world) {
+            if (!mesh.Visible)
+                return;
+
+            hashCombine(signature, EntityIdHash()(entity));
+            hashCombine(signature, mesh.Mesh.GetSubMeshes().size());
+
+            // versions never repeat, so an unchanged version is an unchanged matrix
+            hashCombine(signature, std::hash<uint64_t>()(world.Version));
+        });
+
+    return signature;
+}
+
+
+// Shader::SetMaterial, clustered lights and the cascades use units 0..32
+constexpr int SHADOW_ATLAS_TEXTURE_UNIT = 33;
+
+constexpr float OMNI_SHADOW_NEAR = 0.05f;
+
+// cube face directions and up vectors, must match CUBE_FACE_DIR/CUBE_FACE_UP in entity_lighting.frag
+static const glm::vec3 s_cubeFaceDirs[6] = {
+    {  1.0f,  0.0f,  0.0f }, { -1.0f,  0.0f,  0.0f },
+    {  0.0f,  1.0f,  0.0f }, {  0.0f, -1.0f,  0.0f },
+    {  0.0f,  0.0f,  1.0f }, {  0.0f,  0.0f, -1.0f }
+};
+static const glm::vec3 s_cubeFaceUps[6] = {
+    {  0.0f, -1.0f,  0.0f }, {  0.0f, -1.0f,  0.0f },
+    {  0.0f,  0.0f,  1.0f }, {  0.0f,  0.0f, -1.0f },
+    {  0.0f, -1.0f,  0.0f }, {  0.0f, -1.0f,  0.0f }
+};
+
+// same up vector rule as the lighting shader uses for spot lights
+static glm::vec3 spotUpVector(const glm::vec3& direction)
+{
+    return (std::abs(direction.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+ShadowAtlas::ShadowAtlas(const ShadowAtlasProperties& props)
+    : m_props(props)
+{
+    m_slots.resize(m_props.NumSlots);
+
+    glGenTextures(1, &m_depthTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthTexture);
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0,
+        GL_DEPTH_COMPONENT16,
+        m_props.FaceResolution,
+        m_props.FaceResolution,
+        m_props.NumSlots * LAYERS_PER_SLOT,
+        0,
+        GL_DEPTH_COMPONENT,
+        GL_FLOAT,
+        nullptr
+    );
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteTextures(1, &m_depthTexture);
+}
+
+void ShadowAtlas::Update(std::vector<PointLight>& pointLights, std::vector<SpotLight>& spotLights, const glm::vec3& cameraPosition,
+                         Scene& casters, const Shader& omniDepthShader)
+{
+    m_stats = ShadowAtlasStats();
+
+    struct Candidate
+    {
+        LightType Type;
+        size_t Index;
+        SlotRequest Request;
+    };
+    std::vector<Candidate> candidates;
+
+    for (size_t i = 0; i < pointLights.size(); i++)
+    {
+        PointLight& light = pointLights[i];
+        light.ShadowLayer = -1;
+        if (!light.CastShadows)
+            continue;
+
+        const float range = light.GetRange();
+        const float priority = std::max(glm::length(light.Position - cameraPosition) - range, 0.0f);
+        candidates.push_back({ LightType::Point, i, { light.Position, glm::vec3(0.0f), range, 1.0f, 0, priority } });
+    }
+
+    for (size_t i = 0; i < spotLights.size(); i++)
+    {
+        SpotLight& light = spotLights[i];
+        light.ShadowLayer = -1;
+        if (!light.CastShadows)
+            continue;
+
+        const float range = light.GetRange();
+        const float priority = std::max(glm::length(light.Position - cameraPosition) - range, 0.0f);
+        const glm::vec3 direction = glm::normalize(light.Direction);
+        candidates.push_back({ LightType::Spot, i, { light.Position, direction, range, light.GetShadowFovTangent(), 0, priority } });
+    }
+
+    // the closest light volumes get the slots
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.Request.Priority < b.Request.Priority;
+    });
+    if (candidates.size() > m_slots.size())
+        candidates.resize(m_slots.size());
+
+    // lights that already own a slot keep it, the others take the freed ones
+    std::vector<int> candidateSlot(candidates.size(), -1);
+    std::vector<bool> slotTaken(m_slots.size(), false);
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        for (size_t s = 0; s < m_slots.size(); s++)
+        {
+            if (m_slots[s].Type == candidates[c].Type && m_slots[s].LightIndex == candidates[c].Index)
+            {
+                candidateSlot[c] = static_cast<int>(s);
+                slotTaken[s] = true;
+                break;
+            }
+        }
+    }
+
+    size_t freeSlot = 0;
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        if (candidateSlot[c] >= 0)
+            continue;
+
+        while (slotTaken[freeSlot])
+            freeSlot++;
+
+        Slot& slot = m_slots[freeSlot];
+        slot.Type = candidates[c].Type;
+        slot.LightIndex = candidates[c].Index;
+        slot.Valid = false;
+
+        candidateSlot[c] = static_cast<int>(freeSlot);
+        slotTaken[freeSlot] = true;
+    }
+
+    for (size_t s = 0; s < m_slots.size(); s++)
+    {
+        if (!slotTaken[s])
+        {
+            m_slots[s].Type = LightType::None;
+            m_slots[s].Valid = false;
+        }
+    }
+
+    // find the stale slots
+    std::vector<size_t> staleCandidates;
+    std::vector<EntityId> inRange;
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        SlotRequest& request = candidates[c].Request;
+
+        // the visible casters in the light's sphere, in a fixed order so the signature only changes when they do
+        inRange.clear();
+        casters.GetSpatialIndex().QueryRadius(request.Position, request.Range, inRange);
+        std::sort(inRange.begin(), inRange.end(), [](EntityId a, EntityId b) { return a.Index < b.Index; });
+
+        size_t signature = 0;
+        for (EntityId entity : inRange)
+        {
+            const MeshComponent* mesh = casters.Get<MeshComponent>(entity);
+            const WorldTransformComponent* world = casters.Get<WorldTransformComponent>(entity);
+            if (!mesh || !world || !mesh->Visible)
+                continue;
+
+            hashCombine(signature, EntityIdHash()(entity));
+            hashCombine(signature, std::hash<uint64_t>()(world->Version));
+        }
+        request.CastersSignature = signature;
+
+        const Slot& slot = m_slots[candidateSlot[c]];
+        const bool moved = glm::length(slot.Position - request.Position) > m_props.MoveThreshold
+            || glm::length(slot.Direction - request.Direction) > m_props.MoveThreshold
+            || std::abs(slot.Range - request.Range) > m_props.MoveThreshold;
+
+        if (!slot.Valid || moved || slot.CastersSignature != signature)
+            staleCandidates.push_back(c);
+    }
+
+    // lights without any shadow map first, then the closest ones
+    std::stable_sort(staleCandidates.begin(), staleCandidates.end(), [&](size_t a, size_t b) {
+        const bool validA = m_slots[candidateSlot[a]].Valid;
+        const bool validB = m_slots[candidateSlot[b]].Valid;
+        if (validA != validB)
+            return !validA;
+        return candidates[a].Request.Priority < candidates[b].Request.Priority;
+    });
+
+    const size_t numUpdates = std::min<size_t>(staleCandidates.size(), m_props.MaxUpdatesPerFrame);
+    if (numUpdates > 0)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glViewport(0, 0, m_props.FaceResolution, m_props.FaceResolution);
+        glDepthMask(GL_TRUE);
+
+        for (size_t u = 0; u < numUpdates; u++)
+        {
+            const size_t c = staleCandidates[u];
+            renderSlot(candidateSlot[c], candidates[c].Request, casters, omniDepthShader);
+        }
+
+        // leave the whole array attached for the next frame's layered renders
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    m_stats.UpdatesThisFrame = static_cast<unsigned int>(numUpdates);
+    m_stats.PendingUpdates = static_cast<unsigned int>(staleCandidates.size() - numUpdates);
+
+    // only lights with a rendered map sample it (a stale one is still better than none)
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        const Slot& slot = m_slots[candidateSlot[c]];
+        if (!slot.Valid)
+            continue;
+
+        const int layer = candidateSlot[c] * static_cast<int>(LAYERS_PER_SLOT);
+        if (candidates[c].Type == LightType::Point)
+            pointLights[candidates[c].Index].ShadowLayer = layer;
+        else
+            spotLights[candidates[c].Index].ShadowLayer = layer;
+
+        m_stats.ShadowedLights++;
+    }
+}
+
+void ShadowAtlas::SetUniforms(const Shader& shader) const
+{
+    shader.Use();
+
+    glActiveTexture(GL_TEXTURE0 + SHADOW_ATLAS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.SetInt("u_shadowAtlas", SHADOW_ATLAS_TEXTURE_UNIT);
+}
+
+void ShadowAtlas::renderSlot(unsigned int slotIndex, const SlotRequest& request, Scene& casters, const Shader& omniDepthShader)
+{
+    Slot& slot = m_slots[slotIndex];
+    const bool isPoint = (slot.Type == LightType::Point);
+    const unsigned int layerBase = slotIndex * LAYERS_PER_SLOT;
+    const unsigned int faceCount = isPoint ? 6 : 1;
+
+    // a layered attachment clears every layer of the array, so clear this slot's layers one by one
+    for (unsigned int face = 0; face < faceCount; face++)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0, layerBase + face);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+
+    omniDepthShader.Use();
+
+    if (isPoint)
+    {
+        const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, OMNI_SHADOW_NEAR, request.Range);
+        for (unsigned int face = 0; face < 6; face++)
+        {
+            const glm::mat4 view = glm::lookAt(request.Position, request.Position + s_cubeFaceDirs[face], s_cubeFaceUps[face]);
+            omniDepthShader.SetMat4("u_faceMatrices[" + std::to_string(face) + "]", projection * view);
+        }
+    }
+    else
+    {
+        const float fov = 2.0f * std::atan(request.TanHalfFov);
+        const glm::mat4 projection = glm::perspective(fov, 1.0f, OMNI_SHADOW_NEAR, request.Range);
+        const glm::mat4 view = glm::lookAt(request.Position, request.Position + request.Direction, spotUpVector(request.Direction));
+        omniDepthShader.SetMat4("u_faceMatrices[0]", projection * view);
+    }
+
+    omniDepthShader.SetInt("u_faceCount", static_cast<int>(faceCount));
+    omniDepthShader.SetInt("u_layerBase", static_cast<int>(layerBase));
+    omniDepthShader.SetVec3("u_lightPos", request.Position);
+    omniDepthShader.SetFloat("u_farPlane", request.Range);
+
+    unsigned int culled = 0;
+    m_stats.CastersDrawn += Render::DrawOmniShadowCasters(casters, omniDepthShader, request.Position, request.Range, culled);
+    m_stats.CastersCulled += culled;
+
+    slot.Position = request.Position;
+    slot.Direction = request.Direction;
+    slot.Range = request.Range;
+    slot.CastersSignature = request.CastersSignature;
+    slot.Valid = true;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Camera.hpp"
+#include "Light.hpp"
+#include "Render.hpp"
+#include "Shader.hpp"
+
+struct CascadedShadowMapProperties
+{
+    unsigned int NumCascades = 4;       // up to MAX_CASCADES
+    int Resolution = 2048;
+    float MaxShadowDistance = 60.0f;
+    float SplitLambda = 0.75f;          // 0 = uniform splits, 1 = logarithmic splits
+
+    // cascades from this index on are cached and only re-rendered when needed
+    unsigned int FirstCachedCascade = 2;
+    // cached cascades cover a sphere this much bigger, so the camera can move a bit before they are stale
+    float CachePadding = 0.25f;
+
+    // how far behind the cascade (towards the light) casters are still rendered
+    float CasterDistance = 50.0f;
+};
+
+struct CascadedShadowMapStats
+{
+    unsigned int CascadesRendered = 0;
+    unsigned int CastersDrawn = 0;
+    unsigned int CastersCulled = 0;
+};
+
+/*
+    Cascaded shadow maps for a directional light.
+    The shadow distance is split in NumCascades slices of the camera frustum;
+    each one gets an orthographic light projection fitted to the slice's
+    bounding sphere and snapped to shadow map texels, so shadow edges don't
+    swim when the camera moves or rotates.
+    All cascades live in the layers of one depth texture array.
+*/
+class CascadedShadowMap
+{
+public:
+    static constexpr unsigned int MAX_CASCADES = 4;
+
+    CascadedShadowMap(const CascadedShadowMapProperties& props = CascadedShadowMapProperties());
+    ~CascadedShadowMap();
+
+    CascadedShadowMap(const CascadedShadowMap&) = delete;
+    CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+    // Forces the cached cascades to be rendered again on the next Render call
+    inline void MarkStaticGeometryDirty() noexcept { m_staticGeometryDirty = true; }
+
+    // Fits the cascades to the camera frustum
+    void Update(const Camera& camera, float aspectRatio, float zNear, float zFar, const glm::vec3& lightDirection);
+
+    // Renders the cascades that need it. Changes the viewport and framebuffer bindings:
+    // the caller must restore its own viewport afterwards
+    void Render(Scene& casters, const Shader& depthShader);
+
+    void SetUniforms(const Shader& shader) const;
+
+    inline const CascadedShadowMapStats& GetStats() const noexcept { return m_stats; }
+    inline CascadedShadowMapProperties& GetPropertiesRef() noexcept { return m_props; }
+
+private:
+    CascadedShadowMapProperties m_props;
+    CascadedShadowMapStats m_stats;
+
+    unsigned int m_depthTexture = 0;
+    unsigned int m_fbo = 0;
+
+    struct Cascade
+    {
+        float SplitFar = 0.0f;          // view depth where this cascade ends
+        glm::vec3 Center = glm::vec3(0.0f);
+        float Radius = 0.0f;
+        glm::mat4 LightSpace = glm::mat4(1.0f);
+        bool NeedsRender = true;
+    };
+    Cascade m_cascades[MAX_CASCADES];
+
+    glm::vec3 m_lightDirection = glm::vec3(0.0f);
+    bool m_staticGeometryDirty = true;
+    size_t m_castersSignature = 0;
+
+    glm::mat4 buildLightSpaceMatrix(const glm::vec3& center, float radius) const;
+    size_t computeCastersSignature(Scene& casters) const;
+};
+
+
+struct ShadowAtlasProperties
+{
+    int FaceResolution = 512;
+    unsigned int NumSlots = 8;              // each slot holds one point light (6 faces) or one spot light
+    unsigned int MaxUpdatesPerFrame = 2;    // shadow map renders per frame, the rest wait for the next frames
+    float MoveThreshold = 0.01f;            // how much a light can move before its shadow map is stale
+};
+
+struct ShadowAtlasStats
+{
+    unsigned int ShadowedLights = 0;
+    unsigned int UpdatesThisFrame = 0;
+    unsigned int PendingUpdates = 0;
+    unsigned int CastersDrawn = 0;
+    unsigned int CastersCulled = 0;
+};
+
+/*
+    Shadow maps for point and spot lights, packed in the layers of one depth
+    texture array. A slot is LAYERS_PER_SLOT consecutive layers: point lights
+    use one layer per cube face, spot lights only the first one.
+    Every face of a light is rendered in a single pass, the geometry shader
+    routes each triangle to its layers through gl_Layer. The maps store the
+    linear distance to the light divided by the light's range.
+
+    Each frame the closest shadow casting lights get a slot, and only the
+    ones that moved, got a new slot or whose nearby casters changed are
+    re-rendered, at most MaxUpdatesPerFrame of them.
+    Lights are tracked by their index in the vectors given to Update, so
+    reordering the vectors makes their shadows be rendered again.
+*/
+class ShadowAtlas
+{
+public:
+    static constexpr unsigned int LAYERS_PER_SLOT = 6;
+
+    ShadowAtlas(const ShadowAtlasProperties& props = ShadowAtlasProperties());
+    ~ShadowAtlas();
+
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    // Assigns slots, renders the stale ones and sets ShadowLayer in the lights.
+    // Changes the viewport and framebuffer bindings like CascadedShadowMap::Render
+    void Update(std::vector<PointLight>& pointLights, std::vector<SpotLight>& spotLights, const glm::vec3& cameraPosition,
+                Scene& casters, const Shader& omniDepthShader);
+
+    void SetUniforms(const Shader& shader) const;
+
+    inline const ShadowAtlasStats& GetStats() const noexcept { return m_stats; }
+
+private:
+    ShadowAtlasProperties m_props;
+    ShadowAtlasStats m_stats;
+
+    unsigned int m_depthTexture = 0;
+    unsigned int m_fbo = 0;
+
+    enum class LightType { None, Point, Spot };
+
+    struct Slot
+    {
+        LightType Type = LightType::None;
+        size_t LightIndex = 0;
+
+        // state the shadow map was rendered with
+        glm::vec3 Position = glm::vec3(0.0f);
+        glm::vec3 Direction = glm::vec3(0.0f);
+        float Range = 0.0f;
+        size_t CastersSignature = 0;
+
+        bool Valid = false;     // holds a rendered map of its current light
+    };
+    std::vector<Slot> m_slots;
+
+    // current state of the light owning a slot
+    struct SlotRequest
+    {
+        glm::vec3 Position;
+        glm::vec3 Direction;
+        float Range;
+        float TanHalfFov;       // 1.0 for point lights (90 degrees cube faces)
+        size_t CastersSignature;
+        float Priority;         // distance from the camera to the light volume
+    };
+
+    void renderSlot(unsigned int slot, const SlotRequest& request, Scene& casters, const Shader& omniDepthShader);
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+// SSE2 is part of x86-64, so it is also available when MSVC doesn't advertise it through __SSE2__
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define NE_SIMD_SSE 1
+    #include <emmintrin.h>
+#else
+    #define NE_SIMD_SSE 0
+#endif
+
+// AVX only when the compiler targets it (NE_ENABLE_AVX in CMake), there's no runtime dispatch
+#if defined(__AVX__)
+    #define NE_SIMD_AVX 1
+    #include <immintrin.h>
+#else
+    #define NE_SIMD_AVX 0
+#endif
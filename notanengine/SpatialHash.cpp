@@ -0,0 +1,437 @@
+#include "SpatialHash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+// cell coordinates take 21 bits each in a key
+static constexpr int CELL_BITS = 21;
+static constexpr int64_t CELL_LIMIT = (int64_t(1) << (CELL_BITS - 1)) - 1;
+static constexpr uint64_t CELL_MASK = (uint64_t(1) << CELL_BITS) - 1;
+
+static inline int64_t cellCoordinate(float value, float cellSize) noexcept
+{
+    const float cell = std::floor(value / cellSize);
+    return static_cast<int64_t>(std::clamp(cell, -float(CELL_LIMIT), float(CELL_LIMIT)));
+}
+
+struct CellCoords
+{
+    int64_t x, y, z;
+};
+
+static inline uint64_t packCell(int64_t x, int64_t y, int64_t z) noexcept
+{
+    return (uint64_t(x + CELL_LIMIT) & CELL_MASK) | ((uint64_t(y + CELL_LIMIT) & CELL_MASK) << CELL_BITS)
+        | ((uint64_t(z + CELL_LIMIT) & CELL_MASK) << (2 * CELL_BITS));
+}
+
+static inline CellCoords unpackCell(uint64_t key) noexcept
+{
+    return { int64_t(key & CELL_MASK) - CELL_LIMIT, int64_t((key >> CELL_BITS) & CELL_MASK) - CELL_LIMIT,
+             int64_t((key >> (2 * CELL_BITS)) & CELL_MASK) - CELL_LIMIT };
+}
+
+static inline CellCoords cellOfPoint(const glm::vec3& point, float cellSize) noexcept
+{
+    return { cellCoordinate(point.x, cellSize), cellCoordinate(point.y, cellSize), cellCoordinate(point.z, cellSize) };
+}
+
+static constexpr uint32_t NO_ITEM = std::numeric_limits<uint32_t>::max();
+
+static inline float distanceSquared(const AABB& box, const glm::vec3& point) noexcept
+{
+    const glm::vec3 d = glm::clamp(point, box.Min, box.Max) - point;
+    return glm::dot(d, d);
+}
+
+static inline bool overlaps(const AABB& a, const AABB& b) noexcept
+{
+    return a.Min.x <= b.Max.x && a.Max.x >= b.Min.x && a.Min.y <= b.Max.y && a.Max.y >= b.Min.y && a.Min.z <= b.Max.z && a.Max.z >= b.Min.z;
+}
+
+SpatialHash::SpatialHash(float cellSize)
+    : m_cellSize(std::max(cellSize, 1e-3f))
+{
+    for (unsigned int level = 0; level < MAX_LEVELS; level++)
+        m_levels[level].CellSize = std::ldexp(m_cellSize, static_cast<int>(level));
+}
+
+/// Changes
+
+void SpatialHash::Update(EntityId entity, const AABB& bounds)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_stats.Relocated = 0;
+    m_stats.MovedInPlace = 0;
+    update(entity, bounds);
+}
+
+void SpatialHash::Update(const std::vector<std::pair<EntityId, AABB>>& changes)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_stats.Relocated = 0;
+    m_stats.MovedInPlace = 0;
+    for (const auto& [entity, bounds] : changes)
+        update(entity, bounds);
+}
+
+void SpatialHash::Remove(EntityId entity)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    remove(entity);
+}
+
+void SpatialHash::Clear()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_items.clear();
+    m_itemByEntity.clear();
+    for (Level& level : m_levels)
+    {
+        level.Cells.clear();
+        level.MaxHalfSize = 0.0f;
+        level.Count = 0;
+    }
+    m_extent = AABB();
+    m_stats = SpatialHashStats();
+}
+
+void SpatialHash::update(EntityId entity, const AABB& bounds)
+{
+    if (!bounds.IsValid())
+    {
+        remove(entity);
+        return;
+    }
+
+    const uint32_t level = levelOf(bounds);
+    const uint64_t cell = cellOf(bounds.GetCenter(), level);
+    Level& target = m_levels[level];
+    const glm::vec3 extents = bounds.GetExtents();
+    target.MaxHalfSize = std::max(target.MaxHalfSize, std::max(std::max(extents.x, extents.y), extents.z));
+    m_extent.Expand(bounds);
+
+    const uint32_t index = find(entity);
+    if (index == NO_ITEM)
+    {
+        // a reused entity index takes over its slot, the old entity is gone from the world by then
+        if (entity.Index < m_itemByEntity.size() && m_itemByEntity[entity.Index] != NO_ITEM)
+            remove(m_items[m_itemByEntity[entity.Index]].Entity);
+        if (entity.Index >= m_itemByEntity.size())
+            m_itemByEntity.resize(entity.Index + 1, NO_ITEM);
+
+        m_itemByEntity[entity.Index] = static_cast<uint32_t>(m_items.size());
+        m_items.push_back({ entity, bounds, cell, level, 0 });
+        addToCell(m_itemByEntity[entity.Index]);
+        m_stats.Relocated++;
+        return;
+    }
+
+    Item& item = m_items[index];
+    item.Bounds = bounds;
+    if (item.Level == level && item.Cell == cell)
+    {
+        m_stats.MovedInPlace++;
+        return;
+    }
+
+    removeFromCell(index);
+    item.Level = level;
+    item.Cell = cell;
+    addToCell(index);
+    m_stats.Relocated++;
+}
+
+void SpatialHash::remove(EntityId entity)
+{
+    const uint32_t index = find(entity);
+    if (index == NO_ITEM)
+        return;
+
+    // the last item fills the hole
+    removeFromCell(index);
+    m_itemByEntity[entity.Index] = NO_ITEM;
+
+    const uint32_t last = static_cast<uint32_t>(m_items.size() - 1);
+    if (index != last)
+    {
+        m_items[index] = m_items[last];
+        m_itemByEntity[m_items[index].Entity.Index] = index;
+        m_levels[m_items[index].Level].Cells[m_items[index].Cell][m_items[index].Slot] = index;
+    }
+    m_items.pop_back();
+}
+
+uint32_t SpatialHash::find(EntityId entity) const noexcept
+{
+    if (entity.Index >= m_itemByEntity.size())
+        return NO_ITEM;
+    const uint32_t index = m_itemByEntity[entity.Index];
+    return (index != NO_ITEM && m_items[index].Entity == entity) ? index : NO_ITEM;
+}
+
+void SpatialHash::addToCell(uint32_t index)
+{
+    Item& item = m_items[index];
+    Level& level = m_levels[item.Level];
+    std::vector<uint32_t>& cell = level.Cells[item.Cell];
+    item.Slot = static_cast<uint32_t>(cell.size());
+    cell.push_back(index);
+    level.Count++;
+}
+
+void SpatialHash::removeFromCell(uint32_t index)
+{
+    const Item& item = m_items[index];
+    Level& level = m_levels[item.Level];
+    auto found = level.Cells.find(item.Cell);
+    std::vector<uint32_t>& cell = found->second;
+
+    cell[item.Slot] = cell.back();
+    m_items[cell[item.Slot]].Slot = item.Slot;
+    cell.pop_back();
+    if (cell.empty())
+        level.Cells.erase(found);
+    level.Count--;
+}
+
+uint32_t SpatialHash::levelOf(const AABB& bounds) const noexcept
+{
+    const glm::vec3 size = bounds.Max - bounds.Min;
+    const float largest = std::max(std::max(size.x, size.y), size.z);
+
+    uint32_t level = 0;
+    while (level + 1 < MAX_LEVELS && m_levels[level].CellSize < largest)
+        level++;
+    return level;
+}
+
+uint64_t SpatialHash::cellOf(const glm::vec3& point, uint32_t level) const noexcept
+{
+    const CellCoords c = cellOfPoint(point, m_levels[level].CellSize);
+    return packCell(c.x, c.y, c.z);
+}
+
+/// Queries
+
+template <typename Func>
+void SpatialHash::forEachCandidate(const AABB& box, Func&& func) const
+{
+    for (const Level& level : m_levels)
+    {
+        if (level.Count == 0)
+            continue;
+
+        // the centers of the entities that can reach the box
+        const CellCoords lo = cellOfPoint(box.Min - glm::vec3(level.MaxHalfSize), level.CellSize);
+        const CellCoords hi = cellOfPoint(box.Max + glm::vec3(level.MaxHalfSize), level.CellSize);
+        const double numCells = double(hi.x - lo.x + 1) * double(hi.y - lo.y + 1) * double(hi.z - lo.z + 1);
+
+        // a big box looks at the occupied cells instead of every cell it covers
+        if (numCells > double(level.Cells.size()))
+        {
+            for (const auto& [key, cell] : level.Cells)
+            {
+                const CellCoords c = unpackCell(key);
+                if (c.x < lo.x || c.y < lo.y || c.z < lo.z || c.x > hi.x || c.y > hi.y || c.z > hi.z)
+                    continue;
+                for (uint32_t index : cell)
+                    func(m_items[index]);
+            }
+            continue;
+        }
+
+        for (int64_t z = lo.z; z <= hi.z; z++)
+        {
+            for (int64_t y = lo.y; y <= hi.y; y++)
+            {
+                for (int64_t x = lo.x; x <= hi.x; x++)
+                {
+                    auto found = level.Cells.find(packCell(x, y, z));
+                    if (found == level.Cells.end())
+                        continue;
+                    for (uint32_t index : found->second)
+                        func(m_items[index]);
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::QueryBox(const AABB& box, std::vector<EntityId>& out) const
+{
+    if (!box.IsValid())
+        return;
+
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    forEachCandidate(box, [&](const Item& item) {
+        if (overlaps(item.Bounds, box))
+            out.push_back(item.Entity);
+    });
+}
+
+void SpatialHash::QueryRadius(const glm::vec3& center, float radius, std::vector<EntityId>& out) const
+{
+    if (radius < 0.0f)
+        return;
+
+    const float radiusSquared = radius * radius;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    forEachCandidate(AABB(center - glm::vec3(radius), center + glm::vec3(radius)), [&](const Item& item) {
+        if (distanceSquared(item.Bounds, center) <= radiusSquared)
+            out.push_back(item.Entity);
+    });
+}
+
+void SpatialHash::QueryNearest(const glm::vec3& point, size_t k, std::vector<EntityId>& out) const
+{
+    if (k == 0)
+        return;
+
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    // grow a sphere until it holds k entities: the k closest are then all in it
+    std::vector<std::pair<float, EntityId>> found;
+    for (float radius = m_cellSize; ; radius *= 2.0f)
+    {
+        found.clear();
+        const float radiusSquared = radius * radius;
+        forEachCandidate(AABB(point - glm::vec3(radius), point + glm::vec3(radius)), [&](const Item& item) {
+            const float d = distanceSquared(item.Bounds, point);
+            if (d <= radiusSquared)
+                found.push_back({ d, item.Entity });
+        });
+
+        if (found.size() >= k || found.size() == m_items.size() || !std::isfinite(radius))
+            break;
+    }
+
+    const size_t count = std::min(k, found.size());
+    std::partial_sort(found.begin(), found.begin() + count, found.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (size_t i = 0; i < count; i++)
+        out.push_back(found[i].second);
+}
+
+void SpatialHash::QueryRay(const Ray& ray, std::vector<std::pair<EntityId, float>>& out) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    // only the part of the ray where there may be something
+    float rayStart, rayEnd;
+    if (m_items.empty() || !m_extent.IntersectRay(ray, rayStart, rayEnd))
+        return;
+
+    auto testCell = [&](const std::vector<uint32_t>& cell) {
+        for (uint32_t index : cell)
+        {
+            float entry, exit;
+            if (m_items[index].Bounds.IntersectRay(ray, entry, exit))
+                out.push_back({ m_items[index].Entity, entry });
+        }
+    };
+
+    const glm::vec3 start = ray.Origin + ray.Direction * rayStart;
+    const glm::vec3 end = ray.Origin + ray.Direction * rayEnd;
+    for (const Level& level : m_levels)
+    {
+        if (level.Count == 0)
+            continue;
+
+        // entities are within reach cells of the cell holding their center (1 but on the last level)
+        const int64_t reach = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(level.MaxHalfSize / level.CellSize)));
+        const int64_t side = 2 * reach + 1;
+
+        CellCoords cell = cellOfPoint(start, level.CellSize);
+        const CellCoords last = cellOfPoint(end, level.CellSize);
+        const int64_t steps = std::abs(last.x - cell.x) + std::abs(last.y - cell.y) + std::abs(last.z - cell.z);
+
+        // a long ray through few cells looks at the occupied ones instead
+        if (double(side) * side * (double(steps) + side) > double(level.Cells.size()))
+        {
+            const float grow = level.MaxHalfSize;
+            for (const auto& [key, items] : level.Cells)
+            {
+                const CellCoords c = unpackCell(key);
+                const glm::vec3 min = glm::vec3(float(c.x), float(c.y), float(c.z)) * level.CellSize - glm::vec3(grow);
+                float entry, exit;
+                if (AABB(min, min + glm::vec3(level.CellSize + 2.0f * grow)).IntersectRay(ray, entry, exit))
+                    testCell(items);
+            }
+            continue;
+        }
+
+        auto visit = [&](int64_t x, int64_t y, int64_t z) {
+            auto found = level.Cells.find(packCell(x, y, z));
+            if (found != level.Cells.end())
+                testCell(found->second);
+        };
+
+        // every cell around the first one
+        for (int64_t z = cell.z - reach; z <= cell.z + reach; z++)
+            for (int64_t y = cell.y - reach; y <= cell.y + reach; y++)
+                for (int64_t x = cell.x - reach; x <= cell.x + reach; x++)
+                    visit(x, y, z);
+
+        // then the cells along the ray (Amanatides & Woo). Each step along an axis only brings in the face of
+        // the neighbourhood ahead on that axis, the ray never comes back to the rest
+        int64_t step[3];
+        float next[3], delta[3];
+        int64_t* coords[3] = { &cell.x, &cell.y, &cell.z };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float direction = ray.Direction[axis];
+            step[axis] = direction > 0.0f ? 1 : (direction < 0.0f ? -1 : 0);
+            const float boundary = float(*coords[axis] + (step[axis] > 0 ? 1 : 0)) * level.CellSize;
+            next[axis] = step[axis] != 0 ? (boundary - ray.Origin[axis]) / direction : FLT_MAX;
+            delta[axis] = step[axis] != 0 ? level.CellSize / std::abs(direction) : FLT_MAX;
+        }
+
+        for (int64_t i = 0; i < steps; i++)
+        {
+            const int axis = (next[0] < next[1]) ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+            if (step[axis] == 0)
+                break;
+            *coords[axis] += step[axis];
+            next[axis] += delta[axis];
+
+            const int64_t face = *coords[axis] + step[axis] * reach;
+            const int axisA = (axis + 1) % 3, axisB = (axis + 2) % 3;
+            for (int64_t a = *coords[axisA] - reach; a <= *coords[axisA] + reach; a++)
+            {
+                for (int64_t b = *coords[axisB] - reach; b <= *coords[axisB] + reach; b++)
+                {
+                    int64_t c[3];
+                    c[axis] = face;
+                    c[axisA] = a;
+                    c[axisB] = b;
+                    visit(c[0], c[1], c[2]);
+                }
+            }
+        }
+    }
+}
+
+bool SpatialHash::GetBounds(EntityId entity, AABB& outBounds) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    const uint32_t index = find(entity);
+    if (index == NO_ITEM)
+        return false;
+    outBounds = m_items[index].Bounds;
+    return true;
+}
+
+SpatialHashStats SpatialHash::GetStats() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    SpatialHashStats stats = m_stats;
+    stats.Entities = m_items.size();
+    for (const Level& level : m_levels)
+    {
+        stats.Cells += level.Cells.size();
+        stats.Levels += (level.Count > 0) ? 1 : 0;
+    }
+    return stats;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Bounds.hpp"
+#include "World.hpp"
+
+struct SpatialHashStats
+{
+    size_t Entities = 0;
+    size_t Cells = 0;
+    unsigned int Levels = 0;            // with entities in them
+    unsigned int Relocated = 0;         // by the last Update, entities that changed cell
+    unsigned int MovedInPlace = 0;      // by the last Update, entities that only got new bounds
+};
+
+/*
+    Entities by world bounds, to find those near a point or in a volume
+    without scanning them all.
+    A hierarchy of loose grids hashed by cell: level L has cells of
+    CellSize * 2^L, and an entity goes in the first level whose cells are
+    at least as big as its bounds, in the cell holding its center. A query
+    only looks at the cells of each level its volume, grown by the biggest
+    half size on that level, overlaps. The grids have no edges, so entities
+    can go anywhere.
+    A ray walks the cells along it on every level, and their neighbours
+    the entities may reach out of.
+    Moving an entity within its cell only rewrites its bounds; changing cell
+    is a couple of swaps. Entities with invalid bounds aren't kept.
+    Queries can run from any number of threads at once; changes wait for
+    them and hold them off.
+*/
+class SpatialHash
+{
+public:
+    static constexpr unsigned int MAX_LEVELS = 20;
+
+    // cellSize: of the finest level. About the size of the typical query: much smaller cells make queries look at many empty ones
+    explicit SpatialHash(float cellSize = 1.0f);
+
+    SpatialHash(const SpatialHash&) = delete;
+    SpatialHash& operator=(const SpatialHash&) = delete;
+
+    /// Changes
+
+    // Inserts or moves the entity, removes it if bounds is invalid
+    void Update(EntityId entity, const AABB& bounds);
+    // The same for many entities under one lock
+    void Update(const std::vector<std::pair<EntityId, AABB>>& changes);
+    void Remove(EntityId entity);
+    void Clear();
+
+    /// Queries. Entities are appended to out
+
+    // Bounds overlapping box
+    void QueryBox(const AABB& box, std::vector<EntityId>& out) const;
+    // Bounds closer than radius to center
+    void QueryRadius(const glm::vec3& center, float radius, std::vector<EntityId>& out) const;
+    // The k entities with the bounds closest to point, closest first (bounds around point are at 0)
+    void QueryNearest(const glm::vec3& point, size_t k, std::vector<EntityId>& out) const;
+    // Bounds the ray goes through, with the distance it enters them at. In no particular order
+    void QueryRay(const Ray& ray, std::vector<std::pair<EntityId, float>>& out) const;
+
+    // false if the entity isn't in
+    bool GetBounds(EntityId entity, AABB& outBounds) const;
+
+    SpatialHashStats GetStats() const;
+
+private:
+    struct Item
+    {
+        EntityId Entity;
+        AABB Bounds;
+        uint64_t Cell;          // key in its level's map
+        uint32_t Level;
+        uint32_t Slot;          // index in its cell
+    };
+
+    struct Level
+    {
+        std::unordered_map<uint64_t, std::vector<uint32_t>> Cells;    // item indices by cell key
+        float CellSize = 1.0f;
+        float MaxHalfSize = 0.0f;   // of what was ever in it, so a query knows how far entities reach out of their cell
+        size_t Count = 0;
+    };
+
+    float m_cellSize;
+    std::vector<Item> m_items;
+    std::vector<uint32_t> m_itemByEntity;       // by entity index
+    Level m_levels[MAX_LEVELS];
+    AABB m_extent;      // of every bounds ever put in, where a ray can stop looking
+    SpatialHashStats m_stats;
+
+    mutable std::shared_mutex m_mutex;
+
+    uint32_t find(EntityId entity) const noexcept;
+    void update(EntityId entity, const AABB& bounds);
+    void remove(EntityId entity);
+    void addToCell(uint32_t item);
+    void removeFromCell(uint32_t item);
+
+    uint32_t levelOf(const AABB& bounds) const noexcept;
+    uint64_t cellOf(const glm::vec3& point, uint32_t level) const noexcept;
+
+    // func(const Item&) for every item of the cells that may hold bounds overlapping box
+    template <typename Func>
+    void forEachCandidate(const AABB& box, Func&& func) const;
+};
@@ -1,5 +1,100 @@
 #include "StaticMesh.hpp"
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <limits>
+
+#include <glm/gtc/packing.hpp>
+
+static glm::vec2 octahedralEncode(const glm::vec3& normal)
+{
+    const float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (l1 <= 0.0f)
+        return glm::vec2(0.0f);
+
+    glm::vec3 n = normal / l1;
+    if (n.z < 0.0f)
+    {
+        // fold the lower hemisphere over the diagonals
+        const glm::vec2 signs(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        const glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signs;
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+
+    return glm::vec2(n.x, n.y);
+}
+
+PackedVertex PackVertex(const Vertex& vertex, const glm::vec3& positionBias, const glm::vec3& positionScale)
+{
+    PackedVertex packed;
+
+    for (int c = 0; c < 3; c++)
+    {
+        const float t = positionScale[c] > 0.0f ? (vertex.Position[c] - positionBias[c]) / positionScale[c] : 0.0f;
+        packed.Position[c] = static_cast<uint16_t>(std::lround(std::clamp(t, 0.0f, 1.0f) * 65535.0f));
+    }
+    packed.Position[3] = 0;
+
+    const glm::vec2 oct = octahedralEncode(vertex.Normal);
+    packed.Normal[0] = static_cast<int16_t>(glm::packSnorm1x16(oct.x));
+    packed.Normal[1] = static_cast<int16_t>(glm::packSnorm1x16(oct.y));
+
+    packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+    packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+
+    return packed;
+}
+
+// UV units per model space unit over LOD 0: the square root of the UV area over the surface area
+static float computeTexelDensity(const PackedMeshView& packed)
+{
+    if (!packed.Positions || !packed.Vertices)
+        return 0.0f;
+
+    const size_t first = packed.NumLods > 0 ? packed.Lods[0].IndexOffset : 0;
+    const size_t count = packed.NumLods > 0 ? packed.Lods[0].IndexCount : packed.NumIndices;
+    const auto index = [&packed](size_t i) -> size_t {
+        return packed.IndexType == GL_UNSIGNED_SHORT ? static_cast<const uint16_t*>(packed.Indices)[i]
+                                                     : static_cast<const unsigned int*>(packed.Indices)[i];
+    };
+    const auto texCoords = [&packed](size_t v) {
+        return glm::vec2(glm::unpackHalf1x16(packed.Vertices[v].TexCoords[0]), glm::unpackHalf1x16(packed.Vertices[v].TexCoords[1]));
+    };
+
+    double area = 0.0, uvArea = 0.0;
+    for (size_t i = first; i + 2 < first + count; i += 3)
+    {
+        const size_t a = index(i), b = index(i + 1), c = index(i + 2);
+        area += glm::length(glm::cross(packed.Positions[b] - packed.Positions[a], packed.Positions[c] - packed.Positions[a]));
+
+        const glm::vec2 ab = texCoords(b) - texCoords(a), ac = texCoords(c) - texCoords(a);
+        uvArea += std::abs(ab.x * ac.y - ab.y * ac.x);
+    }
+
+    return (area > 0.0 && uvArea > 0.0) ? static_cast<float>(std::sqrt(uvArea / area)) : 0.0f;
+}
+
+// positions are always the attribute at location 0
+static std::vector<glm::vec3> getPositions(const std::vector<float>& verticesData, const std::vector<VertexAttribProperties>& vertexAttribs)
+{
+    const VertexAttribProperties* posAttrib = nullptr;
+    for (const auto& attrib : vertexAttribs)
+    {
+        if (attrib.Location == 0)
+            posAttrib = &attrib;
+    }
+
+    std::vector<glm::vec3> positions;
+    if (posAttrib && posAttrib->NumValues == 3)
+    {
+        const size_t stride = (posAttrib->Stride ? posAttrib->Stride : 3 * sizeof(float)) / sizeof(float);
+        const size_t offset = posAttrib->Offset / sizeof(float);
+        for (size_t i = offset; i + 2 < verticesData.size(); i += stride)
+            positions.emplace_back(verticesData[i], verticesData[i + 1], verticesData[i + 2]);
+    }
+    return positions;
+}
 
 MeshData::MeshData(const std::vector<float>& verticesData, const std::vector<VertexAttribProperties>& vertexAttribs)
 {
@@ -23,13 +118,22 @@ MeshData::MeshData(const std::vector<float>& verticesData, const std::vector<Ver
         glVertexAttribPointer(
             attrib.Location,
             attrib.NumValues,
-            GL_FLOAT,
-            GL_FALSE,
+            attrib.Type,
+            attrib.Normalized ? GL_TRUE : GL_FALSE,
             attrib.Stride,
             (void*)(attrib.Offset)
         );
         glEnableVertexAttribArray(attrib.Location);
     }
+
+    // glDrawArrays counts vertices, not floats
+    if (!vertexAttribs.empty() && vertexAttribs[0].Stride)
+        NumIndices = vboSize / vertexAttribs[0].Stride;
+
+    const std::vector<glm::vec3> positions = getPositions(verticesData, vertexAttribs);
+    SetupPositionStream(positions);
+    Bvh = MeshBvh::Build(positions.data(), positions.size());
+    TrackGLObjects();
 }
 
 
@@ -50,11 +154,9 @@ MeshData::MeshData(const std::vector<float>& vertexPositions, const std::vector<
     glBufferData(GL_ARRAY_BUFFER, vboSize, vertexPositions.data(), GL_STATIC_DRAW);
 
     /// EBO SETUP
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-
     NumIndices = indices.size();
-    const size_t eboSize = indices.size() * sizeof(unsigned int);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboSize, indices.data(), GL_STATIC_DRAW);
+    const size_t attribStride = (!vertexAttribs.empty() && vertexAttribs[0].Stride) ? vertexAttribs[0].Stride : 3 * sizeof(float);
+    SetupIndexBuffer(indices, vboSize / attribStride);
 
     /// Vertex Attributes
     for (const auto& attrib : vertexAttribs)
@@ -62,13 +164,18 @@ MeshData::MeshData(const std::vector<float>& vertexPositions, const std::vector<
 	glVertexAttribPointer(
 	    attrib.Location,
 	    attrib.NumValues,
-	    GL_FLOAT,
-	    GL_FALSE,
+	    attrib.Type,
+	    attrib.Normalized ? GL_TRUE : GL_FALSE,
 	    attrib.Stride,
 	    (void*)(attrib.Offset)
 	);
 	glEnableVertexAttribArray(attrib.Location);
     }
+
+    const std::vector<glm::vec3> positions = getPositions(vertexPositions, vertexAttribs);
+    SetupPositionStream(positions);
+    Bvh = MeshBvh::Build(positions.data(), positions.size(), indices.data(), indices.size());
+    TrackGLObjects();
 }
 
 MeshData::MeshData(const std::vector<float>& vertexPositions, const std::vector<unsigned int>& indices, const std::vector<VertexAttribProperties>& vertexAttribs, const Material& mat)
@@ -88,11 +195,9 @@ MeshData::MeshData(const std::vector<float>& vertexPositions, const std::vector<
     glBufferData(GL_ARRAY_BUFFER, vboSize, vertexPositions.data(), GL_STATIC_DRAW);
 
     /// EBO SETUP
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-
     NumIndices = indices.size();
-    const size_t eboSize = indices.size() * sizeof(unsigned int);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboSize, indices.data(), GL_STATIC_DRAW);
+    const size_t attribStride = (!vertexAttribs.empty() && vertexAttribs[0].Stride) ? vertexAttribs[0].Stride : 3 * sizeof(float);
+    SetupIndexBuffer(indices, vboSize / attribStride);
 
     /// Vertex Attributes
     for (const auto& attrib : vertexAttribs)
@@ -100,18 +205,115 @@ MeshData::MeshData(const std::vector<float>& vertexPositions, const std::vector<
 	glVertexAttribPointer(
 	    attrib.Location,
 	    attrib.NumValues,
-	    GL_FLOAT,
-	    GL_FALSE,
+	    attrib.Type,
+	    attrib.Normalized ? GL_TRUE : GL_FALSE,
 	    attrib.Stride,
 	    (void*)(attrib.Offset)
 	);
 	glEnableVertexAttribArray(attrib.Location);
     }
+
+    const std::vector<glm::vec3> positions = getPositions(vertexPositions, vertexAttribs);
+    SetupPositionStream(positions);
+    Bvh = MeshBvh::Build(positions.data(), positions.size(), indices.data(), indices.size());
+    TrackGLObjects();
 }
 
-MeshData::MeshData(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const Material& material)
+PackedMeshView PackedMesh::GetView() const noexcept
+{
+    PackedMeshView view;
+    view.Vertices = Vertices.data();
+    view.NumVertices = Vertices.size();
+    view.Positions = Positions.data();
+
+    if (!ShortIndices.empty())
+    {
+        view.Indices = ShortIndices.data();
+        view.NumIndices = ShortIndices.size();
+        view.IndexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        view.Indices = Indices.data();
+        view.NumIndices = Indices.size();
+        view.IndexType = GL_UNSIGNED_INT;
+    }
+
+    view.Lods = Lods.data();
+    view.NumLods = Lods.size();
+    view.Meshlets = Meshlets.data();
+    view.NumMeshlets = Meshlets.size();
+
+    view.Bounds = Bounds;
+    view.PositionScale = PositionScale;
+    view.PositionBias = PositionBias;
+    return view;
+}
+
+PackedMesh PackMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                    const std::vector<MeshLod>& lods, const std::vector<Meshlet>& meshlets)
+{
+    PackedMesh packed;
+    packed.Lods = lods;
+    packed.Meshlets = meshlets;
+
+    packed.Positions.reserve(vertices.size());
+    for (const auto& vertex : vertices)
+    {
+        packed.Positions.push_back(vertex.Position);
+        packed.Bounds.Expand(vertex.Position);
+    }
+
+    if (packed.Bounds.IsValid())
+    {
+        packed.PositionBias = packed.Bounds.Min;
+        packed.PositionScale = packed.Bounds.Max - packed.Bounds.Min;
+    }
+
+    packed.Vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        packed.Vertices[i] = PackVertex(vertices[i], packed.PositionBias, packed.PositionScale);
+
+    if (vertices.size() <= std::numeric_limits<uint16_t>::max() + 1)
+        packed.ShortIndices.assign(indices.begin(), indices.end());
+    else
+        packed.Indices = indices;
+
+    return packed;
+}
+
+MeshData::MeshData(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const Material& material,
+                   const std::vector<MeshLod>& lods, const std::vector<Meshlet>& meshlets)
+    : MeshData(PackMesh(vertices, indices, lods, meshlets).GetView(), material)
+{
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        positions[i] = vertices[i].Position;
+    if (lods.empty())
+        Bvh = MeshBvh::Build(positions.data(), positions.size(), indices.data(), indices.size());
+    else
+        Bvh = MeshBvh::Build(positions.data(), positions.size(), indices.data() + lods[0].IndexOffset, lods[0].IndexCount);
+}
+
+std::shared_ptr<const MeshBvh> BuildMeshBvh(const PackedMeshView& packed)
+{
+    const size_t offset = packed.NumLods > 0 ? packed.Lods[0].IndexOffset : 0;
+    const size_t count = packed.NumLods > 0 ? packed.Lods[0].IndexCount : packed.NumIndices;
+    if (packed.IndexType == GL_UNSIGNED_SHORT)
+        return MeshBvh::Build(packed.Positions, packed.NumVertices, static_cast<const uint16_t*>(packed.Indices) + offset, count);
+    return MeshBvh::Build(packed.Positions, packed.NumVertices, static_cast<const uint32_t*>(packed.Indices) + offset, count);
+}
+
+MeshData::MeshData(const PackedMeshView& packed, const Material& material)
     : Mat(material)
 {
+    Lods.assign(packed.Lods, packed.Lods + packed.NumLods);
+    Meshlets.assign(packed.Meshlets, packed.Meshlets + packed.NumMeshlets);
+
+    QuantizedVertices = true;
+    PositionScale = packed.PositionScale;
+    PositionBias = packed.PositionBias;
+
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
@@ -120,94 +322,158 @@ MeshData::MeshData(const std::vector<Vertex>& vertices, const std::vector<unsign
 
     /// VBO SETUP
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    const size_t vboSize = vertices.size() * sizeof(Vertex);
-    glBufferData(GL_ARRAY_BUFFER, vboSize, vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, packed.NumVertices * sizeof(PackedVertex), packed.Vertices, GL_STATIC_DRAW);
 
     /// EBO SETUP
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    IndexType = packed.IndexType;
+    NumIndices = Lods.empty() ? packed.NumIndices : Lods[0].IndexCount;
 
-    NumIndices = indices.size();
-    const size_t eboSize = indices.size() * sizeof(unsigned int);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboSize, indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.NumIndices * GetIndexSize(), packed.Indices, GL_STATIC_DRAW);
 
     /// Vertex Attributes SETUP
-    constexpr size_t ATT_STRIDE = sizeof(Vertex);
-
-    // position vertex attribute
-    glVertexAttribPointer(
-	0,
-	3,
-	GL_FLOAT,
-	GL_FALSE,
-	ATT_STRIDE,
-	(void*)0
-    );
+    const std::vector<VertexAttribProperties> attribs = {
+        { 0, 3, sizeof(PackedVertex), offsetof(PackedVertex, Position), GL_UNSIGNED_SHORT, true },
+        { 1, 2, sizeof(PackedVertex), offsetof(PackedVertex, Normal), GL_SHORT, true },
+        { 2, 2, sizeof(PackedVertex), offsetof(PackedVertex, TexCoords), GL_HALF_FLOAT, false }
+    };
+
+    for (const auto& attrib : attribs)
+    {
+        glVertexAttribPointer(
+            attrib.Location,
+            attrib.NumValues,
+            attrib.Type,
+            attrib.Normalized ? GL_TRUE : GL_FALSE,
+            attrib.Stride,
+            (void*)(attrib.Offset)
+        );
+        glEnableVertexAttribArray(attrib.Location);
+    }
+
+    SetupPositionStream(packed.Positions, packed.NumVertices);
+    TexelDensity = computeTexelDensity(packed);
+    TrackGLObjects();
+}
+
+void MeshData::SetupIndexBuffer(const std::vector<unsigned int>& indices, size_t numVertices)
+{
+    // expects the VAO to be bound, the element buffer binding is part of its state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    if (numVertices <= std::numeric_limits<uint16_t>::max() + 1)
+    {
+        IndexType = GL_UNSIGNED_SHORT;
+
+        std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        IndexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    }
+}
+
+void MeshData::SetupPositionStream(const std::vector<glm::vec3>& positions)
+{
+    SetupPositionStream(positions.data(), positions.size());
+}
+
+void MeshData::SetupPositionStream(const glm::vec3* positions, size_t numPositions)
+{
+    Bounds = AABB();
+    for (size_t i = 0; i < numPositions; i++)
+        Bounds.Expand(positions[i]);
+
+    glGenVertexArrays(1, &ShadowVAO);
+    glGenBuffers(1, &PositionVBO);
+
+    glBindVertexArray(ShadowVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, PositionVBO);
+    glBufferData(GL_ARRAY_BUFFER, numPositions * sizeof(glm::vec3), positions, GL_STATIC_DRAW);
+
+    // the element buffer binding is part of the VAO state, so share the main one
+    if (UseIndexedDrawing)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
     glEnableVertexAttribArray(0);
 
-    // normal vertex attribute
-    glVertexAttribPointer(
-	1,
-	3,
-	GL_FLOAT,
-	GL_FALSE,
-	ATT_STRIDE,
-	(void*)offsetof(Vertex, Normal)
-    );
-    glEnableVertexAttribArray(1);
-
-    // tex coords vertex attribute
-    glVertexAttribPointer(
-	2,
-	2,
-	GL_FLOAT,
-	GL_FALSE,
-	ATT_STRIDE,
-	(void*)offsetof(Vertex, TexCoords)
-    );
-    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+}
+
+void MeshData::SetupPositionStream(const std::vector<float>& verticesData, const std::vector<VertexAttribProperties>& vertexAttribs)
+{
+    SetupPositionStream(getPositions(verticesData, vertexAttribs));
+}
+
+void MeshData::TrackGLObjects()
+{
+    GLObjects.clear();
+    for (unsigned int vao : { VAO, ShadowVAO })
+    {
+        if (vao)
+            GLObjects.emplace_back(GpuObjectType::VertexArray, vao);
+    }
+    for (unsigned int buffer : { VBO, EBO, PositionVBO })
+    {
+        if (buffer)
+            GLObjects.emplace_back(GpuObjectType::Buffer, buffer);
+    }
 }
 
 StaticMesh::StaticMesh()
+    : m_subMeshes(std::make_shared<std::vector<MeshData>>())
 {
 }
 
 StaticMesh::StaticMesh(const std::vector<MeshData>& subMeshes)
-    : m_meshData(subMeshes)
+    : m_subMeshes(std::make_shared<std::vector<MeshData>>(subMeshes))
 {
 }
 
 StaticMesh::StaticMesh(const std::vector<float>& verticesData, const std::vector<VertexAttribProperties>& vertexAttribs)
+    : StaticMesh()
 {
-    MeshData mesh(verticesData, vertexAttribs);
-    m_meshData.push_back(mesh);
+    m_subMeshes->emplace_back(verticesData, vertexAttribs);
 }
 
 StaticMesh::StaticMesh(const std::vector<float>& vertexPositions, const std::vector<unsigned int>& indices, const std::vector<VertexAttribProperties>& vertexAttribs)
+    : StaticMesh()
 {
-    MeshData mesh(vertexPositions, indices, vertexAttribs);
-    m_meshData.push_back(mesh);
+    m_subMeshes->emplace_back(vertexPositions, indices, vertexAttribs);
 }
 
 StaticMesh::StaticMesh(const std::vector<float>& vertexPositions, const std::vector<unsigned int>& indices, const std::vector<VertexAttribProperties>& vertexAttribs, const Material& mat)
+    : StaticMesh()
 {
-    MeshData mesh(vertexPositions, indices, vertexAttribs, mat);
-    m_meshData.push_back(mesh);
+    m_subMeshes->emplace_back(vertexPositions, indices, vertexAttribs, mat);
 }
 
 StaticMesh::StaticMesh(const StaticMesh& other)
-    : m_meshData(other.m_meshData)
+    : m_subMeshes(other.m_subMeshes)
 {
 }
 
 StaticMesh::StaticMesh(StaticMesh&& other)
-    : m_meshData(std::move(other.m_meshData))
+    : m_subMeshes(std::move(other.m_subMeshes))
 {
+    other.m_subMeshes = std::make_shared<std::vector<MeshData>>();
+}
+
+std::vector<MeshData>& StaticMesh::GetSubMeshesRef()
+{
+    // the submeshes are copied (GL objects and all, by reference) only when another mesh shares them
+    if (m_subMeshes.use_count() > 1)
+        m_subMeshes = std::make_shared<std::vector<MeshData>>(*m_subMeshes);
+    return *m_subMeshes;
 }
 
 void StaticMesh::SetMaterial(const Material& mat)
 {
-    for (auto& mesh : m_meshData)
+    for (auto& mesh : GetSubMeshesRef())
     {
         mesh.UseMaterial = true;
         mesh.Mat = mat;
@@ -216,17 +482,16 @@ void StaticMesh::SetMaterial(const Material& mat)
 
 void StaticMesh::Draw() const noexcept
 {
-    for (const auto& mesh : m_meshData)
+    for (const auto& mesh : *m_subMeshes)
     {
 	    glBindVertexArray(mesh.VAO);
         if (mesh.UseIndexedDrawing)
-	        glDrawElements(GL_TRIANGLES, mesh.NumIndices, GL_UNSIGNED_INT, 0);
+	        glDrawElements(GL_TRIANGLES, mesh.NumIndices, mesh.IndexType, 0);
         else
             glDrawArrays(GL_TRIANGLES, 0, mesh.NumIndices);
     }
 }
 
-
 StaticMesh SimpleMeshFactory::Cube()
 {
     static bool created = false;
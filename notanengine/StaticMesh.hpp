@@ -4,10 +4,16 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "Material.hpp"
+#include "Bounds.hpp"
+#include "Meshlets.hpp"
+#include "MeshBvh.hpp"
+#include "GpuResources.hpp"
 
 struct Vertex
 {
@@ -16,30 +22,151 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// Compact vertex the Vertex constructor of MeshData uploads, 16 bytes instead of 32
+struct PackedVertex
+{
+    uint16_t Position[4];   // unorm16 inside the mesh bounds (see MeshData::PositionScale), w is padding
+    int16_t Normal[2];      // octahedral encoding, snorm16
+    uint16_t TexCoords[2];  // half floats
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+PackedVertex PackVertex(const Vertex& vertex, const glm::vec3& positionBias, const glm::vec3& positionScale);
+
 struct VertexAttribProperties
 {
     unsigned int Location = 0;
     unsigned int NumValues = 0;
     size_t Stride = 0;
     size_t Offset = 0;
+    GLenum Type = GL_FLOAT;
+    bool Normalized = false;    // integer types read as [0, 1] (unsigned) or [-1, 1] (signed)
+};
+
+// Range of the element buffer holding one level of detail
+struct MeshLod
+{
+    unsigned int IndexOffset = 0;   // in indices, not bytes
+    unsigned int IndexCount = 0;
+    float Error = 0.0f;             // geometric deviation from LOD 0, in model space units
 };
 
+/*
+    A submesh already in the layout its GL buffers use. Points into memory
+    owned by someone else (a PackedMesh, or a mapped mesh cache file).
+*/
+struct PackedMeshView
+{
+    const PackedVertex* Vertices = nullptr;
+    size_t NumVertices = 0;
+    const glm::vec3* Positions = nullptr;   // NumVertices float positions for the depth-only stream
+
+    const void* Indices = nullptr;
+    size_t NumIndices = 0;                  // every level of detail
+    GLenum IndexType = GL_UNSIGNED_INT;
+
+    const MeshLod* Lods = nullptr;
+    size_t NumLods = 0;
+    const Meshlet* Meshlets = nullptr;
+    size_t NumMeshlets = 0;
+
+    AABB Bounds;
+    glm::vec3 PositionScale = glm::vec3(1.0f);
+    glm::vec3 PositionBias = glm::vec3(0.0f);
+};
+
+// Owning storage of a packed submesh
+struct PackedMesh
+{
+    std::vector<PackedVertex> Vertices;
+    std::vector<glm::vec3> Positions;
+    std::vector<uint16_t> ShortIndices;     // used when there are few enough vertices,
+    std::vector<unsigned int> Indices;      // otherwise this
+    std::vector<MeshLod> Lods;
+    std::vector<Meshlet> Meshlets;
+    AABB Bounds;
+    glm::vec3 PositionScale = glm::vec3(1.0f);
+    glm::vec3 PositionBias = glm::vec3(0.0f);
+
+    PackedMeshView GetView() const noexcept;
+};
+
+// Quantizes the vertices and picks the index width. CPU only, safe to run from the JobSystem
+PackedMesh PackMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                    const std::vector<MeshLod>& lods = {}, const std::vector<Meshlet>& meshlets = {});
+
+// BVH of the triangles of LOD 0. CPU only, safe to run from the JobSystem
+std::shared_ptr<const MeshBvh> BuildMeshBvh(const PackedMeshView& packed);
+
 struct MeshData
 {
     MeshData(const std::vector<float>& verticesData, const std::vector<VertexAttribProperties>& vertexAttribs);
     MeshData(const std::vector<float>& vertexPositions, const std::vector<unsigned int>& indices, const std::vector<VertexAttribProperties>& vertexAttribs);
     MeshData(const std::vector<float>& vertexPositions, const std::vector<unsigned int>& indices, const std::vector<VertexAttribProperties>& vertexAttribs, const Material& mat);
-    MeshData(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const Material& material);
+    // Uploads the compact PackedVertex format, and 16-bit indices when possible.
+    // indices may hold every level of detail back to back, described by lods (empty = a single level with all indices).
+    // meshlets split LOD 0
+    MeshData(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const Material& material,
+             const std::vector<MeshLod>& lods = {}, const std::vector<Meshlet>& meshlets = {});
+    // Uploads an already packed submesh as is. Leaves Bvh to the caller, which built it with the packing
+    MeshData(const PackedMeshView& packed, const Material& material);
 
     unsigned int VAO = 0;
     unsigned int VBO = 0;
     unsigned int EBO = 0;
-    unsigned int NumIndices = 0;
+    unsigned int NumIndices = 0;    // of LOD 0
+    GLenum IndexType = GL_UNSIGNED_INT;
     bool UseIndexedDrawing = true;
     Material Mat;
     bool UseMaterial = true;
+
+    // Tightly packed positions sharing the EBO, used by depth-only passes (shadow maps)
+    unsigned int ShadowVAO = 0;
+    unsigned int PositionVBO = 0;
+
+    // Bounds in model space
+    AABB Bounds;
+
+    // UV units per model space unit, for the TextureStreamer to size the textures on screen. 0 when unknown
+    float TexelDensity = 0.0f;
+
+    // Quantized vertices store positions relative to the bounds: position = PositionBias + a_Pos * PositionScale
+    bool QuantizedVertices = false;
+    glm::vec3 PositionScale = glm::vec3(1.0f);
+    glm::vec3 PositionBias = glm::vec3(0.0f);
+
+    // Levels of detail sharing the VBO, finest first. Empty for meshes without them
+    std::vector<MeshLod> Lods;
+
+    // Clusters of LOD 0 culled one by one. Empty for meshes without them
+    std::vector<Meshlet> Meshlets;
+
+    // Triangles of LOD 0 for ray queries, CPU side only and shared by the copies. Null when there's none
+    std::shared_ptr<const MeshBvh> Bvh;
+
+    // References to the buffers and vertex arrays above, so they're deleted once no copy of the submesh is left
+    std::vector<GpuObjectRef> GLObjects;
+
+    inline size_t GetIndexSize() const noexcept { return IndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int); }
+
+    // 16-bit indices when numVertices allows it
+    void SetupIndexBuffer(const std::vector<unsigned int>& indices, size_t numVertices);
+
+    void SetupPositionStream(const std::vector<glm::vec3>& positions);
+    void SetupPositionStream(const glm::vec3* positions, size_t numPositions);
+    void SetupPositionStream(const std::vector<float>& verticesData, const std::vector<VertexAttribProperties>& vertexAttribs);
+
+    // Registers the GL objects created by the constructor with GpuResources
+    void TrackGLObjects();
 };
 
+/*
+    Copies of a StaticMesh share their submeshes: copying an entity or a
+    loaded model costs a reference count, not a vector of MeshData.
+    GetSubMeshesRef makes the mesh its own copy first when it's shared
+    (copy on write), so edit through it only when something changes.
+*/
+
 class StaticMesh
 {
 public:
@@ -58,7 +185,7 @@ public:
     {
         if (this != &other)
         {
-            m_meshData = other.m_meshData;
+            m_subMeshes = other.m_subMeshes;
         }
 
         return *this;
@@ -68,20 +195,22 @@ public:
     {
         if (this != &other)
         {
-            m_meshData = std::move(other.m_meshData);
+            m_subMeshes = std::move(other.m_subMeshes);
+            other.m_subMeshes = std::make_shared<std::vector<MeshData>>();
         }
 
         return *this;
     }
 
-    inline std::vector<MeshData>& GetSubMeshesRef() noexcept { return m_meshData; }
+    inline const std::vector<MeshData>& GetSubMeshes() const noexcept { return *m_subMeshes; }
+    std::vector<MeshData>& GetSubMeshesRef();
 
     void SetMaterial(const Material& mat);
 
     void Draw() const noexcept;
 
 private:
-    std::vector<MeshData> m_meshData;
+    std::shared_ptr<std::vector<MeshData>> m_subMeshes;
 };
 
 namespace SimpleMeshFactory
@@ -0,0 +1,243 @@
+#include "SystemScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "JobSystem.hpp"
+
+// One Run. The helper jobs own a reference, so one still queued after Run returned only finds nothing to do
+struct SystemScheduler::FrameState
+{
+    std::mutex Mutex;
+    std::deque<SystemId> ReadyMain, ReadyAny;
+    std::vector<uint32_t> Pending;                  // by system, dependencies not done yet
+    std::atomic<size_t> Remaining{ 0 };
+    std::chrono::steady_clock::time_point Start;
+    std::vector<std::thread::id> Threads;           // by system, the one it ran on
+
+    bool Pop(SystemId& out, bool mainThread)
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        std::deque<SystemId>* ready = (mainThread && !ReadyMain.empty()) ? &ReadyMain : &ReadyAny;
+        if (ready->empty())
+            return false;
+        out = ready->front();
+        ready->pop_front();
+        return true;
+    }
+};
+
+uint32_t SystemScheduler::registerAccessType()
+{
+    static std::atomic<uint32_t> next{ 0 };
+    const uint32_t type = next.fetch_add(1, std::memory_order_relaxed);
+    assert(type < MAX_ACCESS_TYPES && "too many access types");
+    return type;
+}
+
+SystemScheduler::SystemId SystemScheduler::add(const std::string& name, AccessMask reads, AccessMask writes,
+                                               std::function<void()> func, SystemThread thread)
+{
+    SystemInfo info;
+    info.Name = name;
+    // written also covers read
+    info.Reads = reads & ~writes;
+    info.Writes = writes;
+    info.Thread = thread;
+    m_systems.push_back(std::move(info));
+    m_funcs.push_back(std::move(func));
+    m_graphDirty = true;
+    return static_cast<SystemId>(m_systems.size() - 1);
+}
+
+void SystemScheduler::SetEnabled(SystemId system, bool enabled)
+{
+    if (m_systems[system].Enabled == enabled)
+        return;
+    m_systems[system].Enabled = enabled;
+    m_graphDirty = true;
+}
+
+void SystemScheduler::buildGraph()
+{
+    m_order.clear();
+    m_dependents.assign(m_systems.size(), {});
+
+    for (SystemId system = 0; system < m_systems.size(); system++)
+    {
+        SystemInfo& info = m_systems[system];
+        info.Dependencies.clear();
+        info.Timing = SystemTiming();
+        if (!info.Enabled)
+            continue;
+
+        // the order they were added in decides who goes first
+        for (SystemId earlier : m_order)
+        {
+            const SystemInfo& other = m_systems[earlier];
+            const bool conflict = (other.Writes & (info.Reads | info.Writes)) || (info.Writes & other.Reads);
+            if (!conflict)
+                continue;
+            info.Dependencies.push_back(earlier);
+            m_dependents[earlier].push_back(system);
+        }
+        m_order.push_back(system);
+    }
+
+    m_graphDirty = false;
+}
+
+void SystemScheduler::Run()
+{
+    if (m_graphDirty)
+        buildGraph();
+
+    auto state = std::make_shared<FrameState>();
+    state->Pending.resize(m_systems.size(), 0);
+    state->Threads.resize(m_systems.size());
+    state->Remaining.store(m_order.size(), std::memory_order_relaxed);
+
+    size_t readyAny = 0;
+    for (SystemId system : m_order)
+    {
+        const SystemInfo& info = m_systems[system];
+        state->Pending[system] = static_cast<uint32_t>(info.Dependencies.size());
+        if (!info.Dependencies.empty())
+            continue;
+        if (info.Thread == SystemThread::MainThread)
+            state->ReadyMain.push_back(system);
+        else
+        {
+            state->ReadyAny.push_back(system);
+            readyAny++;
+        }
+    }
+
+    state->Start = std::chrono::steady_clock::now();
+
+    // one helper per system ready to go. The calling thread may be busy with a main thread one, and a helper
+    // finding nothing left to do costs little
+    const size_t helpers = std::min<size_t>(readyAny, JobSystem::GetWorkerCount());
+    for (size_t i = 0; i < helpers; i++)
+    {
+        JobSystem::Submit([this, state]() {
+            SystemId system;
+            while (state->Pop(system, false))
+                execute(state, system);
+        });
+    }
+
+    while (state->Remaining.load(std::memory_order_acquire) != 0)
+    {
+        SystemId system;
+        if (state->Pop(system, true))
+            execute(state, system);
+        else
+            std::this_thread::yield();
+    }
+
+    const float frameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - state->Start).count();
+    finishTimeline(*state, frameMs);
+}
+
+void SystemScheduler::execute(const std::shared_ptr<FrameState>& frame, SystemId system)
+{
+    FrameState& state = *frame;
+    const auto start = std::chrono::steady_clock::now();
+    m_funcs[system]();
+    const auto end = std::chrono::steady_clock::now();
+
+    SystemTiming& timing = m_systems[system].Timing;
+    timing.StartMs = std::chrono::duration<float, std::milli>(start - state.Start).count();
+    timing.EndMs = std::chrono::duration<float, std::milli>(end - state.Start).count();
+    state.Threads[system] = std::this_thread::get_id();
+
+    size_t readyAny = 0;
+    {
+        std::lock_guard<std::mutex> lock(state.Mutex);
+        for (SystemId dependent : m_dependents[system])
+        {
+            if (--state.Pending[dependent] != 0)
+                continue;
+            if (m_systems[dependent].Thread == SystemThread::MainThread)
+                state.ReadyMain.push_back(dependent);
+            else
+            {
+                state.ReadyAny.push_back(dependent);
+                readyAny++;
+            }
+        }
+    }
+
+    // same as in Run. Without workers the thread calling Run picks them all up
+    const size_t helpers = std::min<size_t>(readyAny, JobSystem::GetWorkerCount());
+    for (size_t i = 0; i < helpers; i++)
+    {
+        JobSystem::Submit([this, frame]() {
+            SystemId next;
+            while (frame->Pop(next, false))
+                execute(frame, next);
+        });
+    }
+
+    // last: once Remaining is 0, Run may return and the scheduler go away
+    state.Remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void SystemScheduler::finishTimeline(FrameState& state, float frameMs)
+{
+    m_timeline = FrameTimeline();
+    m_timeline.FrameMs = frameMs;
+    m_timeline.Systems = static_cast<unsigned int>(m_order.size());
+
+    /// Lanes: the calling thread first, then the workers by when they first ran something
+    std::vector<SystemId> byStart = m_order;
+    std::sort(byStart.begin(), byStart.end(), [this](SystemId a, SystemId b) {
+        return m_systems[a].Timing.StartMs < m_systems[b].Timing.StartMs;
+    });
+    std::vector<std::thread::id> lanes = { std::this_thread::get_id() };
+    for (SystemId system : byStart)
+    {
+        const auto found = std::find(lanes.begin(), lanes.end(), state.Threads[system]);
+        m_systems[system].Timing.Lane = static_cast<unsigned int>(found - lanes.begin());
+        if (found == lanes.end())
+            lanes.push_back(state.Threads[system]);
+    }
+    m_timeline.Lanes = static_cast<unsigned int>(lanes.size());
+
+    /// Critical path: the dependency chain with the most time in it. m_order has every system after its dependencies
+    std::vector<float> finish(m_systems.size(), 0.0f);
+    std::vector<SystemId> slowestDependency(m_systems.size(), SystemId(-1));
+    SystemId last = SystemId(-1);
+    for (SystemId system : m_order)
+    {
+        SystemTiming& timing = m_systems[system].Timing;
+        timing.Critical = false;
+
+        float ready = 0.0f;
+        for (SystemId dependency : m_systems[system].Dependencies)
+        {
+            if (finish[dependency] > ready)
+            {
+                ready = finish[dependency];
+                slowestDependency[system] = dependency;
+            }
+        }
+        const float duration = timing.EndMs - timing.StartMs;
+        finish[system] = ready + duration;
+        m_timeline.WorkMs += duration;
+
+        if (last == SystemId(-1) || finish[system] > finish[last])
+            last = system;
+    }
+
+    for (SystemId system = last; system != SystemId(-1); system = slowestDependency[system])
+        m_systems[system].Timing.Critical = true;
+    if (last != SystemId(-1))
+        m_timeline.CriticalPathMs = finish[last];
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+    Runs the frame's update systems on the JobSystem, as many at once as
+    their data allows.
+    Every system declares what it touches with a list of types, components
+    and anything else shared (the lights, the camera) alike: a const T is
+    only read, a T is written. A system waits for the systems added before
+    it that write what it touches, or read what it writes; everything else
+    runs concurrently. Adding systems in the order a serial frame would call
+    them therefore gives the same results.
+    Systems marked MainThread (the ones calling GL) only run on the thread
+    calling Run, the others on whichever thread is free, that one included.
+    Run records when and where each system ran, and the chain of
+    dependencies that bounded the frame (the critical path).
+*/
+
+enum class SystemThread
+{
+    Any,
+    MainThread
+};
+
+struct SystemTiming
+{
+    float StartMs = 0.0f;           // since the start of Run
+    float EndMs = 0.0f;
+    unsigned int Lane = 0;          // 0 for the thread calling Run, then in order of first appearance
+    bool Critical = false;          // on the frame's critical path
+};
+
+struct SystemInfo
+{
+    std::string Name;
+    uint64_t Reads = 0;             // access type masks
+    uint64_t Writes = 0;
+    SystemThread Thread = SystemThread::Any;
+    bool Enabled = true;
+    std::vector<uint32_t> Dependencies;     // the enabled systems it waits for
+    SystemTiming Timing;                    // of the last Run it took part in
+};
+
+struct FrameTimeline
+{
+    float FrameMs = 0.0f;           // Run, start to end
+    float WorkMs = 0.0f;            // every system's time added up
+    float CriticalPathMs = 0.0f;    // the longest chain of dependent systems
+    unsigned int Systems = 0;
+    unsigned int Lanes = 0;
+};
+
+class SystemScheduler
+{
+public:
+    using SystemId = uint32_t;
+    using AccessMask = uint64_t;
+
+    static constexpr size_t MAX_ACCESS_TYPES = 64;
+
+    template <typename T>
+    static uint32_t GetAccessType();
+
+    // Ts: what func reads (const T) and writes (T)
+    template <typename... Ts>
+    SystemId Add(const std::string& name, std::function<void()> func, SystemThread thread = SystemThread::Any)
+    {
+        return add(name, ((readBit<Ts>()) | ... | AccessMask(0)), ((writeBit<Ts>()) | ... | AccessMask(0)), std::move(func), thread);
+    }
+
+    void SetEnabled(SystemId system, bool enabled);
+
+    // Every enabled system once, returning when they're all done
+    void Run();
+
+    inline size_t GetSystemCount() const noexcept { return m_systems.size(); }
+    inline const SystemInfo& GetSystem(SystemId system) const { return m_systems[system]; }
+    inline const FrameTimeline& GetTimeline() const noexcept { return m_timeline; }
+
+private:
+    struct FrameState;
+
+    std::vector<SystemInfo> m_systems;
+    std::vector<std::function<void()>> m_funcs;
+    std::vector<std::vector<SystemId>> m_dependents;    // by system, the enabled ones waiting for it
+    std::vector<SystemId> m_order;                      // the enabled systems, in the order they were added
+    bool m_graphDirty = true;
+    FrameTimeline m_timeline;
+
+    static uint32_t registerAccessType();
+
+    template <typename T>
+    static AccessMask readBit() { return std::is_const_v<T> ? AccessMask(1) << GetAccessType<std::remove_const_t<T>>() : 0; }
+    template <typename T>
+    static AccessMask writeBit() { return std::is_const_v<T> ? 0 : AccessMask(1) << GetAccessType<T>(); }
+
+    SystemId add(const std::string& name, AccessMask reads, AccessMask writes, std::function<void()> func, SystemThread thread);
+    void buildGraph();
+    void execute(const std::shared_ptr<FrameState>& frame, SystemId system);
+    // lanes, critical path and totals from the recorded times
+    void finishTimeline(FrameState& state, float frameMs);
+};
+
+template <typename T>
+uint32_t SystemScheduler::GetAccessType()
+{
+    static const uint32_t type = registerAccessType();
+    return type;
+}
@@ -1,5 +1,7 @@
 #include "Texture2D.hpp"
 
+#include <algorithm>
+
 Texture2D::Texture2D()
     : m_unit(0), m_glID(0), m_props()
 {
@@ -11,17 +13,27 @@ Texture2D::Texture2D(unsigned char* data, const Texture2DProperties& props, unsi
     SetupRenderData(data, props, unit);
 }
 
+Texture2D::Texture2D(const TextureCompression::CompressedImage& image, const Texture2DProperties& props, unsigned int unit, size_t firstLevel)
+    : m_unit(unit), m_glID(0), m_props(props)
+{
+    SetupMipChainRenderData(image, props, unit, firstLevel);
+}
+
 Texture2D::Texture2D(const Texture2D& other)
     :	m_unit(other.m_unit),
 	m_glID(other.m_glID),
-	m_props(other.m_props)
+	m_props(other.m_props),
+	m_owner(other.m_owner),
+	m_glObject(other.m_glObject)
 {
 }
 
 Texture2D::Texture2D(Texture2D&& other)
     :	m_unit(std::move(other.m_unit)),
 	m_glID(std::move(other.m_glID)),
-	m_props(std::move(other.m_props))
+	m_props(std::move(other.m_props)),
+	m_owner(std::move(other.m_owner)),
+	m_glObject(std::move(other.m_glObject))
 {
 }
 
@@ -31,6 +43,7 @@ void Texture2D::SetupRenderData(unsigned char* data, const Texture2DProperties&
     m_props = props;
 
     glGenTextures(1, &m_glID);
+    m_glObject = GpuObjectRef(GpuObjectType::Texture, m_glID);
 
     glActiveTexture(GL_TEXTURE0 + unit);
 
@@ -59,9 +72,50 @@ void Texture2D::SetupRenderData(unsigned char* data, const Texture2DProperties&
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
-void Texture2D::Bind()
+void Texture2D::SetupMipChainRenderData(const TextureCompression::CompressedImage& image, const Texture2DProperties& props, unsigned int unit, size_t firstLevel)
 {
-    glActiveTexture(GL_TEXTURE0 + m_unit);
+    m_unit = unit;
+    m_props = props;
+
+    glGenTextures(1, &m_glID);
+    m_glObject = GpuObjectRef(GpuObjectType::Texture, m_glID);
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, m_glID);
+
+    // no glTexStorage2D in GL 3.3, each level is specified on its own and the level range set by hand
+    const GLenum format = TextureCompression::GetGLFormat(image.Format, image.Channels);
+    const bool compressed = TextureCompression::IsBlockCompressed(image.Format);
+    // raw RGB rows aren't 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    firstLevel = std::min(firstLevel, image.Levels.size() - 1);
+    for (size_t level = firstLevel; level < image.Levels.size(); level++)
+    {
+        const TextureCompression::CompressedLevel& info = image.Levels[level];
+        const unsigned char* data = image.Data.data() + info.Offset;
+        if (compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, info.Width, info.Height, 0, static_cast<GLsizei>(info.Size), data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, info.Width, info.Height, 0, format, GL_UNSIGNED_BYTE, data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(firstLevel));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.Levels.size()) - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void Texture2D::Bind() const
+{
+    Bind(m_unit);
+}
+
+void Texture2D::Bind(unsigned int unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
     glBindTexture(GL_TEXTURE_2D, m_glID);
 }
 
@@ -2,14 +2,18 @@
 
 #include <glad/glad.h>
 
+#include <memory>
 #include <string>
 #include <utility>
 
+#include "GpuResources.hpp"
+#include "TextureCompression.hpp"
+
 struct Texture2DProperties
 {
     int Width = 0;
     int Height = 0;
-    GLenum Format = GL_RGB;
+    GLenum Format = GL_RGB;     // a GL_COMPRESSED_* format for block compressed textures
     std::string Path = "";
 };
 
@@ -18,6 +22,7 @@ class Texture2D
 public:
     Texture2D();
     Texture2D(unsigned char* data, const Texture2DProperties& props, unsigned int unit=0);
+    Texture2D(const TextureCompression::CompressedImage& image, const Texture2DProperties& props, unsigned int unit=0, size_t firstLevel=0);
 
     Texture2D(const Texture2D& other);
     Texture2D(Texture2D&& other);
@@ -29,6 +34,8 @@ public:
 	    this->m_unit = other.m_unit;
 	    this->m_glID = other.m_glID;
 	    this->m_props = other.m_props;
+	    this->m_owner = other.m_owner;
+	    this->m_glObject = other.m_glObject;
 	}
 
 	return *this;
@@ -41,14 +48,21 @@ public:
 	    this->m_unit = std::move(other.m_unit);
 	    this->m_glID = std::move(other.m_glID);
 	    this->m_props = std::move(other.m_props);
+	    this->m_owner = std::move(other.m_owner);
+	    this->m_glObject = std::move(other.m_glObject);
 	}
 
 	return *this;
     }
 
     void SetupRenderData(unsigned char* data, const Texture2DProperties& props, unsigned int unit=0);
+    // Every level of the chain from firstLevel on as it is (block compressed or raw), no mipmaps to generate.
+    // firstLevel becomes the base level, the finer ones are left undefined for the TextureStreamer
+    void SetupMipChainRenderData(const TextureCompression::CompressedImage& image, const Texture2DProperties& props, unsigned int unit=0, size_t firstLevel=0);
 
-    void Bind();
+    void Bind() const;
+    // Binds to the given unit instead of the texture's own
+    void Bind(unsigned int unit) const;
 
     inline unsigned int GetID() const noexcept { return m_glID; }
 
@@ -56,10 +70,19 @@ public:
     inline void SetUnit(unsigned int unit) noexcept { m_unit = unit; }
 
     inline Texture2DProperties GetProperties() const noexcept { return m_props; }
+    // Only describes the texture, the GL storage is left as it is
+    inline void SetProperties(const Texture2DProperties& props) { m_props = props; }
+
+    // Shared by every copy. Cached textures get one from the texture cache, which releases the GL texture once the last copy is gone
+    inline void SetOwner(std::shared_ptr<void> owner) noexcept { m_owner = std::move(owner); }
+    inline const std::shared_ptr<void>& GetOwner() const noexcept { return m_owner; }
 
 private:
     unsigned int m_unit = 0;
     unsigned int m_glID = 0;
     Texture2DProperties m_props;
+    std::shared_ptr<void> m_owner;
+    // every copy holds a reference, the GL texture is deleted a few frames after the last one is gone
+    GpuObjectRef m_glObject;
 };
 
@@ -0,0 +1,734 @@
+#include "TextureCompression.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "JobSystem.hpp"
+#include "MeshCache.hpp"
+#include "Simd.hpp"
+
+static std::atomic<bool> g_enabled{ true };
+
+/// Blocks
+
+// 4x4 texels as RGBA, edges clamped. Missing channels read like GL does: 0 for green and blue, 255 for alpha
+static void fetchBlock(const unsigned char* pixels, int width, int height, int channels, int blockX, int blockY, unsigned char out[16][4])
+{
+    for (int y = 0; y < 4; y++)
+    {
+        const int py = std::min(blockY * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++)
+        {
+            const int px = std::min(blockX * 4 + x, width - 1);
+            const unsigned char* src = pixels + (size_t(py) * width + px) * channels;
+            unsigned char* dst = out[y * 4 + x];
+            dst[0] = src[0];
+            dst[1] = channels > 1 ? src[1] : 0;
+            dst[2] = channels > 2 ? src[2] : 0;
+            dst[3] = channels > 3 ? src[3] : 255;
+        }
+    }
+}
+
+// Single channel block: the channel's min and max as endpoints, 8 interpolated values
+static void encodeBC4(const unsigned char block[16][4], int channel, unsigned char out[8])
+{
+    alignas(16) float values[16];
+    unsigned char lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        const unsigned char v = block[i][channel];
+        values[i] = v;
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+    }
+
+    // hi > lo selects the 8-value mode: index 0 is hi, 1 is lo, 2..7 step from hi to lo
+    out[0] = hi;
+    out[1] = lo;
+
+    alignas(16) int steps[16] = {};
+    if (hi != lo)
+    {
+        const float scale = 7.0f / float(hi - lo);
+#if NE_SIMD_SSE
+        const __m128 high = _mm_set1_ps(float(hi));
+        const __m128 scaleV = _mm_set1_ps(scale);
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (int i = 0; i < 16; i += 4)
+        {
+            const __m128 t = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(high, _mm_load_ps(values + i)), scaleV), half);
+            _mm_store_si128(reinterpret_cast<__m128i*>(steps + i), _mm_cvttps_epi32(t));
+        }
+#else
+        for (int i = 0; i < 16; i++)
+            steps[i] = static_cast<int>((float(hi) - values[i]) * scale + 0.5f);
+#endif
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        const int step = std::clamp(steps[i], 0, 7);
+        const uint64_t index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+        bits |= index << (3 * i);
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+}
+
+static uint16_t packRGB565(const float color[3])
+{
+    const int r = std::clamp(static_cast<int>(color[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+    const int g = std::clamp(static_cast<int>(color[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+    const int b = std::clamp(static_cast<int>(color[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+// Bit replication, like the hardware expands it
+static void unpackRGB565(uint16_t packed, int out[3])
+{
+    const int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+struct ColorBlock
+{
+    alignas(16) float R[16];
+    alignas(16) float G[16];
+    alignas(16) float B[16];
+};
+
+// Steps (0 = c0 .. 3 = c1) of each texel along the c0-c1 line, and the squared error of the picks
+static float selectSteps(const ColorBlock& block, uint16_t c0, uint16_t c1, int outSteps[16])
+{
+    int e0[3], e1[3];
+    unpackRGB565(c0, e0);
+    unpackRGB565(c1, e1);
+
+    const float dir[3] = { float(e1[0] - e0[0]), float(e1[1] - e0[1]), float(e1[2] - e0[2]) };
+    const float length2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+    const float scale = length2 > 0.0f ? 3.0f / length2 : 0.0f;
+
+#if NE_SIMD_SSE
+    const __m128 e0r = _mm_set1_ps(float(e0[0])), e0g = _mm_set1_ps(float(e0[1])), e0b = _mm_set1_ps(float(e0[2]));
+    const __m128 dr = _mm_set1_ps(dir[0]), dg = _mm_set1_ps(dir[1]), db = _mm_set1_ps(dir[2]);
+    const __m128 scaleV = _mm_set1_ps(scale);
+    const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i three = _mm_set1_epi32(3);
+    __m128 error = _mm_setzero_ps();
+
+    for (int i = 0; i < 16; i += 4)
+    {
+        const __m128 r = _mm_sub_ps(_mm_load_ps(block.R + i), e0r);
+        const __m128 g = _mm_sub_ps(_mm_load_ps(block.G + i), e0g);
+        const __m128 b = _mm_sub_ps(_mm_load_ps(block.B + i), e0b);
+
+        const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r, dr), _mm_mul_ps(g, dg)), _mm_mul_ps(b, db)), scaleV);
+        __m128i step = _mm_cvttps_epi32(_mm_add_ps(_mm_max_ps(t, _mm_setzero_ps()), half));
+        // no _mm_min_epi32 in SSE2
+        const __m128i over = _mm_cmpgt_epi32(step, three);
+        step = _mm_or_si128(_mm_and_si128(over, three), _mm_andnot_si128(over, step));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outSteps + i), step);
+
+        // the picked palette entry, relative to e0
+        const __m128 w = _mm_mul_ps(_mm_cvtepi32_ps(step), third);
+        const __m128 er = _mm_sub_ps(r, _mm_mul_ps(dr, w));
+        const __m128 eg = _mm_sub_ps(g, _mm_mul_ps(dg, w));
+        const __m128 eb = _mm_sub_ps(b, _mm_mul_ps(db, w));
+        error = _mm_add_ps(error, _mm_add_ps(_mm_add_ps(_mm_mul_ps(er, er), _mm_mul_ps(eg, eg)), _mm_mul_ps(eb, eb)));
+    }
+
+    alignas(16) float errors[4];
+    _mm_store_ps(errors, error);
+    return errors[0] + errors[1] + errors[2] + errors[3];
+#else
+    float error = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        const float r = block.R[i] - e0[0], g = block.G[i] - e0[1], b = block.B[i] - e0[2];
+        const float t = (r * dir[0] + g * dir[1] + b * dir[2]) * scale;
+        const int step = std::clamp(static_cast<int>(std::max(t, 0.0f) + 0.5f), 0, 3);
+        outSteps[i] = step;
+
+        const float w = step / 3.0f;
+        const float er = r - dir[0] * w, eg = g - dir[1] * w, eb = b - dir[2] * w;
+        error += er * er + eg * eg + eb * eb;
+    }
+    return error;
+#endif
+}
+
+// Endpoints minimizing the squared error for the given steps. False when the steps don't pin two endpoints down
+static bool fitEndpoints(const ColorBlock& block, const int steps[16], float outE0[3], float outE1[3])
+{
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    float x0[3] = {}, x1[3] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        const float w1 = steps[i] / 3.0f, w0 = 1.0f - w1;
+        a += w0 * w0;
+        b += w0 * w1;
+        c += w1 * w1;
+
+        const float color[3] = { block.R[i], block.G[i], block.B[i] };
+        for (int k = 0; k < 3; k++)
+        {
+            x0[k] += w0 * color[k];
+            x1[k] += w1 * color[k];
+        }
+    }
+
+    const float det = a * c - b * b;
+    if (std::abs(det) < 1e-6f)
+        return false;
+
+    for (int k = 0; k < 3; k++)
+    {
+        outE0[k] = std::clamp((c * x0[k] - b * x1[k]) / det, 0.0f, 255.0f);
+        outE1[k] = std::clamp((a * x1[k] - b * x0[k]) / det, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+// Colour block, always in the 4-colour mode (c0 > c1) so it's also valid as the colour half of BC3
+static void encodeBC1(const unsigned char block[16][4], unsigned char out[8])
+{
+    ColorBlock colors;
+    float mean[3] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        colors.R[i] = block[i][0];
+        colors.G[i] = block[i][1];
+        colors.B[i] = block[i][2];
+        mean[0] += colors.R[i];
+        mean[1] += colors.G[i];
+        mean[2] += colors.B[i];
+    }
+    for (float& m : mean)
+        m /= 16.0f;
+
+    // covariance, then its main axis by power iteration
+    float cov[6] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        const float r = colors.R[i] - mean[0], g = colors.G[i] - mean[1], b = colors.B[i] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 4; iteration++)
+    {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        const float largest = std::max({ std::abs(x), std::abs(y), std::abs(z) });
+        if (largest < 1e-6f)
+            break;
+        axis[0] = x / largest;
+        axis[1] = y / largest;
+        axis[2] = z / largest;
+    }
+    const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (float& a : axis)
+        a /= axisLength;
+
+    float tMin = 0.0f, tMax = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        const float t = (colors.R[i] - mean[0]) * axis[0] + (colors.G[i] - mean[1]) * axis[1] + (colors.B[i] - mean[2]) * axis[2];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    // the extremes pulled in by 1/16 of the range, the palette covers the bulk of the texels better
+    const float inset = (tMax - tMin) / 16.0f;
+    float e0[3], e1[3];
+    for (int k = 0; k < 3; k++)
+    {
+        e0[k] = std::clamp(mean[k] + axis[k] * (tMax - inset), 0.0f, 255.0f);
+        e1[k] = std::clamp(mean[k] + axis[k] * (tMin + inset), 0.0f, 255.0f);
+    }
+
+    uint16_t c0 = packRGB565(e0), c1 = packRGB565(e1);
+    int steps[16];
+    float error = selectSteps(colors, c0, c1, steps);
+
+    // one least squares pass on the picked steps
+    float refined0[3], refined1[3];
+    if (error > 0.0f && fitEndpoints(colors, steps, refined0, refined1))
+    {
+        const uint16_t r0 = packRGB565(refined0), r1 = packRGB565(refined1);
+        int refinedSteps[16];
+        const float refinedError = selectSteps(colors, r0, r1, refinedSteps);
+        if (refinedError < error)
+        {
+            c0 = r0;
+            c1 = r1;
+            std::copy(refinedSteps, refinedSteps + 16, steps);
+        }
+    }
+
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+        for (int& step : steps)
+            step = 3 - step;
+    }
+
+    // step to index: c0, c1, then the 2/3 and 1/3 mixes
+    static constexpr uint32_t STEP_TO_INDEX[4] = { 0, 2, 3, 1 };
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        for (int i = 0; i < 16; i++)
+            indices |= STEP_TO_INDEX[steps[i]] << (2 * i);
+    }
+
+    out[0] = static_cast<unsigned char>(c0);
+    out[1] = static_cast<unsigned char>(c0 >> 8);
+    out[2] = static_cast<unsigned char>(c1);
+    out[3] = static_cast<unsigned char>(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+static void encodeBlock(TextureCompression::BlockFormat format, const unsigned char block[16][4], unsigned char* out)
+{
+    using TextureCompression::BlockFormat;
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        encodeBC1(block, out);
+        break;
+    case BlockFormat::BC3:
+        encodeBC4(block, 3, out);
+        encodeBC1(block, out + 8);
+        break;
+    case BlockFormat::BC4:
+        encodeBC4(block, 0, out);
+        break;
+    case BlockFormat::BC5:
+        encodeBC4(block, 0, out);
+        encodeBC4(block, 1, out + 8);
+        break;
+    default:
+        break;
+    }
+}
+
+/// Reference decoder
+
+static void decodeBC4(const unsigned char* in, int channel, unsigned char out[16][4])
+{
+    const int a0 = in[0], a1 = in[1];
+    int palette[8] = { a0, a1 };
+    if (a0 > a1)
+    {
+        for (int i = 2; i < 8; i++)
+            palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+    }
+    else
+    {
+        for (int i = 2; i < 6; i++)
+            palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++)
+        bits |= uint64_t(in[2 + i]) << (8 * i);
+
+    for (int i = 0; i < 16; i++)
+        out[i][channel] = static_cast<unsigned char>(palette[(bits >> (3 * i)) & 7]);
+}
+
+static void decodeBC1(const unsigned char* in, bool alwaysFourColors, unsigned char out[16][4])
+{
+    const uint16_t c0 = uint16_t(in[0] | (in[1] << 8)), c1 = uint16_t(in[2] | (in[3] << 8));
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+
+    const bool fourColors = alwaysFourColors || c0 > c1;
+    for (int k = 0; k < 3; k++)
+    {
+        if (fourColors)
+        {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+        }
+        else
+        {
+            palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+            palette[3][k] = 0;
+        }
+    }
+
+    const uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24);
+    for (int i = 0; i < 16; i++)
+    {
+        const int* color = palette[(indices >> (2 * i)) & 3];
+        out[i][0] = static_cast<unsigned char>(color[0]);
+        out[i][1] = static_cast<unsigned char>(color[1]);
+        out[i][2] = static_cast<unsigned char>(color[2]);
+    }
+}
+
+/// Disk cache
+
+struct TextureCacheHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Format;
+    uint64_t SourceHash;
+    uint64_t ContentHash;
+    int32_t Width;
+    int32_t Height;
+    int32_t Channels;
+    uint32_t NumLevels;
+    uint64_t DataSize;
+};
+
+struct TextureCacheLevel
+{
+    int32_t Width;
+    int32_t Height;
+    uint64_t Offset;
+    uint64_t Size;
+};
+
+static constexpr char TEXTURE_CACHE_MAGIC[8] = { 'N', 'E', 'T', 'E', 'X', 0, 0, 0 };
+
+namespace TextureCompression
+{
+    GLenum GetGLFormat(BlockFormat format, int channels)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BlockFormat::Uncompressed:
+            switch (channels)
+            {
+            case 1: return GL_RED;
+            case 2: return GL_RG;
+            case 3: return GL_RGB;
+            default: return GL_RGBA;
+            }
+        default: return 0;
+        }
+    }
+
+    size_t GetBlockSize(BlockFormat format)
+    {
+        return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+    }
+
+    const char* GetFormatName(BlockFormat format)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1: return "BC1";
+        case BlockFormat::BC3: return "BC3";
+        case BlockFormat::BC4: return "BC4";
+        case BlockFormat::BC5: return "BC5";
+        case BlockFormat::Uncompressed: return "uncompressed";
+        default: return "none";
+        }
+    }
+
+    size_t GetLevelSize(BlockFormat format, int width, int height, int channels)
+    {
+        if (format == BlockFormat::Uncompressed)
+            return size_t(width) * height * channels;
+        return size_t((width + 3) / 4) * size_t((height + 3) / 4) * GetBlockSize(format);
+    }
+
+    BlockFormat ChooseFormat(const unsigned char* pixels, int width, int height, int channels, bool normalMap)
+    {
+        if (normalMap)
+            return BlockFormat::BC5;
+
+        switch (channels)
+        {
+        case 1: return BlockFormat::BC4;
+        case 2: return BlockFormat::BC5;
+        case 3: return BlockFormat::BC1;
+        default: break;
+        }
+
+        // RGBA images whose alpha is never used don't need the alpha block
+        const size_t numPixels = size_t(width) * height;
+        for (size_t i = 0; i < numPixels; i++)
+        {
+            if (pixels[i * 4 + 3] != 255)
+                return BlockFormat::BC3;
+        }
+        return BlockFormat::BC1;
+    }
+
+    CompressedImage Compress(const unsigned char* pixels, int width, int height, int channels, BlockFormat format,
+                             const MipChain::MipChainProperties& mipProps)
+    {
+        CompressedImage image;
+        if (!pixels || width <= 0 || height <= 0 || format == BlockFormat::None)
+            return image;
+
+        image.Format = format;
+        image.Width = width;
+        image.Height = height;
+        image.Channels = channels;
+
+        // level sizes first, so every level encodes straight into its place
+        size_t dataSize = 0;
+        for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2))
+        {
+            const size_t size = GetLevelSize(format, w, h, channels);
+            image.Levels.push_back(CompressedLevel{ w, h, dataSize, size });
+            dataSize += size;
+            if (w == 1 && h == 1)
+                break;
+        }
+        image.Data.resize(dataSize);
+
+        // normal maps and other two channel data aren't colour
+        MipChain::MipChainProperties chainProps = mipProps;
+        if (format == BlockFormat::BC5)
+            chainProps.SRGB = false;
+        const std::vector<MipChain::MipLevel> mips = MipChain::Build(pixels, width, height, channels, chainProps);
+
+        const size_t blockSize = GetBlockSize(format);
+        for (size_t level = 0; level < image.Levels.size(); level++)
+        {
+            const CompressedLevel& info = image.Levels[level];
+            const unsigned char* levelPixels = level == 0 ? pixels : mips[level - 1].Pixels.data();
+            unsigned char* dst = image.Data.data() + info.Offset;
+
+            if (format == BlockFormat::Uncompressed)
+            {
+                std::memcpy(dst, levelPixels, info.Size);
+                continue;
+            }
+
+            const int blocksX = (info.Width + 3) / 4;
+            const int blocksY = (info.Height + 3) / 4;
+            JobSystem::ParallelFor(blocksY, 4, [&](size_t begin, size_t end) {
+                unsigned char block[16][4];
+                for (size_t by = begin; by < end; by++)
+                {
+                    for (int bx = 0; bx < blocksX; bx++)
+                    {
+                        fetchBlock(levelPixels, info.Width, info.Height, channels, bx, static_cast<int>(by), block);
+                        encodeBlock(format, block, dst + (by * blocksX + bx) * blockSize);
+                    }
+                }
+            });
+        }
+
+        return image;
+    }
+
+    std::vector<unsigned char> Decompress(const CompressedImage& image, size_t level)
+    {
+        if (!image.IsValid() || level >= image.Levels.size())
+            return {};
+
+        const CompressedLevel& info = image.Levels[level];
+        std::vector<unsigned char> out(size_t(info.Width) * info.Height * 4);
+
+        if (image.Format == BlockFormat::Uncompressed)
+        {
+            const unsigned char* in = image.Data.data() + info.Offset;
+            const size_t numPixels = size_t(info.Width) * info.Height;
+            for (size_t i = 0; i < numPixels; i++)
+            {
+                unsigned char* texel = &out[i * 4];
+                texel[0] = texel[1] = texel[2] = 0;
+                texel[3] = 255;
+                std::memcpy(texel, in + i * image.Channels, image.Channels);
+            }
+            return out;
+        }
+
+        const size_t blockSize = GetBlockSize(image.Format);
+        const int blocksX = (info.Width + 3) / 4;
+        const int blocksY = (info.Height + 3) / 4;
+
+        for (int by = 0; by < blocksY; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                const unsigned char* in = image.Data.data() + info.Offset + (size_t(by) * blocksX + bx) * blockSize;
+
+                unsigned char block[16][4];
+                for (auto& texel : block)
+                {
+                    texel[0] = texel[1] = texel[2] = 0;
+                    texel[3] = 255;
+                }
+
+                switch (image.Format)
+                {
+                case BlockFormat::BC1: decodeBC1(in, false, block); break;
+                case BlockFormat::BC3: decodeBC4(in, 3, block); decodeBC1(in + 8, true, block); break;
+                case BlockFormat::BC4: decodeBC4(in, 0, block); break;
+                case BlockFormat::BC5: decodeBC4(in, 0, block); decodeBC4(in + 8, 1, block); break;
+                default: break;
+                }
+
+                for (int y = 0; y < 4 && by * 4 + y < info.Height; y++)
+                {
+                    for (int x = 0; x < 4 && bx * 4 + x < info.Width; x++)
+                        std::memcpy(&out[((size_t(by) * 4 + y) * info.Width + bx * 4 + x) * 4], block[y * 4 + x], 4);
+                }
+            }
+        }
+
+        return out;
+    }
+
+    float MeasurePSNR(const CompressedImage& image, const unsigned char* pixels)
+    {
+        const std::vector<unsigned char> decoded = Decompress(image, 0);
+        if (decoded.empty() || !pixels)
+            return 0.0f;
+
+        int numChannels;
+        switch (image.Format)
+        {
+        case BlockFormat::BC1: numChannels = 3; break;
+        case BlockFormat::BC3: numChannels = 4; break;
+        case BlockFormat::BC4: numChannels = 1; break;
+        case BlockFormat::BC5: numChannels = 2; break;
+        default: numChannels = 4; break;
+        }
+        numChannels = std::min(numChannels, image.Channels);
+
+        double squaredError = 0.0;
+        const size_t numPixels = size_t(image.Width) * image.Height;
+        for (size_t i = 0; i < numPixels; i++)
+        {
+            for (int c = 0; c < numChannels; c++)
+            {
+                const double diff = double(decoded[i * 4 + c]) - double(pixels[i * image.Channels + c]);
+                squaredError += diff * diff;
+            }
+        }
+
+        const double mse = squaredError / double(numPixels * numChannels);
+        return mse > 0.0 ? static_cast<float>(10.0 * std::log10(255.0 * 255.0 / mse)) : 99.0f;
+    }
+
+    bool ReadCache(const std::string& path, uint64_t sourceHash, CompressedImage& outImage, uint64_t& outContentHash)
+    {
+        MeshCache::MappedFile file;
+        if (!file.Open(path) || file.GetSize() < sizeof(TextureCacheHeader))
+            return false;
+
+        TextureCacheHeader header;
+        std::memcpy(&header, file.GetData(), sizeof(header));
+        if (std::memcmp(header.Magic, TEXTURE_CACHE_MAGIC, sizeof(header.Magic)) != 0 || header.Version != ENCODER_VERSION
+            || header.SourceHash != sourceHash || header.Format == 0 || header.Format > uint32_t(BlockFormat::Uncompressed)
+            || header.Width <= 0 || header.Height <= 0 || header.Channels < 1 || header.Channels > 4
+            || header.NumLevels == 0 || header.NumLevels > 32)
+            return false;
+
+        const size_t levelsSize = header.NumLevels * sizeof(TextureCacheLevel);
+        if (file.GetSize() != sizeof(header) + levelsSize + header.DataSize)
+            return false;
+
+        CompressedImage image;
+        image.Format = static_cast<BlockFormat>(header.Format);
+        image.Width = header.Width;
+        image.Height = header.Height;
+        image.Channels = header.Channels;
+
+        const unsigned char* levels = file.GetData() + sizeof(header);
+        for (uint32_t i = 0; i < header.NumLevels; i++)
+        {
+            TextureCacheLevel level;
+            std::memcpy(&level, levels + i * sizeof(level), sizeof(level));
+            if (level.Width <= 0 || level.Height <= 0 || level.Size != GetLevelSize(image.Format, level.Width, level.Height, image.Channels)
+                || level.Offset > header.DataSize || level.Size > header.DataSize - level.Offset)
+                return false;
+
+            image.Levels.push_back(CompressedLevel{ level.Width, level.Height, size_t(level.Offset), size_t(level.Size) });
+        }
+
+        const unsigned char* data = levels + levelsSize;
+        image.Data.assign(data, data + header.DataSize);
+
+        outImage = std::move(image);
+        outContentHash = header.ContentHash;
+        return true;
+    }
+
+    bool WriteCache(const std::string& path, uint64_t sourceHash, uint64_t contentHash, const CompressedImage& image)
+    {
+        if (!image.IsValid())
+            return false;
+
+        TextureCacheHeader header = {};
+        std::memcpy(header.Magic, TEXTURE_CACHE_MAGIC, sizeof(header.Magic));
+        header.Version = ENCODER_VERSION;
+        header.Format = static_cast<uint32_t>(image.Format);
+        header.SourceHash = sourceHash;
+        header.ContentHash = contentHash;
+        header.Width = image.Width;
+        header.Height = image.Height;
+        header.Channels = image.Channels;
+        header.NumLevels = static_cast<uint32_t>(image.Levels.size());
+        header.DataSize = image.Data.size();
+
+        // several threads may encode the same texture, each writes its own file and the last rename wins
+        const std::string tempPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file)
+                return false;
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const auto& level : image.Levels)
+            {
+                const TextureCacheLevel record{ level.Width, level.Height, uint64_t(level.Offset), uint64_t(level.Size) };
+                file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            }
+            file.write(reinterpret_cast<const char*>(image.Data.data()), static_cast<std::streamsize>(image.Data.size()));
+            if (!file)
+                return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error)
+        {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        g_enabled.store(enabled);
+    }
+
+    bool IsEnabled()
+    {
+        return g_enabled.load();
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MipChain.hpp"
+
+// EXT_texture_compression_s3tc isn't in the GL 3.3 core headers glad was generated for, every desktop driver has it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/*
+    CPU encoder for the BC block formats, so textures take 4 to 8 times less
+    VRAM and bandwidth than raw RGB(A)8:
+      BC1  RGB, 8 bytes per 4x4 block
+      BC3  RGBA, BC1 colour plus a BC4 alpha block, 16 bytes
+      BC4  one channel, 8 bytes
+      BC5  two channels (two BC4 blocks), 16 bytes
+    Colour endpoints come from the principal axis of the block's colours,
+    refined once by least squares. Indices are picked by projecting on the
+    endpoint line, four pixels at a time with SSE. Blocks are spread on the
+    JobSystem.
+    Mip levels come from MipChain (gamma-correct, alpha coverage kept) and are
+    encoded like level 0. With compression off the levels stay raw
+    (BlockFormat::Uncompressed), so either way a texture never waits on
+    glGenerateMipmap.
+    Images are kept in a disk cache (see ReadCache/WriteCache), so filtering
+    and encoding only happen the first time a texture is loaded.
+*/
+namespace TextureCompression
+{
+    // bump when the encoder output changes, the cached images are encoded again
+    constexpr uint32_t ENCODER_VERSION = 2;
+
+    enum class BlockFormat : uint32_t
+    {
+        None,
+        BC1,
+        BC3,
+        BC4,
+        BC5,
+        Uncompressed    // raw 8-bit texels, as many channels as the source
+    };
+
+    struct CompressedLevel
+    {
+        int Width = 0;
+        int Height = 0;
+        size_t Offset = 0;      // in Data
+        size_t Size = 0;
+    };
+
+    struct CompressedImage
+    {
+        BlockFormat Format = BlockFormat::None;
+        int Width = 0;
+        int Height = 0;
+        int Channels = 0;                       // of the source image, and of the texels when Uncompressed
+        std::vector<CompressedLevel> Levels;    // finest first, down to 1x1
+        std::vector<unsigned char> Data;
+
+        inline bool IsValid() const noexcept { return Format != BlockFormat::None && !Levels.empty(); }
+    };
+
+    // channels only matters for Uncompressed (GL_RED to GL_RGBA)
+    GLenum GetGLFormat(BlockFormat format, int channels = 4);
+    size_t GetBlockSize(BlockFormat format);
+    const char* GetFormatName(BlockFormat format);
+    size_t GetLevelSize(BlockFormat format, int width, int height, int channels = 4);
+    inline bool IsBlockCompressed(BlockFormat format) noexcept { return format != BlockFormat::None && format != BlockFormat::Uncompressed; }
+
+    // BC4 for one channel, BC5 for two and for normal maps (x and y, z is rebuilt in the shader),
+    // BC1 for colour and for RGBA whose alpha is all opaque, BC3 otherwise
+    BlockFormat ChooseFormat(const unsigned char* pixels, int width, int height, int channels, bool normalMap = false);
+
+    // Mip chain down to 1x1 (see MipChain), every level encoded. BC5 is filtered as linear data. Safe on any thread
+    CompressedImage Compress(const unsigned char* pixels, int width, int height, int channels, BlockFormat format,
+                             const MipChain::MipChainProperties& mipProps = {});
+
+    // Reference decode of a level to RGBA8, to check the encoder against (Uncompressed levels are expanded)
+    std::vector<unsigned char> Decompress(const CompressedImage& image, size_t level);
+
+    // PSNR in dB of level 0 against the source, over the channels the format keeps
+    float MeasurePSNR(const CompressedImage& image, const unsigned char* pixels);
+
+    // sourceHash identifies what the image was made from (the file, how it was decoded). False on a miss or a stale file
+    bool ReadCache(const std::string& path, uint64_t sourceHash, CompressedImage& outImage, uint64_t& outContentHash);
+    bool WriteCache(const std::string& path, uint64_t sourceHash, uint64_t contentHash, const CompressedImage& image);
+
+    // On by default. Off, textures upload uncompressed
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+}
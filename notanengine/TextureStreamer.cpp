@@ -0,0 +1,405 @@
+#include "TextureStreamer.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "AsyncLoader.hpp"
+
+struct StreamedTexture
+{
+    std::weak_ptr<void> Owner;      // the texture cache entry, the texture is gone once it expires
+    uint64_t Serial = 0;            // tells a read for this registration from one for an older texture with the same name
+    unsigned int Texture = 0;
+    TextureCompression::CompressedImage Layout;     // format and levels, no data
+
+    // the whole chain, while levels of it are uploading (or for good when there's no cache file to read it back from)
+    std::shared_ptr<const TextureCompression::CompressedImage> Source;
+    bool KeepSource = false;
+    std::string CachePath;
+    uint64_t SourceHash = 0;
+    bool Reading = false;
+    bool Failed = false;            // the cache file couldn't be read back, the texture stays as it is
+
+    size_t TailLevel = 0;           // always resident
+    size_t ResidentLevel = 0;       // finest level in VRAM, the base level
+    size_t TargetLevel = 0;         // finest level the last requests need
+
+    // level ResidentLevel - 1 being uploaded, its storage already counted as resident
+    bool Uploading = false;
+    int NextRow = 0;
+
+    /// requests
+    float WantedLevel = FLT_MAX;
+    float Priority = 0.0f;
+    float LastPriority = 0.0f;
+    uint64_t LastUsedFrame = 0;
+};
+
+struct ReadResult
+{
+    unsigned int Texture = 0;
+    uint64_t Serial = 0;
+    std::shared_ptr<const TextureCompression::CompressedImage> Source;     // null if the read failed
+};
+
+struct StreamerState
+{
+    bool enabled = true;
+    size_t budget = TextureStreamer::DEFAULT_BUDGET;
+    size_t uploadBudget = TextureStreamer::DEFAULT_UPLOAD_BUDGET;
+    uint64_t frame = 1;
+    uint64_t nextSerial = 1;
+    size_t residentBytes = 0;
+
+    std::unordered_map<unsigned int, StreamedTexture> textures;
+    TextureStreamer::TextureStreamerStats stats;
+
+    // filled by the loader threads
+    std::mutex readMutex;
+    std::vector<ReadResult> reads;
+};
+static StreamerState g_streamer;
+
+static size_t getResidentBytes(const StreamedTexture& texture)
+{
+    const size_t first = texture.Uploading ? texture.ResidentLevel - 1 : texture.ResidentLevel;
+    size_t bytes = 0;
+    for (size_t level = first; level < texture.Layout.Levels.size(); level++)
+        bytes += texture.Layout.Levels[level].Size;
+    return bytes;
+}
+
+static size_t getFullBytes(const StreamedTexture& texture)
+{
+    size_t bytes = 0;
+    for (const auto& level : texture.Layout.Levels)
+        bytes += level.Size;
+    return bytes;
+}
+
+static void collectReads()
+{
+    std::vector<ReadResult> reads;
+    {
+        std::lock_guard<std::mutex> lock(g_streamer.readMutex);
+        reads.swap(g_streamer.reads);
+    }
+
+    for (auto& read : reads)
+    {
+        auto it = g_streamer.textures.find(read.Texture);
+        if (it == g_streamer.textures.end() || it->second.Serial != read.Serial)
+            continue;
+
+        StreamedTexture& texture = it->second;
+        texture.Reading = false;
+        // the file changed since the texture was loaded
+        if (!read.Source || read.Source->Format != texture.Layout.Format || read.Source->Levels.size() != texture.Layout.Levels.size())
+        {
+            texture.Failed = true;
+            continue;
+        }
+        texture.Source = std::move(read.Source);
+    }
+}
+
+static void startRead(StreamedTexture& texture)
+{
+    texture.Reading = true;
+    AsyncLoader::Submit([name = texture.Texture, serial = texture.Serial, path = texture.CachePath, hash = texture.SourceHash]() {
+        auto image = std::make_shared<TextureCompression::CompressedImage>();
+        uint64_t contentHash = 0;
+        if (!TextureCompression::ReadCache(path, hash, *image, contentHash))
+            image.reset();
+
+        std::lock_guard<std::mutex> lock(g_streamer.readMutex);
+        g_streamer.reads.push_back(ReadResult{ name, serial, std::move(image) });
+    });
+}
+
+// Drops the finest resident level: raised base level first, then the level respecified empty to free its storage
+static void evictLevel(StreamedTexture& texture)
+{
+    const GLint level = static_cast<GLint>(texture.ResidentLevel);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture.Texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    g_streamer.residentBytes -= texture.Layout.Levels[texture.ResidentLevel].Size;
+    texture.ResidentLevel++;
+    g_streamer.stats.LevelsEvicted++;
+}
+
+// Levels the texture doesn't need go first, then the least recently used, then the lowest priority
+static bool evictsBefore(const StreamedTexture& a, const StreamedTexture& b)
+{
+    const bool aUnneeded = a.ResidentLevel < a.TargetLevel, bUnneeded = b.ResidentLevel < b.TargetLevel;
+    if (aUnneeded != bUnneeded)
+        return aUnneeded;
+    if (a.LastUsedFrame != b.LastUsedFrame)
+        return a.LastUsedFrame < b.LastUsedFrame;
+    return a.LastPriority < b.LastPriority;
+}
+
+// Evicts until needed more bytes fit in the budget. Textures used since the last Update that matter at least as
+// much as requester keep the levels they need. False when there's nothing left to evict
+static bool makeRoom(size_t needed, const StreamedTexture* requester)
+{
+    while (g_streamer.residentBytes + needed > g_streamer.budget)
+    {
+        StreamedTexture* victim = nullptr;
+        for (auto& [name, texture] : g_streamer.textures)
+        {
+            if (&texture == requester || texture.Uploading || texture.ResidentLevel >= texture.TailLevel)
+                continue;
+
+            const bool unneeded = texture.ResidentLevel < texture.TargetLevel;
+            if (requester && !unneeded && texture.LastUsedFrame == g_streamer.frame && texture.LastPriority >= requester->LastPriority)
+                continue;
+
+            if (!victim || evictsBefore(texture, *victim))
+                victim = &texture;
+        }
+
+        if (!victim)
+            return false;
+        evictLevel(*victim);
+    }
+    return true;
+}
+
+// The next finer level of the textures missing some, the ones covering the most pixels first
+static void startLoads()
+{
+    std::vector<StreamedTexture*> candidates;
+    unsigned int holdingSource = 0;
+    for (auto& [name, texture] : g_streamer.textures)
+    {
+        // chains read for levels that aren't needed anymore
+        if (!texture.KeepSource && !texture.Uploading && texture.Source && texture.TargetLevel >= texture.ResidentLevel)
+            texture.Source.reset();
+
+        if (texture.Reading || (texture.Source && !texture.KeepSource))
+            holdingSource++;
+
+        if (!texture.Failed && !texture.Uploading && texture.TargetLevel < texture.ResidentLevel)
+            candidates.push_back(&texture);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+        if (a->LastUsedFrame != b->LastUsedFrame)
+            return a->LastUsedFrame > b->LastUsedFrame;
+        return a->LastPriority > b->LastPriority;
+    });
+
+    for (StreamedTexture* texture : candidates)
+    {
+        if (!texture->Source)
+        {
+            // a few chains in memory at once, the others wait for their turn
+            if (!texture->Reading && holdingSource < TextureStreamer::MAX_PENDING_READS)
+            {
+                startRead(*texture);
+                holdingSource++;
+            }
+            continue;
+        }
+
+        if (!makeRoom(texture->Layout.Levels[texture->ResidentLevel - 1].Size, texture))
+        {
+            // everything left is worth more than this, it gets read again once there's room
+            if (!texture->KeepSource)
+                texture->Source.reset();
+            break;
+        }
+
+        texture->Uploading = true;
+        texture->NextRow = 0;
+        g_streamer.residentBytes += texture->Layout.Levels[texture->ResidentLevel - 1].Size;
+    }
+}
+
+static size_t uploadLevels()
+{
+    size_t uploaded = 0;
+    for (auto& [name, texture] : g_streamer.textures)
+    {
+        while (texture.Uploading && uploaded < g_streamer.uploadBudget)
+        {
+            const size_t level = texture.ResidentLevel - 1;
+            uploaded += AsyncLoader::UploadLevelRows(texture.Texture, *texture.Source, level, texture.NextRow,
+                                                     g_streamer.uploadBudget - uploaded);
+            if (texture.NextRow < texture.Layout.Levels[level].Height)
+                continue;
+
+            // still bound by the upload
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level));
+            texture.ResidentLevel = level;
+            texture.Uploading = false;
+            g_streamer.stats.LevelsStreamed++;
+        }
+    }
+    return uploaded;
+}
+
+namespace TextureStreamer
+{
+    void SetEnabled(bool enabled)
+    {
+        g_streamer.enabled = enabled;
+    }
+
+    bool IsEnabled()
+    {
+        return g_streamer.enabled;
+    }
+
+    void SetBudget(size_t bytes)
+    {
+        g_streamer.budget = bytes;
+    }
+
+    size_t GetBudget()
+    {
+        return g_streamer.budget;
+    }
+
+    void SetUploadBudget(size_t bytesPerFrame)
+    {
+        g_streamer.uploadBudget = std::max<size_t>(bytesPerFrame, 1);
+    }
+
+    size_t GetUploadBudget()
+    {
+        return g_streamer.uploadBudget;
+    }
+
+    size_t GetTailLevel(const TextureCompression::CompressedImage& image)
+    {
+        for (size_t level = 0; level < image.Levels.size(); level++)
+        {
+            if (image.Levels[level].Width <= RESIDENT_TAIL_SIZE && image.Levels[level].Height <= RESIDENT_TAIL_SIZE)
+                return level;
+        }
+        return 0;
+    }
+
+    void Register(const Texture2D& texture, const TextureCompression::CompressedImage& image,
+                  const std::string& cachePath, uint64_t sourceHash, size_t residentLevel)
+    {
+        if (!texture.GetOwner() || residentLevel == 0 || residentLevel >= image.Levels.size())
+            return;
+
+        auto it = g_streamer.textures.find(texture.GetID());
+        if (it != g_streamer.textures.end())
+        {
+            g_streamer.residentBytes -= getResidentBytes(it->second);
+            g_streamer.textures.erase(it);
+        }
+
+        StreamedTexture& streamed = g_streamer.textures[texture.GetID()];
+        streamed.Owner = texture.GetOwner();
+        streamed.Serial = g_streamer.nextSerial++;
+        streamed.Texture = texture.GetID();
+
+        streamed.Layout.Format = image.Format;
+        streamed.Layout.Width = image.Width;
+        streamed.Layout.Height = image.Height;
+        streamed.Layout.Channels = image.Channels;
+        streamed.Layout.Levels = image.Levels;
+
+        streamed.CachePath = cachePath;
+        streamed.SourceHash = sourceHash;
+        if (cachePath.empty())
+        {
+            streamed.Source = std::make_shared<TextureCompression::CompressedImage>(image);
+            streamed.KeepSource = true;
+        }
+
+        streamed.TailLevel = streamed.ResidentLevel = streamed.TargetLevel = residentLevel;
+        streamed.LastUsedFrame = g_streamer.frame;
+        g_streamer.residentBytes += getResidentBytes(streamed);
+    }
+
+    void RequestLevel(const Texture2D& texture, float uvPerUnit, float pixelsPerUnit, float priority)
+    {
+        auto it = g_streamer.textures.find(texture.GetID());
+        if (it == g_streamer.textures.end())
+            return;
+
+        StreamedTexture& streamed = it->second;
+        const float level = GetSampledLevel(streamed.Layout.Width, streamed.Layout.Height, uvPerUnit, pixelsPerUnit);
+        streamed.WantedLevel = std::min(streamed.WantedLevel, level);
+        streamed.Priority = std::max(streamed.Priority, priority);
+        streamed.LastUsedFrame = g_streamer.frame;
+    }
+
+    void Update()
+    {
+        collectReads();
+
+        // textures whose cache entry is gone, and the targets of the requests since the last Update
+        for (auto it = g_streamer.textures.begin(); it != g_streamer.textures.end();)
+        {
+            StreamedTexture& texture = it->second;
+            if (texture.Owner.expired())
+            {
+                g_streamer.residentBytes -= getResidentBytes(texture);
+                it = g_streamer.textures.erase(it);
+                continue;
+            }
+
+            if (texture.LastUsedFrame == g_streamer.frame)
+            {
+                const float wanted = std::max(texture.WantedLevel, 0.0f);
+                texture.TargetLevel = std::min(static_cast<size_t>(wanted), texture.TailLevel);
+                texture.LastPriority = texture.Priority;
+            }
+            texture.WantedLevel = FLT_MAX;
+            texture.Priority = 0.0f;
+            ++it;
+        }
+
+        // the budget may have been lowered
+        makeRoom(0, nullptr);
+        startLoads();
+        g_streamer.stats.BytesUploaded = uploadLevels();
+
+        g_streamer.stats.Textures = static_cast<unsigned int>(g_streamer.textures.size());
+        g_streamer.stats.Streaming = 0;
+        g_streamer.stats.FullBytes = 0;
+        for (const auto& [name, texture] : g_streamer.textures)
+        {
+            if (texture.Reading || texture.Uploading)
+                g_streamer.stats.Streaming++;
+            g_streamer.stats.FullBytes += getFullBytes(texture);
+        }
+        g_streamer.stats.ResidentBytes = g_streamer.residentBytes;
+        g_streamer.stats.Budget = g_streamer.budget;
+
+        g_streamer.frame++;
+    }
+
+    void Shutdown()
+    {
+        g_streamer.textures.clear();
+        g_streamer.residentBytes = 0;
+
+        std::lock_guard<std::mutex> lock(g_streamer.readMutex);
+        g_streamer.reads.clear();
+    }
+
+    const TextureStreamerStats& GetStats()
+    {
+        return g_streamer.stats;
+    }
+}
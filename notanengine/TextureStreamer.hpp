@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Texture2D.hpp"
+#include "TextureCompression.hpp"
+
+/*
+    Keeps textures in a fixed VRAM budget by streaming their mip levels.
+    A texture starts with only its coarse tail (levels of RESIDENT_TAIL_SIZE
+    and smaller) in VRAM. While drawing, the renderer requests the finest
+    level each texture needs from the screen-space footprint of the
+    submeshes using it (their UV density at their distance). Update then
+    brings the missing levels in, one level at a time, finest wanted first
+    for the textures covering the most pixels: the chain is read back from
+    the texture disk cache on a loader thread and uploaded in bands within
+    the upload budget.
+    Going over the budget evicts levels: first those finer than their
+    texture currently needs, then the least recently used, then the lowest
+    priority. The texture's base level is raised and the dropped level
+    respecified empty, which frees its storage (GL 3.3 has no sparse or
+    immutable textures to do better).
+    Textures are tracked by their texture cache entry and forgotten once it's
+    gone. GL thread only.
+*/
+namespace TextureStreamer
+{
+    constexpr size_t DEFAULT_BUDGET = 256 * 1024 * 1024;
+    constexpr size_t DEFAULT_UPLOAD_BUDGET = 4 * 1024 * 1024;
+    // levels this size and smaller are always resident
+    constexpr int RESIDENT_TAIL_SIZE = 64;
+    // source reads on the loader threads at once
+    constexpr unsigned int MAX_PENDING_READS = 4;
+
+    struct TextureStreamerStats
+    {
+        unsigned int Textures = 0;
+        unsigned int Streaming = 0;         // reading or uploading a level
+        size_t ResidentBytes = 0;
+        size_t FullBytes = 0;               // what every level of every texture would take
+        size_t Budget = 0;
+        size_t BytesUploaded = 0;           // during the last Update
+        unsigned int LevelsStreamed = 0;
+        unsigned int LevelsEvicted = 0;
+    };
+
+    // On by default. Off, textures created afterwards upload every level
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    void SetBudget(size_t bytes);
+    size_t GetBudget();
+    void SetUploadBudget(size_t bytesPerFrame);
+    size_t GetUploadBudget();
+
+    // Finest level of the resident tail of image, 0 when the whole image is small enough to stay resident
+    size_t GetTailLevel(const TextureCompression::CompressedImage& image);
+
+    // Takes over the levels finer than residentLevel of a texture whose levels from residentLevel on are uploaded.
+    // The chain is read back from cachePath when needed, and kept in memory when there's no cache file.
+    // Textures without a texture cache owner aren't tracked
+    void Register(const Texture2D& texture, const TextureCompression::CompressedImage& image,
+                  const std::string& cachePath, uint64_t sourceHash, size_t residentLevel);
+
+    // Level (fractional, 0 is the full image) a width x height texture is sampled at when uvPerUnit of its UV
+    // range covers pixelsPerUnit screen pixels. 0 when the UV density isn't known
+    inline float GetSampledLevel(int width, int height, float uvPerUnit, float pixelsPerUnit) noexcept
+    {
+        if (uvPerUnit <= 0.0f || pixelsPerUnit <= 0.0f)
+            return 0.0f;
+        const float texelsPerUnit = uvPerUnit * static_cast<float>(std::max({ width, height, 1 }));
+        return std::log2(std::max(texelsPerUnit / pixelsPerUnit, 1.0f));
+    }
+
+    // The texture is used this frame, uvPerUnit of its UV range per world unit at pixelsPerUnit screen pixels per
+    // world unit. The level is worked out from the size of the image streamed, not the texture's properties, which
+    // stay those of the placeholder for textures loaded asynchronously.
+    // priority grows with the pixels it covers (the largest request wins)
+    void RequestLevel(const Texture2D& texture, float uvPerUnit, float pixelsPerUnit, float priority);
+
+    // Evicts over the budget, starts reads and uploads levels, for the requests made since the last call. Once per frame
+    void Update();
+    // Forgets every texture. Run after AsyncLoader::Shutdown, no read is in flight anymore
+    void Shutdown();
+
+    const TextureStreamerStats& GetStats();
+}
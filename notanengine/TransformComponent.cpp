@@ -1,15 +1,42 @@
 #include "TransformComponent.hpp"
 
-#include <glm/gtc/matrix_transform.hpp>
+#include <atomic>
+
+#include "TransformSystem.hpp"
+
+// shared by every transform, so a version never repeats even across copies
+static std::atomic<uint64_t> g_nextVersion{ 1 };
+
+const glm::mat4& TransformComponent::GetTransformMatrix() const
+{
+    if (m_dirty)
+        updateTransformMatrix();
+    return m_transMatrix;
+}
+
+uint64_t TransformComponent::GetVersion() const
+{
+    if (m_dirty)
+        updateTransformMatrix();
+    return m_version;
+}
+
+glm::quat TransformComponent::GetOrientation() const
+{
+    syncOrientation();
+    return m_orientation;
+}
 
 void TransformComponent::SetPosition(const glm::vec3 &pos)
 {
     m_position = pos;
+    m_dirty = true;
 }
 
 void TransformComponent::SetPosition(float x, float y, float z)
 {
     m_position = glm::vec3(x, y, z);
+    m_dirty = true;
 }
 
 void TransformComponent::Translate(const glm::vec3 &pos)
@@ -20,67 +47,83 @@ void TransformComponent::Translate(const glm::vec3 &pos)
 void TransformComponent::SetRotation(const glm::vec3 &rot)
 {
     m_rotation = rot;
+    m_dirty = true;
 }
 
 void TransformComponent::SetRotation(float x, float y, float z)
 {
     m_rotation = glm::vec3(x, y, z);
+    m_dirty = true;
 }
 
-void TransformComponent::Rotate(float deg, const glm::vec3& axis)
+void TransformComponent::SetOrientation(const glm::quat& orientation)
 {
-    // TODO: implement rotation around other axis
-    // this works if axis is (1,0,0) (0,1,0) or (0,0,1)
-    // but i have no idea if it works around other axis
-    glm::vec3 norm = glm::normalize(axis);
-    glm::vec3 newRot = norm * deg; 
+    m_orientation = glm::normalize(orientation);
+    m_rotation = m_eulerMirror = QuatToEuler(m_orientation);
+    m_dirty = true;
+}
 
-    SetRotation(newRot);
+void TransformComponent::Rotate(float deg, const glm::vec3& axis)
+{
+    syncOrientation();
+    SetOrientation(m_orientation * glm::angleAxis(glm::radians(deg), glm::normalize(axis)));
 }
 
 void TransformComponent::SetScale(const glm::vec3 &scale)
 {
     m_scale = scale;
+    m_dirty = true;
 }
 
 void TransformComponent::SetScale(float x, float y, float z)
 {
     m_scale = glm::vec3(x, y, z);
+    m_dirty = true;
 }
 
 void TransformComponent::Scale(float factor)
 {
     m_scale = glm::vec3(factor);
+    m_dirty = true;
 }
 
 void TransformComponent::Update()
 {
-    updateTransformMatrix();
+    if (m_dirty)
+        updateTransformMatrix();
 }
 
-void TransformComponent::updateTransformMatrix()
+void TransformComponent::syncOrientation() const
 {
-    m_transMatrix = glm::mat4(1.0f);
+    if (m_rotation == m_eulerMirror)
+        return;
+    m_orientation = EulerToQuat(m_rotation);
+    m_eulerMirror = m_rotation;
+}
 
-    // Translation (relative to origin (0,0,0))
-    m_transMatrix = glm::translate(m_transMatrix, m_position);
+bool TransformComponent::BeginRebuild() const
+{
+    m_dirty = false;
+    syncOrientation();
 
-    // Rotation
-    // TODO: QUATERNIONS
-    float angleX = glm::radians(m_rotation.x);
-    float angleY = glm::radians(m_rotation.y);
-    float angleZ = glm::radians(m_rotation.z);
+    // a Get*Ref that wrote nothing, or a change undone before the matrix was needed
+    if (m_version != 0 && m_position == m_builtPosition && m_orientation == m_builtOrientation && m_scale == m_builtScale)
+        return false;
 
-    // x-axis
-    if (angleX)
-        m_transMatrix = glm::rotate(m_transMatrix, angleX, glm::vec3(1.0f, 0.0f, 0.0f));
-    // y-axis
-    if (angleY)
-        m_transMatrix = glm::rotate(m_transMatrix, angleY, glm::vec3(0.0f, 1.0f, 0.0f));
-    // z-axis
-    if (angleZ)
-        m_transMatrix = glm::rotate(m_transMatrix, angleZ, glm::vec3(0.0f, 0.0f, 1.0f));
+    m_builtPosition = m_position;
+    m_builtOrientation = m_orientation;
+    m_builtScale = m_scale;
+    return true;
+}
 
-    // Scale
-    m_transMatrix = glm::scale(m_transMatrix, m_scale);
+void TransformComponent::EndRebuild(const glm::mat4& matrix) const
+{
+    m_transMatrix = matrix;
+    m_version = g_nextVersion.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TransformComponent::updateTransformMatrix() const
+{
+    if (BeginRebuild())
+        EndRebuild(ComposeTRS(m_position, m_orientation, m_scale));
 }
@@ -1,19 +1,38 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
 
 /*
     A transform component contains position, scale and rotation.
     The transform matrix is stored and calculated through this.
+    The rotation is a quaternion; the Euler angles (degrees) are how the
+    editor shows it, and editing them replaces the quaternion. Rotate
+    composes with the current rotation around any axis.
+    Changes only mark it dirty, the matrix is rebuilt the next time it's
+    asked for (or on Update). Every rebuild that changes it gets a new
+    version, unique across all transforms, so caches of things derived from
+    the matrix (world bounds, shadow maps) can tell when they're stale by
+    comparing a number.
+    The Get*Ref accessors mark the transform dirty too, since whoever holds
+    the reference (the ImGui editor) may write through it; a rebuild that
+    finds nothing changed keeps the version.
 */
 class TransformComponent
 {
 public:
     TransformComponent()
         : m_position(0.0f), m_rotation(0.0f), m_scale(1.0f), m_transMatrix(1.0f) {}
-    
+
     TransformComponent(const TransformComponent& other)
-        : m_position(other.m_position), m_rotation(other.m_rotation), m_scale(other.m_scale), m_transMatrix(1.0f) {}
+        : m_position(other.m_position), m_rotation(other.m_rotation), m_scale(other.m_scale), m_transMatrix(1.0f),
+          m_orientation(other.m_orientation), m_eulerMirror(other.m_eulerMirror) {}
+
+    // moving keeps the built matrix and its version: it's the same transform in another place (entity storage)
+    TransformComponent(TransformComponent&& other) noexcept = default;
+    TransformComponent& operator=(TransformComponent&& other) noexcept = default;
 
     TransformComponent& operator=(const TransformComponent& other)
     {
@@ -22,40 +41,67 @@ public:
             this->m_position = other.m_position;
             this->m_rotation = other.m_rotation;
             this->m_scale = other.m_scale;
+            this->m_orientation = other.m_orientation;
+            this->m_eulerMirror = other.m_eulerMirror;
+            this->m_dirty = true;
         }
-        this->updateTransformMatrix();
         return *this;
     }
 
     inline glm::vec3 GetPosition() const noexcept { return m_position; }
     inline glm::vec3 GetRotation() const noexcept { return m_rotation; }
     inline glm::vec3 GetScale() const noexcept { return m_scale; }
+    glm::quat GetOrientation() const;
 
-    inline glm::mat4 GetTransformMatrix() const noexcept { return m_transMatrix; }
+    // Rebuilt first if the transform changed since the last call
+    const glm::mat4& GetTransformMatrix() const;
+    // Version of the matrix GetTransformMatrix returns, 0 before it's first built
+    uint64_t GetVersion() const;
+    inline bool IsDirty() const noexcept { return m_dirty; }
 
     void SetPosition(const glm::vec3& pos);
     void SetPosition(float x, float y, float z);
     void Translate(const glm::vec3& pos);
-    inline glm::vec3& GetPositionRef() noexcept { return m_position; }
+    inline glm::vec3& GetPositionRef() noexcept { m_dirty = true; return m_position; }
 
     void SetRotation(const glm::vec3& rot);
     void SetRotation(float x, float y, float z);
+    void SetOrientation(const glm::quat& orientation);
+    // Turns deg degrees around axis (in the transform's own space) on top of the current rotation
     void Rotate(float deg, const glm::vec3& axis);
-    inline glm::vec3& GetRotationRef() noexcept { return m_rotation; }
+    inline glm::vec3& GetRotationRef() noexcept { m_dirty = true; return m_rotation; }
 
     void SetScale(const glm::vec3& scale);
     void SetScale(float x, float y, float z);
     void Scale(float factor);
-    inline glm::vec3& GetScaleRef() noexcept { return m_scale; }
+    inline glm::vec3& GetScaleRef() noexcept { m_dirty = true; return m_scale; }
 
+    // Rebuilds the matrix if it's dirty, nothing to do otherwise
     void Update();
 
+    // Building the matrix elsewhere, many at once (Scene::UpdateTransforms). BeginRebuild clears the dirty flag and
+    // returns true when the matrix is stale: EndRebuild then takes the matrix of GetPosition, GetOrientation and
+    // GetScale, and gives it a new version. Nothing else may read the matrix in between
+    bool BeginRebuild() const;
+    void EndRebuild(const glm::mat4& matrix) const;
+
 private:
     glm::vec3 m_position;
     glm::vec3 m_rotation;
     glm::vec3 m_scale;
 
-    glm::mat4 m_transMatrix;
+    // built lazily from const getters
+    mutable glm::mat4 m_transMatrix;
+    // the actual rotation, and the Euler angles it was last converted from/to: m_rotation differing means it was edited
+    mutable glm::quat m_orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    mutable glm::vec3 m_eulerMirror = glm::vec3(0.0f);
+    mutable bool m_dirty = true;
+    mutable uint64_t m_version = 0;
+    // what m_transMatrix was built from
+    mutable glm::vec3 m_builtPosition = glm::vec3(0.0f);
+    mutable glm::quat m_builtOrientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    mutable glm::vec3 m_builtScale = glm::vec3(1.0f);
 
-    void updateTransformMatrix();
+    void syncOrientation() const;
+    void updateTransformMatrix() const;
 };
@@ -0,0 +1,312 @@
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include "JobSystem.hpp"
+
+static constexpr uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+
+// shared by every hierarchy, so a version never repeats
+static std::atomic<uint64_t> g_nextVersion{ 1 };
+
+TransformHierarchy::NodeId TransformHierarchy::Add(const glm::mat4& local, NodeId parent)
+{
+    NodeId node;
+    if (!m_freeIds.empty())
+    {
+        node = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    else
+    {
+        node = static_cast<NodeId>(m_indices.size());
+        m_indices.push_back(NO_INDEX);
+    }
+
+    // after the parent's subtree, which is also the end of the array when building depth first
+    uint32_t parentIndex = NO_INDEX;
+    uint32_t position = static_cast<uint32_t>(m_nodes.size());
+    if (parent != INVALID_NODE)
+    {
+        parentIndex = m_indices[parent];
+        position = parentIndex + m_subtreeSizes[parentIndex];
+    }
+    const bool append = position == m_nodes.size();
+
+    m_nodes.insert(m_nodes.begin() + position, node);
+    m_parentNodes.insert(m_parentNodes.begin() + position, parent);
+    m_flags.insert(m_flags.begin() + position, uint8_t(0));
+    m_locals.insert(m_locals.begin() + position, local);
+    m_worlds.insert(m_worlds.begin() + position, local);
+    m_versions.insert(m_versions.begin() + position, uint64_t(0));
+
+    if (append)
+    {
+        m_indices[node] = position;
+        m_parents.push_back(parentIndex);
+        m_subtreeSizes.push_back(1);
+        for (uint32_t p = parentIndex; p != NO_INDEX; p = m_parents[p])
+            m_subtreeSizes[p]++;
+    }
+    else
+        reindex();
+
+    markDirty(position);
+    m_stats.Nodes = static_cast<unsigned int>(GetSize());
+    return node;
+}
+
+void TransformHierarchy::Remove(NodeId node)
+{
+    const uint32_t index = m_indices[node];
+
+    // the last node without children (the last one added, building depth first) just goes
+    if (index + 1 == m_nodes.size() && m_subtreeSizes[index] == 1)
+    {
+        for (uint32_t p = m_parents[index]; p != NO_INDEX; p = m_parents[p])
+            m_subtreeSizes[p]--;
+        forEachColumn([](auto& column) { column.pop_back(); });
+        m_parents.pop_back();
+        m_subtreeSizes.pop_back();
+        m_indices[node] = NO_INDEX;
+        m_freeIds.push_back(node);
+        m_stats.Nodes = static_cast<unsigned int>(GetSize());
+        return;
+    }
+
+    // a placeholder otherwise. Its identity matrix passes its parent's world matrix to its children, which stay in
+    // its subtree, inside the parent's
+    m_flags[index] |= FLAG_REMOVED;
+    m_locals[index] = glm::mat4(1.0f);
+    if (m_subtreeSizes[index] > 1)
+        markDirty(index);
+    m_removedCount++;
+
+    // amortized: the array is rewritten once per quarter of it removed
+    if (m_removedCount * 4 > m_nodes.size())
+        compact();
+    m_stats.Nodes = static_cast<unsigned int>(GetSize());
+}
+
+bool TransformHierarchy::SetParent(NodeId node, NodeId parent)
+{
+    const uint32_t index = m_indices[node];
+    const uint32_t size = m_subtreeSizes[index];
+
+    // the end of the new parent's subtree, which can't be inside the moved one
+    uint32_t target = static_cast<uint32_t>(m_nodes.size());
+    if (parent != INVALID_NODE)
+    {
+        const uint32_t parentIndex = m_indices[parent];
+        if (parentIndex >= index && parentIndex < index + size)
+            return false;
+        target = parentIndex + m_subtreeSizes[parentIndex];
+    }
+
+    m_parentNodes[index] = parent;
+    if (target > index + size)
+        forEachColumn([&](auto& column) { std::rotate(column.begin() + index, column.begin() + index + size, column.begin() + target); });
+    else if (target < index)
+        forEachColumn([&](auto& column) { std::rotate(column.begin() + target, column.begin() + index, column.begin() + index + size); });
+    reindex();
+
+    markDirty(m_indices[node]);
+    return true;
+}
+
+TransformHierarchy::NodeId TransformHierarchy::GetParent(NodeId node) const
+{
+    return liveParent(m_indices[node]);
+}
+
+void TransformHierarchy::Reserve(size_t count)
+{
+    forEachColumn([count](auto& column) { column.reserve(count); });
+    m_parents.reserve(count);
+    m_subtreeSizes.reserve(count);
+    m_indices.reserve(count);
+}
+
+void TransformHierarchy::Clear()
+{
+    forEachColumn([](auto& column) { column.clear(); });
+    m_parents.clear();
+    m_subtreeSizes.clear();
+    m_indices.clear();
+    m_freeIds.clear();
+    m_removedCount = 0;
+    m_dirty = false;
+    m_stats = TransformHierarchyStats();
+}
+
+void TransformHierarchy::SetLocal(NodeId node, const glm::mat4& local)
+{
+    const uint32_t index = m_indices[node];
+    m_locals[index] = local;
+    markDirty(index);
+}
+
+const glm::mat4& TransformHierarchy::GetLocal(NodeId node) const
+{
+    return m_locals[m_indices[node]];
+}
+
+const glm::mat4& TransformHierarchy::GetWorld(NodeId node) const
+{
+    return m_worlds[m_indices[node]];
+}
+
+uint64_t TransformHierarchy::GetVersion(NodeId node) const
+{
+    return m_versions[m_indices[node]];
+}
+
+void TransformHierarchy::Update(size_t minBatchSize)
+{
+    m_stats.NodesUpdated = 0;
+    m_stats.Jobs = 0;
+    if (!m_dirty)
+        return;
+    m_dirty = false;
+
+    const uint32_t count = static_cast<uint32_t>(m_nodes.size());
+    const uint64_t version = g_nextVersion.fetch_add(1, std::memory_order_relaxed);
+    // big enough to be worth a job, small enough to give every worker a few
+    const uint32_t maxJobSize = std::max(static_cast<uint32_t>(minBatchSize), count / (4 * (JobSystem::GetWorkerCount() + 1)));
+
+    /// Find the ranges to recompute. The nodes above them and the roots of the big subtrees are done here,
+    // so every range only depends on nodes already up to date
+    m_jobs.clear();
+    uint32_t total = 0;
+    uint32_t i = 0;
+    while (i < count)
+    {
+        const uint8_t flags = m_flags[i];
+        const uint32_t size = m_subtreeSizes[i];
+
+        if (flags & FLAG_DIRTY)
+        {
+            total += (size > maxJobSize) ? 1 : size;
+            if (size > maxJobSize)
+            {
+                computeRange(i, i + 1, version);
+                for (uint32_t c = i + 1; c < i + size; c += m_subtreeSizes[c])
+                    m_flags[c] |= FLAG_DIRTY;
+                i++;
+                continue;
+            }
+
+            // consecutive dirty subtrees share a job
+            if (!m_jobs.empty() && m_jobs.back().End == i && m_jobs.back().End - m_jobs.back().Begin + size <= maxJobSize)
+                m_jobs.back().End += size;
+            else
+                m_jobs.push_back({ i, i + size });
+            i += size;
+        }
+        else if (flags & FLAG_DIRTY_BELOW)
+        {
+            m_flags[i] &= FLAG_REMOVED;
+            i++;
+        }
+        else
+            i += size;
+    }
+
+    /// Recompute them
+    if (m_jobs.size() > 1 && total >= 2 * minBatchSize)
+    {
+        JobSystem::ParallelFor(m_jobs.size(), 1, [this, version](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; j++)
+                computeRange(m_jobs[j].Begin, m_jobs[j].End, version);
+        });
+        m_stats.Jobs = static_cast<unsigned int>(m_jobs.size());
+    }
+    else
+    {
+        for (const Range& job : m_jobs)
+            computeRange(job.Begin, job.End, version);
+    }
+
+    m_stats.NodesUpdated = total;
+}
+
+void TransformHierarchy::markDirty(uint32_t index)
+{
+    m_flags[index] |= FLAG_DIRTY;
+    // an ancestor already marked has its own ancestors marked too
+    for (uint32_t p = m_parents[index]; p != NO_INDEX && !(m_flags[p] & FLAG_DIRTY_BELOW); p = m_parents[p])
+        m_flags[p] |= FLAG_DIRTY_BELOW;
+    m_dirty = true;
+}
+
+TransformHierarchy::NodeId TransformHierarchy::liveParent(uint32_t index) const
+{
+    NodeId parent = m_parentNodes[index];
+    while (parent != INVALID_NODE && (m_flags[m_indices[parent]] & FLAG_REMOVED))
+        parent = m_parentNodes[m_indices[parent]];
+    return parent;
+}
+
+void TransformHierarchy::compact()
+{
+    // parents first, so a removed parent already points past its own removed ancestors
+    const uint32_t count = static_cast<uint32_t>(m_nodes.size());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint32_t parent = m_parents[i];
+        if (parent == NO_INDEX || !(m_flags[parent] & FLAG_REMOVED))
+            continue;
+        m_parentNodes[i] = m_parentNodes[parent];
+        // the placeholder's change wasn't passed down yet
+        if (m_flags[parent] & FLAG_DIRTY)
+            m_flags[i] |= FLAG_DIRTY;
+    }
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (m_flags[i] & FLAG_REMOVED)
+        {
+            m_indices[m_nodes[i]] = NO_INDEX;
+            m_freeIds.push_back(m_nodes[i]);
+            continue;
+        }
+        if (kept != i)
+            forEachColumn([kept, i](auto& column) { column[kept] = std::move(column[i]); });
+        kept++;
+    }
+    forEachColumn([kept](auto& column) { column.resize(kept); });
+    m_removedCount = 0;
+    reindex();
+}
+
+void TransformHierarchy::reindex()
+{
+    const uint32_t count = static_cast<uint32_t>(m_nodes.size());
+    for (uint32_t i = 0; i < count; i++)
+        m_indices[m_nodes[i]] = i;
+
+    m_parents.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        m_parents[i] = (m_parentNodes[i] == INVALID_NODE) ? NO_INDEX : m_indices[m_parentNodes[i]];
+
+    // children after their parent: going backwards, a subtree is complete before it's added to its parent
+    m_subtreeSizes.assign(count, 1);
+    for (uint32_t i = count; i-- > 0;)
+    {
+        if (m_parents[i] != NO_INDEX)
+            m_subtreeSizes[m_parents[i]] += m_subtreeSizes[i];
+    }
+}
+
+void TransformHierarchy::computeRange(uint32_t begin, uint32_t end, uint64_t version)
+{
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const uint32_t parent = m_parents[i];
+        m_worlds[i] = (parent == NO_INDEX) ? m_locals[i] : m_worlds[parent] * m_locals[i];
+        m_flags[i] &= FLAG_REMOVED;
+        m_versions[i] = version;
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct TransformHierarchyStats
+{
+    unsigned int Nodes = 0;
+    unsigned int NodesUpdated = 0;      // during the last Update
+    unsigned int Jobs = 0;              // ranges the last Update ran on the JobSystem, 0 when it ran alone
+};
+
+/*
+    Parent/child transforms, world = parent's world * local.
+    Nodes are kept in one flat array in depth first order, so a parent is
+    always before its children and a subtree is the contiguous range
+    [node, node + subtree size). Update is one linear pass over the array:
+    a node whose local matrix changed has its whole range recomputed, clean
+    subtrees are skipped in one step, and nodes only above a change are
+    walked through. The ranges to recompute are independent of each other,
+    they're split across the JobSystem (a subtree too big for one job gives
+    its children subtrees instead).
+    Nodes are referred to by ids that survive the array being reordered.
+    Adding under the last added branch (building a tree depth first) is
+    cheap, and so is removing: the node stays as a placeholder with an
+    identity matrix, so its children see their new parent's, until the
+    placeholders make up a quarter of the array and are compacted away
+    together. Other structural changes rewrite the array: they're meant
+    for load time and editing, not every frame.
+*/
+class TransformHierarchy
+{
+public:
+    using NodeId = uint32_t;
+    static constexpr NodeId INVALID_NODE = std::numeric_limits<NodeId>::max();
+
+    // A node under parent (a root without one), after the parent's other descendants
+    NodeId Add(const glm::mat4& local = glm::mat4(1.0f), NodeId parent = INVALID_NODE);
+    // The node's children are moved to its parent, keeping their local matrices
+    void Remove(NodeId node);
+    // Moves the node and its subtree under parent. false if parent is in that subtree
+    bool SetParent(NodeId node, NodeId parent);
+    NodeId GetParent(NodeId node) const;
+    void Reserve(size_t count);
+    void Clear();
+
+    inline size_t GetSize() const noexcept { return m_nodes.size() - m_removedCount; }
+
+    void SetLocal(NodeId node, const glm::mat4& local);
+    const glm::mat4& GetLocal(NodeId node) const;
+    // As of the last Update
+    const glm::mat4& GetWorld(NodeId node) const;
+    // Changes every time Update recomputes the node's world matrix
+    uint64_t GetVersion(NodeId node) const;
+
+    inline bool IsDirty() const noexcept { return m_dirty; }
+    // Recomputes the world matrices of the changed subtrees, in jobs of at least minBatchSize nodes
+    void Update(size_t minBatchSize = 1024);
+
+    inline const TransformHierarchyStats& GetStats() const noexcept { return m_stats; }
+
+private:
+    enum : uint8_t
+    {
+        FLAG_DIRTY = 1,         // the local matrix changed, the whole subtree needs recomputing
+        FLAG_DIRTY_BELOW = 2,   // some descendant is dirty
+        FLAG_REMOVED = 4        // a placeholder for a removed node, until compact
+    };
+
+    struct Range
+    {
+        uint32_t Begin;
+        uint32_t End;
+    };
+
+    // by array index, parents first
+    std::vector<NodeId> m_nodes;
+    std::vector<NodeId> m_parentNodes;
+    std::vector<uint32_t> m_parents;        // index of the parent, rebuilt from m_parentNodes
+    std::vector<uint32_t> m_subtreeSizes;   // the node included
+    std::vector<uint8_t> m_flags;
+    std::vector<glm::mat4> m_locals;
+    std::vector<glm::mat4> m_worlds;
+    std::vector<uint64_t> m_versions;
+
+    // by id
+    std::vector<uint32_t> m_indices;
+    std::vector<NodeId> m_freeIds;
+
+    uint32_t m_removedCount = 0;    // placeholders in the array
+    bool m_dirty = false;
+    std::vector<Range> m_jobs;
+    TransformHierarchyStats m_stats;
+
+    // the columns that move with their node
+    template <typename Func>
+    void forEachColumn(Func&& func)
+    {
+        func(m_nodes); func(m_parentNodes); func(m_flags); func(m_locals); func(m_worlds); func(m_versions);
+    }
+
+    void markDirty(uint32_t index);
+    // The first ancestor not removed
+    NodeId liveParent(uint32_t index) const;
+    // Drops the placeholders, their children going to the first ancestor left
+    void compact();
+    // m_indices, m_parents and m_subtreeSizes from the order of m_nodes and m_parentNodes
+    void reindex();
+    void computeRange(uint32_t begin, uint32_t end, uint64_t version);
+};
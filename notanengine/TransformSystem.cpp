@@ -0,0 +1,313 @@
+#include "TransformSystem.hpp"
+
+#include <cmath>
+
+#include "JobSystem.hpp"
+#include "Simd.hpp"
+
+glm::mat4 ComposeTRS(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    const float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+    const float xx = x * x, yy = y * y, zz = z * z;
+    const float xy = x * y, xz = x * z, yz = y * z;
+    const float wx = w * x, wy = w * y, wz = w * z;
+
+    glm::mat4 m;
+    m[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * scale.x;
+    m[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * scale.y;
+    m[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * scale.z;
+    m[3] = glm::vec4(position, 1.0f);
+    return m;
+}
+
+glm::quat EulerToQuat(const glm::vec3& degrees)
+{
+    const glm::vec3 radians = glm::radians(degrees);
+    return glm::angleAxis(radians.x, glm::vec3(1.0f, 0.0f, 0.0f))
+         * glm::angleAxis(radians.y, glm::vec3(0.0f, 1.0f, 0.0f))
+         * glm::angleAxis(radians.z, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+glm::vec3 QuatToEuler(const glm::quat& rotation)
+{
+    // R = Rx(a) * Ry(b) * Rz(c): row 0 column 2 is sin(b), the rest of row 0 and column 2 give c and a
+    const glm::mat3 r = glm::mat3_cast(rotation);
+    const float sinB = glm::clamp(r[2][0], -1.0f, 1.0f);
+
+    float a, b = std::asin(sinB), c;
+    if (std::abs(sinB) < 0.9999f)
+    {
+        a = std::atan2(-r[2][1], r[2][2]);
+        c = std::atan2(-r[1][0], r[0][0]);
+    }
+    else
+    {
+        // gimbal lock, a and c turn around the same axis: all of it goes to a
+        a = std::atan2(r[1][2], r[1][1]);
+        c = 0.0f;
+    }
+    return glm::degrees(glm::vec3(a, b, c));
+}
+
+/// Kernels
+
+struct TransformStreams
+{
+    const float* PositionX; const float* PositionY; const float* PositionZ;
+    const float* RotationX; const float* RotationY; const float* RotationZ; const float* RotationW;
+    const float* ScaleX; const float* ScaleY; const float* ScaleZ;
+};
+
+static void composeScalar(const TransformStreams& s, size_t begin, size_t end, glm::mat4* out)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        out[i] = ComposeTRS(glm::vec3(s.PositionX[i], s.PositionY[i], s.PositionZ[i]),
+                            glm::quat(s.RotationW[i], s.RotationX[i], s.RotationY[i], s.RotationZ[i]),
+                            glm::vec3(s.ScaleX[i], s.ScaleY[i], s.ScaleZ[i]));
+    }
+}
+
+#if NE_SIMD_SSE
+// x, y, z, w hold one component of a column for 4 transforms, written as that column of each of the 4 matrices
+static inline void storeColumn(float* matrices, int column, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(matrices + 0 * 16 + column * 4, x);
+    _mm_storeu_ps(matrices + 1 * 16 + column * 4, y);
+    _mm_storeu_ps(matrices + 2 * 16 + column * 4, z);
+    _mm_storeu_ps(matrices + 3 * 16 + column * 4, w);
+}
+
+static size_t composeSSE(const TransformStreams& s, size_t begin, size_t end, glm::mat4* out)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(s.RotationX + i), y = _mm_loadu_ps(s.RotationY + i);
+        const __m128 z = _mm_loadu_ps(s.RotationZ + i), w = _mm_loadu_ps(s.RotationW + i);
+
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        const __m128 sx = _mm_loadu_ps(s.ScaleX + i), sy = _mm_loadu_ps(s.ScaleY + i), sz = _mm_loadu_ps(s.ScaleZ + i);
+        float* matrices = &out[i][0][0];
+
+        storeColumn(matrices, 0,
+                    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+                    zero);
+        storeColumn(matrices, 1,
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+                    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+                    zero);
+        storeColumn(matrices, 2,
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+                    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+                    zero);
+        storeColumn(matrices, 3, _mm_loadu_ps(s.PositionX + i), _mm_loadu_ps(s.PositionY + i), _mm_loadu_ps(s.PositionZ + i), one);
+    }
+    return i;
+}
+#endif
+
+#if NE_SIMD_AVX
+// Same as storeColumn for 8 transforms: the low halves are the first 4, the high halves the next 4
+static inline void storeColumn8(float* matrices, int column, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+    storeColumn(matrices, column, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+                _mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+    storeColumn(matrices + 4 * 16, column, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+                _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+}
+
+static size_t composeAVX(const TransformStreams& s, size_t begin, size_t end, glm::mat4* out)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(s.RotationX + i), y = _mm256_loadu_ps(s.RotationY + i);
+        const __m256 z = _mm256_loadu_ps(s.RotationZ + i), w = _mm256_loadu_ps(s.RotationW + i);
+
+        const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+        const __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+        const __m256 sx = _mm256_loadu_ps(s.ScaleX + i), sy = _mm256_loadu_ps(s.ScaleY + i), sz = _mm256_loadu_ps(s.ScaleZ + i);
+        float* matrices = &out[i][0][0];
+
+        storeColumn8(matrices, 0,
+                     _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+                     _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+                     _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx),
+                     zero);
+        storeColumn8(matrices, 1,
+                     _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+                     _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+                     _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy),
+                     zero);
+        storeColumn8(matrices, 2,
+                     _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+                     _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+                     _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz),
+                     zero);
+        storeColumn8(matrices, 3, _mm256_loadu_ps(s.PositionX + i), _mm256_loadu_ps(s.PositionY + i),
+                     _mm256_loadu_ps(s.PositionZ + i), one);
+    }
+    return i;
+}
+#endif
+
+/// TransformSystem
+
+TransformSystem::Kernel TransformSystem::GetKernel() noexcept
+{
+#if NE_SIMD_AVX
+    return Kernel::AVX;
+#elif NE_SIMD_SSE
+    return Kernel::SSE;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+const char* TransformSystem::GetKernelName(Kernel kernel) noexcept
+{
+    switch (kernel)
+    {
+    case Kernel::SSE: return "SSE";
+    case Kernel::AVX: return "AVX";
+    default: return "scalar";
+    }
+}
+
+size_t TransformSystem::Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    const glm::quat r = glm::normalize(rotation);
+    m_positionX.push_back(position.x); m_positionY.push_back(position.y); m_positionZ.push_back(position.z);
+    m_rotationX.push_back(r.x); m_rotationY.push_back(r.y); m_rotationZ.push_back(r.z); m_rotationW.push_back(r.w);
+    m_scaleX.push_back(scale.x); m_scaleY.push_back(scale.y); m_scaleZ.push_back(scale.z);
+
+    m_matrices.push_back(ComposeTRS(position, r, scale));
+    return m_matrices.size() - 1;
+}
+
+void TransformSystem::RemoveSwapBack(size_t index)
+{
+    for (auto* stream : { &m_positionX, &m_positionY, &m_positionZ, &m_rotationX, &m_rotationY, &m_rotationZ, &m_rotationW,
+                          &m_scaleX, &m_scaleY, &m_scaleZ })
+    {
+        (*stream)[index] = stream->back();
+        stream->pop_back();
+    }
+    m_matrices[index] = m_matrices.back();
+    m_matrices.pop_back();
+}
+
+void TransformSystem::Reserve(size_t count)
+{
+    for (auto* stream : { &m_positionX, &m_positionY, &m_positionZ, &m_rotationX, &m_rotationY, &m_rotationZ, &m_rotationW,
+                          &m_scaleX, &m_scaleY, &m_scaleZ })
+        stream->reserve(count);
+    m_matrices.reserve(count);
+}
+
+void TransformSystem::Resize(size_t count)
+{
+    for (auto* stream : { &m_positionX, &m_positionY, &m_positionZ, &m_rotationX, &m_rotationY, &m_rotationZ })
+        stream->resize(count, 0.0f);
+    for (auto* stream : { &m_rotationW, &m_scaleX, &m_scaleY, &m_scaleZ })
+        stream->resize(count, 1.0f);
+    m_matrices.resize(count, glm::mat4(1.0f));
+}
+
+void TransformSystem::Clear()
+{
+    for (auto* stream : { &m_positionX, &m_positionY, &m_positionZ, &m_rotationX, &m_rotationY, &m_rotationZ, &m_rotationW,
+                          &m_scaleX, &m_scaleY, &m_scaleZ })
+        stream->clear();
+    m_matrices.clear();
+}
+
+void TransformSystem::SetPosition(size_t index, const glm::vec3& position)
+{
+    m_positionX[index] = position.x;
+    m_positionY[index] = position.y;
+    m_positionZ[index] = position.z;
+}
+
+void TransformSystem::SetRotation(size_t index, const glm::quat& rotation)
+{
+    const glm::quat r = glm::normalize(rotation);
+    m_rotationX[index] = r.x;
+    m_rotationY[index] = r.y;
+    m_rotationZ[index] = r.z;
+    m_rotationW[index] = r.w;
+}
+
+void TransformSystem::SetScale(size_t index, const glm::vec3& scale)
+{
+    m_scaleX[index] = scale.x;
+    m_scaleY[index] = scale.y;
+    m_scaleZ[index] = scale.z;
+}
+
+glm::vec3 TransformSystem::GetPosition(size_t index) const
+{
+    return glm::vec3(m_positionX[index], m_positionY[index], m_positionZ[index]);
+}
+
+glm::quat TransformSystem::GetRotation(size_t index) const
+{
+    return glm::quat(m_rotationW[index], m_rotationX[index], m_rotationY[index], m_rotationZ[index]);
+}
+
+glm::vec3 TransformSystem::GetScale(size_t index) const
+{
+    return glm::vec3(m_scaleX[index], m_scaleY[index], m_scaleZ[index]);
+}
+
+void TransformSystem::Compose(size_t begin, size_t end)
+{
+    Compose(begin, end, GetKernel());
+}
+
+void TransformSystem::Compose(size_t begin, size_t end, Kernel kernel)
+{
+    const TransformStreams streams{
+        m_positionX.data(), m_positionY.data(), m_positionZ.data(),
+        m_rotationX.data(), m_rotationY.data(), m_rotationZ.data(), m_rotationW.data(),
+        m_scaleX.data(), m_scaleY.data(), m_scaleZ.data()
+    };
+
+    // the wide kernels leave the tail that doesn't fill a register to the narrower ones
+    size_t i = begin;
+#if NE_SIMD_AVX
+    if (kernel == Kernel::AVX)
+        i = composeAVX(streams, i, end, m_matrices.data());
+#endif
+#if NE_SIMD_SSE
+    if (kernel != Kernel::Scalar)
+        i = composeSSE(streams, i, end, m_matrices.data());
+#endif
+    composeScalar(streams, i, end, m_matrices.data());
+}
+
+void TransformSystem::ComposeAll(size_t minBatchSize)
+{
+    JobSystem::ParallelFor(GetSize(), minBatchSize, [this](size_t begin, size_t end) {
+        Compose(begin, end);
+    });
+}
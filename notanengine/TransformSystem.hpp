@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Translation * rotation * scale, the matrix every transform of the engine is built as
+glm::mat4 ComposeTRS(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+// Rotation matrices of the editor's Euler angles (degrees, applied X then Y then Z like glm::rotate calls) and back
+glm::quat EulerToQuat(const glm::vec3& degrees);
+glm::vec3 QuatToEuler(const glm::quat& rotation);
+
+/*
+    Positions, rotations (unit quaternions) and scales of many transforms,
+    one array per component (structure of arrays), and their matrices.
+    Compose builds the matrices of a whole range at once: 4 transforms per
+    iteration with SSE, 8 with AVX (NE_ENABLE_AVX), each lane one transform,
+    transposed into the column-major matrices at the end. ComposeAll splits
+    the range on the JobSystem. Scene::UpdateTransforms builds the frame's
+    changed entity transforms with it.
+    Indices are dense: RemoveSwapBack moves the last transform into the hole.
+*/
+class TransformSystem
+{
+public:
+    enum class Kernel
+    {
+        Scalar,
+        SSE,
+        AVX
+    };
+
+    // The widest kernel this build has
+    static Kernel GetKernel() noexcept;
+    static const char* GetKernelName(Kernel kernel) noexcept;
+
+    size_t Add(const glm::vec3& position = glm::vec3(0.0f), const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+               const glm::vec3& scale = glm::vec3(1.0f));
+    // The last transform takes index's place
+    void RemoveSwapBack(size_t index);
+    // New transforms are identities
+    void Resize(size_t count);
+    void Reserve(size_t count);
+    void Clear();
+
+    inline size_t GetSize() const noexcept { return m_matrices.size(); }
+
+    void SetPosition(size_t index, const glm::vec3& position);
+    void SetRotation(size_t index, const glm::quat& rotation);
+    void SetScale(size_t index, const glm::vec3& scale);
+
+    glm::vec3 GetPosition(size_t index) const;
+    glm::quat GetRotation(size_t index) const;
+    glm::vec3 GetScale(size_t index) const;
+
+    // Matrices of [begin, end) with the given kernel (the widest available one by default)
+    void Compose(size_t begin, size_t end);
+    void Compose(size_t begin, size_t end, Kernel kernel);
+    // Every matrix, in batches of at least minBatchSize transforms on the JobSystem
+    void ComposeAll(size_t minBatchSize = 4096);
+
+    inline const glm::mat4& GetMatrix(size_t index) const noexcept { return m_matrices[index]; }
+    inline const glm::mat4* GetMatrices() const noexcept { return m_matrices.data(); }
+
+private:
+    std::vector<float> m_positionX, m_positionY, m_positionZ;
+    std::vector<float> m_rotationX, m_rotationY, m_rotationZ, m_rotationW;
+    std::vector<float> m_scaleX, m_scaleY, m_scaleZ;
+
+    std::vector<glm::mat4> m_matrices;
+};
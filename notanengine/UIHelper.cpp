@@ -1,5 +1,8 @@
 #include "UIHelper.hpp"
 
+#include <chrono>
+#include <cstdio>
+
 #include <glm/gtc/type_ptr.hpp>
 
 
@@ -50,50 +53,144 @@ namespace UIHelper
         ImGui::End();
     }
 
-    void EntityPropertiesManager(const std::unordered_map<std::string, std::tuple<Entity&, const Shader&>>& entities)
+    void FramePacerWindow(FramePacer& pacer)
+    {
+        ImGui::Begin("Frame Pacing");
+
+        FramePacerSettings& settings = pacer.GetSettingsRef();
+        ImGui::Checkbox("Enabled", &settings.Enabled);
+        ImGui::SliderFloat("Target FPS", &settings.TargetFps, 0.0f, 360.0f, settings.TargetFps > 0.0f ? "%.0f" : "unlimited");
+        int maxInFlight = static_cast<int>(settings.MaxFramesInFlight);
+        if (ImGui::SliderInt("Max frames in flight", &maxInFlight, 0, FramePacer::MAX_FRAMES_IN_FLIGHT, maxInFlight > 0 ? "%d" : "no limit"))
+            settings.MaxFramesInFlight = static_cast<unsigned int>(maxInFlight);
+        ImGui::Checkbox("Late camera latch", &settings.LateLatch);
+
+        const FramePacerStats& stats = pacer.GetStats();
+        ImGui::Text("CPU: %.2f ms, GPU wait: %.2f ms (%u in flight)", stats.CpuMs, stats.GpuWaitMs, stats.FramesInFlight);
+        ImGui::Text("Slept: %.2f ms, spun: %.3f ms, late by %.3f ms", stats.SleepMs, stats.SpinMs, stats.LateByMs);
+        ImGui::Text("Sleep error: %.3f ms", stats.SleepErrorMs);
+
+        ImGui::End();
+    }
+
+    void EntityPropertiesManager(Scene& scene, const Camera& camera, const glm::mat4& projection)
     {
         ImGui::Begin("Entity Properties");
 
-        unsigned int entityId = 0;
-	static Entity* selectedEntity = nullptr;
-	unsigned int selectedId = 0;
-        for (auto& [name, tupleEntityShader] : entities)
-        {
-	    const std::string entityButton = name + "##" + std::to_string(entityId);
-            Entity& entity = std::get<0>(tupleEntityShader);
+	const WorldStats worldStats = scene.GetWorld().GetStats();
+	ImGui::Text("%zu entities, %zu archetypes, %zu chunks (%.1f MB)", worldStats.Entities, worldStats.Archetypes, worldStats.Chunks,
+		    worldStats.ChunkBytes / (1024.0 * 1024.0));
+	const SpatialHashStats spatialStats = scene.GetSpatialIndex().GetStats();
+	ImGui::Text("Spatial index: %zu entities in %zu cells, %u levels. Last update: %u relocated, %u moved in place",
+		    spatialStats.Entities, spatialStats.Cells, spatialStats.Levels, spatialStats.Relocated, spatialStats.MovedInPlace);
 
+	// only the named entities are listed, not the ones spawned in bulk
+	std::vector<std::pair<EntityId, const std::string*>> named;
+	scene.GetWorld().ForEach<const NameComponent>([&named](EntityId entity, const NameComponent& name) {
+	    named.push_back({ entity, &name.Name });
+	});
+
+	static EntityId selectedEntity;
+        for (const auto& [entity, name] : named)
+        {
+	    const std::string entityButton = *name + "##" + std::to_string(entity.Index);
 	    if (ImGui::Button(entityButton.c_str()))
-	    {
-		selectedEntity = &entity;
-		selectedId = entityId;
-	    }
+		selectedEntity = entity;
 	    ImGui::SameLine();
-
-	    entityId++;
         }
+	ImGui::NewLine();
+
+	// a click outside the windows picks what is under the cursor, or at the center of the screen while the camera has the mouse
+	static std::string pickResult = "click in the scene";
+	const ImGuiIO& io = ImGui::GetIO();
+	if (ImGui::IsMouseClicked(0) && !io.WantCaptureMouse && io.DisplaySize.x > 0.0f && io.DisplaySize.y > 0.0f)
+	{
+	    glm::vec2 ndc(0.0f);
+	    const bool cursorCaptured = glfwGetInputMode(glfwGetCurrentContext(), GLFW_CURSOR) == GLFW_CURSOR_DISABLED;
+	    if (!cursorCaptured && ImGui::IsMousePosValid())
+		ndc = glm::vec2(2.0f * io.MousePos.x / io.DisplaySize.x - 1.0f, 1.0f - 2.0f * io.MousePos.y / io.DisplaySize.y);
+
+	    const auto start = std::chrono::high_resolution_clock::now();
+	    SceneRayHit hit;
+	    const bool picked = scene.Raycast(camera.GetRay(ndc, projection), hit);
+	    const float pickUs = std::chrono::duration<float, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+	    char result[160];
+	    if (picked)
+	    {
+		selectedEntity = hit.Entity;
+		const NameComponent* name = scene.Get<NameComponent>(hit.Entity);
+		std::snprintf(result, sizeof(result), "%s, submesh %zu triangle %u at %.2f (%.1f us)",
+			      name ? name->Name.c_str() : "unnamed", hit.SubMesh, hit.Hit.Triangle, hit.Hit.Distance, pickUs);
+	    }
+	    else
+		std::snprintf(result, sizeof(result), "nothing (%.1f us)", pickUs);
+	    pickResult = result;
+	}
+	ImGui::Text("Picked: %s", pickResult.c_str());
 
-	if (selectedEntity)
+	TransformComponent* transform = scene.Get<TransformComponent>(selectedEntity);
+	MeshComponent* meshComponent = scene.Get<MeshComponent>(selectedEntity);
+	if (transform && meshComponent)
 	{
             ImGui::Text("Properties");
 
-            const std::string id = std::to_string(selectedId);
+            const std::string id = std::to_string(selectedEntity.Index);
             std::string labelId = std::string("Position##") + id;
-            ImGui::InputFloat3(labelId.c_str(), glm::value_ptr(selectedEntity->Transform.GetPositionRef()));
+            ImGui::InputFloat3(labelId.c_str(), glm::value_ptr(transform->GetPositionRef()));
 
             labelId = std::string("Rotation##") + id;
-            ImGui::InputFloat3(labelId.c_str(), glm::value_ptr(selectedEntity->Transform.GetRotationRef()));
+            ImGui::InputFloat3(labelId.c_str(), glm::value_ptr(transform->GetRotationRef()));
 
             labelId = std::string("Scale##") + id; 
-            ImGui::InputFloat3(labelId.c_str(), glm::value_ptr(selectedEntity->Transform.GetScaleRef()));
+            ImGui::InputFloat3(labelId.c_str(), glm::value_ptr(transform->GetScaleRef()));
 
-            bool visibility = selectedEntity->IsVisible();
             const std::string visibleLabel = std::string("Is visible##") + id;
-            ImGui::Checkbox(visibleLabel.c_str(), &visibility);
-            selectedEntity->SetVisible(visibility);
+            ImGui::Checkbox(visibleLabel.c_str(), &meshComponent->Visible);
+
+	    // the transform above is relative to the parent
+	    const char* parentName = "None";
+	    for (const auto& [entity, name] : named)
+	    {
+		if (scene.HasParent(selectedEntity, entity))
+		    parentName = name->c_str();
+	    }
+	    const std::string parentLabel = std::string("Parent##") + id;
+	    if (ImGui::BeginCombo(parentLabel.c_str(), parentName))
+	    {
+		if (ImGui::Selectable("None", scene.HasParent(selectedEntity, EntityId())))
+		    scene.SetParent(selectedEntity, EntityId());
+		for (const auto& [entity, name] : named)
+		{
+		    // a descendant can't be chosen, SetParent refuses it
+		    if (entity != selectedEntity && ImGui::Selectable(name->c_str(), scene.HasParent(selectedEntity, entity)))
+			scene.SetParent(selectedEntity, entity);
+		}
+		ImGui::EndCombo();
+	    }
+
+	    // the closest entities to this one, from the spatial index
+	    AABB bounds;
+	    if (scene.GetSpatialIndex().GetBounds(selectedEntity, bounds))
+	    {
+		std::vector<EntityId> nearest;
+		scene.GetSpatialIndex().QueryNearest(bounds.GetCenter(), 4, nearest);
+		std::string nearby;
+		for (EntityId entity : nearest)
+		{
+		    const NameComponent* name = scene.Get<NameComponent>(entity);
+		    if (entity != selectedEntity && name)
+			nearby += (nearby.empty() ? "" : ", ") + name->Name;
+		}
+		ImGui::Text("Nearest: %s", nearby.empty() ? "-" : nearby.c_str());
+	    }
 
+	    // the submeshes may be shared with other entities, only an actual edit gives this one its own copy
+	    StaticMesh& entityMesh = meshComponent->Mesh;
 	    unsigned int materialId = 0;
-	    for (auto& mesh : selectedEntity->GetMeshRef().GetSubMeshesRef())
+	    for (size_t i = 0; i < entityMesh.GetSubMeshes().size(); i++)
 	    {
+		const MeshData& mesh = entityMesh.GetSubMeshes()[i];
 		if (!mesh.UseMaterial)
 		    continue;
 
@@ -101,10 +198,14 @@ namespace UIHelper
 
 		const std::string id = std::to_string(materialId);
 		std::string label = "Shininess##" + id;
-		ImGui::SliderFloat(label.c_str(), &mesh.Mat.Shininess, 0.1f, 512.0f);
+		float shininess = mesh.Mat.Shininess;
+		if (ImGui::SliderFloat(label.c_str(), &shininess, 0.1f, 512.0f))
+		    entityMesh.GetSubMeshesRef()[i].Mat.Shininess = shininess;
 
 		label = "Tiling Factor##" + id;
-		ImGui::SliderFloat(label.c_str(), &mesh.Mat.TilingFactor, 0.5f, 10.0f);
+		float tilingFactor = mesh.Mat.TilingFactor;
+		if (ImGui::SliderFloat(label.c_str(), &tilingFactor, 0.5f, 10.0f))
+		    entityMesh.GetSubMeshesRef()[i].Mat.TilingFactor = tilingFactor;
 
 		materialId++;
 	    }
@@ -125,6 +226,188 @@ namespace UIHelper
         ImGui::End();
     }
 
+    void LightClusterStatsWindow(const ClusterGridStats& stats)
+    {
+        ImGui::Begin("Clustered Lights");
+
+        ImGui::Text("Lights in view: %u", stats.NumLights);
+        ImGui::Text("Light/cluster assignments: %u", stats.NumAssignments);
+        ImGui::Text("Max lights in a cluster: %u", stats.MaxLightsInCluster);
+        ImGui::Text("Dropped assignments (cluster full): %u", stats.NumOverflows);
+        ImGui::Text("CPU assignment time: %f ms", stats.UpdateTimeMs);
+
+        ImGui::End();
+    }
+
+    void ShadowStatsWindow(const CascadedShadowMapStats& stats)
+    {
+        ImGui::Begin("Shadows");
+
+        ImGui::Text("Cascades rendered this frame: %u", stats.CascadesRendered);
+        ImGui::Text("Casters drawn: %u", stats.CastersDrawn);
+        ImGui::Text("Casters culled: %u", stats.CastersCulled);
+
+        ImGui::End();
+    }
+
+    void ShadowAtlasStatsWindow(const ShadowAtlasStats& stats)
+    {
+        ImGui::Begin("Local Light Shadows");
+
+        ImGui::Text("Shadowed lights: %u", stats.ShadowedLights);
+        ImGui::Text("Shadow maps rendered this frame: %u", stats.UpdatesThisFrame);
+        ImGui::Text("Pending updates: %u", stats.PendingUpdates);
+        ImGui::Text("Casters drawn: %u", stats.CastersDrawn);
+        ImGui::Text("Casters culled: %u", stats.CastersCulled);
+
+        ImGui::End();
+    }
+
+    void AsyncLoaderStatsWindow(const AsyncLoader::AsyncLoaderStats& stats)
+    {
+        ImGui::Begin("Asset Loading");
+
+        int budgetMB = static_cast<int>(AsyncLoader::GetUploadBudget() / (1024 * 1024));
+        if (ImGui::SliderInt("Upload budget (MB/frame)", &budgetMB, 1, 64))
+            AsyncLoader::SetUploadBudget(static_cast<size_t>(budgetMB) * 1024 * 1024);
+
+        bool compress = TextureCompression::IsEnabled();
+        if (ImGui::Checkbox("Compress textures (BC1/3/4/5)", &compress))
+            TextureCompression::SetEnabled(compress);
+
+        ImGui::Text("Pending textures: %u", stats.PendingTextures);
+        ImGui::Text("Pending models: %u", stats.PendingModels);
+        ImGui::Text("Loaded: %u textures, %u models", stats.TexturesLoaded, stats.ModelsLoaded);
+        ImGui::Text("Uploaded this frame: %.2f MB (%.2f ms)", stats.BytesUploaded / (1024.0f * 1024.0f), stats.UploadMs);
+
+        const ResourceManager::TextureCacheStats cache = ResourceManager::GetTextureCacheStats();
+        ImGui::Text("Cached textures: %zu (%zu released)", cache.Textures, cache.Released);
+        ImGui::Text("Cache hits: %zu by path, %zu by content, %zu misses", cache.PathHits, cache.ContentHits, cache.Misses);
+
+        const GpuResourceStats gpu = GpuResources::GetStats();
+        ImGui::Text("GPU objects: %zu textures, %zu buffers, %zu vertex arrays, %zu programs",
+                    gpu.LiveObjects[static_cast<size_t>(GpuObjectType::Texture)],
+                    gpu.LiveObjects[static_cast<size_t>(GpuObjectType::Buffer)],
+                    gpu.LiveObjects[static_cast<size_t>(GpuObjectType::VertexArray)],
+                    gpu.LiveObjects[static_cast<size_t>(GpuObjectType::Program)]);
+        ImGui::Text("Waiting for deletion: %zu (%zu deleted last frame, after %u frames)",
+                    gpu.PendingDeletions, gpu.DeletedLastFrame, GpuResources::GetDeletionDelay());
+
+        ImGui::End();
+    }
+
+    void TextureStreamerStatsWindow(const TextureStreamer::TextureStreamerStats& stats)
+    {
+        ImGui::Begin("Texture Streaming");
+
+        bool enabled = TextureStreamer::IsEnabled();
+        if (ImGui::Checkbox("Stream mip levels (textures loaded from now on)", &enabled))
+            TextureStreamer::SetEnabled(enabled);
+
+        int budgetMB = static_cast<int>(TextureStreamer::GetBudget() / (1024 * 1024));
+        if (ImGui::SliderInt("VRAM budget (MB)", &budgetMB, 16, 2048))
+            TextureStreamer::SetBudget(static_cast<size_t>(budgetMB) * 1024 * 1024);
+
+        int uploadMB = static_cast<int>(TextureStreamer::GetUploadBudget() / (1024 * 1024));
+        if (ImGui::SliderInt("Upload budget (MB/frame)", &uploadMB, 1, 64))
+            TextureStreamer::SetUploadBudget(static_cast<size_t>(uploadMB) * 1024 * 1024);
+
+        ImGui::Text("Textures: %u (%u streaming)", stats.Textures, stats.Streaming);
+        ImGui::Text("Resident: %.1f MB of %.1f MB budget, %.1f MB fully resident",
+                    stats.ResidentBytes / (1024.0f * 1024.0f), stats.Budget / (1024.0f * 1024.0f), stats.FullBytes / (1024.0f * 1024.0f));
+        ImGui::Text("Levels streamed: %u, evicted: %u", stats.LevelsStreamed, stats.LevelsEvicted);
+        ImGui::Text("Uploaded this frame: %.2f MB", stats.BytesUploaded / (1024.0f * 1024.0f));
+
+        ImGui::End();
+    }
+
+    void SystemSchedulerWindow(SystemScheduler& scheduler)
+    {
+        ImGui::Begin("Frame Timeline");
+
+        const FrameTimeline& timeline = scheduler.GetTimeline();
+        ImGui::Text("%u systems on %u threads", timeline.Systems, timeline.Lanes);
+        ImGui::Text("Update: %.3f ms, work: %.3f ms (%.1fx)", timeline.FrameMs, timeline.WorkMs,
+                    timeline.FrameMs > 0.0f ? timeline.WorkMs / timeline.FrameMs : 0.0f);
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.3f, 1.0f), "Critical path: %.3f ms", timeline.CriticalPathMs);
+
+	/// Timeline: a row per thread, the main one on top
+	const float laneHeight = 20.0f;
+	const float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+	const float pixelsPerMs = width / std::max(timeline.FrameMs, 1e-3f);
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+	drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + timeline.Lanes * laneHeight), IM_COL32(30, 30, 30, 255));
+	for (SystemScheduler::SystemId system = 0; system < scheduler.GetSystemCount(); system++)
+	{
+	    const SystemInfo& info = scheduler.GetSystem(system);
+	    if (!info.Enabled)
+		continue;
+
+	    const SystemTiming& timing = info.Timing;
+	    const ImVec2 min(origin.x + timing.StartMs * pixelsPerMs, origin.y + timing.Lane * laneHeight + 1.0f);
+	    const ImVec2 max(std::max(origin.x + timing.EndMs * pixelsPerMs, min.x + 2.0f), min.y + laneHeight - 2.0f);
+	    drawList->AddRectFilled(min, max, timing.Critical ? IM_COL32(200, 70, 50, 255) : IM_COL32(60, 110, 180, 255), 2.0f);
+
+	    // the name only if it fits
+	    if (ImGui::CalcTextSize(info.Name.c_str()).x + 4.0f < max.x - min.x)
+		drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32(255, 255, 255, 255), info.Name.c_str());
+
+	    if (ImGui::IsMouseHoveringRect(min, max))
+		ImGui::SetTooltip("%s\n%.3f ms, from %.3f ms%s", info.Name.c_str(), timing.EndMs - timing.StartMs, timing.StartMs,
+				  timing.Critical ? "\non the critical path" : "");
+	}
+	ImGui::Dummy(ImVec2(width, timeline.Lanes * laneHeight));
+
+	/// Systems, what they wait for, and switches
+	if (ImGui::CollapsingHeader("Systems"))
+	{
+	    for (SystemScheduler::SystemId system = 0; system < scheduler.GetSystemCount(); system++)
+	    {
+		const SystemInfo& info = scheduler.GetSystem(system);
+		bool enabled = info.Enabled;
+		if (ImGui::Checkbox(info.Name.c_str(), &enabled))
+		    scheduler.SetEnabled(system, enabled);
+		if (!info.Enabled)
+		    continue;
+
+		ImGui::SameLine();
+		ImGui::Text("%.3f ms%s", info.Timing.EndMs - info.Timing.StartMs, info.Thread == SystemThread::MainThread ? " (main thread)" : "");
+
+		std::string after;
+		for (SystemScheduler::SystemId dependency : info.Dependencies)
+		    after += (after.empty() ? "" : ", ") + scheduler.GetSystem(dependency).Name;
+		if (!after.empty())
+		    ImGui::Text("    after %s", after.c_str());
+	    }
+	}
+
+        ImGui::End();
+    }
+
+    void GeometryStatsWindow(const Render::GeometryStats& stats)
+    {
+        ImGui::Begin("Geometry");
+
+        float threshold = Render::GetLodErrorThreshold();
+        if (ImGui::SliderFloat("Max error (pixels)", &threshold, 0.0f, 16.0f))
+            Render::SetLodErrorThreshold(threshold);
+
+        Render::MeshletCullingSettings& culling = Render::GetMeshletCullingSettingsRef();
+        ImGui::Checkbox("Meshlet culling", &culling.Enabled);
+        ImGui::Checkbox("Backface meshlet culling", &culling.Backface);
+
+        ImGui::Text("Triangles drawn: %u", stats.TrianglesDrawn);
+        ImGui::Text("Triangles at LOD 0: %u", stats.TrianglesAtLod0);
+        if (stats.TrianglesAtLod0 > 0)
+            ImGui::Text("Ratio: %.1f%%", 100.0f * stats.TrianglesDrawn / stats.TrianglesAtLod0);
+        ImGui::Text("Meshlets culled: %u / %u", stats.MeshletsCulled, stats.MeshletsTested);
+        ImGui::Text("Meshlet draw ranges: %u", stats.MeshletRanges);
+
+        ImGui::End();
+    }
+
     void CameraAndProjectionPropertiesManager(Camera& camera, float& pNear, float& pFar)
     {
         ImGui::Begin("Camera and Projection Properties");
@@ -10,10 +10,16 @@
 #include <unordered_map>
 #include <tuple>
 
-#include "Entity.hpp"
+#include "Scene.hpp"
 #include "Light.hpp"
+#include "ClusteredLighting.hpp"
+#include "ShadowMap.hpp"
 #include "Camera.hpp"
 #include "Render.hpp"
+#include "AsyncLoader.hpp"
+#include "TextureStreamer.hpp"
+#include "SystemScheduler.hpp"
+#include "FramePacer.hpp"
 
 namespace UIHelper
 {
@@ -24,9 +30,27 @@ namespace UIHelper
 
     void FrameStatsWindow(float deltaTime);
 
-    void EntityPropertiesManager(const EntityRenderMap& entities);
+    void FramePacerWindow(FramePacer& pacer);
+
+    // Entity buttons, and a click in the scene picks the entity under the cursor
+    void EntityPropertiesManager(Scene& scene, const Camera& camera, const glm::mat4& projection);
 
     void DirectionalLightPropertiesManager(DirectionalLight& dirLight);
 
+    void LightClusterStatsWindow(const ClusterGridStats& stats);
+
+    void ShadowStatsWindow(const CascadedShadowMapStats& stats);
+
+    void ShadowAtlasStatsWindow(const ShadowAtlasStats& stats);
+
+    void GeometryStatsWindow(const Render::GeometryStats& stats);
+
+    void AsyncLoaderStatsWindow(const AsyncLoader::AsyncLoaderStats& stats);
+
+    void TextureStreamerStatsWindow(const TextureStreamer::TextureStreamerStats& stats);
+
+    // The last Run's systems on a timeline, one row per thread, and a switch for each
+    void SystemSchedulerWindow(SystemScheduler& scheduler);
+
     void CameraAndProjectionPropertiesManager(Camera& camera, float& pNear, float& pFar);
 }
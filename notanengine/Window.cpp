@@ -12,17 +12,24 @@
 #include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/backends/imgui_impl_opengl3.h>
 
-#include <stb/stb_image.h>
-
 #include "Shader.hpp"
 #include "Input.hpp"
 #include "Camera.hpp"
 #include "StaticMesh.hpp"
-#include "Entity.hpp"
+#include "Scene.hpp"
+#include "SystemScheduler.hpp"
 #include "ResourceManager.hpp"
 #include "Render.hpp"
 #include "UIHelper.hpp"
 #include "Light.hpp"
+#include "ClusteredLighting.hpp"
+#include "ShadowMap.hpp"
+#include "JobSystem.hpp"
+#include "AsyncLoader.hpp"
+#include "AssetIndex.hpp"
+#include "GpuResources.hpp"
+#include "TextureStreamer.hpp"
+#include "FramePacer.hpp"
 
 static bool g_bResized = false;
 static struct {int newWidth; int newHeight; } g_updatedProperties;
@@ -95,7 +102,9 @@ void Window::Init()
     // Get assets locations
     ResourceManager::InitializeLocations();
 
-    stbi_set_flip_vertically_on_load(true);
+    // Start worker threads
+    JobSystem::Init();
+    AsyncLoader::Init();
 }
 
 void Window::MainLoop()
@@ -118,36 +127,39 @@ void Window::MainLoop()
     Shader basicShader = ResourceManager::LoadShader("shaders/basic_shader.vert", "shaders/basic_shader.frag");
     Shader lightingShader = ResourceManager::LoadShader("shaders/objfile_shaders/entity_lighting.vert", "shaders/objfile_shaders/entity_lighting.frag");
     Shader outlineShader = ResourceManager::LoadShader("shaders/tests/stencil_outline.vert", "shaders/tests/stencil_outline.frag");
+    Shader shadowDepthShader = ResourceManager::LoadShader("shaders/shadows/shadow_depth.vert", "shaders/shadows/shadow_depth.frag");
+    Shader omniShadowShader = ResourceManager::LoadShader("shaders/shadows/omni_shadow.vert", "shaders/shadows/omni_shadow.geom", "shaders/shadows/omni_shadow.frag");
+
+    Scene scene;
 
-    stbi_set_flip_vertically_on_load(false);
-    Entity sponza(ResourceManager::LoadModel("models/Sponza/sponza.obj").Mesh);
-    sponza.Transform.Scale(0.01f);
-    sponza.SetVisible(false);
+    // streams in over the first frames, the entity has no submeshes until then
+    const EntityId sponza = scene.CreateEntity("Sponza", StaticMesh(), basicShader);
+    AsyncLoader::LoadModel("models/Sponza/sponza.obj", [&scene, sponza](const ResourceManager::Model& model) {
+        if (MeshComponent* mesh = scene.Get<MeshComponent>(sponza))
+            mesh->Mesh = model.Mesh;
+    });
+    scene.Get<TransformComponent>(sponza)->Scale(0.01f);
+    scene.Get<MeshComponent>(sponza)->Visible = false;
 
-    Entity cube(SimpleMeshFactory::Cube());
+    const EntityId cube = scene.CreateEntity("Cube", SimpleMeshFactory::Cube(), basicShader);
     Material cubeMaterial;
-    cubeMaterial.DiffuseMaps.push_back(ResourceManager::LoadTextureFromFile("textures/container.jpg"));
-    cube.GetMeshRef().SetMaterial(cubeMaterial);
+    cubeMaterial.DiffuseMaps.push_back(AsyncLoader::LoadTexture("textures/container.jpg"));
+    scene.Get<MeshComponent>(cube)->Mesh.SetMaterial(cubeMaterial);
 
-    Entity cube2(cube);
-    cube2.Transform.SetPosition(-1.5f, 0.0f, 0.0f);
+    const EntityId cube2 = scene.CloneEntity(cube, "Cube2");
+    scene.Get<TransformComponent>(cube2)->SetPosition(-1.5f, 0.0f, 0.0f);
+    scene.GetWorld().Add(cube2, AnimationComponent{ glm::vec3(0.0f, 1.0f, 0.0f), 30.0f });
 
-    Entity floor(SimpleMeshFactory::Plane());
+    const EntityId floor = scene.CreateEntity("Floor", SimpleMeshFactory::Plane(), basicShader);
     Material floorMat;
-    floorMat.DiffuseMaps.push_back(ResourceManager::LoadTextureFromFile("textures/trak_tile.jpg"));
+    floorMat.DiffuseMaps.push_back(AsyncLoader::LoadTexture("textures/trak_tile.jpg"));
     floorMat.TilingFactor = 2.0f;
-    floor.GetMeshRef().SetMaterial(floorMat);
-    floor.Transform.SetPosition(0.0f, -0.5f, 0.0f);
-    floor.Transform.Scale(10.0f);
-    floor.Transform.Rotate(-90.0f, glm::vec3(1.0f, 0.0f, 0.0f));
-
-    EntityRenderMap entitiesMap = {
-        { "Sponza", { sponza, basicShader } },
-        { "Cube", { cube, basicShader } },
-        { "Cube2", { cube2, basicShader } },
-        { "Floor", { floor, basicShader } }
-    };
-    
+    scene.Get<MeshComponent>(floor)->Mesh.SetMaterial(floorMat);
+    TransformComponent& floorTransform = *scene.Get<TransformComponent>(floor);
+    floorTransform.SetPosition(0.0f, -0.5f, 0.0f);
+    floorTransform.Scale(10.0f);
+    floorTransform.Rotate(-90.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+
 
 
     DirectionalLight dirLight;
@@ -168,10 +180,69 @@ void Window::MainLoop()
     spotLight.InnerCutoff = 12.5f;
     spotLight.OuterCutoff = 17.5f;
 
+    // Clustered lights: scatter a grid of small colored point lights through sponza
+    std::vector<PointLight> pointLights;
+    std::vector<SpotLight> spotLights;
+    const glm::vec3 lightColors[] = {
+        { 1.0f, 0.3f, 0.2f }, { 0.2f, 1.0f, 0.3f }, { 0.3f, 0.4f, 1.0f }, { 1.0f, 0.9f, 0.4f }
+    };
+    for (int x = 0; x < 16; x++)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            for (int z = 0; z < 8; z++)
+            {
+                const glm::vec3 color = lightColors[(x + y + z) % 4];
+                pointLights.emplace_back(
+                    glm::vec3(-18.0f + x * 2.4f, 1.0f + y * 3.0f, -8.0f + z * 2.3f),
+                    glm::vec3(0.0f), color, color,
+                    1.0f, 0.7f, 1.8f
+                );
+                // only the ones closest to the camera get a shadow map slot
+                pointLights.back().CastShadows = true;
+            }
+        }
+    }
+
+    LightClusterGrid lightClusters;
+
+    CascadedShadowMap shadowMap;
+    ShadowAtlas shadowAtlas;
+
     float deltaTime = 0.0f;
     float lastFrame = 0.0f;
+
+    // The frame's updates, between the input and UI above and the draws. In the order a serial frame calls them:
+    // each waits for the ones before it touching the same data
+    SystemScheduler systems;
+    systems.Add<TransformComponent, const AnimationComponent>("Animation", [&]() { scene.Animate(deltaTime); });
+    // reading a transform's matrix rebuilds it when it changed
+    systems.Add<TransformComponent, WorldTransformComponent, TransformHierarchy>("Transforms", [&]() { scene.UpdateTransforms(); });
+    systems.Add<const MeshComponent, const WorldTransformComponent, WorldBoundsComponent, SpatialHash>("Bounds", [&]() { scene.UpdateBounds(); });
+    systems.Add<const MeshComponent, const WorldTransformComponent, const WorldBoundsComponent, VisibilityComponent, const Camera>(
+        "LOD selection", [&]() { Render::SelectLods(scene, camera, projection); });
+    // sets the lights' ShadowLayer, so it must run before the clusters gather them
+    systems.Add<const MeshComponent, const WorldTransformComponent, const WorldBoundsComponent, std::vector<PointLight>, std::vector<SpotLight>,
+                const SpatialHash, ShadowAtlas, const Camera>(
+        "Shadow atlas", [&]() { shadowAtlas.Update(pointLights, spotLights, camera.Transform.GetPosition(), scene, omniShadowShader); },
+        SystemThread::MainThread);
+    systems.Add<const std::vector<PointLight>, const std::vector<SpotLight>, LightClusterGrid, const Camera>(
+        "Light assignment", [&]() { lightClusters.Assign(camera.GetLookAtMatrix(), projection, pNear, pFar, pointLights, spotLights); });
+    systems.Add<const MeshComponent, const WorldTransformComponent, const WorldBoundsComponent, CascadedShadowMap, const Camera>(
+        "Cascaded shadows", [&]() {
+            shadowMap.Update(camera, m_aspectRatio, pNear, pFar, dirLight.Direction);
+            shadowMap.Render(scene, shadowDepthShader);
+        },
+        SystemThread::MainThread);
+
+    FramePacer pacer;
+
     while (!glfwWindowShouldClose(m_glfwWindow))
     {
+        // wait for the frame's turn first, so the input below is as fresh as it gets
+        pacer.BeginFrame();
+        glfwPollEvents();
+
         float currentFrame = (float)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
@@ -184,15 +255,31 @@ void Window::MainLoop()
         UIHelper::NewFrame();
 
         UIHelper::FrameStatsWindow(deltaTime);
+        UIHelper::FramePacerWindow(pacer);
+
+        // finished loads go to the GPU before anything draws
+        AssetIndex::Poll();
+        AsyncLoader::Update();
+        JobSystem::RunMainThreadJobs();
+        UIHelper::AsyncLoaderStatsWindow(AsyncLoader::GetStats());
+        // the requests of the last frame's draws
+        TextureStreamer::Update();
+        UIHelper::TextureStreamerStatsWindow(TextureStreamer::GetStats());
 	
-        UIHelper::EntityPropertiesManager(entitiesMap);
+        UIHelper::EntityPropertiesManager(scene, camera, projection);
 
         UIHelper::DirectionalLightPropertiesManager(dirLight);
 
         UIHelper::CameraAndProjectionPropertiesManager(camera, pNear, pFar);
 
+        // last frame's numbers, the entities draw after this
+        UIHelper::GeometryStatsWindow(Render::GetGeometryStats());
+        Render::ResetGeometryStats();
+
         if (g_bResized)
             this->updateWindowProperties();
+        lightClusters.SetViewportSize(m_width, m_height);
+        Render::SetViewportHeight(m_height);
 
         if (Input::GetKeyState(GLFW_KEY_ESCAPE))
         {
@@ -231,6 +318,11 @@ void Window::MainLoop()
             pChanged = false;
 
 
+        // late latch: the input once more after the UI work, right before the camera moves. The view is then fixed
+        // for the rest of the frame, so culling, shadows, light clusters and the main pass all agree on it
+        if (pacer.GetSettingsRef().LateLatch)
+            glfwPollEvents();
+
         camera.Update(deltaTime);
 
         projection = glm::perspective(
@@ -248,33 +340,50 @@ void Window::MainLoop()
         lightingShader.SetBool("u_useDirectionalLight", true);
         dirLight.SetLightUniforms(lightingShader);
 
-        Render::UpdateAndDrawEntityMap(entitiesMap, deltaTime, camera, projection);
+        systems.Run();
+        UIHelper::SystemSchedulerWindow(systems);
+
+        glViewport(0, 0, m_width, m_height);
+        shadowAtlas.SetUniforms(lightingShader);
+        UIHelper::ShadowAtlasStatsWindow(shadowAtlas.GetStats());
+
+        lightClusters.Upload();
+        lightClusters.SetUniforms(lightingShader);
+        UIHelper::LightClusterStatsWindow(lightClusters.GetStats());
+
+        shadowMap.SetUniforms(lightingShader);
+        UIHelper::ShadowStatsWindow(shadowMap.GetStats());
+
+        Render::DrawScene(scene, camera, projection);
 
 #define TEST_STENCIL_TEST 1
 #if TEST_STENCIL_TEST
 	
 	const glm::vec3 outlineColor = glm::vec3(1.0f, 0.0f, 0.0f);
-	cube.Update(deltaTime);
-	Render::DrawOutlineEntity(cube, basicShader, outlineShader, outlineColor, camera, projection);
+	Render::DrawOutlineEntity(scene, cube, basicShader, outlineShader, outlineColor, camera, projection);
 
     
-	cube2.Update(deltaTime);
-	Render::DrawOutlineEntity(cube2, basicShader, outlineShader, outlineColor, camera, projection, 1.05f);
+	Render::DrawOutlineEntity(scene, cube2, basicShader, outlineShader, outlineColor, camera, projection, 1.05f);
 
 #endif
 
 	UIHelper::Render();
 
         glfwSwapBuffers(m_glfwWindow);
-        glfwPollEvents();
+        pacer.EndFrame();
+        GpuResources::EndFrame();
     }
-
-    Terminate();
 }
 
 void Window::Terminate()
 {
+    AsyncLoader::Shutdown();
+    TextureStreamer::Shutdown();
+    JobSystem::Shutdown();
+    AssetIndex::Shutdown();
+
     UIHelper::Terminate();
+    GpuResources::Shutdown();
 
     glfwDestroyWindow(m_glfwWindow);
     glfwTerminate();
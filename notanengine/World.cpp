@@ -0,0 +1,235 @@
+#include "World.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+
+/// Component types
+
+// types register from whichever thread first uses them
+static std::mutex g_componentTypesMutex;
+
+std::deque<World::ComponentInfo>& World::getComponentTypes()
+{
+    // shared by every world, so a type has the same index in all of them
+    static std::deque<ComponentInfo> types;
+    return types;
+}
+
+uint32_t World::registerComponentType(const ComponentInfo& info)
+{
+    std::lock_guard<std::mutex> lock(g_componentTypesMutex);
+    auto& types = getComponentTypes();
+    assert(types.size() < MAX_COMPONENT_TYPES && "too many component types");
+    types.push_back(info);
+    return static_cast<uint32_t>(types.size() - 1);
+}
+
+World::ComponentInfo World::getComponentInfo(uint32_t type)
+{
+    std::lock_guard<std::mutex> lock(g_componentTypesMutex);
+    return getComponentTypes()[type];
+}
+
+/// World
+
+World::~World()
+{
+    for (auto& arch : m_archetypes)
+    {
+        for (Chunk& chunk : arch->Chunks)
+        {
+            for (size_t c = 0; c < arch->Types.size(); c++)
+            {
+                const ComponentInfo& info = arch->Infos[c];
+                std::byte* column = arch->GetColumn(chunk, arch->Types[c]);
+                for (uint32_t row = 0; row < chunk.Count; row++)
+                    info.Destroy(column + row * info.Size);
+            }
+            ::operator delete(chunk.Data, std::align_val_t(64));
+        }
+    }
+}
+
+void World::Destroy(EntityId entity)
+{
+    if (!IsAlive(entity))
+        return;
+
+    EntityRecord& record = m_records[entity.Index];
+    eraseRow(*record.Arch, record.Chunk, record.Row);
+
+    record.Arch = nullptr;
+    record.Generation++;
+    m_freeIndices.push_back(entity.Index);
+    m_entityCount--;
+}
+
+bool World::IsAlive(EntityId entity) const noexcept
+{
+    return entity.Index < m_records.size() && m_records[entity.Index].Arch
+        && m_records[entity.Index].Generation == entity.Generation;
+}
+
+size_t World::Count(ComponentMask mask) const
+{
+    size_t count = 0;
+    for (const auto& arch : m_archetypes)
+    {
+        if ((arch->Mask & mask) == mask)
+            count += arch->Count;
+    }
+    return count;
+}
+
+WorldStats World::GetStats() const
+{
+    WorldStats stats;
+    stats.Entities = m_entityCount;
+    stats.Archetypes = m_archetypes.size();
+    for (const auto& arch : m_archetypes)
+    {
+        stats.Chunks += arch->Chunks.size();
+        stats.ChunkBytes += arch->Chunks.size() * arch->ChunkBytes;
+    }
+    return stats;
+}
+
+World::Archetype& World::getArchetype(ComponentMask mask)
+{
+    if (auto found = m_archetypeByMask.find(mask); found != m_archetypeByMask.end())
+        return *found->second;
+
+    auto arch = std::make_unique<Archetype>();
+    arch->Mask = mask;
+    std::fill(std::begin(arch->Columns), std::end(arch->Columns), -1);
+    for (uint32_t type = 0; type < MAX_COMPONENT_TYPES; type++)
+    {
+        if (mask & (ComponentMask(1) << type))
+        {
+            arch->Columns[type] = static_cast<int>(arch->Types.size());
+            arch->Types.push_back(type);
+            arch->Infos.push_back(getComponentInfo(type));
+        }
+    }
+
+    /// Chunk layout: the ids, then each column, each aligned for its type
+    size_t rowBytes = sizeof(EntityId);
+    for (const ComponentInfo& info : arch->Infos)
+        rowBytes += info.Size;
+
+    auto layout = [&arch](uint32_t capacity) {
+        size_t offset = sizeof(EntityId) * capacity;
+        arch->Offsets.clear();
+        for (const ComponentInfo& info : arch->Infos)
+        {
+            offset = (offset + info.Alignment - 1) / info.Alignment * info.Alignment;
+            arch->Offsets.push_back(static_cast<uint32_t>(offset));
+            offset += info.Size * capacity;
+        }
+        return offset;
+    };
+
+    // components bigger than a chunk get chunks of one entity
+    uint32_t capacity = static_cast<uint32_t>(std::max<size_t>(CHUNK_SIZE / rowBytes, 1));
+    while (capacity > 1 && layout(capacity) > CHUNK_SIZE)
+        capacity--;
+    arch->Capacity = capacity;
+    arch->ChunkBytes = std::max(layout(capacity), CHUNK_SIZE);
+
+    Archetype* out = arch.get();
+    m_archetypes.push_back(std::move(arch));
+    m_archetypeByMask.emplace(mask, out);
+    return *out;
+}
+
+EntityId World::allocateId()
+{
+    EntityId entity;
+    if (!m_freeIndices.empty())
+    {
+        entity.Index = m_freeIndices.back();
+        m_freeIndices.pop_back();
+    }
+    else
+    {
+        entity.Index = static_cast<uint32_t>(m_records.size());
+        m_records.emplace_back();
+    }
+    entity.Generation = m_records[entity.Index].Generation;
+    m_entityCount++;
+    return entity;
+}
+
+std::pair<uint32_t, uint32_t> World::allocateRow(Archetype& arch, EntityId entity)
+{
+    if (arch.Chunks.empty() || arch.Chunks.back().Count == arch.Capacity)
+        arch.Chunks.push_back({ static_cast<std::byte*>(::operator new(arch.ChunkBytes, std::align_val_t(64))), 0 });
+
+    Chunk& chunk = arch.Chunks.back();
+    const uint32_t chunkIndex = static_cast<uint32_t>(arch.Chunks.size() - 1);
+    const uint32_t row = chunk.Count++;
+    arch.GetIds(chunk)[row] = entity;
+    arch.Count++;
+
+    EntityRecord& record = m_records[entity.Index];
+    record.Arch = &arch;
+    record.Chunk = chunkIndex;
+    record.Row = row;
+    return { chunkIndex, row };
+}
+
+void World::eraseRow(Archetype& arch, uint32_t chunkIndex, uint32_t row)
+{
+    Chunk& chunk = arch.Chunks[chunkIndex];
+    for (size_t c = 0; c < arch.Types.size(); c++)
+        arch.Infos[c].Destroy(chunk.Data + arch.Offsets[c] + row * arch.Infos[c].Size);
+
+    // the archetype's last entity fills the hole, keeping every chunk but the last full
+    Chunk& last = arch.Chunks.back();
+    const uint32_t lastRow = last.Count - 1;
+    if (&last != &chunk || lastRow != row)
+    {
+        for (size_t c = 0; c < arch.Types.size(); c++)
+        {
+            const ComponentInfo& info = arch.Infos[c];
+            void* source = last.Data + arch.Offsets[c] + lastRow * info.Size;
+            info.MoveConstruct(chunk.Data + arch.Offsets[c] + row * info.Size, source);
+            info.Destroy(source);
+        }
+
+        const EntityId moved = arch.GetIds(last)[lastRow];
+        arch.GetIds(chunk)[row] = moved;
+        m_records[moved.Index].Chunk = chunkIndex;
+        m_records[moved.Index].Row = row;
+    }
+
+    last.Count--;
+    arch.Count--;
+    if (last.Count == 0)
+    {
+        ::operator delete(last.Data, std::align_val_t(64));
+        arch.Chunks.pop_back();
+    }
+}
+
+void World::moveEntity(EntityId entity, Archetype& to)
+{
+    EntityRecord& record = m_records[entity.Index];
+    Archetype& from = *record.Arch;
+    const uint32_t fromChunk = record.Chunk, fromRow = record.Row;
+
+    const auto [toChunk, toRow] = allocateRow(to, entity);
+    Chunk& source = from.Chunks[fromChunk];
+    for (size_t c = 0; c < from.Types.size(); c++)
+    {
+        const uint32_t type = from.Types[c];
+        if (to.Columns[type] < 0)
+            continue;
+        const ComponentInfo& info = from.Infos[c];
+        info.MoveConstruct(to.GetColumn(to.Chunks[toChunk], type) + toRow * info.Size, from.GetColumn(source, type) + fromRow * info.Size);
+    }
+
+    // the moved-from components are destroyed with the row, and the record points to the new one already
+    eraseRow(from, fromChunk, fromRow);
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "JobSystem.hpp"
+
+/*
+    Entity-component storage by archetype.
+    Every set of component types (an archetype) keeps its entities in
+    fixed size chunks, one dense column per component type in each chunk,
+    so a query walks a few contiguous arrays per chunk instead of following
+    a pointer per entity. Entities are ids with a generation: a destroyed
+    entity's slot is reused with the next generation, and the old id stops
+    resolving. Create and Destroy are O(1) (the archetype's last entity
+    fills the hole). Adding or removing a component moves the entity to
+    another archetype.
+    Component types are any movable type, up to MAX_COMPONENT_TYPES of them.
+    Nothing may create, destroy or change the components of an entity while
+    a query runs.
+*/
+
+struct EntityId
+{
+    static constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+    uint32_t Index = INVALID_INDEX;
+    uint32_t Generation = 0;
+
+    inline bool IsValid() const noexcept { return Index != INVALID_INDEX; }
+    bool operator==(const EntityId& other) const noexcept = default;
+};
+
+struct EntityIdHash
+{
+    inline size_t operator()(const EntityId& id) const noexcept
+    {
+        return std::hash<uint64_t>()((uint64_t(id.Generation) << 32) | id.Index);
+    }
+};
+
+struct WorldStats
+{
+    size_t Entities = 0;
+    size_t Archetypes = 0;
+    size_t Chunks = 0;
+    size_t ChunkBytes = 0;
+};
+
+class World
+{
+public:
+    static constexpr size_t MAX_COMPONENT_TYPES = 64;
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+    using ComponentMask = uint64_t;
+
+    World() = default;
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+    ~World();
+
+    template <typename T>
+    static uint32_t GetComponentType();
+
+    template <typename... Ts>
+    static ComponentMask GetMask() { return ((ComponentMask(1) << GetComponentType<Ts>()) | ... | ComponentMask(0)); }
+
+    /// Entities
+
+    template <typename... Ts>
+    EntityId Create(Ts&&... components);
+
+    // count entities with copies of the same components, filling the chunks in order. Their ids are appended to outIds
+    template <typename... Ts>
+    void Spawn(size_t count, std::vector<EntityId>* outIds, const Ts&... components);
+
+    void Destroy(EntityId entity);
+    bool IsAlive(EntityId entity) const noexcept;
+    inline size_t GetEntityCount() const noexcept { return m_entityCount; }
+
+    /// Components
+
+    // nullptr if the entity is gone or doesn't have it
+    template <typename T>
+    T* Get(EntityId entity);
+    template <typename T>
+    const T* Get(EntityId entity) const;
+
+    template <typename T>
+    bool Has(EntityId entity) const { return IsAlive(entity) && (m_records[entity.Index].Arch->Mask & GetMask<T>()); }
+
+    // Replaces it if the entity has it already. nullptr, and nothing added, if the entity is gone
+    template <typename T>
+    T* Add(EntityId entity, T component);
+    // Nothing to do if the entity is gone or doesn't have it
+    template <typename T>
+    void Remove(EntityId entity);
+
+    /// Queries: every entity having all of Ts. A const T only reads the column
+
+    // func(size_t count, const EntityId* ids, Ts*... columns) once per chunk
+    template <typename... Ts, typename Func>
+    void ForEachChunk(Func&& func);
+    // func(EntityId, Ts&...) per entity
+    template <typename... Ts, typename Func>
+    void ForEach(Func&& func);
+    // ForEachChunk with the chunks spread on the JobSystem. func must only touch its own chunk
+    template <typename... Ts, typename Func>
+    void ParallelForEachChunk(Func&& func);
+
+    size_t Count(ComponentMask mask) const;
+
+    WorldStats GetStats() const;
+
+private:
+    struct ComponentInfo
+    {
+        size_t Size;
+        size_t Alignment;
+        void (*MoveConstruct)(void* destination, void* source);
+        void (*Destroy)(void* component);
+    };
+
+    struct Chunk
+    {
+        std::byte* Data;
+        uint32_t Count;
+    };
+
+    struct Archetype
+    {
+        ComponentMask Mask;
+        std::vector<uint32_t> Types;                // in type order
+        std::vector<ComponentInfo> Infos;           // same order
+        std::vector<uint32_t> Offsets;              // of each type's column in a chunk, same order
+        int Columns[MAX_COMPONENT_TYPES];           // index in Types by type, -1 if absent
+        uint32_t Capacity;                          // entities per chunk
+        size_t ChunkBytes;
+        std::vector<Chunk> Chunks;                  // all full but the last
+        size_t Count = 0;
+
+        inline EntityId* GetIds(const Chunk& chunk) const { return reinterpret_cast<EntityId*>(chunk.Data); }
+        inline std::byte* GetColumn(const Chunk& chunk, uint32_t type) const { return chunk.Data + Offsets[Columns[type]]; }
+    };
+
+    struct EntityRecord
+    {
+        Archetype* Arch = nullptr;
+        uint32_t Chunk = 0;
+        uint32_t Row = 0;
+        uint32_t Generation = 0;
+    };
+
+    std::vector<std::unique_ptr<Archetype>> m_archetypes;
+    std::unordered_map<ComponentMask, Archetype*> m_archetypeByMask;
+    std::vector<EntityRecord> m_records;
+    std::vector<uint32_t> m_freeIndices;
+    size_t m_entityCount = 0;
+
+    static uint32_t registerComponentType(const ComponentInfo& info);
+    // every world's component types, by index
+    static std::deque<ComponentInfo>& getComponentTypes();
+    static ComponentInfo getComponentInfo(uint32_t type);
+
+    Archetype& getArchetype(ComponentMask mask);
+    EntityId allocateId();
+    // a free row at the end of the archetype, for entity
+    std::pair<uint32_t, uint32_t> allocateRow(Archetype& arch, EntityId entity);
+    // Destroys the row's components and moves the archetype's last entity into it
+    void eraseRow(Archetype& arch, uint32_t chunk, uint32_t row);
+    // Moves the entity's components to arch (those arch doesn't have are destroyed), the new ones are left to construct
+    void moveEntity(EntityId entity, Archetype& to);
+
+    template <typename T>
+    static T* getComponent(const Archetype& arch, const Chunk& chunk, uint32_t row)
+    {
+        return reinterpret_cast<T*>(arch.GetColumn(chunk, GetComponentType<std::remove_const_t<T>>())) + row;
+    }
+
+    // the matching archetypes
+    template <typename... Ts>
+    std::vector<Archetype*> match() const
+    {
+        const ComponentMask mask = GetMask<std::remove_const_t<Ts>...>();
+        std::vector<Archetype*> out;
+        for (const auto& arch : m_archetypes)
+        {
+            if ((arch->Mask & mask) == mask && arch->Count > 0)
+                out.push_back(arch.get());
+        }
+        return out;
+    }
+};
+
+/// Templates
+
+template <typename T>
+uint32_t World::GetComponentType()
+{
+    static_assert(std::is_move_constructible_v<T>, "components must be movable");
+    static const uint32_t type = registerComponentType({
+        sizeof(T), alignof(T),
+        [](void* destination, void* source) { new (destination) T(std::move(*static_cast<T*>(source))); },
+        [](void* component) { static_cast<T*>(component)->~T(); }
+    });
+    return type;
+}
+
+template <typename... Ts>
+EntityId World::Create(Ts&&... components)
+{
+    Archetype& arch = getArchetype(GetMask<std::decay_t<Ts>...>());
+    const EntityId entity = allocateId();
+    const auto [chunk, row] = allocateRow(arch, entity);
+    (new (getComponent<std::decay_t<Ts>>(arch, arch.Chunks[chunk], row)) std::decay_t<Ts>(std::forward<Ts>(components)), ...);
+    return entity;
+}
+
+template <typename... Ts>
+void World::Spawn(size_t count, std::vector<EntityId>* outIds, const Ts&... components)
+{
+    Archetype& arch = getArchetype(GetMask<Ts...>());
+    m_records.reserve(m_records.size() + count);
+    if (outIds)
+        outIds->reserve(outIds->size() + count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const EntityId entity = allocateId();
+        const auto [chunk, row] = allocateRow(arch, entity);
+        (new (getComponent<Ts>(arch, arch.Chunks[chunk], row)) Ts(components), ...);
+        if (outIds)
+            outIds->push_back(entity);
+    }
+}
+
+template <typename T>
+T* World::Get(EntityId entity)
+{
+    if (!IsAlive(entity))
+        return nullptr;
+    const EntityRecord& record = m_records[entity.Index];
+    if (!(record.Arch->Mask & GetMask<T>()))
+        return nullptr;
+    return getComponent<T>(*record.Arch, record.Arch->Chunks[record.Chunk], record.Row);
+}
+
+template <typename T>
+const T* World::Get(EntityId entity) const
+{
+    return const_cast<World*>(this)->Get<T>(entity);
+}
+
+template <typename T>
+T* World::Add(EntityId entity, T component)
+{
+    // a destroyed slot has no archetype, a reused one belongs to another entity
+    if (!IsAlive(entity))
+        return nullptr;
+
+    if (T* existing = Get<T>(entity))
+    {
+        *existing = std::move(component);
+        return existing;
+    }
+
+    const EntityRecord& record = m_records[entity.Index];
+    moveEntity(entity, getArchetype(record.Arch->Mask | GetMask<T>()));
+    const EntityRecord& moved = m_records[entity.Index];
+    return new (getComponent<T>(*moved.Arch, moved.Arch->Chunks[moved.Chunk], moved.Row)) T(std::move(component));
+}
+
+template <typename T>
+void World::Remove(EntityId entity)
+{
+    // Has checks the entity is alive first, like Get
+    if (!Has<T>(entity))
+        return;
+    moveEntity(entity, getArchetype(m_records[entity.Index].Arch->Mask & ~GetMask<T>()));
+}
+
+template <typename... Ts, typename Func>
+void World::ForEachChunk(Func&& func)
+{
+    for (Archetype* arch : match<Ts...>())
+    {
+        for (const Chunk& chunk : arch->Chunks)
+            func(size_t(chunk.Count), static_cast<const EntityId*>(arch->GetIds(chunk)), getComponent<Ts>(*arch, chunk, 0)...);
+    }
+}
+
+template <typename... Ts, typename Func>
+void World::ForEach(Func&& func)
+{
+    ForEachChunk<Ts...>([&func](size_t count, const EntityId* ids, Ts*... columns) {
+        for (size_t i = 0; i < count; i++)
+            func(ids[i], columns[i]...);
+    });
+}
+
+template <typename... Ts, typename Func>
+void World::ParallelForEachChunk(Func&& func)
+{
+    std::vector<std::pair<Archetype*, const Chunk*>> chunks;
+    for (Archetype* arch : match<Ts...>())
+    {
+        for (const Chunk& chunk : arch->Chunks)
+            chunks.push_back({ arch, &chunk });
+    }
+
+    JobSystem::ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const auto [arch, chunk] = chunks[i];
+            func(size_t(chunk->Count), static_cast<const EntityId*>(arch->GetIds(*chunk)), getComponent<Ts>(*arch, *chunk, 0)...);
+        }
+    });
+}
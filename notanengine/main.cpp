@@ -15,6 +15,8 @@ int main()
     }
     
     window.MainLoop();
+    // the main loop's resources are gone by now, so the context can be destroyed
+    window.Terminate();
 
     return 0;
 }